@@ -26,10 +26,20 @@ pub fn build(b: *std.Build) void {
     const esl_sources = &[_][]const u8{
         "src/esl.c",
         "src/esl_buffer.c",
+        "src/esl_channel.c",
         "src/esl_config.c",
+        "src/esl_dispatcher.c",
         "src/esl_event.c",
         "src/esl_json.c",
+        "src/esl_parser.c",
+        "src/esl_pipeline.c",
+        "src/esl_queue.c",
+        "src/esl_reactor.c",
+        "src/esl_scan.c",
+        "src/esl_server.c",
         "src/esl_threadmutex.c",
+        "src/esl_uring.c",
+        "src/esl_wakeup.c",
         "src/parson.c",
     };
 
@@ -48,6 +48,7 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -73,6 +74,11 @@ static inline int esl_set_string_impl(char *x, size_t z, const char *y) {
 typedef struct esl_event_header esl_event_header_t;
 typedef struct esl_event esl_event_t;
 typedef struct esl_mutex esl_mutex_t;
+typedef struct esl_uring esl_uring_t;
+typedef struct esl_parser esl_parser_t;
+typedef struct esl_pipeline esl_pipeline_t;
+typedef struct esl_queue esl_queue_t;
+typedef struct esl_wakeup esl_wakeup_t;
 
 typedef enum {
   ESL_POLL_READ = (1 << 0),
@@ -168,6 +174,54 @@ constexpr esl_socket_t ESL_SOCK_INVALID = -1;
 constexpr esl_size_t BUF_CHUNK = 65'536 * 50;
 constexpr esl_size_t BUF_START = 65'536 * 100;
 
+/*! \brief How a handle sizes its receive buffers */
+typedef enum {
+  /*! Start with BUF_START bytes and grow by BUF_CHUNK */
+  ESL_FOOTPRINT_DEFAULT = 0,
+  /*! Start with a few KB, double only when a packet needs it and shrink
+   * back once it has been parsed */
+  ESL_FOOTPRINT_COMPACT
+} esl_footprint_mode_t;
+
+/*! \brief Memory held by a handle, see esl_handle_footprint */
+typedef struct {
+  /*! sizeof(esl_handle_t) */
+  esl_size_t handle_size;
+  /*! Size of the packet buffer */
+  esl_size_t buffer_size;
+  /*! Bytes waiting in the packet buffer */
+  esl_size_t buffer_used;
+  /*! Parser scratch space and partially received body */
+  esl_size_t parser_size;
+  /*! Sum of the sizes above */
+  esl_size_t total;
+} esl_footprint_t;
+
+/*! \brief How a handle waits for its socket */
+typedef enum {
+  /*! poll() before every blocking read */
+  ESL_WAIT_POLL = 0,
+  /*! Try the read first and poll() only when it would block, saving a
+   * syscall whenever data is already there */
+  ESL_WAIT_OPTIMISTIC,
+  /*! Like ESL_WAIT_OPTIMISTIC, but spin on the socket for up to spin_us
+   * before sleeping in poll(). Trades a CPU for wakeup latency */
+  ESL_WAIT_BUSY_POLL
+} esl_wait_mode_t;
+
+/*! \brief Wait strategy of a handle, see esl_handle_set_wait_strategy.
+ * Zero fields take the documented defaults. */
+typedef struct {
+  esl_wait_mode_t mode;
+  /*! Longest single poll() of a blocking read, and so how soon it notices
+   * the handle was disconnected, default 1000 ms */
+  uint32_t poll_ms;
+  /*! How long a send may wait for room in the socket, default 1000 ms */
+  uint32_t send_timeout_ms;
+  /*! Spin budget of ESL_WAIT_BUSY_POLL in microseconds, default 50 */
+  uint32_t spin_us;
+} esl_wait_strategy_t;
+
 /*! \brief A handle that will hold the socket information and
            different events received. */
 typedef struct {
@@ -182,7 +236,19 @@ typedef struct {
   int errnum;
   /*! The inner contents received by the socket. Used only internally. */
   esl_buffer_t *packet_buf;
-  char socket_buf[65536];
+  /*! Frames events out of packet_buf. Used only internally. */
+  esl_parser_t *parser;
+  /*! io_uring transport, when enabled with esl_handle_use_uring */
+  esl_uring_t *uring;
+  /*! Replies awaited by esl_send_async callers. Used only internally. */
+  esl_pipeline_t *pipeline;
+  /*! Receive buffer sizing, see esl_handle_set_footprint */
+  esl_footprint_mode_t footprint;
+  /*! Socket waits, see esl_handle_set_wait_strategy */
+  esl_wait_strategy_t wait;
+  /*! Interrupts blocked waits, see esl_handle_wakeup. Used only
+   * internally. */
+  esl_wakeup_t *wakeup;
   /*! Last command reply */
   char last_reply[1024];
   /*! Last command reply when called with esl_send_recv */
@@ -191,18 +257,22 @@ typedef struct {
   esl_event_t *last_event;
   /*! Last event received when called by esl_send_recv */
   esl_event_t *last_sr_event;
-  /*! This will hold already processed events queued by esl_recv_event */
-  esl_event_t *race_event;
+  /*! This will hold already processed events queued for esl_recv_event,
+   * see esl_handle_set_event_queue */
+  esl_queue_t *event_queue;
   /*! Events that have content-type == text/plain and a body */
   esl_event_t *last_ievent;
   /*! For outbound socket. Will hold reply information when connect\n\n is sent
    */
   esl_event_t *info_event;
-  /*! Socket is connected or not */
-  int connected;
+  /*! Socket is connected or not. Atomic, so either side may read or clear
+   * it without the other's lock */
+  _Atomic int connected;
   struct sockaddr_in addr;
-  /*! Internal mutex */
+  /*! Internal mutex, taken by the receive side */
   esl_mutex_t *mutex;
+  /*! Serializes writes to the socket, so senders never wait on a reader */
+  esl_mutex_t *send_mutex;
   int async_execute;
   int event_lock;
   int destroyed;
@@ -271,10 +341,33 @@ typedef void (*esl_listen_callback_t)(esl_socket_t server_sock,
 [[nodiscard]] ESL_DECLARE(esl_status_t)
     esl_attach_handle(esl_handle_t *handle, esl_socket_t socket,
                       struct sockaddr_in *addr);
+/*! Prefix of a host string naming a Unix-domain socket instead of a TCP
+ * host, as in "unix:/run/freeswitch/esl.sock". "unix:@name" names a Linux
+ * abstract socket, which leaves no file behind. The port is ignored. */
+#define ESL_UNIX_PREFIX "unix:"
+/*!
+    \brief Build a Unix-domain address from a "unix:/path" host string
+    \param host Host string
+    \param[out] addr The address
+    \param[out] len Length of the address to pass to bind() or connect()
+    \return ESL_SUCCESS, ESL_BREAK when host does not start with
+   ESL_UNIX_PREFIX, ESL_FAIL when the path is empty or too long
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_unix_sockaddr(const char *host, struct sockaddr_un *addr,
+                      socklen_t *len);
+/*!
+    \brief Remove the socket file of a Unix-domain address, if it names one.
+   Listeners call it before binding, to replace a socket left by an earlier
+   run, and after closing. Other kinds of files are left alone
+    \param addr The address
+*/
+ESL_DECLARE(void) esl_unix_unlink(const struct sockaddr_un *addr);
 /*!
     \brief Will bind to host and callback when event is received. Used for
    outbound socket.
-    \param host Host to bind to
+    \param host Host to bind to; a "unix:/path" host listens on a
+   Unix-domain socket instead
     \param port Port to bind to
     \param callback Callback that will be called upon data received
 */
@@ -283,6 +376,15 @@ typedef void (*esl_listen_callback_t)(esl_socket_t server_sock,
     esl_listen(const char *host, esl_port_t port,
                esl_listen_callback_t callback, void *user_data,
                esl_socket_t *server_sockP);
+/*!
+    \brief Like esl_listen, but runs the callback on a pool of worker threads
+   (see esl_server.h) so the accepting thread is never blocked by it. TCP
+   listeners bind every address whatever host is; "unix:/path" hosts are
+   honoured
+    \param max listen() backlog. Callbacks run on workers started as
+   connections arrive, on the esl_thread_create_detached stack size, up to
+   1024 at once; further connections wait for one to return
+*/
 [[nodiscard]] ESL_DECLARE(esl_status_t)
     esl_listen_threaded(const char *host, esl_port_t port,
                         esl_listen_callback_t callback, void *user_data,
@@ -319,7 +421,8 @@ typedef void (*esl_listen_callback_t)(esl_socket_t server_sock,
     \brief Connect a handle to a host/port with a specific password. This will
    also authenticate against the server
     \param handle Handle to connect
-    \param host Host to be connected
+    \param host Host to be connected, or "unix:/path" for a Unix-domain
+   socket
     \param port Port to be connected
     \param password FreeSWITCH server username (optional)
     \param password FreeSWITCH server password
@@ -341,6 +444,59 @@ esl_connect(esl_handle_t *handle, const char *host, esl_port_t port,
     \param handle Handle to be disconnected
 */
 [[nodiscard]] ESL_DECLARE(esl_status_t) esl_disconnect(esl_handle_t *handle);
+/*!
+    \brief Choose how the handle sizes its receive buffers. Takes full effect
+   when set before connecting or attaching; on a connected handle it changes
+   how the existing buffer grows and shrinks from then on
+    \param handle Handle to configure
+    \param mode ESL_FOOTPRINT_DEFAULT or ESL_FOOTPRINT_COMPACT
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_handle_set_footprint(esl_handle_t *handle, esl_footprint_mode_t mode);
+/*!
+    \brief Report how much memory a handle holds
+    \param handle Handle to inspect
+    \param[out] footprint Sizes of the handle and its buffers
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_handle_footprint(esl_handle_t *handle, esl_footprint_t *footprint);
+/*!
+    \brief Choose how the handle waits for its socket when reading and
+   sending. Like the footprint, it survives until esl_disconnect
+    \param handle Handle to configure
+    \param strategy Wait strategy, nullptr for the defaults
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_handle_set_wait_strategy(esl_handle_t *handle,
+                                 const esl_wait_strategy_t *strategy);
+/*!
+    \brief Make every receive or send blocked on the handle return
+   ESL_INTERRUPTED at once, including esl_reply_wait and esl_job_wait.
+   Calls started afterwards wait as usual. May be called from any thread
+   while the handle is connected
+    \param handle Handle to wake
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_handle_wakeup(esl_handle_t *handle);
+/*!
+    \brief Wait until one of several handles has something to read or is
+   woken with esl_handle_wakeup. Events already buffered count as readable
+    \param handles Handles to wait on
+    \param n Number of handles
+    \param ms Maximum time to wait, 0 to wait without limit
+    \param[out] ready If not nullptr, the index of the handle that is
+   readable or was woken
+    \return ESL_SUCCESS when a handle is readable, ESL_INTERRUPTED when one
+   was woken, ESL_BREAK on timeout, ESL_FAIL on errors
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_wait_handles(esl_handle_t **handles, size_t n, uint32_t ms,
+                     size_t *ready);
+/*!
+    \brief Milliseconds on CLOCK_MONOTONIC, the clock of every deadline
+   taken by the library
+*/
+[[nodiscard]] ESL_DECLARE(uint64_t) esl_monotonic_ms(void);
 /*!
     \brief Send a raw command using specific handle
     \param handle Handle to send the command to
@@ -349,11 +505,12 @@ esl_connect(esl_handle_t *handle, const char *host, esl_port_t port,
 [[nodiscard]] ESL_DECLARE(esl_status_t)
     esl_send(esl_handle_t *handle, const char *cmd);
 /*!
-    \brief Poll the handle's socket until an event is received or a connection
-   error occurs
+    \brief Poll the handle's socket until an event is received, a connection
+   error occurs (ESL_FAIL) or the handle is woken with esl_handle_wakeup
+   (ESL_INTERRUPTED)
     \param handle Handle to poll
-    \param check_q If set to 1, will check the handle queue (handle->race_event)
-   and return the last event from it
+    \param check_q If set to 1, will check the handle queue
+   (handle->event_queue) and return the oldest event from it
     \param[out] save_event If this is not nullptr, will return the event
    received
 */
@@ -364,22 +521,88 @@ esl_connect(esl_handle_t *handle, const char *host, esl_port_t port,
    error occurs or ms expires
     \param handle Handle to poll
     \param ms Maximum time to poll
-    \param check_q If set to 1, will check the handle queue (handle->race_event)
-   and return the last event from it
+    \param check_q If set to 1, will check the handle queue
+   (handle->event_queue) and return the oldest event from it
     \param[out] save_event If this is not nullptr, will return the event
    received
 */
 [[nodiscard]] ESL_DECLARE(esl_status_t)
     esl_recv_event_timed(esl_handle_t *handle, uint32_t ms, int check_q,
                          esl_event_t **save_event);
+/*!
+    \brief Like esl_recv_event_timed, but up to an absolute deadline. Time
+   spent on a partly received event counts against it too
+    \param handle Handle to poll
+    \param deadline_ms Time on the esl_monotonic_ms clock to give up at, 0
+   to wait without limit
+    \param check_q If set to 1, will check the handle queue
+   (handle->event_queue) and return the oldest event from it
+    \param[out] save_event If this is not nullptr, will return the event
+   received
+    \return ESL_SUCCESS, ESL_BREAK when the deadline passed or another thread
+   is reading the handle, ESL_INTERRUPTED when woken with esl_handle_wakeup,
+   ESL_FAIL on connection errors
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_recv_event_until(esl_handle_t *handle, uint64_t deadline_ms,
+                         int check_q, esl_event_t **save_event);
+/*!
+    \brief Parse the next event without blocking. Complete packets already
+   buffered on the handle are returned first, otherwise at most one read is
+   attempted on the socket
+    \param handle Handle to read from
+    \param check_q If set to 1, will check the handle queue
+   (handle->event_queue) and return the oldest event from it
+    \param[out] save_event If this is not nullptr, will return the event
+   received
+    \return ESL_SUCCESS when an event was parsed, ESL_BREAK when more data is
+   needed, ESL_FAIL on connection errors
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_recv_event_nowait(esl_handle_t *handle, int check_q,
+                          esl_event_t **save_event);
+/*!
+    \brief Take every event the handle can produce now under one hold of
+   the handle mutex: events already queued on the handle, then every
+   complete packet in the receive buffer, then whatever one read from the
+   socket completes. Only when none of that yields an event does it wait
+   up to timeout_ms for the socket. As with save_event, events are returned
+   as received and handle->last_ievent is not set
+    \param handle Handle to read from
+    \param[out] out Array receiving up to max events, owned by the caller
+    \param max Size of out
+    \param timeout_ms Maximum time to wait when nothing is ready, 0 to not
+   wait
+    \param[out] n Number of events stored in out
+    \return ESL_SUCCESS when at least one event was returned, ESL_BREAK when
+   none was ready in time, ESL_INTERRUPTED when woken with esl_handle_wakeup
+   first, ESL_FAIL on connection errors (events read before
+   the error are returned first, with ESL_SUCCESS)
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_recv_events(esl_handle_t *handle, esl_event_t **out, size_t max,
+                    uint32_t timeout_ms, size_t *n);
 /*!
     \brief This will send a command and place its response event on
-   handle->last_sr_event and handle->last_sr_reply
+   handle->last_sr_event and handle->last_sr_reply. It only takes the send
+   lock, so it does not wait for a thread blocked in esl_recv_event; that
+   thread hands the reply over when it reads it
     \param handle Handle to be used
     \param cmd Raw command to send
 */
 [[nodiscard]] ESL_DECLARE(esl_status_t)
     esl_send_recv_timed(esl_handle_t *handle, const char *cmd, uint32_t ms);
+/*!
+    \brief Like esl_send_recv_timed, but up to an absolute deadline that
+   covers sending the command as well as waiting for its reply
+    \param handle Handle to be used
+    \param cmd Raw command to send
+    \param deadline_ms Time on the esl_monotonic_ms clock to give up at, 0
+   to wait without limit
+*/
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_send_recv_until(esl_handle_t *handle, const char *cmd,
+                        uint64_t deadline_ms);
 [[nodiscard]] static inline esl_status_t esl_send_recv(esl_handle_t *handle,
                                                        const char *cmd) {
   return esl_send_recv_timed(handle, cmd, 0);
@@ -25,5 +25,6 @@ typedef enum {
   ESL_FAIL,
   ESL_BREAK,
   ESL_DISCONNECTED,
-  ESL_GENERR
+  ESL_GENERR,
+  ESL_INTERRUPTED
 } esl_status_t;
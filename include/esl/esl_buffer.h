@@ -55,6 +55,20 @@ typedef struct esl_buffer esl_buffer_t;
     esl_buffer_create(esl_buffer_t **buffer, esl_size_t blocksize,
                       esl_size_t start_len, esl_size_t max_len);
 
+/*! \brief Allocate a new dynamic esl_buffer backed by a memfd mapped twice
+ * back to back, so buffered data never wraps and is never compacted
+ * \param buffer returned pointer to the new buffer
+ * \param blocksize length to remap by as data is added
+ * \param start_len ammount of memory to reserve initially, rounded up to a
+ * whole number of pages
+ * \param max_len length the buffer is allowed to grow to
+ * \return status, ESL_FAIL where memfd mappings are unavailable
+ * \note seeking and looping only reach back to data not yet overwritten
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_buffer_create_mirrored(esl_buffer_t **buffer, esl_size_t blocksize,
+                               esl_size_t start_len, esl_size_t max_len);
+
 /*! \brief Get the length of a esl_buffer_t
  * \param buffer any buffer of type esl_buffer_t
  * \return int size of the buffer.
@@ -112,6 +126,44 @@ ESL_DECLARE(void) esl_buffer_set_loops(esl_buffer_t *buffer, int32_t loops);
 ESL_DECLARE(esl_size_t)
 esl_buffer_write(esl_buffer_t *buffer, const void *data, esl_size_t datalen);
 
+/*! \brief Make room at the end of the buffer so data can be written into it
+ * in place, e.g. by recv(), instead of being copied in with esl_buffer_write
+ * \param buffer any buffer of type esl_buffer_t
+ * \param min_len amount of contiguous space wanted, capped by the space
+ * max_len still allows
+ * \param data returned pointer to the free space
+ * \return amount of contiguous space at data, or 0 if the buffer is full
+ * \note the pointer is valid until the next call that changes the buffer
+ */
+ESL_DECLARE(esl_size_t)
+esl_buffer_reserve(esl_buffer_t *buffer, esl_size_t min_len, void **data);
+
+/*! \brief Add data written into space returned by esl_buffer_reserve
+ * \param buffer any buffer of type esl_buffer_t
+ * \param datalen amount of data that was written
+ * \return int amount of buffer used after the commit, or 0 if datalen is
+ * larger than the reserved space
+ */
+ESL_DECLARE(esl_size_t)
+esl_buffer_commit(esl_buffer_t *buffer, esl_size_t datalen);
+
+/*! \brief Choose how the buffer grows when data does not fit
+ * \param buffer any buffer of type esl_buffer_t
+ * \param geometric true to at least double the buffer each time, false to
+ * grow by blocksize
+ */
+ESL_DECLARE(void)
+esl_buffer_set_geometric(esl_buffer_t *buffer, bool geometric);
+
+/*! \brief Give memory back once the buffer holds less than len bytes
+ * \param buffer any buffer of type esl_buffer_t
+ * \param len size to shrink to, raised to the amount in use (and to whole
+ * pages for mirrored buffers)
+ * \return int size of the buffer afterwards
+ */
+ESL_DECLARE(esl_size_t)
+esl_buffer_shrink(esl_buffer_t *buffer, esl_size_t len);
+
 /*! \brief Remove data from the buffer
  * \param buffer any buffer of type esl_buffer_t
  * \param datalen amount of data to be removed
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "esl/esl.h"
+#include "esl/esl_threadmutex.h"
+
+/**
+ * @defgroup esl_channel Event Channels
+ * Bounded lock-free rings of esl_event_t pointers for handing events from
+ * the thread reading a handle to worker threads created with
+ * esl_thread_create_detached. Pushing and popping never take a lock; a
+ * consumer with nothing to do can sleep in esl_event_channel_wait, and
+ * producers only make a system call to wake it when it actually sleeps.
+ * @{
+ */
+typedef struct esl_event_channel esl_event_channel_t;
+
+/*! \brief Who may use a channel concurrently */
+typedef enum {
+  /*! One producer thread and one consumer thread */
+  ESL_CHANNEL_SPSC = 0,
+  /*! Any number of producer threads and one consumer thread */
+  ESL_CHANNEL_MPSC
+} esl_channel_mode_t;
+
+/*! \brief Create a channel
+ * \param channel returned pointer to the new channel
+ * \param capacity most events held at once, rounded up to a power of two
+ * \param mode ESL_CHANNEL_SPSC or ESL_CHANNEL_MPSC
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_event_channel_create(esl_event_channel_t **channel, esl_size_t capacity,
+                             esl_channel_mode_t mode);
+
+/*! \brief Destroy a channel and the events still in it. No thread may be
+ * using it any more.
+ * \param channel the channel to destroy
+ */
+ESL_DECLARE(void) esl_event_channel_destroy(esl_event_channel_t **channel);
+
+/*! \brief Append an event
+ * \param channel the channel
+ * \param event event to append, taken over on ESL_SUCCESS
+ * \return ESL_SUCCESS, or ESL_BREAK if the channel is full (the caller keeps
+ * the event)
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_event_channel_push(esl_event_channel_t *channel, esl_event_t *event);
+
+/*! \brief Append as many of n events as fit, in order, with one claim on
+ * the ring and at most one wakeup
+ * \param channel the channel
+ * \param events events to append; the first *pushed are taken over
+ * \param n number of events
+ * \param[out] pushed number of events appended
+ * \return ESL_SUCCESS if any were appended, ESL_BREAK if the channel is
+ * full
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_event_channel_push_batch(esl_event_channel_t *channel,
+                                 esl_event_t **events, esl_size_t n,
+                                 esl_size_t *pushed);
+
+/*! \brief Remove the oldest event. Consumer thread only.
+ * \param channel the channel
+ * \param[out] event the event, owned by the caller
+ * \return ESL_SUCCESS, or ESL_BREAK if the channel is empty
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_event_channel_pop(esl_event_channel_t *channel, esl_event_t **event);
+
+/*! \brief Remove up to max of the oldest events. Consumer thread only.
+ * \param channel the channel
+ * \param[out] out array receiving the events, owned by the caller
+ * \param max size of out
+ * \param[out] n number of events removed
+ * \return ESL_SUCCESS if any were removed, ESL_BREAK if the channel is empty
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_event_channel_pop_batch(esl_event_channel_t *channel,
+                                esl_event_t **out, esl_size_t max,
+                                esl_size_t *n);
+
+/*! \brief Sleep until the channel has an event. Consumer thread only.
+ * \param channel the channel
+ * \param ms maximum time to sleep in milliseconds, 0 to sleep until an
+ * event arrives
+ * \return ESL_SUCCESS when an event is ready, ESL_BREAK on timeout
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_event_channel_wait(esl_event_channel_t *channel, uint32_t ms);
+
+/*! \brief Number of events in the channel, approximate while producers or
+ * the consumer are active
+ * \param channel the channel
+ * \return depth
+ */
+ESL_DECLARE(esl_size_t) esl_event_channel_depth(esl_event_channel_t *channel);
+
+/** @} */
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "esl/esl.h"
+#include "esl/esl_event.h"
+
+/**
+ * @defgroup esl_dispatcher Sharded Event Dispatch
+ * Spreads events over a fixed set of worker threads while keeping the
+ * events of one call in order: each event goes to the shard picked by a
+ * hash of its Unique-ID header (or Job-UUID, or Core-UUID), and each shard
+ * is a bounded esl_event_channel drained by one worker. Events without any
+ * of those headers all go to shard 0.
+ * @{
+ */
+typedef struct esl_dispatcher esl_dispatcher_t;
+
+/*! \brief Called on a shard's worker thread for each of its events
+ * \param dispatcher the dispatcher
+ * \param event the event, owned by the callback (destroy it with
+ * esl_event_destroy)
+ * \param shard index of the shard, 0 to shards - 1
+ * \param user_data the pointer given to esl_dispatcher_create
+ */
+typedef void (*esl_dispatch_callback_t)(esl_dispatcher_t *dispatcher,
+                                        esl_event_t *event, unsigned shard,
+                                        void *user_data);
+
+/*! \brief What esl_dispatcher_dispatch does when the shard is full */
+typedef enum {
+  /*! Wait for the shard's worker to make room */
+  ESL_DISPATCH_OVERFLOW_BLOCK = 0,
+  /*! Return ESL_BREAK and leave the event with the caller */
+  ESL_DISPATCH_OVERFLOW_REJECT
+} esl_dispatch_overflow_t;
+
+/*! \brief Dispatcher settings. Zero fields take the documented defaults. */
+typedef struct {
+  /*! Worker threads, one per shard, default the number of online CPUs */
+  unsigned shards;
+  /*! Events each shard holds, rounded up to a power of two, default 4096 */
+  esl_size_t queue_len;
+  /*! Behaviour when a shard is full */
+  esl_dispatch_overflow_t overflow;
+  /*! Worker stack size in bytes, default the system default */
+  size_t stack_size;
+} esl_dispatcher_config_t;
+
+/*! \brief Counters of one shard, see esl_dispatcher_get_stats */
+typedef struct {
+  /*! Events waiting for the worker */
+  esl_size_t depth;
+  /*! Most events ever waiting at once */
+  esl_size_t high_water;
+  /*! Events accepted by esl_dispatcher_dispatch */
+  uint64_t dispatched;
+  /*! Events handed to the callback */
+  uint64_t handled;
+  /*! Events refused because the shard was full */
+  uint64_t rejected;
+} esl_dispatcher_stats_t;
+
+/*! \brief Create a dispatcher and start its workers
+ * \param dispatcher returned pointer to the new dispatcher
+ * \param config settings, nullptr for the defaults
+ * \param callback called for every event
+ * \param user_data passed through to the callback
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_dispatcher_create(esl_dispatcher_t **dispatcher,
+                          const esl_dispatcher_config_t *config,
+                          esl_dispatch_callback_t callback, void *user_data);
+
+/*! \brief Stop a dispatcher. Events already dispatched are still handed to
+ * the callback before the workers exit.
+ * \param dispatcher dispatcher to destroy
+ */
+ESL_DECLARE(void) esl_dispatcher_destroy(esl_dispatcher_t **dispatcher);
+
+/*! \brief Queue an event on the shard of its call. Any thread may
+ * dispatch.
+ * \param dispatcher the dispatcher
+ * \param event the event, taken over on ESL_SUCCESS
+ * \return ESL_SUCCESS, or ESL_BREAK if the shard is full under
+ * ESL_DISPATCH_OVERFLOW_REJECT
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_dispatcher_dispatch(esl_dispatcher_t *dispatcher, esl_event_t *event);
+
+/*! \brief Shard an event would be dispatched to
+ * \param dispatcher the dispatcher
+ * \param event the event
+ * \return index of the shard
+ */
+ESL_DECLARE(unsigned)
+esl_dispatcher_shard(esl_dispatcher_t *dispatcher, esl_event_t *event);
+
+/*! \brief Number of shards
+ * \param dispatcher the dispatcher
+ * \return shards
+ */
+ESL_DECLARE(unsigned) esl_dispatcher_shards(esl_dispatcher_t *dispatcher);
+
+/*! \brief Read the counters of one shard
+ * \param dispatcher the dispatcher
+ * \param shard index of the shard
+ * \param stats returned counters
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_dispatcher_get_stats(esl_dispatcher_t *dispatcher, unsigned shard,
+                             esl_dispatcher_stats_t *stats);
+
+/** @} */
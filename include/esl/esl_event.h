@@ -37,6 +37,7 @@
 
 typedef struct esl_event_header esl_event_header_t;
 typedef struct esl_event esl_event_t;
+typedef struct esl_event_arena esl_event_arena_t;
 
 typedef enum {
   ESL_STACK_BOTTOM,
@@ -160,8 +161,136 @@ struct esl_event_header {
   /*! hash of the header name */
   unsigned long hash;
   struct esl_event_header *next;
+  /*! header flags (esl_event_header_flag_t) */
+  int flags;
+  /*! length of the name, set for ESL_HF_BORROWED headers */
+  esl_size_t name_len;
+  /*! length of the value, set for ESL_HF_BORROWED headers */
+  esl_size_t value_len;
 };
 
+typedef enum {
+  /*! name and value point into the event's header_block instead of being
+   * allocated for the header */
+  ESL_HF_BORROWED = (1 << 0),
+  /*! the header itself lives in its event's arena and is released with it */
+  ESL_HF_ARENA = (1 << 1),
+  /*! the name was taken from the event pool's string slabs */
+  ESL_HF_POOLED = (1 << 2),
+  /*! the name is the static interned copy, see esl_header_key_t */
+  ESL_HF_INTERNED = (1 << 3)
+} esl_event_header_flag_t;
+
+/*! \brief Well-known FreeSWITCH header names. A header added or parsed with
+ * exactly one of these names points at a single static copy of it, whose
+ * case-folded hash is computed ahead of time. */
+typedef enum {
+  ESL_HDR_EVENT_NAME,
+  ESL_HDR_EVENT_SUBCLASS,
+  ESL_HDR_EVENT_SEQUENCE,
+  ESL_HDR_EVENT_UUID,
+  ESL_HDR_EVENT_DATE_LOCAL,
+  ESL_HDR_EVENT_DATE_GMT,
+  ESL_HDR_EVENT_DATE_TIMESTAMP,
+  ESL_HDR_EVENT_CALLING_FILE,
+  ESL_HDR_EVENT_CALLING_FUNCTION,
+  ESL_HDR_EVENT_CALLING_LINE_NUMBER,
+  ESL_HDR_CORE_UUID,
+  ESL_HDR_FREESWITCH_HOSTNAME,
+  ESL_HDR_FREESWITCH_SWITCHNAME,
+  ESL_HDR_FREESWITCH_IPV4,
+  ESL_HDR_FREESWITCH_IPV6,
+  ESL_HDR_CONTENT_TYPE,
+  ESL_HDR_CONTENT_LENGTH,
+  ESL_HDR_CONTENT_DISPOSITION,
+  ESL_HDR_REPLY_TEXT,
+  ESL_HDR_JOB_UUID,
+  ESL_HDR_JOB_COMMAND,
+  ESL_HDR_JOB_COMMAND_ARG,
+  ESL_HDR_UNIQUE_ID,
+  ESL_HDR_OTHER_LEG_UNIQUE_ID,
+  ESL_HDR_CHANNEL_STATE,
+  ESL_HDR_CHANNEL_STATE_NUMBER,
+  ESL_HDR_CHANNEL_NAME,
+  ESL_HDR_CHANNEL_CALL_STATE,
+  ESL_HDR_CHANNEL_CALL_UUID,
+  ESL_HDR_CHANNEL_PRESENCE_ID,
+  ESL_HDR_CHANNEL_HIT_DIALPLAN,
+  ESL_HDR_CHANNEL_READ_CODEC_NAME,
+  ESL_HDR_CHANNEL_READ_CODEC_RATE,
+  ESL_HDR_CHANNEL_WRITE_CODEC_NAME,
+  ESL_HDR_CHANNEL_WRITE_CODEC_RATE,
+  ESL_HDR_ANSWER_STATE,
+  ESL_HDR_CALL_DIRECTION,
+  ESL_HDR_PRESENCE_CALL_DIRECTION,
+  ESL_HDR_HANGUP_CAUSE,
+  ESL_HDR_APPLICATION,
+  ESL_HDR_APPLICATION_DATA,
+  ESL_HDR_APPLICATION_RESPONSE,
+  ESL_HDR_APPLICATION_UUID,
+  ESL_HDR_CALLER_DIRECTION,
+  ESL_HDR_CALLER_USERNAME,
+  ESL_HDR_CALLER_DIALPLAN,
+  ESL_HDR_CALLER_CALLER_ID_NAME,
+  ESL_HDR_CALLER_CALLER_ID_NUMBER,
+  ESL_HDR_CALLER_ORIG_CALLER_ID_NAME,
+  ESL_HDR_CALLER_ORIG_CALLER_ID_NUMBER,
+  ESL_HDR_CALLER_CALLEE_ID_NAME,
+  ESL_HDR_CALLER_CALLEE_ID_NUMBER,
+  ESL_HDR_CALLER_NETWORK_ADDR,
+  ESL_HDR_CALLER_ANI,
+  ESL_HDR_CALLER_DESTINATION_NUMBER,
+  ESL_HDR_CALLER_UNIQUE_ID,
+  ESL_HDR_CALLER_SOURCE,
+  ESL_HDR_CALLER_CONTEXT,
+  ESL_HDR_CALLER_CHANNEL_NAME,
+  ESL_HDR_CALLER_PROFILE_INDEX,
+  ESL_HDR_CALLER_PROFILE_CREATED_TIME,
+  ESL_HDR_CALLER_CHANNEL_CREATED_TIME,
+  ESL_HDR_CALLER_CHANNEL_ANSWERED_TIME,
+  ESL_HDR_CALLER_CHANNEL_PROGRESS_TIME,
+  ESL_HDR_CALLER_CHANNEL_PROGRESS_MEDIA_TIME,
+  ESL_HDR_CALLER_CHANNEL_HANGUP_TIME,
+  ESL_HDR_CALLER_CHANNEL_TRANSFER_TIME,
+  ESL_HDR_CALLER_CHANNEL_RESURRECT_TIME,
+  ESL_HDR_CALLER_CHANNEL_BRIDGED_TIME,
+  ESL_HDR_CALLER_CHANNEL_LAST_HOLD,
+  ESL_HDR_CALLER_CHANNEL_HOLD_ACCUM,
+  ESL_HDR_CALLER_SCREEN_BIT,
+  ESL_HDR_CALLER_PRIVACY_HIDE_NAME,
+  ESL_HDR_CALLER_PRIVACY_HIDE_NUMBER,
+  ESL_HDR_VARIABLE_UUID,
+  ESL_HDR_VARIABLE_CALL_UUID,
+  ESL_HDR_VARIABLE_DIRECTION,
+  ESL_HDR_VARIABLE_SESSION_ID,
+  ESL_HDR_VARIABLE_CHANNEL_NAME,
+  ESL_HDR_VARIABLE_SIP_CALL_ID,
+  ESL_HDR_COUNT
+} esl_header_key_t;
+
+/*! \brief Content-Type values of the event socket protocol */
+typedef enum {
+  ESL_CT_UNKNOWN,
+  ESL_CT_AUTH_REQUEST,
+  ESL_CT_API_RESPONSE,
+  ESL_CT_COMMAND_REPLY,
+  ESL_CT_TEXT_EVENT_PLAIN,
+  ESL_CT_TEXT_EVENT_JSON,
+  ESL_CT_TEXT_EVENT_XML,
+  ESL_CT_TEXT_DISCONNECT_NOTICE,
+  ESL_CT_TEXT_RUDE_REJECTION,
+  ESL_CT_LOG_DATA,
+  ESL_CT_COUNT
+} esl_content_type_t;
+
+/*! \brief Read-only view of a header */
+typedef struct {
+  const char *name;
+  esl_size_t name_len;
+  const char *value;
+  esl_size_t value_len;
+} esl_header_view_t;
+
 /*! \brief Representation of an event */
 struct esl_event {
   /*! the event id (descriptor) */
@@ -186,6 +315,20 @@ struct esl_event {
   unsigned long key;
   struct esl_event *next;
   int flags;
+  /*! received header block that borrowed headers point into */
+  char *header_block;
+  /*! headers and strings are carved from here, see esl_event_create_arena */
+  esl_event_arena_t *arena;
+  /*! number of headers in the list */
+  esl_size_t header_count;
+  /*! open-addressing table of the first header of each name, built on the
+   * first lookup once the event has enough headers to make walking the list
+   * slow; nullptr until then */
+  esl_event_header_t **index;
+  /*! slots in index, a power of two */
+  esl_size_t index_size;
+  /*! slots in index holding a header or a deleted marker */
+  esl_size_t index_used;
 };
 
 typedef enum { ESL_EF_UNIQ_HEADERS = (1 << 0) } esl_event_flag_t;
@@ -204,6 +347,23 @@ ESL_DECLARE(esl_status_t)
 esl_event_create_subclass(esl_event_t **event, esl_event_types_t event_id,
                           const char *subclass_name);
 
+/*!
+  \brief Create an event whose headers are bump-allocated from a few large
+  blocks owned by the event
+  \param event a nullptr pointer on which to create the event
+  \param event_id the event id enumeration of the desired event
+  \param subclass_name the subclass name for custom event (only valid when
+  event_id is ESL_EVENT_CUSTOM)
+  \return ESL_SUCCESS on success
+  \note Plain headers appended with esl_event_add_header_string or
+  esl_event_add_header_borrowed cost no allocation of their own, and
+  esl_event_destroy releases them all at once. Deleted headers keep their
+  space until then.
+*/
+ESL_DECLARE(esl_status_t)
+esl_event_create_arena(esl_event_t **event, esl_event_types_t event_id,
+                       const char *subclass_name);
+
 /*!
   \brief Set the priority of an event
   \param event the event to set the priority on
@@ -226,6 +386,62 @@ ESL_DECLARE(char *)
 esl_event_get_header_idx(esl_event_t *event, const char *header_name, int idx);
 #define esl_event_get_header(_e, _h) esl_event_get_header_idx(_e, _h, -1)
 
+/*!
+  \brief Retrieve a header by its well-known name
+  \param event the event to read the header from
+  \param key the header name
+  \return the first header of that name, compared without regard to case
+  \note Needs no hashing, and interned names match on pointer equality
+*/
+ESL_DECLARE(esl_event_header_t *)
+esl_event_get_header_key_ptr(esl_event_t *event, esl_header_key_t key);
+ESL_DECLARE(char *)
+esl_event_get_header_key(esl_event_t *event, esl_header_key_t key);
+
+/*!
+  \brief The interned copy of a well-known header name
+  \param key the header name
+  \return the name, or nullptr for an invalid key
+*/
+ESL_DECLARE(const char *) esl_header_key_name(esl_header_key_t key);
+
+/*!
+  \brief Retrieve a header as a (pointer, length) view without copying
+  \param event the event to read the header from
+  \param header_name the name of the header to read
+  \param view filled in with the header name and value
+  \return true if the header exists
+  \note the view is valid until the header is changed or the event destroyed
+*/
+ESL_DECLARE(bool)
+esl_event_get_header_view(esl_event_t *event, const char *header_name,
+                          esl_header_view_t *view);
+
+/*!
+  \brief Add a header whose name and value are used in place
+  \param event the event to add the header to
+  \param header_name the name of the header, NUL terminated
+  \param name_len length of header_name
+  \param value the value of the header, NUL terminated
+  \param value_len length of value
+  \return ESL_SUCCESS if the header was added
+  \note Both strings must stay valid for the life of the event, normally by
+  living in event->header_block. Headers that need index, array or body
+  handling are copied as esl_event_add_header_string would.
+*/
+ESL_DECLARE(esl_status_t)
+esl_event_add_header_borrowed(esl_event_t *event, char *header_name,
+                              esl_size_t name_len, char *value,
+                              esl_size_t value_len);
+
+/*!
+  \brief Give every borrowed header its own copy of its name and value and
+  release the header block
+  \param event the event to materialize
+  \return ESL_SUCCESS, or ESL_FAIL if an allocation failed
+*/
+ESL_DECLARE(esl_status_t) esl_event_materialize(esl_event_t *event);
+
 /*!
   \brief Retrieve the body value from an event
   \param event the event to read the body from
@@ -301,6 +517,13 @@ ESL_DECLARE(const char *) esl_event_name(esl_event_types_t event);
 ESL_DECLARE(esl_status_t)
 esl_name_event(const char *name, esl_event_types_t *type);
 
+/*!
+  \brief Classify a Content-Type value, ignoring case
+  \param value the value of a Content-Type header, may be nullptr
+  \return the content type, or ESL_CT_UNKNOWN
+*/
+ESL_DECLARE(esl_content_type_t) esl_content_type(const char *value);
+
 /*!
   \brief Render a string representation of an event sutable for printing or
   network transport
@@ -341,4 +564,36 @@ esl_event_set_body(esl_event_t *event, const char *body);
 
 ESL_DECLARE(const char *) esl_priority_name(esl_priority_t priority);
 
+/*! \brief Event pool counters. A hit reused a pooled object, a miss had to
+ * allocate one that will be pooled when freed. */
+typedef struct {
+  uint64_t event_hits;
+  uint64_t event_misses;
+  uint64_t header_hits;
+  uint64_t header_misses;
+  uint64_t string_hits;
+  uint64_t string_misses;
+} esl_event_pool_stats_t;
+
+/*!
+  \brief Turn the event pool on or off for the whole process
+  \param enable true to recycle events, headers and short header names
+  \note Off by default. While on, freed objects go to a cache owned by the
+  freeing thread, which trades batches with a process-wide overflow list,
+  and are reused instead of allocated. Turning the pool off stops that
+  without releasing what is cached, see esl_event_pool_trim.
+*/
+ESL_DECLARE(void) esl_event_pool_enable(bool enable);
+
+/*!
+  \brief Free the objects cached by the calling thread and the overflow list
+*/
+ESL_DECLARE(void) esl_event_pool_trim(void);
+
+/*!
+  \brief Read the pool counters
+  \param stats returned counters
+*/
+ESL_DECLARE(void) esl_event_pool_get_stats(esl_event_pool_stats_t *stats);
+
 ///\}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2010-2012, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "esl/esl.h"
+
+/**
+ * @defgroup esl_parser Protocol Parser
+ * Incremental parser for the event socket wire format. Bytes are fed in
+ * chunks of any size, from any transport, and complete events come out as
+ * soon as their header block and content-length body have arrived. The
+ * parser never blocks and never touches a socket.
+ * @{
+ */
+
+/*! \brief Create a parser
+ * \param parser returned pointer to the new parser
+ * \param buffer buffer to accumulate input in, or nullptr to let the parser
+ * allocate and own one. A caller supplied buffer is not destroyed with the
+ * parser.
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_parser_create(esl_parser_t **parser, esl_buffer_t *buffer);
+
+/*! \brief Destroy a parser and any partially received event
+ * \param parser parser to destroy
+ */
+ESL_DECLARE(void) esl_parser_destroy(esl_parser_t **parser);
+
+/*! \brief Append received bytes to the parser input
+ * \param parser the parser
+ * \param data received bytes
+ * \param len number of bytes
+ * \return ESL_FAIL with errno set to EMSGSIZE if the input buffer is full
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_parser_feed(esl_parser_t *parser, const void *data, esl_size_t len);
+
+/*! \brief Take the next complete event out of the input
+ * \param parser the parser
+ * \param event returned SOCKET_DATA event, owned by the caller
+ * \return ESL_SUCCESS with an event, ESL_BREAK if more input is needed,
+ * ESL_FAIL on a malformed or oversized packet with errno set
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_parser_next(esl_parser_t *parser, esl_event_t **event);
+
+/*! \brief Where the rest of the current event body goes. Once
+ * esl_parser_next has returned ESL_BREAK part way through a body and the
+ * input buffer is empty, a transport can receive the remaining bytes
+ * straight into the body instead of through the buffer.
+ * \param parser the parser
+ * \param data returned pointer to the unfilled part of the body
+ * \return number of body bytes still missing, 0 if none can be taken now
+ */
+ESL_DECLARE(esl_size_t)
+esl_parser_body_window(esl_parser_t *parser, void **data);
+
+/*! \brief Account for bytes written into the body window
+ * \param parser the parser
+ * \param len number of bytes written
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_parser_body_commit(esl_parser_t *parser, esl_size_t len);
+
+/*! \brief Choose how header strings of parsed events are stored. With views
+ * (the default) each event keeps one copy of its header block, its headers
+ * point into it (see ESL_HF_BORROWED) and come from the event's arena (see
+ * esl_event_create_arena); without, every header, name and value is
+ * allocated separately.
+ * \param parser the parser
+ * \param enable true to parse headers as views
+ */
+ESL_DECLARE(void)
+esl_parser_set_header_views(esl_parser_t *parser, bool enable);
+
+/*! \brief Drop buffered input and any partially received event
+ * \param parser the parser
+ */
+ESL_DECLARE(void) esl_parser_reset(esl_parser_t *parser);
+
+/*! \brief Memory the parser holds besides its input buffer
+ * \param parser the parser
+ * \return bytes of header scratch space and partially received body
+ */
+ESL_DECLARE(esl_size_t) esl_parser_footprint(esl_parser_t *parser);
+
+/*! \brief Free the header scratch space; it is allocated again, only as
+ * large as needed, for the next header block
+ * \param parser the parser
+ */
+ESL_DECLARE(void) esl_parser_trim(esl_parser_t *parser);
+
+/*! \brief Input buffer of the parser, for transports that append to it
+ * directly instead of calling esl_parser_feed
+ * \param parser the parser
+ * \return the input buffer
+ */
+ESL_DECLARE(esl_buffer_t *) esl_parser_buffer(esl_parser_t *parser);
+
+/** @} */
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "esl/esl.h"
+
+/**
+ * @defgroup esl_pipeline Pipelined Commands
+ * Lets many threads have commands in flight on one handle at the same
+ * time. FreeSWITCH answers commands in the order it receives them, so each
+ * command sent with esl_send_async gets a reply future at the back of a
+ * FIFO, and every api/response or command/reply read from the handle
+ * completes the future at the front. Other events are queued on the handle
+ * (handle->event_queue) as esl_send_recv does.
+ *
+ * Background jobs submitted with esl_bgapi_submit carry a Job-UUID chosen
+ * here and are kept in a table keyed by it; the BACKGROUND_JOB event with
+ * that Job-UUID completes the job instead of being queued on the handle.
+ * @{
+ */
+typedef struct esl_reply esl_reply_t;
+typedef struct esl_job esl_job_t;
+
+/*! \brief Size of a Job-UUID string including the terminating NUL */
+constexpr esl_size_t ESL_JOB_UUID_SIZE = 37;
+
+/*! \brief Called once when a background job completes or fails. Runs on
+ * the thread that read the BACKGROUND_JOB event (or noticed the failure),
+ * which may still hold the handle mutex, so it should not block.
+ * \param job the job
+ * \param event the BACKGROUND_JOB event (its body is the command output),
+ * the -ERR reply if the command was refused, or nullptr if the connection
+ * failed; owned by the job
+ * \param status ESL_SUCCESS or ESL_FAIL
+ * \param user_data as given to esl_bgapi_submit
+ */
+typedef void (*esl_job_callback_t)(esl_job_t *job, esl_event_t *event,
+                                   esl_status_t status, void *user_data);
+
+/*! \brief Send a command without waiting for its reply
+ * \param handle connected handle
+ * \param cmd raw command to send
+ * \param reply returned future for the reply, release it with
+ * esl_reply_destroy
+ * \return status
+ * \note once a handle has been used here, esl_send_recv on it goes through
+ * the same FIFO so replies stay matched to their commands
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_send_async(esl_handle_t *handle, const char *cmd, esl_reply_t **reply);
+
+/*! \brief Wait for the reply to a command sent with esl_send_async. While
+ * waiting, one of the waiting threads reads the handle on behalf of all.
+ * \param handle the handle the command was sent on
+ * \param reply the future
+ * \param ms maximum time to wait in milliseconds, 0 to wait forever
+ * \param[out] event if not nullptr, the reply event, owned by the caller
+ * \return ESL_SUCCESS with the reply, ESL_BREAK on timeout or
+ * ESL_INTERRUPTED when woken with esl_handle_wakeup (the future stays
+ * valid either way), ESL_FAIL if the connection failed first
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_reply_wait(esl_handle_t *handle, esl_reply_t *reply, uint32_t ms,
+                   esl_event_t **event);
+
+/*! \brief Like esl_reply_wait, but up to an absolute deadline
+ * \param handle the handle the command was sent on
+ * \param reply the future
+ * \param deadline_ms time on the esl_monotonic_ms clock to give up at, 0 to
+ * wait forever
+ * \param[out] event if not nullptr, the reply event, owned by the caller
+ * \return as esl_reply_wait
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_reply_wait_until(esl_handle_t *handle, esl_reply_t *reply,
+                         uint64_t deadline_ms, esl_event_t **event);
+
+/*! \brief Release a reply future. A reply that has not arrived yet is
+ * still taken off the FIFO when it does, and then discarded.
+ * \param reply future to release
+ */
+ESL_DECLARE(void) esl_reply_destroy(esl_reply_t **reply);
+
+/*! \brief Run an api command in the background and track its result
+ * \param handle connected handle
+ * \param cmd api command and arguments, without the bgapi prefix
+ * \param callback if not nullptr, called when the job completes
+ * \param user_data passed to callback
+ * \param job if not nullptr, returned job to wait on, release it with
+ * esl_job_destroy; may only be nullptr when a callback is given
+ * \return status of sending the command
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_bgapi_submit(esl_handle_t *handle, const char *cmd,
+                     esl_job_callback_t callback, void *user_data,
+                     esl_job_t **job);
+
+/*! \brief Wait for a background job to complete. Reads the handle like
+ * esl_reply_wait.
+ * \param handle the handle the job was submitted on
+ * \param job the job
+ * \param ms maximum time to wait in milliseconds, 0 to wait forever
+ * \param[out] event if not nullptr, the BACKGROUND_JOB event (or the -ERR
+ * reply on failure), owned by the caller
+ * \return ESL_SUCCESS when the job completed, ESL_BREAK on timeout or
+ * ESL_INTERRUPTED when woken with esl_handle_wakeup (the job stays valid
+ * either way), ESL_FAIL if the command was refused or the connection
+ * failed
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_job_wait(esl_handle_t *handle, esl_job_t *job, uint32_t ms,
+                 esl_event_t **event);
+
+/*! \brief Job-UUID of a background job
+ * \param job the job
+ * \return the Job-UUID, valid while the job is
+ */
+ESL_DECLARE(const char *) esl_job_uuid(esl_job_t *job);
+
+/*! \brief Release a job. A job that has not completed yet still runs its
+ * callback when it does.
+ * \param job job to release
+ */
+ESL_DECLARE(void) esl_job_destroy(esl_job_t **job);
+
+/*! \brief Create the reply FIFO of a handle. Used internally.
+ * \param pipeline returned pointer to the new FIFO
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_pipeline_create(esl_pipeline_t **pipeline);
+
+/*! \brief Complete the oldest pending reply with a reply event. Used
+ * internally by the receive path.
+ * \param pipeline the FIFO, may be nullptr
+ * \param event reply event, taken over when ESL_SUCCESS is returned
+ * \return ESL_SUCCESS if a reply was pending
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_pipeline_deliver(esl_pipeline_t *pipeline, esl_event_t *event);
+
+/*! \brief Whether any background job is outstanding. Used internally by
+ * the receive path to skip looking for BACKGROUND_JOB events; safe to call
+ * without holding any lock.
+ * \param pipeline the FIFO, may be nullptr
+ * \return true if a job is waiting for its event
+ */
+ESL_DECLARE(bool) esl_pipeline_has_jobs(esl_pipeline_t *pipeline);
+
+/*! \brief Complete the background job with the given Job-UUID. Used
+ * internally by the receive path.
+ * \param pipeline the FIFO
+ * \param uuid Job-UUID of the event
+ * \param event BACKGROUND_JOB event, taken over when ESL_SUCCESS is
+ * returned
+ * \return ESL_SUCCESS if the job was outstanding
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_pipeline_resolve_job(esl_pipeline_t *pipeline, const char *uuid,
+                             esl_event_t *event);
+
+/*! \brief Fail every pending reply and job, e.g. after the connection
+ * dropped
+ * \param pipeline the FIFO, may be nullptr
+ */
+ESL_DECLARE(void) esl_pipeline_fail(esl_pipeline_t *pipeline);
+
+/*! \brief Fail every pending reply and job and release the handle's
+ * reference to the FIFO. Futures and jobs still held stay valid.
+ * \param pipeline the FIFO to close
+ */
+ESL_DECLARE(void) esl_pipeline_close(esl_pipeline_t **pipeline);
+
+/** @} */
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "esl/esl.h"
+
+/**
+ * @defgroup esl_queue Event Queue
+ * Bounded FIFO of parsed events that a handle keeps for esl_recv_event when
+ * they arrive while something else is reading it, e.g. events interleaved
+ * with the reply esl_send_recv waits for. Events are kept in one ring per
+ * priority, merged back into arrival order on pop, so push, pop and
+ * eviction by priority are O(1); the rings grow by doubling up to the
+ * configured capacity. What happens to an event that arrives when the queue
+ * is full is set by the overflow policy.
+ * @{
+ */
+
+/*! \brief What a push does when the queue already holds capacity events */
+typedef enum {
+  /*! Drop the event that has waited longest and queue the new one */
+  ESL_QUEUE_OVERFLOW_DROP_OLDEST = 0,
+  /*! Wait up to block_ms for a consumer to make room, then drop the new
+   * event */
+  ESL_QUEUE_OVERFLOW_BLOCK,
+  /*! Drop the oldest of the lowest priority events queued, or the new event
+   * if its priority is lower than all of them */
+  ESL_QUEUE_OVERFLOW_DROP_PRIORITY
+} esl_queue_overflow_t;
+
+/*! \brief Queue settings. Zero fields take the documented defaults. */
+typedef struct {
+  /*! Most events held at once, default 16384 */
+  esl_size_t capacity;
+  /*! Behaviour when capacity events are already queued */
+  esl_queue_overflow_t overflow;
+  /*! Longest a push waits for room under ESL_QUEUE_OVERFLOW_BLOCK, in
+   * milliseconds, default 1000 */
+  uint32_t block_ms;
+} esl_queue_config_t;
+
+/*! \brief Queue counters, see esl_queue_get_stats */
+typedef struct {
+  /*! Events queued now */
+  esl_size_t depth;
+  /*! Most events ever queued at once */
+  esl_size_t high_water;
+  /*! Events pushed, including those dropped */
+  uint64_t pushed;
+  /*! Events dropped by the overflow policy */
+  uint64_t dropped;
+} esl_queue_stats_t;
+
+/*! \brief Create an event queue
+ * \param queue returned pointer to the new queue
+ * \param config settings, nullptr for the defaults
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_queue_create(esl_queue_t **queue, const esl_queue_config_t *config);
+
+/*! \brief Change the settings of a queue
+ * \param queue the queue
+ * \param config new settings, nullptr for the defaults
+ * \return ESL_FAIL if more events than the new capacity are queued
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_queue_configure(esl_queue_t *queue, const esl_queue_config_t *config);
+
+/*! \brief Destroy a queue and the events still in it. A push waiting in
+ * esl_queue_wait_room returns once it wakes up.
+ * \param queue the queue to destroy
+ */
+ESL_DECLARE(void) esl_queue_destroy(esl_queue_t **queue);
+
+/*! \brief Append an event. The queue takes the event over either way.
+ * Under ESL_QUEUE_OVERFLOW_BLOCK a full queue drops the new event, so
+ * callers use esl_queue_push_wait instead.
+ * \param queue the queue
+ * \param event event to append
+ * \return ESL_SUCCESS if it was queued, ESL_BREAK if it was dropped because
+ * the queue is full, see esl_queue_overflow_t
+ */
+ESL_DECLARE(esl_status_t)
+esl_queue_push(esl_queue_t *queue, esl_event_t *event);
+
+/*! \brief Append an event, first waiting up to block_ms for room when an
+ * ESL_QUEUE_OVERFLOW_BLOCK queue is full. outer is released (once) while
+ * waiting and taken back after the event is queued, so a consumer holding
+ * outer cannot slip a newer event in ahead of it. Under the other policies
+ * this is esl_queue_push.
+ * \param queue the queue
+ * \param event event to append, taken over either way
+ * \param outer mutex held once by the caller that consumers need, or
+ * nullptr
+ * \return as esl_queue_push, or ESL_FAIL if the queue was destroyed
+ * meanwhile (it must not be used again)
+ */
+ESL_DECLARE(esl_status_t)
+esl_queue_push_wait(esl_queue_t *queue, esl_event_t *event,
+                    esl_mutex_t *outer);
+
+/*! \brief Wait for a full ESL_QUEUE_OVERFLOW_BLOCK queue to have room,
+ * releasing outer (once) while waiting. Returns at once under the other
+ * policies or when there is room.
+ * \param queue the queue
+ * \param outer mutex held by the caller that consumers need, or nullptr
+ * \return ESL_SUCCESS if there is room, ESL_BREAK once block_ms ran out,
+ * ESL_FAIL if the queue was destroyed meanwhile (it must not be used
+ * again)
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_queue_wait_room(esl_queue_t *queue, esl_mutex_t *outer);
+
+/*! \brief Remove the oldest event. An empty queue with a push blocked in
+ * esl_queue_push_wait waits for that push, which already has room.
+ * \param queue the queue, may be nullptr
+ * \return the event, owned by the caller, or nullptr if the queue is empty
+ */
+ESL_DECLARE(esl_event_t *) esl_queue_pop(esl_queue_t *queue);
+
+/*! \brief Number of events queued
+ * \param queue the queue, may be nullptr
+ * \return depth
+ */
+ESL_DECLARE(esl_size_t) esl_queue_depth(esl_queue_t *queue);
+
+/*! \brief Read the counters of a queue
+ * \param queue the queue
+ * \param stats returned counters
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_queue_get_stats(esl_queue_t *queue, esl_queue_stats_t *stats);
+
+/*! \brief Configure the queue of events a handle holds for esl_recv_event
+ * \param handle Handle to configure, connected or not
+ * \param config settings, nullptr for the defaults
+ * \return ESL_FAIL if more events than the new capacity are queued
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_handle_set_event_queue(esl_handle_t *handle,
+                               const esl_queue_config_t *config);
+
+/*! \brief Queue an event on a handle for esl_recv_event, creating the
+ * queue with the defaults if needed. Used internally; the caller holds the
+ * handle mutex once, which a blocking push releases while it waits.
+ * \param handle the handle
+ * \param event event to queue, taken over either way
+ * \return as esl_queue_push, or ESL_FAIL if the handle was disconnected
+ * while waiting
+ */
+ESL_DECLARE(esl_status_t)
+esl_handle_queue_event(esl_handle_t *handle, esl_event_t *event);
+
+/** @} */
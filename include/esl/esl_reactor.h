@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "esl/esl.h"
+
+/**
+ * @defgroup esl_reactor Reactor Routines
+ * Drives any number of connected handles from a single thread. Every
+ * handle socket is registered with one epoll instance; when it becomes
+ * readable the reactor frames and parses all complete packets buffered on
+ * the handle and hands each event to the handle's callback.
+ * @{
+ */
+typedef struct esl_reactor esl_reactor_t;
+
+/*! \brief Called for every event parsed on a handle driven by a reactor
+ * \param reactor the reactor dispatching the event
+ * \param handle the handle the event was received on
+ * \param event the received event, owned by the callback (destroy it with
+ * esl_event_destroy). nullptr when the handle disconnected; the handle has
+ * already been removed from the reactor at that point. While the callback
+ * runs, handle->last_ievent holds the parsed inner event, if any.
+ * \param user_data the pointer given to esl_reactor_add_handle
+ */
+typedef void (*esl_reactor_callback_t)(esl_reactor_t *reactor,
+                                       esl_handle_t *handle,
+                                       esl_event_t *event, void *user_data);
+
+/*! \brief Create a new reactor
+ * \param reactor returned pointer to the new reactor
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_reactor_create(esl_reactor_t **reactor);
+
+/*! \brief Destroy a reactor. Handles still registered are left connected.
+ * \param reactor reactor to destroy
+ */
+ESL_DECLARE(void) esl_reactor_destroy(esl_reactor_t **reactor);
+
+/*! \brief Register a connected handle with the reactor
+ * \param reactor the reactor
+ * \param handle a connected handle (esl_connect or esl_attach_handle)
+ * \param callback called for every event received on the handle
+ * \param user_data passed through to the callback
+ * \return status
+ * \note the handle must not be read with esl_recv_event while registered,
+ * and must be removed before esl_disconnect is called on it.
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_reactor_add_handle(esl_reactor_t *reactor, esl_handle_t *handle,
+                           esl_reactor_callback_t callback, void *user_data);
+
+/*! \brief Stop driving a handle. Safe to call from inside a callback.
+ * \param reactor the reactor
+ * \param handle the handle to remove
+ * \return ESL_SUCCESS if the handle was registered
+ */
+ESL_DECLARE(esl_status_t)
+esl_reactor_remove_handle(esl_reactor_t *reactor, esl_handle_t *handle);
+
+/*! \brief Number of handles currently registered
+ * \param reactor the reactor
+ * \return handle count
+ */
+ESL_DECLARE(esl_size_t) esl_reactor_count(esl_reactor_t *reactor);
+
+/*! \brief Wait once for socket activity and dispatch the resulting events
+ * \param reactor the reactor
+ * \param ms maximum time to wait in milliseconds, 0 to poll without blocking
+ * \return ESL_SUCCESS if any event was dispatched, ESL_BREAK on timeout or
+ * wakeup, ESL_FAIL on error
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_reactor_run_once(esl_reactor_t *reactor, uint32_t ms);
+
+/*! \brief Dispatch events until esl_reactor_stop is called
+ * \param reactor the reactor
+ * \return ESL_SUCCESS when stopped, ESL_FAIL on error
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_reactor_run(esl_reactor_t *reactor);
+
+/*! \brief Make esl_reactor_run return. May be called from any thread.
+ * \param reactor the reactor
+ */
+ESL_DECLARE(void) esl_reactor_stop(esl_reactor_t *reactor);
+
+/** @} */
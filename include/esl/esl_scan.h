@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2010-2012, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "esl/esl_base.h"
+
+/**
+ * @defgroup esl_scan Scanning Kernels
+ * Byte scanning used by the framer and the header parsers. SSE2 and AVX2
+ * versions are picked at runtime on x86-64, with a portable fallback
+ * everywhere else.
+ * @{
+ */
+
+/*! \brief One header line found by esl_scan_header_lines, as offsets from
+ * the start of the scanned data */
+typedef struct {
+  /*! first byte of the line */
+  esl_size_t start;
+  /*! first ':' in the line, or end if there is none */
+  esl_size_t colon;
+  /*! the terminating '\n' */
+  esl_size_t end;
+} esl_scan_line_t;
+
+/*! \brief Find the first byte equal to either of two values
+ * \param data bytes to scan
+ * \param len number of bytes
+ * \param a first byte value
+ * \param b second byte value
+ * \return offset of the first match, or len if there is none
+ */
+ESL_DECLARE(esl_size_t)
+esl_scan_find2(const void *data, esl_size_t len, unsigned char a,
+               unsigned char b);
+
+/*! \brief Split a header block into lines and locate each line's first ':'
+ * in a single pass
+ * \param data header block
+ * \param len number of bytes
+ * \param lines returned lines
+ * \param max_lines capacity of lines
+ * \param block_len returned offset just past the empty line ("\n" or "\r\n")
+ * that ends the block, or 0 if it was not reached
+ * \return number of lines stored. The empty line is not included. If the
+ * return equals max_lines and block_len is 0, scanning stopped early and
+ * can be resumed at lines[max_lines - 1].end + 1.
+ */
+ESL_DECLARE(esl_size_t)
+esl_scan_header_lines(const char *data, esl_size_t len,
+                      esl_scan_line_t *lines, esl_size_t max_lines,
+                      esl_size_t *block_len);
+
+/*! \brief Name of the kernel set in use: "avx2", "sse2" or "scalar" */
+ESL_DECLARE(const char *) esl_scan_impl(void);
+
+/*! \brief Select a kernel set by name, mainly for testing and benchmarks
+ * \param name "avx2", "sse2" or "scalar", or nullptr for the best one the
+ * CPU supports
+ * \return ESL_FAIL if the set is not available on this CPU or build
+ */
+ESL_DECLARE(esl_status_t) esl_scan_set_impl(const char *name);
+
+/** @} */
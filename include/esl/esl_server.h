@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "esl/esl.h"
+
+/**
+ * @defgroup esl_server Pooled Outbound Server
+ * Accepts outbound socket connections on one or more acceptor threads and
+ * hands them to a fixed set of worker threads through a bounded admission
+ * queue. Each connection is passed to the same esl_listen_callback_t that
+ * esl_listen_threaded uses, on a worker thread; the callback owns the
+ * client socket.
+ * @{
+ */
+typedef struct esl_server esl_server_t;
+
+/*! \brief esl_server_config_t.workers value for a pool that starts a worker
+ * whenever a connection is queued with none idle, so every connection runs
+ * at once as with a thread per connection. Workers stay for later
+ * connections. */
+constexpr int ESL_SERVER_WORKERS_UNBOUNDED = -1;
+
+/*! \brief What an acceptor does with a connection when the admission queue
+ * is full */
+typedef enum {
+  /*! Stop accepting until a worker frees a slot; new connections wait in
+   * the listen backlog */
+  ESL_SERVER_OVERFLOW_BLOCK = 0,
+  /*! Close the new connection */
+  ESL_SERVER_OVERFLOW_REJECT,
+  /*! Close the connection that has waited longest and queue the new one */
+  ESL_SERVER_OVERFLOW_DROP_OLDEST
+} esl_server_overflow_t;
+
+/*! \brief Server settings. Zero fields take the documented defaults. */
+typedef struct {
+  /*! IPv4 address to bind, nullptr for all addresses, or "unix:/path" for a
+   * Unix-domain socket (port and acceptors are then ignored) */
+  const char *host;
+  /*! Port to bind, 0 for any free port (see esl_server_port) */
+  esl_port_t port;
+  /*! listen() backlog, default 10000 */
+  int backlog;
+  /*! Worker threads running callbacks, default 128, or
+   * ESL_SERVER_WORKERS_UNBOUNDED */
+  int workers;
+  /*! Start workers as connections arrive, up to workers, instead of all of
+   * them when the server runs. Started workers stay for later connections. */
+  bool lazy_workers;
+  /*! Accepted connections waiting for a worker, default 1024 */
+  int queue_len;
+  /*! Behaviour when queue_len connections are already waiting */
+  esl_server_overflow_t overflow;
+  /*! Acceptor threads, default 1. With more than one, each gets its own
+   * SO_REUSEPORT listener where the system supports it, so the kernel
+   * spreads incoming connections across them. */
+  int acceptors;
+  /*! Worker stack size in bytes, default the system default */
+  size_t stack_size;
+} esl_server_config_t;
+
+/*! \brief Connection counters, see esl_server_get_stats */
+typedef struct {
+  /*! Connections accepted */
+  uint64_t accepted;
+  /*! Connections closed by ESL_SERVER_OVERFLOW_REJECT */
+  uint64_t rejected;
+  /*! Connections closed by ESL_SERVER_OVERFLOW_DROP_OLDEST */
+  uint64_t dropped;
+  /*! Connections handed to the callback */
+  uint64_t handled;
+  /*! Connections waiting in the admission queue now */
+  uint64_t queued;
+} esl_server_stats_t;
+
+/*! \brief Create a server and bind its listening sockets
+ * \param server returned pointer to the new server
+ * \param config settings, or nullptr for all defaults
+ * \param callback called on a worker thread for each accepted connection
+ * \param user_data passed through to the callback
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_server_create(esl_server_t **server, const esl_server_config_t *config,
+                      esl_listen_callback_t callback, void *user_data);
+
+/*! \brief Accept and dispatch connections until esl_server_stop is called.
+ * The calling thread is one of the acceptors. Connections still queued when
+ * the server stops are closed; callbacks already running are waited for.
+ * \param server the server
+ * \return ESL_SUCCESS when stopped, ESL_FAIL if the threads could not be
+ * started or accepting failed
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t) esl_server_run(esl_server_t *server);
+
+/*! \brief Make esl_server_run return. May be called from any thread,
+ * including a callback.
+ * \param server the server
+ */
+ESL_DECLARE(void) esl_server_stop(esl_server_t *server);
+
+/*! \brief Close the listening sockets and free the server. It must not be
+ * running.
+ * \param server server to destroy
+ */
+ESL_DECLARE(void) esl_server_destroy(esl_server_t **server);
+
+/*! \brief Port the server is listening on
+ * \param server the server
+ * \return the bound port
+ */
+ESL_DECLARE(esl_port_t) esl_server_port(esl_server_t *server);
+
+/*! \brief Read the connection counters
+ * \param server the server
+ * \param stats returned counters
+ */
+ESL_DECLARE(void)
+esl_server_get_stats(esl_server_t *server, esl_server_stats_t *stats);
+
+/** @} */
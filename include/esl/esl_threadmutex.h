@@ -32,6 +32,7 @@ esl_thread_create_detached(esl_thread_function_t func, void *data);
 esl_status_t esl_thread_create_detached_ex(esl_thread_function_t func,
                                            void *data, size_t stack_size);
 void esl_thread_override_default_stacksize(size_t size);
+size_t esl_thread_default_stacksize(void);
 ESL_DECLARE(esl_status_t) esl_mutex_create(esl_mutex_t **mutex);
 ESL_DECLARE(esl_status_t) esl_mutex_destroy(esl_mutex_t **mutex);
 ESL_DECLARE(esl_status_t) esl_mutex_lock(esl_mutex_t *mutex);
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include "esl/esl.h"
+
+/**
+ * @defgroup esl_uring io_uring Transport
+ * Optional Linux io_uring backend for the handle receive and send paths.
+ * Inbound data is collected by a single multishot recv that picks buffers
+ * from a provided-buffer ring, so a busy socket costs no syscall per chunk;
+ * outbound commands and their terminator go out as linked send SQEs in one
+ * submission. Support is detected at runtime and handles that are not
+ * switched over keep using poll() and recv()/send().
+ * @{
+ */
+
+/*! \brief Check whether the running kernel supports the io_uring transport
+ * (provided buffer rings and multishot recv). The result is cached.
+ * \return true if esl_uring_create can be expected to succeed
+ */
+ESL_DECLARE(bool) esl_uring_supported(void);
+
+/*! \brief Create a ring bound to a connected socket and arm its receive
+ * \param ring returned pointer to the new ring
+ * \param sock connected stream socket
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_uring_create(esl_uring_t **ring, esl_socket_t sock);
+
+/*! \brief Destroy a ring. Data received but not yet read is discarded.
+ * \param ring ring to destroy
+ */
+ESL_DECLARE(void) esl_uring_destroy(esl_uring_t **ring);
+
+/*! \brief Stop receiving on the ring and move every byte it already took
+ * off the socket into buffer, so the socket can be read directly again
+ * \param ring the ring
+ * \param buffer buffer to append pending data to
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_uring_detach(esl_uring_t *ring, esl_buffer_t *buffer);
+
+/*! \brief File descriptor that polls readable while the ring has
+ * completions to reap, for use with epoll
+ * \param ring the ring
+ * \return the ring descriptor
+ */
+ESL_DECLARE(int) esl_uring_fd(esl_uring_t *ring);
+
+/*! \brief Append received data to buffer
+ * \param ring the ring
+ * \param buffer destination buffer
+ * \param ms maximum time to wait for data, 0 to only collect what has
+ * already completed
+ * \param wakeup wakeup that cuts the wait short, or nullptr
+ * \param since generation of wakeup noted before blocking
+ * \return bytes appended, 0 on timeout, -1 on error or end of stream with
+ * errno set, EINTR when woken with nothing received
+ */
+[[nodiscard]] ESL_DECLARE(esl_ssize_t)
+    esl_uring_recv(esl_uring_t *ring, esl_buffer_t *buffer, uint32_t ms,
+                   esl_wakeup_t *wakeup, uint64_t since);
+
+/*! \brief Send the iovecs in order as one chain of linked send SQEs. A
+ * wakeup cancels what is still in flight, like a timeout.
+ * \param ring the ring
+ * \param iov data to send
+ * \param iovcnt number of entries in iov
+ * \param ms maximum time to wait for the chain to complete
+ * \param wakeup wakeup that cuts the wait short, or nullptr
+ * \param since generation of wakeup noted before blocking
+ * \return bytes sent in order before the first short or failed send, -1 on
+ * error with errno set, EINTR when woken before anything was sent
+ */
+[[nodiscard]] ESL_DECLARE(esl_ssize_t)
+    esl_uring_sendv(esl_uring_t *ring, const struct iovec *iov, int iovcnt,
+                    uint32_t ms, esl_wakeup_t *wakeup, uint64_t since);
+
+/*! \brief Switch a connected handle to or from the io_uring transport
+ * \param handle a connected handle
+ * \note Switch before adding the handle to a reactor.
+ * \param enable true to move receives and sends onto a ring
+ * \return ESL_SUCCESS if the handle now uses the requested transport,
+ * ESL_FAIL if io_uring is unavailable (the handle keeps working as before)
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_handle_use_uring(esl_handle_t *handle, bool enable);
+
+/** @} */
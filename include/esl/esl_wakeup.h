@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <poll.h>
+
+#include "esl/esl.h"
+
+/**
+ * @defgroup esl_wakeup Wakeups
+ * An eventfd (a non-blocking pipe where there is none) that interrupts
+ * threads blocked on a handle. Every signal bumps a generation counter; a
+ * wait that noted the generation before blocking is interrupted once it
+ * changes, so every thread blocked at the time of the signal returns, and
+ * a wait started after it is not affected. Each connected handle owns one,
+ * see esl_handle_wakeup.
+ * @{
+ */
+
+/*! \brief A wait polling the descriptor, see esl_wakeup_enter */
+typedef struct esl_wakeup_waiter {
+  uint64_t since;
+  struct esl_wakeup_waiter *next;
+} esl_wakeup_waiter_t;
+
+/*! \brief Create a wakeup
+ * \param wakeup returned pointer to the new wakeup
+ * \return status
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_wakeup_create(esl_wakeup_t **wakeup);
+
+/*! \brief Destroy a wakeup. No thread may still be waiting on it.
+ * \param wakeup wakeup to destroy
+ */
+ESL_DECLARE(void) esl_wakeup_destroy(esl_wakeup_t **wakeup);
+
+/*! \brief Interrupt every wait blocked on the wakeup. May be called from
+ * any thread, including signal handlers.
+ * \param wakeup the wakeup
+ */
+ESL_DECLARE(void) esl_wakeup_signal(esl_wakeup_t *wakeup);
+
+/*! \brief Generation to note before blocking
+ * \param wakeup the wakeup, may be nullptr
+ * \return the number of signals so far, 0 for nullptr
+ */
+ESL_DECLARE(uint64_t) esl_wakeup_generation(esl_wakeup_t *wakeup);
+
+/*! \brief Descriptor that becomes readable when the wakeup is signalled,
+ * for callers polling it along with their own
+ * \param wakeup the wakeup, may be nullptr
+ * \return the descriptor, or -1 for nullptr
+ */
+ESL_DECLARE(int) esl_wakeup_fd(esl_wakeup_t *wakeup);
+
+/*! \brief Whether the wakeup was signalled since a generation was noted
+ * \param wakeup the wakeup, may be nullptr
+ * \param since generation noted before blocking
+ * \return true if signalled since
+ */
+ESL_DECLARE(bool) esl_wakeup_fired(esl_wakeup_t *wakeup, uint64_t since);
+
+/*! \brief Clear signals from the descriptor so it does not keep polling
+ * as readable. Left alone while a wait registered with esl_wakeup_enter
+ * has not seen the latest signal; the last of those clears it on leaving.
+ * \param wakeup the wakeup, may be nullptr
+ */
+ESL_DECLARE(void) esl_wakeup_clear(esl_wakeup_t *wakeup);
+
+/*! \brief Register a wait that polls esl_wakeup_fd itself, so the
+ * descriptor is not cleared before the wait has seen a signal meant for it.
+ * esl_wakeup_poll registers on its own.
+ * \param wakeup the wakeup, may be nullptr
+ * \param waiter registration, owned by the caller until esl_wakeup_leave
+ * \param since generation noted before blocking
+ */
+ESL_DECLARE(void)
+esl_wakeup_enter(esl_wakeup_t *wakeup, esl_wakeup_waiter_t *waiter,
+                 uint64_t since);
+
+/*! \brief Unregister a wait, clearing the descriptor if it was the last
+ * one interrupted
+ * \param wakeup the wakeup, may be nullptr
+ * \param waiter registration passed to esl_wakeup_enter
+ */
+ESL_DECLARE(void)
+esl_wakeup_leave(esl_wakeup_t *wakeup, esl_wakeup_waiter_t *waiter);
+
+/*! \brief poll() the given descriptors and the wakeup
+ * \param wakeup the wakeup, may be nullptr
+ * \param since generation noted before blocking
+ * \param pfds descriptors to poll, with room for one more entry after the
+ * last that is used for the wakeup
+ * \param n number of descriptors in pfds
+ * \param ms maximum time to wait in milliseconds
+ * \return ESL_SUCCESS when a descriptor is ready (see its revents),
+ * ESL_BREAK on timeout, ESL_INTERRUPTED when signalled since, ESL_FAIL
+ * on error
+ */
+[[nodiscard]] ESL_DECLARE(esl_status_t)
+    esl_wakeup_poll(esl_wakeup_t *wakeup, uint64_t since,
+                    struct pollfd *pfds, nfds_t n, uint32_t ms);
+
+/** @} */
@@ -33,32 +33,46 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netdb.h>
 #include <poll.h>
+#include <stddef.h>
+
+#include <sys/stat.h>
 
 #include "esl/esl.h"
 #include "esl/esl_event.h"
+#include "esl/esl_parser.h"
+#include "esl/esl_pipeline.h"
+#include "esl/esl_queue.h"
+#include "esl/esl_scan.h"
+#include "esl/esl_server.h"
 #include "esl/esl_threadmutex.h"
+#include "esl/esl_uring.h"
+#include "esl/esl_wakeup.h"
 
 #define closesocket(x)                                                         \
   shutdown((x), 2);                                                            \
   close((x))
 
-static inline esl_ssize_t esl_min_ssize(esl_ssize_t x, esl_ssize_t y) {
-  return x < y ? x : y;
-}
-static inline esl_ssize_t esl_max_ssize(esl_ssize_t x, esl_ssize_t y) {
-  return x > y ? x : y;
-}
-static inline esl_ssize_t esl_clamp_ssize(esl_ssize_t min, esl_ssize_t max,
-                                          esl_ssize_t val) {
-  return esl_min_ssize(max, esl_max_ssize(val, min));
-}
-
-constexpr esl_size_t ESL_MAX_CONTENT_LENGTH = 16'777'216;
 constexpr esl_size_t ESL_MAX_PACKET_BUFFER_LENGTH = 67'108'864;
+constexpr esl_size_t ESL_RECV_CHUNK = 65'536;
+/* ESL_FOOTPRINT_COMPACT sizing: initial packet buffer and receive size, and
+ * the buffer size above which it is shrunk back once drained. */
+constexpr esl_size_t ESL_COMPACT_BUF_START = 4096;
+constexpr esl_size_t ESL_COMPACT_SHRINK_AT = 16'384;
 constexpr esl_size_t ESL_MAX_EVENT_PLAIN_HEADERS = 4'096;
 constexpr esl_size_t ESL_MAX_EVENT_PLAIN_LINE_LENGTH = 65'536;
+constexpr esl_size_t ESL_EVENT_PLAIN_LINE_BATCH = 64;
+/* esl_wait_strategy_t defaults */
+constexpr uint32_t ESL_WAIT_POLL_MS = 1000;
+constexpr uint32_t ESL_WAIT_SEND_TIMEOUT_MS = 1000;
+constexpr uint32_t ESL_WAIT_SPIN_US = 50;
+/* handle_poll and handle_recv result when the handle was woken */
+constexpr esl_ssize_t ESL_POLL_INTERRUPTED = -2;
+/* esl_listen_threaded callbacks running at once; later connections wait in
+ * the server's admission queue, then in the listen backlog */
+constexpr int ESL_LISTEN_THREADED_WORKERS = 1024;
 
 /* Written by Marc Espie, public domain */
 constexpr esl_ssize_t ESL_CTYPE_NUM_CHARS = 256;
@@ -390,11 +404,19 @@ ESL_DECLARE(char *) esl_url_decode(char *s) {
 }
 
 static int sock_setup(esl_handle_t *handle) {
+  struct sockaddr_storage local;
+  socklen_t local_len = sizeof(local);
 
   if (handle->sock == ESL_SOCK_INVALID) {
     return ESL_FAIL;
   }
 
+  /* Nagle only applies to TCP */
+  if (getsockname(handle->sock, (struct sockaddr *)&local, &local_len) == 0 &&
+      local.ss_family != AF_INET && local.ss_family != AF_INET6) {
+    return ESL_SUCCESS;
+  }
+
   {
     int x = 1;
     if (setsockopt(handle->sock, IPPROTO_TCP, TCP_NODELAY, &x, sizeof(x)) !=
@@ -407,6 +429,327 @@ static int sock_setup(esl_handle_t *handle) {
   return ESL_SUCCESS;
 }
 
+/* Prefer a mirrored packet buffer so large bodies straddling the end of it
+ * are never compacted; fall back to a plain one where memfd is missing. */
+static esl_status_t handle_create_packet_buf(esl_handle_t *handle) {
+  const bool compact = handle->footprint == ESL_FOOTPRINT_COMPACT;
+  const esl_size_t start = compact ? ESL_COMPACT_BUF_START : BUF_START;
+  const esl_size_t chunk = compact ? ESL_COMPACT_BUF_START : BUF_CHUNK;
+
+  if (esl_buffer_create_mirrored(&handle->packet_buf, chunk, start,
+                                 ESL_MAX_PACKET_BUFFER_LENGTH) !=
+          ESL_SUCCESS &&
+      esl_buffer_create(&handle->packet_buf, chunk, start,
+                        ESL_MAX_PACKET_BUFFER_LENGTH) != ESL_SUCCESS) {
+    return ESL_FAIL;
+  }
+  esl_buffer_set_geometric(handle->packet_buf, compact);
+
+  return ESL_SUCCESS;
+}
+
+/* Give the handle its send-side lock and its reply FIFO, so commands can be
+ * written and answered while another thread is reading events. */
+static esl_status_t handle_create_duplex(esl_handle_t *handle) {
+  if (!handle->send_mutex &&
+      esl_mutex_create(&handle->send_mutex) != ESL_SUCCESS) {
+    return ESL_FAIL;
+  }
+  if (!handle->pipeline && esl_pipeline_create(&handle->pipeline) !=
+                               ESL_SUCCESS) {
+    esl_mutex_destroy(&handle->send_mutex);
+    return ESL_FAIL;
+  }
+  if (!handle->wakeup && esl_wakeup_create(&handle->wakeup) != ESL_SUCCESS) {
+    esl_pipeline_close(&handle->pipeline);
+    esl_mutex_destroy(&handle->send_mutex);
+    return ESL_FAIL;
+  }
+
+  return ESL_SUCCESS;
+}
+
+/* Give back what a large packet made the buffers grow to, once it has been
+ * parsed. Only for ESL_FOOTPRINT_COMPACT handles. */
+static void handle_trim(esl_handle_t *handle) {
+  if (handle->footprint != ESL_FOOTPRINT_COMPACT) {
+    return;
+  }
+  if (handle->packet_buf &&
+      esl_buffer_len(handle->packet_buf) > ESL_COMPACT_SHRINK_AT &&
+      esl_buffer_inuse(handle->packet_buf) <= ESL_COMPACT_BUF_START) {
+    (void)esl_buffer_shrink(handle->packet_buf, ESL_COMPACT_BUF_START);
+  }
+  if (esl_parser_footprint(handle->parser) > ESL_COMPACT_BUF_START) {
+    esl_parser_trim(handle->parser);
+  }
+}
+
+ESL_DECLARE(esl_status_t)
+esl_handle_set_footprint(esl_handle_t *handle, esl_footprint_mode_t mode) {
+  if (!handle || (mode != ESL_FOOTPRINT_DEFAULT &&
+                  mode != ESL_FOOTPRINT_COMPACT)) {
+    return ESL_FAIL;
+  }
+
+  if (handle->mutex) {
+    esl_mutex_lock(handle->mutex);
+  }
+
+  handle->footprint = mode;
+  if (handle->packet_buf) {
+    esl_buffer_set_geometric(handle->packet_buf,
+                             mode == ESL_FOOTPRINT_COMPACT);
+    handle_trim(handle);
+  }
+
+  if (handle->mutex) {
+    esl_mutex_unlock(handle->mutex);
+  }
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_handle_set_wait_strategy(esl_handle_t *handle,
+                             const esl_wait_strategy_t *strategy) {
+  if (!handle || (strategy && strategy->mode != ESL_WAIT_POLL &&
+                  strategy->mode != ESL_WAIT_OPTIMISTIC &&
+                  strategy->mode != ESL_WAIT_BUSY_POLL)) {
+    return ESL_FAIL;
+  }
+
+  handle->wait = strategy ? *strategy : (esl_wait_strategy_t){0};
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(uint64_t) esl_monotonic_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1'000'000;
+}
+
+static uint64_t handle_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1'000'000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static uint32_t handle_poll_ms(const esl_handle_t *handle) {
+  return handle->wait.poll_ms ? handle->wait.poll_ms : ESL_WAIT_POLL_MS;
+}
+
+static uint32_t handle_send_timeout_ms(const esl_handle_t *handle) {
+  return handle->wait.send_timeout_ms ? handle->wait.send_timeout_ms
+                                      : ESL_WAIT_SEND_TIMEOUT_MS;
+}
+
+/* poll() fd and the handle's wakeup. Returns the esl_poll_t flags that
+ * fired, 0 on timeout, -1 on errors or ESL_POLL_INTERRUPTED when the
+ * handle was woken since the generation since was noted. */
+static int handle_poll(const esl_handle_t *handle, esl_socket_t fd,
+                       esl_poll_t flags, uint32_t ms, uint64_t since) {
+  struct pollfd pfds[2] = {{.fd = fd}};
+  int activity = 0;
+
+  if ((flags & ESL_POLL_READ)) {
+    pfds[0].events |= POLLIN;
+  }
+  if ((flags & ESL_POLL_WRITE)) {
+    pfds[0].events |= POLLOUT;
+  }
+
+  switch (esl_wakeup_poll(handle->wakeup, since, pfds, 1, ms)) {
+  case ESL_SUCCESS:
+    break;
+  case ESL_INTERRUPTED:
+    return ESL_POLL_INTERRUPTED;
+  case ESL_BREAK:
+    return 0;
+  default:
+    return -1;
+  }
+
+  if ((pfds[0].revents & POLLIN)) {
+    activity |= ESL_POLL_READ;
+  }
+  if ((pfds[0].revents & POLLOUT)) {
+    activity |= ESL_POLL_WRITE;
+  }
+  if ((pfds[0].revents & POLLERR) && (flags & ESL_POLL_ERROR)) {
+    activity |= ESL_POLL_ERROR;
+  }
+
+  return activity;
+}
+
+/* Wait up to ms for fd to become readable. Busy-polling handles first check
+ * it without sleeping for their spin budget (capped at ms). */
+static int handle_wait_read(const esl_handle_t *handle, esl_socket_t fd,
+                            uint32_t ms, uint64_t since) {
+  if (handle->wait.mode == ESL_WAIT_BUSY_POLL) {
+    uint64_t spin_us =
+        handle->wait.spin_us ? handle->wait.spin_us : ESL_WAIT_SPIN_US;
+    uint64_t until;
+
+    if (spin_us > (uint64_t)ms * 1000) {
+      spin_us = (uint64_t)ms * 1000;
+    }
+    until = handle_now_us() + spin_us;
+    do {
+      const int activity =
+          handle_poll(handle, fd, ESL_POLL_READ | ESL_POLL_ERROR, 0, since);
+
+      if (activity != 0) {
+        return activity;
+      }
+    } while (handle_now_us() < until);
+  }
+
+  return handle_poll(handle, fd, ESL_POLL_READ | ESL_POLL_ERROR, ms, since);
+}
+
+ESL_DECLARE(esl_status_t) esl_handle_wakeup(esl_handle_t *handle) {
+  if (!handle || handle->wakeup == nullptr) {
+    return ESL_FAIL;
+  }
+
+  esl_wakeup_signal(handle->wakeup);
+
+  return ESL_SUCCESS;
+}
+
+/* Whether a handle has events ready without reading its socket. A handle
+ * another thread is reading is left to that thread. */
+static bool handle_has_buffered(esl_handle_t *handle) {
+  bool buffered = false;
+
+  if (handle->mutex && esl_mutex_trylock(handle->mutex) == ESL_SUCCESS) {
+    buffered = esl_queue_depth(handle->event_queue) ||
+               (handle->packet_buf &&
+                esl_buffer_packet_count(handle->packet_buf));
+    esl_mutex_unlock(handle->mutex);
+  }
+
+  return buffered;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_wait_handles(esl_handle_t **handles, size_t n, uint32_t ms,
+                 size_t *ready) {
+  const uint64_t deadline = esl_monotonic_ms() + ms;
+  struct pollfd *pfds = nullptr;
+  uint64_t *since = nullptr;
+  esl_wakeup_waiter_t *waiters = nullptr;
+  size_t entered = 0;
+  esl_status_t status = ESL_FAIL;
+
+  if (handles == nullptr || n == 0) {
+    return ESL_FAIL;
+  }
+
+  if ((pfds = calloc(2 * n, sizeof(*pfds))) == nullptr ||
+      (since = calloc(n, sizeof(*since))) == nullptr ||
+      (waiters = calloc(n, sizeof(*waiters))) == nullptr) {
+    goto done;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (handles[i] == nullptr || !handles[i]->connected) {
+      goto done;
+    }
+    since[i] = esl_wakeup_generation(handles[i]->wakeup);
+    /* polled directly, so other waits must not clear it under us */
+    esl_wakeup_enter(handles[i]->wakeup, &waiters[i], since[i]);
+    entered++;
+    if (handle_has_buffered(handles[i])) {
+      if (ready) {
+        *ready = i;
+      }
+      status = ESL_SUCCESS;
+      goto done;
+    }
+    pfds[i] = (struct pollfd){.fd = handles[i]->uring
+                                        ? esl_uring_fd(handles[i]->uring)
+                                        : handles[i]->sock,
+                              .events = POLLIN};
+    pfds[n + i] = (struct pollfd){.fd = esl_wakeup_fd(handles[i]->wakeup),
+                                  .events = POLLIN};
+  }
+
+  for (;;) {
+    const uint64_t now = esl_monotonic_ms();
+    int timeout = -1;
+
+    if (ms) {
+      if (now >= deadline) {
+        status = ESL_BREAK;
+        break;
+      }
+      timeout = deadline - now > INT_MAX ? INT_MAX : (int)(deadline - now);
+    }
+    if (poll(pfds, 2 * n, timeout) < 0 && errno != EINTR) {
+      break;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      if (esl_wakeup_fired(handles[i]->wakeup, since[i])) {
+        status = ESL_INTERRUPTED;
+      } else if (pfds[n + i].revents) {
+        /* a signal from before the wait started */
+        esl_wakeup_clear(handles[i]->wakeup);
+        continue;
+      } else if (pfds[i].revents) {
+        status = ESL_SUCCESS;
+      } else {
+        continue;
+      }
+      if (ready) {
+        *ready = i;
+      }
+      goto done;
+    }
+  }
+
+done:
+  for (size_t i = 0; i < entered; i++) {
+    esl_wakeup_leave(handles[i]->wakeup, &waiters[i]);
+  }
+  free(waiters);
+  free(since);
+  free(pfds);
+  return status;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_handle_footprint(esl_handle_t *handle, esl_footprint_t *footprint) {
+  if (!handle || !footprint) {
+    return ESL_FAIL;
+  }
+
+  if (handle->mutex) {
+    esl_mutex_lock(handle->mutex);
+  }
+
+  *footprint = (esl_footprint_t){.handle_size = sizeof(*handle)};
+  if (handle->packet_buf) {
+    footprint->buffer_size = esl_buffer_len(handle->packet_buf);
+    footprint->buffer_used = esl_buffer_inuse(handle->packet_buf);
+  }
+  footprint->parser_size = esl_parser_footprint(handle->parser);
+  footprint->total =
+      footprint->handle_size + footprint->buffer_size + footprint->parser_size;
+
+  if (handle->mutex) {
+    esl_mutex_unlock(handle->mutex);
+  }
+
+  return ESL_SUCCESS;
+}
+
 ESL_DECLARE(esl_status_t)
 esl_attach_handle(esl_handle_t *handle, esl_socket_t socket,
                   struct sockaddr_in *addr) {
@@ -433,14 +776,13 @@ esl_attach_handle(esl_handle_t *handle, esl_socket_t socket,
     created_mutex = true;
   }
 
-  if (!handle->packet_buf) {
-    if (esl_buffer_create(&handle->packet_buf, BUF_CHUNK, BUF_START,
-                          ESL_MAX_PACKET_BUFFER_LENGTH) != ESL_SUCCESS) {
-      if (created_mutex) {
-        esl_mutex_destroy(&handle->mutex);
-      }
-      return ESL_FAIL;
+  if ((!handle->packet_buf &&
+       handle_create_packet_buf(handle) != ESL_SUCCESS) ||
+      handle_create_duplex(handle) != ESL_SUCCESS) {
+    if (created_mutex) {
+      esl_mutex_destroy(&handle->mutex);
     }
+    return ESL_FAIL;
   }
 
   handle->connected = 1;
@@ -636,28 +978,55 @@ esl_events(esl_handle_t *handle, esl_event_type_t etype, const char *value) {
   return esl_send_recv(handle, send_buf);
 }
 
-static int esl_socket_reuseaddr(esl_socket_t socket) {
-  int reuse_addr = 1;
-  return setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse_addr,
-                    sizeof(reuse_addr));
+ESL_DECLARE(esl_status_t)
+esl_unix_sockaddr(const char *host, struct sockaddr_un *addr,
+                  socklen_t *len) {
+  const char *path;
+  size_t path_len;
+
+  if (host == nullptr || addr == nullptr || len == nullptr ||
+      strncmp(host, ESL_UNIX_PREFIX, sizeof(ESL_UNIX_PREFIX) - 1) != 0) {
+    return ESL_BREAK;
+  }
+
+  path = host + sizeof(ESL_UNIX_PREFIX) - 1;
+  path_len = strlen(path);
+  if (path_len == 0 || path_len >= sizeof(addr->sun_path)) {
+    return ESL_FAIL;
+  }
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  memcpy(addr->sun_path, path, path_len);
+
+  if (path[0] == '@') {
+    /* abstract: the name is the bytes after a leading NUL, unterminated */
+    addr->sun_path[0] = '\0';
+    *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len);
+  } else {
+    *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path_len + 1);
+  }
+
+  return ESL_SUCCESS;
 }
 
-struct thread_handler {
-  esl_listen_callback_t callback;
-  esl_socket_t server_sock;
-  esl_socket_t client_sock;
-  struct sockaddr_in addr;
-  void *user_data;
-};
+ESL_DECLARE(void) esl_unix_unlink(const struct sockaddr_un *addr) {
+  struct stat st;
 
-static void *client_thread([[maybe_unused]] esl_thread_t *me, void *obj) {
-  struct thread_handler *handler = (struct thread_handler *)obj;
+  if (addr == nullptr || addr->sun_family != AF_UNIX ||
+      addr->sun_path[0] == '\0') {
+    return;
+  }
 
-  handler->callback(handler->server_sock, handler->client_sock, &handler->addr,
-                    handler->user_data);
-  free(handler);
+  if (lstat(addr->sun_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    (void)unlink(addr->sun_path);
+  }
+}
 
-  return nullptr;
+static int esl_socket_reuseaddr(esl_socket_t socket) {
+  int reuse_addr = 1;
+  return setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse_addr,
+                    sizeof(reuse_addr));
 }
 
 static int prepare_sock(esl_socket_t sock) {
@@ -672,18 +1041,24 @@ static int prepare_sock(esl_socket_t sock) {
 }
 
 ESL_DECLARE(esl_status_t)
-esl_listen([[maybe_unused]] const char *host, esl_port_t port,
+esl_listen(const char *host, esl_port_t port,
            esl_listen_callback_t callback, void *user_data,
            esl_socket_t *server_sockP) {
   esl_socket_t server_sock = ESL_SOCK_INVALID;
   struct sockaddr_in addr;
+  struct sockaddr_un unix_addr;
+  socklen_t unix_len = 0;
   esl_status_t status = ESL_SUCCESS;
+  esl_status_t is_unix;
 
-  if ((server_sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+  if (callback == nullptr ||
+      (is_unix = esl_unix_sockaddr(host, &unix_addr, &unix_len)) == ESL_FAIL) {
     return ESL_FAIL;
   }
-  if (callback == nullptr) {
-    closesocket(server_sock);
+
+  if ((server_sock = is_unix == ESL_SUCCESS
+                         ? socket(AF_UNIX, SOCK_STREAM, 0)
+                         : socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
     return ESL_FAIL;
   }
 
@@ -691,19 +1066,28 @@ esl_listen([[maybe_unused]] const char *host, esl_port_t port,
     *server_sockP = server_sock;
   }
 
-  if (esl_socket_reuseaddr(server_sock) != 0) {
-    status = ESL_FAIL;
-    goto end;
-  }
+  if (is_unix == ESL_SUCCESS) {
+    esl_unix_unlink(&unix_addr);
+    if (bind(server_sock, (struct sockaddr *)&unix_addr, unix_len) < 0) {
+      is_unix = ESL_BREAK;
+      status = ESL_FAIL;
+      goto end;
+    }
+  } else {
+    if (esl_socket_reuseaddr(server_sock) != 0) {
+      status = ESL_FAIL;
+      goto end;
+    }
 
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_addr.s_addr = htonl(INADDR_ANY);
-  addr.sin_port = htons(port);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
 
-  if (bind(server_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    status = ESL_FAIL;
-    goto end;
+    if (bind(server_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      status = ESL_FAIL;
+      goto end;
+    }
   }
 
   if (listen(server_sock, 10000) < 0) {
@@ -739,124 +1123,74 @@ esl_listen([[maybe_unused]] const char *host, esl_port_t port,
 end:
 
   closesocket(server_sock);
+  if (is_unix == ESL_SUCCESS) {
+    esl_unix_unlink(&unix_addr);
+  }
 
   return status;
 }
 
 ESL_DECLARE(esl_status_t)
-esl_listen_threaded([[maybe_unused]] const char *host, esl_port_t port,
+esl_listen_threaded(const char *host, esl_port_t port,
                     esl_listen_callback_t callback, void *user_data, int max) {
-  esl_socket_t server_sock = ESL_SOCK_INVALID;
-  struct sockaddr_in addr;
-  esl_status_t status = ESL_SUCCESS;
-  struct thread_handler *handler = nullptr;
+  /* TCP hosts have never been honoured here; keep binding every address */
+  const esl_server_config_t config = {
+      .host = host && strncmp(host, ESL_UNIX_PREFIX,
+                              sizeof(ESL_UNIX_PREFIX) - 1) == 0
+                  ? host
+                  : nullptr,
+      .port = port,
+      .backlog = max,
+      /* the thread per connection this replaces, but capped: a worker is
+       * only started when a connection finds none idle, on the same small
+       * stack */
+      .workers = ESL_LISTEN_THREADED_WORKERS,
+      .lazy_workers = true,
+      .stack_size = esl_thread_default_stacksize()};
+  esl_server_t *server = nullptr;
+  esl_status_t status;
 
-  if ((server_sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
-    return ESL_FAIL;
-  }
-  if (callback == nullptr) {
-    closesocket(server_sock);
+  if (esl_server_create(&server, &config, callback, user_data) !=
+      ESL_SUCCESS) {
     return ESL_FAIL;
   }
 
-  if (esl_socket_reuseaddr(server_sock) != 0) {
-    status = ESL_FAIL;
-    goto end;
+  status = esl_server_run(server);
+  esl_server_destroy(&server);
+
+  return status;
+}
+
+ESL_DECLARE(int)
+esl_wait_sock(esl_socket_t sock, uint32_t ms, esl_poll_t flags) {
+  struct pollfd pfds[2] = {{0}};
+  int s = 0, r = 0;
+
+  if (sock == ESL_SOCK_INVALID) {
+    return ESL_SOCK_INVALID;
   }
 
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_addr.s_addr = htonl(INADDR_ANY);
-  addr.sin_port = htons(port);
+  pfds[0].fd = sock;
 
-  if (bind(server_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    status = ESL_FAIL;
-    goto end;
+  if ((flags & ESL_POLL_READ)) {
+    pfds[0].events |= POLLIN;
   }
 
-  if (listen(server_sock, max) < 0) {
-    status = ESL_FAIL;
-    goto end;
+  if ((flags & ESL_POLL_WRITE)) {
+    pfds[0].events |= POLLOUT;
   }
 
-  for (;;) {
-    int client_sock;
-    struct sockaddr_in echoClntAddr;
-    socklen_t clntLen;
+  if ((flags & ESL_POLL_ERROR)) {
+    pfds[0].events |= POLLERR;
+  }
 
-    clntLen = sizeof(echoClntAddr);
+  s = poll(pfds, 1, ms);
 
-    client_sock =
-        accept(server_sock, (struct sockaddr *)&echoClntAddr, &clntLen);
-    if (client_sock == ESL_SOCK_INVALID) {
-      if (errno == EINTR) {
-        continue;
-      }
-      status = ESL_FAIL;
-      goto end;
-    }
-
-    if (prepare_sock(client_sock) != 0) {
-      closesocket(client_sock);
-      continue;
-    }
-
-    handler = calloc(1, sizeof(*handler));
-    if (handler == nullptr) {
-      closesocket(client_sock);
-      status = ESL_FAIL;
-      goto end;
-    }
-    handler->callback = callback;
-    handler->server_sock = server_sock;
-    handler->client_sock = client_sock;
-    handler->addr = echoClntAddr;
-    handler->user_data = user_data;
-    if (esl_thread_create_detached(client_thread, handler) != ESL_SUCCESS) {
-      free(handler);
-      closesocket(client_sock);
-      status = ESL_FAIL;
-      goto end;
-    }
-  }
-
-end:
-
-  closesocket(server_sock);
-
-  return status;
-}
-
-ESL_DECLARE(int)
-esl_wait_sock(esl_socket_t sock, uint32_t ms, esl_poll_t flags) {
-  struct pollfd pfds[2] = {{0}};
-  int s = 0, r = 0;
-
-  if (sock == ESL_SOCK_INVALID) {
-    return ESL_SOCK_INVALID;
-  }
-
-  pfds[0].fd = sock;
-
-  if ((flags & ESL_POLL_READ)) {
-    pfds[0].events |= POLLIN;
-  }
-
-  if ((flags & ESL_POLL_WRITE)) {
-    pfds[0].events |= POLLOUT;
-  }
-
-  if ((flags & ESL_POLL_ERROR)) {
-    pfds[0].events |= POLLERR;
-  }
-
-  s = poll(pfds, 1, ms);
-
-  if (s < 0) {
-    r = s;
-  } else if (s > 0) {
-    if ((pfds[0].revents & POLLIN)) {
-      r |= ESL_POLL_READ;
+  if (s < 0) {
+    r = s;
+  } else if (s > 0) {
+    if ((pfds[0].revents & POLLIN)) {
+      r |= ESL_POLL_READ;
     }
     if ((pfds[0].revents & POLLOUT)) {
       r |= ESL_POLL_WRITE;
@@ -879,6 +1213,8 @@ esl_connect_timeout(esl_handle_t *handle, const char *host, esl_port_t port,
   struct addrinfo hints = {0}, *result;
   struct sockaddr_in *sockaddr_in;
   struct sockaddr_in6 *sockaddr_in6;
+  struct sockaddr_un sockaddr_un;
+  esl_status_t is_unix;
   socklen_t socklen;
   int fd_flags = 0;
   int sock_error = 0;
@@ -896,13 +1232,27 @@ esl_connect_timeout(esl_handle_t *handle, const char *host, esl_port_t port,
   }
 
   if (!handle->packet_buf) {
-    if (esl_buffer_create(&handle->packet_buf, BUF_CHUNK, BUF_START,
-                          ESL_MAX_PACKET_BUFFER_LENGTH) != ESL_SUCCESS) {
+    if (handle_create_packet_buf(handle) != ESL_SUCCESS) {
       snprintf(handle->err, sizeof(handle->err), "Buffer Allocation Error");
       goto fail;
     }
   }
 
+  if (handle_create_duplex(handle) != ESL_SUCCESS) {
+    snprintf(handle->err, sizeof(handle->err), "Mutex Allocation Error");
+    goto fail;
+  }
+
+  if ((is_unix = esl_unix_sockaddr(host, &sockaddr_un, &socklen)) ==
+      ESL_FAIL) {
+    esl_snprintf(handle->err, sizeof(handle->err), "Invalid socket path");
+    goto fail;
+  }
+  if (is_unix == ESL_SUCCESS) {
+    memcpy(&handle->sockaddr, &sockaddr_un, sizeof(sockaddr_un));
+    goto resolved;
+  }
+
   hints.ai_socktype = SOCK_STREAM;
 
   if (getaddrinfo(host, nullptr, &hints, &result)) {
@@ -937,7 +1287,9 @@ esl_connect_timeout(esl_handle_t *handle, const char *host, esl_port_t port,
     goto fail;
   }
 
-  handle->sock = socket(handle->sockaddr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+resolved:
+  handle->sock = socket(handle->sockaddr.ss_family, SOCK_STREAM,
+                        is_unix == ESL_SUCCESS ? 0 : IPPROTO_TCP);
 
   if (handle->sock == ESL_SOCK_INVALID) {
     snprintf(handle->err, sizeof(handle->err), "Socket Error");
@@ -1023,7 +1375,7 @@ esl_connect_timeout(esl_handle_t *handle, const char *host, esl_port_t port,
 
   hval = esl_event_get_header(handle->last_event, "content-type");
 
-  if (esl_safe_strcasecmp(hval, "auth/request")) {
+  if (esl_content_type(hval) != ESL_CT_AUTH_REQUEST) {
     snprintf(handle->err, sizeof(handle->err), "Connection Error");
     goto fail;
   }
@@ -1068,14 +1420,17 @@ fail:
 
 ESL_DECLARE(esl_status_t) esl_disconnect(esl_handle_t *handle) {
   esl_mutex_t *mutex = nullptr;
+  esl_mutex_t *send_mutex = nullptr;
+  esl_wakeup_t *wakeup = nullptr;
   esl_status_t status = ESL_FAIL;
-  esl_event_t *ep;
 
   if (handle == nullptr) {
     return ESL_FAIL;
   }
 
   mutex = handle->mutex;
+  send_mutex = handle->send_mutex;
+  wakeup = handle->wakeup;
 
   if (handle->destroyed) {
     return ESL_FAIL;
@@ -1087,24 +1442,30 @@ ESL_DECLARE(esl_status_t) esl_disconnect(esl_handle_t *handle) {
     status = ESL_SUCCESS;
   }
 
+  /* readers and writers blocked on the handle hold its locks; wake them
+   * so the locks can be had */
+  esl_wakeup_signal(wakeup);
+
+  if (send_mutex) {
+    esl_mutex_lock(send_mutex);
+  }
   if (mutex) {
     esl_mutex_lock(mutex);
   }
 
   handle->connected = 0;
 
-  ep = handle->race_event;
+  /* nobody can be inside the ring now that both locks are held */
+  esl_uring_destroy(&handle->uring);
 
-  while (ep) {
-    esl_event_t *e = ep;
-    ep = ep->next;
-    esl_event_destroy(&e);
-  }
+  esl_queue_destroy(&handle->event_queue);
 
   esl_event_safe_destroy(&handle->last_event);
   esl_event_safe_destroy(&handle->last_sr_event);
   esl_event_safe_destroy(&handle->last_ievent);
   esl_event_safe_destroy(&handle->info_event);
+  esl_parser_destroy(&handle->parser);
+  esl_pipeline_close(&handle->pipeline);
 
   if (handle->packet_buf) {
     esl_buffer_destroy(&handle->packet_buf);
@@ -1119,6 +1480,13 @@ ESL_DECLARE(esl_status_t) esl_disconnect(esl_handle_t *handle) {
     esl_mutex_unlock(mutex);
     esl_mutex_destroy(&mutex);
   }
+  if (send_mutex) {
+    esl_mutex_unlock(send_mutex);
+    esl_mutex_lock(send_mutex);
+    esl_mutex_unlock(send_mutex);
+    esl_mutex_destroy(&send_mutex);
+  }
+  esl_wakeup_destroy(&wakeup);
 
   return status;
 }
@@ -1126,279 +1494,336 @@ ESL_DECLARE(esl_status_t) esl_disconnect(esl_handle_t *handle) {
 ESL_DECLARE(esl_status_t)
 esl_recv_event_timed(esl_handle_t *handle, uint32_t ms, int check_q,
                      esl_event_t **save_event) {
-  int activity;
-  esl_status_t status = ESL_SUCCESS;
-
   if (!ms) {
     return esl_recv_event(handle, check_q, save_event);
   }
 
+  return esl_recv_event_until(handle, esl_monotonic_ms() + ms, check_q,
+                              save_event);
+}
+
+/* Every turn takes what can be parsed without blocking and only then waits
+ * for the socket, for no longer than is left, so a trickling event cannot
+ * hold the caller past the deadline. */
+ESL_DECLARE(esl_status_t)
+esl_recv_event_until(esl_handle_t *handle, uint64_t deadline_ms, int check_q,
+                     esl_event_t **save_event) {
+  uint64_t since;
+
+  if (!deadline_ms) {
+    return esl_recv_event(handle, check_q, save_event);
+  }
+
   if (!handle || !handle->connected || handle->sock == ESL_SOCK_INVALID ||
       handle->mutex == nullptr || handle->packet_buf == nullptr) {
     return ESL_FAIL;
   }
 
-  if (check_q) {
-    esl_mutex_lock(handle->mutex);
-    if (handle->race_event || esl_buffer_packet_count(handle->packet_buf)) {
-      esl_mutex_unlock(handle->mutex);
-      return esl_recv_event(handle, check_q, save_event);
+  since = esl_wakeup_generation(handle->wakeup);
+
+  for (;;) {
+    esl_status_t status;
+    esl_socket_t fd;
+    uint64_t now;
+    int activity;
+
+    if (esl_mutex_trylock(handle->mutex) != ESL_SUCCESS) {
+      return ESL_BREAK;
     }
+    status = esl_recv_event_nowait(handle, check_q, save_event);
+    /* with io_uring the socket is drained by the kernel, so completions
+     * show up on the ring descriptor instead */
+    fd = handle->uring ? esl_uring_fd(handle->uring) : handle->sock;
     esl_mutex_unlock(handle->mutex);
-  }
-
-  if (handle->packet_buf && esl_buffer_inuse(handle->packet_buf)) {
-    activity = ESL_POLL_READ;
-  } else {
-    activity = esl_wait_sock(handle->sock, ms, ESL_POLL_READ | ESL_POLL_ERROR);
-  }
 
-  if (activity < 0) {
-    handle->connected = 0;
-    return ESL_FAIL;
-  }
+    if (status != ESL_BREAK) {
+      return status;
+    }
 
-  if (activity == 0 || !(activity & ESL_POLL_READ) ||
-      (esl_mutex_trylock(handle->mutex) != ESL_SUCCESS)) {
-    return ESL_BREAK;
-  }
+    if ((now = esl_monotonic_ms()) >= deadline_ms) {
+      return ESL_BREAK;
+    }
 
-  if ((activity & ESL_POLL_READ)) {
-    if (esl_recv_event(handle, check_q, save_event)) {
-      status = ESL_FAIL;
+    activity = handle_wait_read(handle, fd,
+                                deadline_ms - now > UINT32_MAX
+                                    ? UINT32_MAX
+                                    : (uint32_t)(deadline_ms - now),
+                                since);
+    if (activity == ESL_POLL_INTERRUPTED) {
+      return ESL_INTERRUPTED;
+    }
+    if (activity < 0) {
+      handle->connected = 0;
+      return ESL_FAIL;
     }
-  } else {
-    status = ESL_BREAK;
   }
-
-  esl_mutex_unlock(handle->mutex);
-
-  return status;
 }
 
-static esl_ssize_t handle_recv(esl_handle_t *handle, void *data,
-                               esl_size_t datalen) {
-  esl_ssize_t activity = -1;
-
-  if (handle->connected) {
-    if ((activity = esl_wait_sock(handle->sock, 1000,
-                                  ESL_POLL_READ | ESL_POLL_ERROR)) > 0) {
-      if ((activity & ESL_POLL_ERROR)) {
-        esl_set_last_error(handle, errno);
-        activity = -1;
-      } else if ((activity & ESL_POLL_READ)) {
-        auto received = recv(handle->sock, data, datalen, 0);
-        if (received == 0) {
-          activity = -1;
-        } else if (received < 0) {
-          if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
-            activity = 0;
-          } else {
-            esl_set_last_error(handle, errno);
-            activity = -1;
-          }
-        } else {
-          activity = received;
-        }
-      }
+static esl_ssize_t handle_recv_result(esl_handle_t *handle,
+                                      esl_ssize_t received) {
+  if (received == 0) {
+    return -1;
+  }
+  if (received < 0) {
+    if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
     }
+    esl_set_last_error(handle, errno);
+    return -1;
   }
 
-  return activity;
+  return received;
 }
 
-ESL_DECLARE(esl_status_t)
-esl_recv_event(esl_handle_t *handle, int check_q, esl_event_t **save_event) {
-  char *c;
-  esl_ssize_t rrval;
-  esl_event_t *revent = nullptr;
-  char *beg;
-  char *hname, *hval;
-  char *col;
-  char *cl;
-  esl_ssize_t len;
+static esl_ssize_t handle_recv(esl_handle_t *handle, struct iovec *iov,
+                               int iovcnt, bool wait, uint64_t since) {
+  struct msghdr msg = {.msg_iov = iov, .msg_iovlen = (size_t)iovcnt};
+  esl_ssize_t activity;
 
-  if (!handle || !handle->connected || handle->sock == ESL_SOCK_INVALID ||
-      handle->mutex == nullptr || handle->packet_buf == nullptr) {
-    return ESL_FAIL;
+  if (!handle->connected) {
+    return -1;
   }
 
-  esl_mutex_lock(handle->mutex);
+  /* optimistic reads skip the poll() whenever data is already waiting */
+  if (!wait || handle->wait.mode != ESL_WAIT_POLL) {
+    const auto received = recvmsg(handle->sock, &msg, MSG_DONTWAIT);
 
-  esl_event_safe_destroy(&handle->last_ievent);
+    if (!wait || received >= 0 ||
+        (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      return handle_recv_result(handle, received);
+    }
+  }
 
-  if (check_q && handle->race_event) {
-    revent = handle->race_event;
-    handle->race_event = handle->race_event->next;
-    revent->next = nullptr;
+  if ((activity = handle_wait_read(handle, handle->sock,
+                                   handle_poll_ms(handle), since)) <= 0) {
+    return activity;
+  }
 
-    goto parse_event;
+  if ((activity & ESL_POLL_ERROR)) {
+    esl_set_last_error(handle, errno);
+    return -1;
   }
 
-  while (!revent && handle->connected) {
-    esl_size_t len1;
-    const esl_size_t available_packets =
-        esl_buffer_packet_count(handle->packet_buf);
-
-    len1 = esl_buffer_read_packet(handle->packet_buf, handle->socket_buf,
-                                  sizeof(handle->socket_buf) - 1);
-    if (len1 == 0 && available_packets > 0) {
-      esl_set_last_error(handle, EMSGSIZE);
-      esl_snprintf(handle->err, sizeof(handle->err), "Event header too large");
-      goto fail;
-    }
+  return handle_recv_result(handle, recvmsg(handle->sock, &msg, 0));
+}
 
-    if (len1 > 0) {
-      char *data = (char *)handle->socket_buf;
-      char *p, *e;
+static esl_status_t handle_ensure_parser(esl_handle_t *handle) {
+  if (!handle->parser &&
+      esl_parser_create(&handle->parser, handle->packet_buf) != ESL_SUCCESS) {
+    return ESL_FAIL;
+  }
 
-      *(data + len1) = '\0';
+  return ESL_SUCCESS;
+}
 
-      if (esl_event_create(&revent, ESL_EVENT_CLONE) != ESL_SUCCESS ||
-          revent == nullptr) {
-        goto fail;
-      }
-      revent->event_id = ESL_EVENT_SOCKET_DATA;
-      if (esl_event_add_header_string(revent, ESL_STACK_BOTTOM, "Event-Name",
-                                      "SOCKET_DATA") != ESL_SUCCESS) {
-        goto fail;
-      }
+/* Pull one chunk from the socket. Bytes land directly in free space at the
+ * end of the packet buffer, or, while the parser is waiting on the rest of
+ * a body, directly in the body allocation. Returns ESL_BREAK when nothing
+ * could be read without blocking. */
+static esl_status_t handle_fill(esl_handle_t *handle, bool wait,
+                                uint64_t since) {
+  struct iovec iov[2];
+  esl_size_t body_len = 0;
+  esl_size_t room;
+  void *body = nullptr;
+  void *space = nullptr;
+  esl_ssize_t rrval;
+  int iovcnt = 0;
 
-      p = data;
-
-      while (p) {
-        hname = p;
-        p = nullptr;
-
-        if ((hval = strchr(hname, ':'))) {
-          *hval++ = '\0';
-          while (*hval == ' ' || *hval == '\t')
-            hval++;
-
-          if ((e = strchr(hval, '\n'))) {
-            *e++ = '\0';
-            while (*e == '\n' || *e == '\r')
-              e++;
-
-            esl_url_decode(hval);
-            esl_log(ESL_LOG_DEBUG, "RECV HEADER [%s] = [%s]\n", hname, hval);
-            if (!strncmp(hval, "ARRAY::", 7)) {
-              if (esl_event_add_array(revent, hname, hval) != 0) {
-                goto fail;
-              }
-            } else {
-              if (esl_event_add_header_string(revent, ESL_STACK_BOTTOM, hname,
-                                              hval) != ESL_SUCCESS) {
-                goto fail;
-              }
-            }
-
-            p = e;
-          }
-        }
-      }
+  if (handle_ensure_parser(handle) != ESL_SUCCESS) {
+    return ESL_FAIL;
+  }
 
-      break;
+  if (handle->uring) {
+    /* the ring appends straight into packet_buf */
+    rrval = -1;
+    if (handle->connected &&
+        (rrval = esl_uring_recv(handle->uring, handle->packet_buf,
+                                wait ? handle_poll_ms(handle) : 0,
+                                handle->wakeup, since)) < 0 &&
+        errno == EINTR) {
+      return ESL_INTERRUPTED;
     }
-
-    rrval =
-        handle_recv(handle, handle->socket_buf, sizeof(handle->socket_buf) - 1);
-
-    if (rrval == 0) {
-      continue;
-    } else if (rrval < 0) {
-      if (handle->errnum == 0) {
-        esl_set_last_error(handle, errno);
-      }
-      goto fail;
+  } else {
+    if ((body_len = esl_parser_body_window(handle->parser, &body))) {
+      iov[iovcnt++] = (struct iovec){.iov_base = body, .iov_len = body_len};
+    }
+    if ((room = esl_buffer_reserve(handle->packet_buf,
+                                   handle->footprint == ESL_FOOTPRINT_COMPACT
+                                       ? ESL_COMPACT_BUF_START
+                                       : ESL_RECV_CHUNK,
+                                   &space))) {
+      iov[iovcnt++] = (struct iovec){.iov_base = space, .iov_len = room};
     }
 
-    *((char *)handle->socket_buf +
-      (size_t)esl_clamp_ssize((esl_ssize_t)0,
-                              (esl_ssize_t)(sizeof(handle->socket_buf) - 1),
-                              rrval)) = '\0';
+    if (iovcnt == 0) {
+      errno = EMSGSIZE;
+      rrval = -1;
+    } else {
+      rrval = handle_recv(handle, iov, iovcnt, wait, since);
+    }
+  }
 
-    if (esl_buffer_write(handle->packet_buf, handle->socket_buf,
-                         (esl_size_t)rrval) == 0) {
-      esl_set_last_error(handle, EMSGSIZE);
+  if (rrval == 0) {
+    return ESL_BREAK;
+  } else if (rrval == ESL_POLL_INTERRUPTED) {
+    return ESL_INTERRUPTED;
+  } else if (rrval < 0) {
+    if (handle->errnum == 0) {
+      esl_set_last_error(handle, errno);
+    }
+    if (errno == EMSGSIZE) {
       esl_snprintf(handle->err, sizeof(handle->err),
                    "Inbound packet buffer limit reached");
-      goto fail;
     }
+    return ESL_FAIL;
   }
 
-  if (!revent) {
-    goto fail;
+  if (body_len) {
+    const esl_size_t taken =
+        (esl_size_t)rrval < body_len ? (esl_size_t)rrval : body_len;
+
+    (void)esl_parser_body_commit(handle->parser, taken);
+    rrval -= (esl_ssize_t)taken;
   }
 
-  if ((cl = esl_event_get_header(revent, "content-length"))) {
-    esl_ssize_t sofar = 0;
-    char *endptr = nullptr;
-    unsigned long long parsed_len = 0;
+  if (rrval > 0 && !handle->uring) {
+    (void)esl_buffer_commit(handle->packet_buf, (esl_size_t)rrval);
+  }
 
-    errno = 0;
-    parsed_len = strtoull(cl, &endptr, 10);
-    if (errno != 0 || endptr == cl || (endptr != nullptr && *endptr != '\0') ||
-        parsed_len > (unsigned long long)ESL_MAX_CONTENT_LENGTH) {
-      esl_event_destroy(&revent);
-      goto fail;
-    }
-    len = (esl_ssize_t)parsed_len;
+  return ESL_SUCCESS;
+}
 
-    if ((size_t)len > (SIZE_MAX - 1)) {
-      esl_event_destroy(&revent);
-      goto fail;
-    }
+/* Frame the next packet out of the packet buffer without touching the
+ * socket. */
+static esl_status_t handle_frame_event(esl_handle_t *handle,
+                                       esl_event_t **event) {
+  esl_status_t status;
 
-    auto body = (char *)calloc((size_t)len + 1, sizeof(char));
-    if (body == nullptr) {
-      esl_event_destroy(&revent);
-      goto fail;
+  if (handle_ensure_parser(handle) != ESL_SUCCESS) {
+    *event = nullptr;
+    return ESL_FAIL;
+  }
+
+  if ((status = esl_parser_next(handle->parser, event)) == ESL_FAIL) {
+    esl_set_last_error(handle, errno);
+    if (errno == EMSGSIZE) {
+      esl_snprintf(handle->err, sizeof(handle->err), "Event header too large");
     }
+  } else if (status == ESL_SUCCESS) {
+    handle_trim(handle);
+  }
 
-    do {
-      esl_ssize_t r, s = esl_buffer_inuse(handle->packet_buf);
+  return status;
+}
 
-      if (s >= len) {
-        sofar = esl_buffer_read(handle->packet_buf, body, len);
-      } else {
-        r = handle_recv(handle, handle->socket_buf,
-                        sizeof(handle->socket_buf) - 1);
+/* Parse a text/event-plain body into handle->last_ievent. The inner event
+ * keeps its own copy of the text and its headers borrow from it. */
+static void handle_parse_event_plain(esl_handle_t *handle, const char *text) {
+  esl_scan_line_t lines[ESL_EVENT_PLAIN_LINE_BATCH];
+  esl_event_t *ievent = nullptr;
+  esl_size_t inner_header_count = 0;
+  esl_size_t block_len = 0;
+  esl_size_t off = 0;
+  esl_size_t body_off;
+  const esl_size_t len = strlen(text);
+  char *block;
+
+  if ((block = strdup(text)) == nullptr) {
+    return;
+  }
+  if (esl_event_create_arena(&ievent, ESL_EVENT_CLONE, nullptr) !=
+      ESL_SUCCESS) {
+    free(block);
+    return;
+  }
+  ievent->header_block = block;
 
-        if (r < 0) {
-          if (handle->errnum == 0) {
-            esl_set_last_error(handle, errno);
-          }
-          free(body);
+  for (;;) {
+    const esl_size_t n =
+        esl_scan_header_lines(block + off, len - off, lines,
+                              ESL_EVENT_PLAIN_LINE_BATCH, &block_len);
+
+    for (esl_size_t i = 0; i < n; i++) {
+      const esl_size_t colon = off + lines[i].colon;
+      const esl_size_t end = off + lines[i].end;
+      char *hname = block + off + lines[i].start;
+      char *hval;
+      esl_size_t vlen;
+
+      if (lines[i].end - lines[i].start > ESL_MAX_EVENT_PLAIN_LINE_LENGTH ||
+          ++inner_header_count > ESL_MAX_EVENT_PLAIN_HEADERS) {
+        goto fail;
+      }
+
+      if (colon == end) {
+        continue;
+      }
+
+      block[colon] = '\0';
+      block[end] = '\0';
+      hval = block + colon + 1;
+      while (*hval == ' ')
+        hval++;
+
+      vlen = (esl_size_t)(block + end - hval);
+      if (memchr(hval, '%', vlen)) {
+        vlen = strlen(esl_url_decode(hval));
+      }
+      esl_log(ESL_LOG_DEBUG, "RECV INNER HEADER [%s] = [%s]\n", hname, hval);
+
+      if (!strcasecmp(hname, "event-name")) {
+        esl_event_del_header(ievent, "event-name");
+        if (esl_name_event(hval, &ievent->event_id) != ESL_SUCCESS) {
           goto fail;
-        } else if (r == 0) {
-          continue;
         }
+      }
 
-        *((char *)handle->socket_buf +
-          (size_t)esl_clamp_ssize((esl_ssize_t)0,
-                                  (esl_ssize_t)(sizeof(handle->socket_buf) - 1),
-                                  r)) = '\0';
-        if (esl_buffer_write(handle->packet_buf, handle->socket_buf,
-                             (esl_size_t)r) == 0) {
-          esl_set_last_error(handle, EMSGSIZE);
-          esl_snprintf(handle->err, sizeof(handle->err),
-                       "Inbound packet buffer limit reached");
-          free(body);
+      if (!strncmp(hval, "ARRAY::", 7)) {
+        if (esl_event_add_array(ievent, hname, hval) != 0) {
           goto fail;
         }
+      } else if (esl_event_add_header_borrowed(
+                     ievent, hname, (esl_size_t)(block + colon - hname), hval,
+                     vlen) != ESL_SUCCESS) {
+        goto fail;
       }
+    }
 
-    } while (sofar < len);
+    if (block_len) {
+      body_off = off + block_len;
+      break;
+    }
+    if (n < ESL_EVENT_PLAIN_LINE_BATCH) {
+      body_off = n ? off + lines[n - 1].end + 1 : off;
+      break;
+    }
+    off += lines[n - 1].end + 1;
+  }
 
-    revent->body = body;
+  if (esl_event_get_header(ievent, "content-length") &&
+      esl_event_set_body(ievent, block + body_off) != ESL_SUCCESS) {
+    goto fail;
   }
 
-parse_event:
+  handle->last_ievent = ievent;
+  return;
+
+fail:
+  esl_event_destroy(&ievent);
+}
+
+static esl_status_t handle_event_received(esl_handle_t *handle,
+                                          esl_event_t **eventp,
+                                          esl_event_t **save_event) {
+  esl_event_t *revent = *eventp;
+  esl_content_type_t ct;
+  char *hval;
 
   if (save_event) {
     *save_event = revent;
     revent = nullptr;
+    *eventp = nullptr;
   } else {
     esl_event_safe_destroy(&handle->last_event);
     handle->last_event = revent;
@@ -1411,96 +1836,18 @@ parse_event:
       snprintf(handle->last_reply, sizeof(handle->last_reply), "%s", hval);
     }
 
-    hval = esl_event_get_header(revent, "content-type");
+    ct = esl_content_type(esl_event_get_header(revent, "content-type"));
 
-    if (!esl_safe_strcasecmp(hval, "text/disconnect-notice") && revent->body) {
+    if (ct == ESL_CT_TEXT_DISCONNECT_NOTICE && revent->body) {
       const char *dval = esl_event_get_header(revent, "content-disposition");
       if (esl_strlen_zero(dval) || strcasecmp(dval, "linger")) {
-        goto fail;
+        return ESL_FAIL;
       }
     }
 
     if (revent->body) {
-      if (!esl_safe_strcasecmp(hval, "text/event-plain")) {
-        esl_event_types_t et = ESL_EVENT_CLONE;
-        esl_size_t inner_header_count = 0;
-        char *body = strdup(revent->body);
-
-        if (body != nullptr &&
-            esl_event_create(&handle->last_ievent, et) == ESL_SUCCESS) {
-          beg = body;
-
-          while (beg) {
-            if (!(c = strchr(beg, '\n'))) {
-              break;
-            }
-            if ((size_t)(c - beg) > ESL_MAX_EVENT_PLAIN_LINE_LENGTH) {
-              esl_event_safe_destroy(&handle->last_ievent);
-              break;
-            }
-            if (++inner_header_count > ESL_MAX_EVENT_PLAIN_HEADERS) {
-              esl_event_safe_destroy(&handle->last_ievent);
-              break;
-            }
-
-            hname = beg;
-            hval = col = nullptr;
-
-            if ((col = strchr(hname, ':'))) {
-              hval = col + 1;
-              *col = '\0';
-              while (*hval == ' ')
-                hval++;
-            }
-
-            *c = '\0';
-
-            if (hval) {
-              esl_url_decode(hval);
-              esl_log(ESL_LOG_DEBUG, "RECV INNER HEADER [%s] = [%s]\n", hname,
-                      hval);
-              if (!strcasecmp(hname, "event-name")) {
-                esl_event_del_header(handle->last_ievent, "event-name");
-                if (esl_name_event(hval, &handle->last_ievent->event_id) !=
-                    ESL_SUCCESS) {
-                  esl_event_safe_destroy(&handle->last_ievent);
-                  break;
-                }
-              }
-
-              if (!strncmp(hval, "ARRAY::", 7)) {
-                if (esl_event_add_array(handle->last_ievent, hname, hval) !=
-                    0) {
-                  esl_event_safe_destroy(&handle->last_ievent);
-                  break;
-                }
-              } else {
-                if (esl_event_add_header_string(handle->last_ievent,
-                                                ESL_STACK_BOTTOM, hname,
-                                                hval) != ESL_SUCCESS) {
-                  esl_event_safe_destroy(&handle->last_ievent);
-                  break;
-                }
-              }
-            }
-
-            beg = c + 1;
-
-            if (*beg == '\n') {
-              beg++;
-              break;
-            }
-          }
-
-          if (beg &&
-              esl_event_get_header(handle->last_ievent, "content-length")) {
-            if (esl_event_set_body(handle->last_ievent, beg) != ESL_SUCCESS) {
-              esl_event_safe_destroy(&handle->last_ievent);
-            }
-          }
-        }
-
-        free(body);
+      if (ct == ESL_CT_TEXT_EVENT_PLAIN) {
+        handle_parse_event_plain(handle, revent->body);
 
         if (handle->last_ievent != nullptr && esl_log_level >= 7) {
           char *foo = nullptr;
@@ -1511,7 +1858,7 @@ parse_event:
             free(foo);
           }
         }
-      } else if (!esl_safe_strcasecmp(hval, "text/event-json")) {
+      } else if (ct == ESL_CT_TEXT_EVENT_JSON) {
         if (esl_event_create_json(&handle->last_ievent, revent->body) !=
             ESL_SUCCESS) {
           esl_event_safe_destroy(&handle->last_ievent);
@@ -1529,6 +1876,139 @@ parse_event:
     }
   }
 
+  return ESL_SUCCESS;
+}
+
+/* Hand a command reply to the oldest esl_send_async caller still waiting,
+ * if there is one. */
+static bool handle_route_reply(esl_handle_t *handle, esl_event_t **revent) {
+  esl_content_type_t ct;
+
+  if (!handle->pipeline || *revent == nullptr) {
+    return false;
+  }
+
+  ct = esl_content_type(esl_event_get_header(*revent, "content-type"));
+  if (ct != ESL_CT_API_RESPONSE && ct != ESL_CT_COMMAND_REPLY) {
+    return false;
+  }
+
+  if (esl_pipeline_deliver(handle->pipeline, *revent) != ESL_SUCCESS) {
+    return false;
+  }
+
+  *revent = nullptr;
+  return true;
+}
+
+/* Hand a BACKGROUND_JOB event to the esl_bgapi_submit job waiting for its
+ * Job-UUID, if there is one. */
+static bool handle_route_job(esl_handle_t *handle, esl_event_t **revent) {
+  esl_content_type_t ct;
+  const char *uuid;
+
+  if (*revent == nullptr || !esl_pipeline_has_jobs(handle->pipeline) ||
+      !(*revent)->body || !strstr((*revent)->body, "BACKGROUND_JOB")) {
+    return false;
+  }
+
+  esl_event_safe_destroy(&handle->last_ievent);
+
+  ct = esl_content_type(esl_event_get_header(*revent, "content-type"));
+  if (ct == ESL_CT_TEXT_EVENT_PLAIN) {
+    handle_parse_event_plain(handle, (*revent)->body);
+  } else if (ct == ESL_CT_TEXT_EVENT_JSON) {
+    if (esl_event_create_json(&handle->last_ievent, (*revent)->body) !=
+        ESL_SUCCESS) {
+      esl_event_safe_destroy(&handle->last_ievent);
+    }
+  }
+
+  if (handle->last_ievent == nullptr) {
+    return false;
+  }
+
+  if (handle->last_ievent->event_id != ESL_EVENT_BACKGROUND_JOB ||
+      (uuid = esl_event_get_header(handle->last_ievent, "job-uuid")) ==
+          nullptr ||
+      esl_pipeline_resolve_job(handle->pipeline, uuid, handle->last_ievent) !=
+          ESL_SUCCESS) {
+    esl_event_safe_destroy(&handle->last_ievent);
+    return false;
+  }
+
+  handle->last_ievent = nullptr;
+  esl_event_destroy(revent);
+  return true;
+}
+
+static esl_status_t handle_recv_event(esl_handle_t *handle, int check_q,
+                                      esl_event_t **save_event, bool wait) {
+  esl_event_t *revent = nullptr;
+  esl_status_t status = ESL_FAIL;
+  uint64_t since;
+
+  if (!handle || !handle->connected || handle->sock == ESL_SOCK_INVALID ||
+      handle->mutex == nullptr || handle->packet_buf == nullptr) {
+    return ESL_FAIL;
+  }
+
+  /* noted before the lock, so waking also reaches a caller still queued
+   * behind another reader */
+  since = esl_wakeup_generation(handle->wakeup);
+  esl_mutex_lock(handle->mutex);
+
+  esl_event_safe_destroy(&handle->last_ievent);
+
+  if (check_q && (revent = esl_queue_pop(handle->event_queue))) {
+    goto parse_event;
+  }
+
+  while (!revent && handle->connected) {
+    if ((status = handle_frame_event(handle, &revent)) == ESL_SUCCESS) {
+      if (handle_route_reply(handle, &revent) ||
+          handle_route_job(handle, &revent)) {
+        continue;
+      }
+      break;
+    }
+    if (status == ESL_FAIL) {
+      goto fail;
+    }
+
+    if ((status = handle_fill(handle, wait, since)) == ESL_FAIL) {
+      goto fail;
+    }
+
+    if (status == ESL_INTERRUPTED) {
+      esl_mutex_unlock(handle->mutex);
+      return ESL_INTERRUPTED;
+    }
+
+    if (status == ESL_BREAK && !wait) {
+      esl_mutex_unlock(handle->mutex);
+      return ESL_BREAK;
+    }
+
+    if (!wait && (status = handle_frame_event(handle, &revent)) != ESL_SUCCESS) {
+      esl_mutex_unlock(handle->mutex);
+      return status == ESL_BREAK ? ESL_BREAK : ESL_FAIL;
+    }
+    if (!handle_route_reply(handle, &revent)) {
+      (void)handle_route_job(handle, &revent);
+    }
+  }
+
+  if (!revent) {
+    goto fail;
+  }
+
+parse_event:
+
+  if (handle_event_received(handle, &revent, save_event) != ESL_SUCCESS) {
+    goto fail;
+  }
+
   esl_mutex_unlock(handle->mutex);
 
   return ESL_SUCCESS;
@@ -1540,30 +2020,206 @@ fail:
   }
   esl_event_destroy(&revent);
 
-  esl_mutex_unlock(handle->mutex);
-
   handle->connected = 0;
+  esl_pipeline_fail(handle->pipeline);
+
+  esl_mutex_unlock(handle->mutex);
 
   return ESL_FAIL;
 }
 
-ESL_DECLARE(esl_status_t) esl_send(esl_handle_t *handle, const char *cmd) {
-  size_t cmdlen = 0;
-  size_t sent_total = 0;
-  const char *out = nullptr;
-  const char *terminator = "\n\n";
+ESL_DECLARE(esl_status_t)
+esl_recv_event(esl_handle_t *handle, int check_q, esl_event_t **save_event) {
+  return handle_recv_event(handle, check_q, save_event, true);
+}
+
+ESL_DECLARE(esl_status_t)
+esl_recv_event_nowait(esl_handle_t *handle, int check_q,
+                      esl_event_t **save_event) {
+  return handle_recv_event(handle, check_q, save_event, false);
+}
+
+/* Frame every complete packet in the receive buffer into out, routing
+ * replies and jobs as handle_recv_event does. */
+static esl_status_t handle_frame_events(esl_handle_t *handle, esl_event_t **out,
+                                        size_t max, size_t *count) {
+  while (*count < max) {
+    esl_event_t *revent = nullptr;
+    const esl_status_t status = handle_frame_event(handle, &revent);
+
+    if (status != ESL_SUCCESS) {
+      return status == ESL_BREAK ? ESL_SUCCESS : ESL_FAIL;
+    }
+    if (handle_route_reply(handle, &revent) ||
+        handle_route_job(handle, &revent)) {
+      continue;
+    }
+    out[(*count)++] = revent;
+  }
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_recv_events(esl_handle_t *handle, esl_event_t **out, size_t max,
+                uint32_t timeout_ms, size_t *n) {
+  esl_status_t status;
+  size_t count = 0;
+  uint64_t since;
+
+  if (n) {
+    *n = 0;
+  }
 
   if (!handle || !handle->connected || handle->sock == ESL_SOCK_INVALID ||
-      cmd == nullptr) {
+      handle->mutex == nullptr || handle->packet_buf == nullptr ||
+      out == nullptr || max == 0 || n == nullptr) {
     return ESL_FAIL;
   }
 
-  cmdlen = strlen(cmd);
-  if (cmdlen == 0) {
+  since = esl_wakeup_generation(handle->wakeup);
+  esl_mutex_lock(handle->mutex);
+
+  while (count < max && (out[count] = esl_queue_pop(handle->event_queue))) {
+    count++;
+  }
+
+  if (handle_frame_events(handle, out, max, &count) != ESL_SUCCESS) {
+    goto fail;
+  }
+
+  if (count < max) {
+    if (!count && timeout_ms) {
+      const esl_socket_t fd =
+          handle->uring ? esl_uring_fd(handle->uring) : handle->sock;
+      int activity;
+
+      esl_mutex_unlock(handle->mutex);
+      activity = handle_wait_read(handle, fd, timeout_ms, since);
+      esl_mutex_lock(handle->mutex);
+
+      if (activity == ESL_POLL_INTERRUPTED) {
+        esl_mutex_unlock(handle->mutex);
+        return ESL_INTERRUPTED;
+      }
+      if (activity < 0 || !handle->connected) {
+        goto fail;
+      }
+      if (activity == 0) {
+        esl_mutex_unlock(handle->mutex);
+        return ESL_BREAK;
+      }
+    }
+
+    if ((status = handle_fill(handle, false, since)) == ESL_FAIL ||
+        (status == ESL_SUCCESS &&
+         handle_frame_events(handle, out, max, &count) != ESL_SUCCESS)) {
+      goto fail;
+    }
+  }
+
+  esl_mutex_unlock(handle->mutex);
+
+  *n = count;
+  return count ? ESL_SUCCESS : ESL_BREAK;
+
+fail:
+
+  /* hand over what was read before the connection failed; the next call
+   * reports the failure */
+  handle->connected = 0;
+  esl_pipeline_fail(handle->pipeline);
+
+  esl_mutex_unlock(handle->mutex);
+
+  *n = count;
+  return count ? ESL_SUCCESS : ESL_FAIL;
+}
+
+/* Send the command and, when needed, its terminator as one linked chain on
+ * the handle's ring. */
+static esl_status_t handle_send_uring(esl_handle_t *handle, const char *cmd,
+                                      size_t cmdlen, bool terminate,
+                                      uint64_t since) {
+  struct iovec iov[2] = {
+      {.iov_base = (void *)cmd, .iov_len = cmdlen},
+      {.iov_base = (void *)"\n\n", .iov_len = terminate ? 2 : 0},
+  };
+  struct iovec *vp = iov;
+  int count = terminate ? 2 : 1;
+
+  while (count > 0) {
+    auto just_sent =
+        esl_uring_sendv(handle->uring, vp, count,
+                        handle_send_timeout_ms(handle), handle->wakeup, since);
+
+    if (just_sent < 0 && errno == EINTR) {
+      /* as on the socket path, a half-sent command spoils the stream */
+      if (vp != iov || vp->iov_base != (void *)cmd) {
+        handle->connected = 0;
+      }
+      return ESL_INTERRUPTED;
+    }
+    if (just_sent <= 0) {
+      handle->connected = 0;
+      esl_set_last_error(handle, just_sent == 0 ? EPIPE : errno);
+      return ESL_FAIL;
+    }
+
+    while (count > 0 && (size_t)just_sent >= vp->iov_len) {
+      just_sent -= (esl_ssize_t)vp->iov_len;
+      vp++;
+      count--;
+    }
+
+    if (count > 0) {
+      vp->iov_base = (char *)vp->iov_base + just_sent;
+      vp->iov_len -= (size_t)just_sent;
+    }
+  }
+
+  return ESL_SUCCESS;
+}
+
+/* Wait for room in the socket after a short write, up to the handle's send
+ * timeout. partial tells whether part of the command is already out. */
+static esl_status_t handle_send_wait(esl_handle_t *handle, uint64_t since,
+                                     bool partial) {
+  const int wait_status =
+      handle_poll(handle, handle->sock, ESL_POLL_WRITE | ESL_POLL_ERROR,
+                  handle_send_timeout_ms(handle), since);
+
+  if (wait_status == ESL_POLL_INTERRUPTED) {
+    /* the peer would read the rest of the stream as part of this command */
+    if (partial) {
+      handle->connected = 0;
+    }
+    return ESL_INTERRUPTED;
+  }
+
+  if (wait_status <= 0 || (wait_status & ESL_POLL_ERROR)) {
+    handle->connected = 0;
+    esl_set_last_error(handle, errno);
     return ESL_FAIL;
   }
 
-  esl_log(ESL_LOG_DEBUG, "SEND\n%s\n", cmd);
+  return ESL_SUCCESS;
+}
+
+/* Write a command and its terminator with the send lock held. */
+static esl_status_t handle_send(esl_handle_t *handle, const char *cmd,
+                                size_t cmdlen, uint64_t since) {
+  esl_status_t status;
+  size_t sent_total = 0;
+  const char *out = nullptr;
+  const char *terminator = "\n\n";
+
+  if (handle->uring) {
+    return handle_send_uring(
+        handle, cmd, cmdlen,
+        !(cmdlen >= 2 && cmd[cmdlen - 1] == '\n' && cmd[cmdlen - 2] == '\n'),
+        since);
+  }
 
   out = cmd;
   sent_total = 0;
@@ -1578,14 +2234,10 @@ ESL_DECLARE(esl_status_t) esl_send(esl_handle_t *handle, const char *cmd) {
 
     if (just_sent < 0 &&
         (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
-      if (errno != EINTR) {
-        const int wait_status =
-            esl_wait_sock(handle->sock, 1000, ESL_POLL_WRITE | ESL_POLL_ERROR);
-        if (wait_status <= 0 || (wait_status & ESL_POLL_ERROR)) {
-          handle->connected = 0;
-          esl_set_last_error(handle, errno);
-          return ESL_FAIL;
-        }
+      if (errno != EINTR &&
+          (status = handle_send_wait(handle, since, sent_total > 0)) !=
+              ESL_SUCCESS) {
+        return status;
       }
       continue;
     }
@@ -1614,14 +2266,9 @@ ESL_DECLARE(esl_status_t) esl_send(esl_handle_t *handle, const char *cmd) {
 
       if (just_sent < 0 &&
           (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
-        if (errno != EINTR) {
-          const int wait_status = esl_wait_sock(
-              handle->sock, 1000, ESL_POLL_WRITE | ESL_POLL_ERROR);
-          if (wait_status <= 0 || (wait_status & ESL_POLL_ERROR)) {
-            handle->connected = 0;
-            esl_set_last_error(handle, errno);
-            return ESL_FAIL;
-          }
+        if (errno != EINTR &&
+            (status = handle_send_wait(handle, since, true)) != ESL_SUCCESS) {
+          return status;
         }
         continue;
       }
@@ -1641,77 +2288,88 @@ ESL_DECLARE(esl_status_t) esl_send(esl_handle_t *handle, const char *cmd) {
   return ESL_SUCCESS;
 }
 
-ESL_DECLARE(esl_status_t)
-esl_send_recv_timed(esl_handle_t *handle, const char *cmd, uint32_t ms) {
-  const char *hval;
+ESL_DECLARE(esl_status_t) esl_send(esl_handle_t *handle, const char *cmd) {
   esl_status_t status;
+  size_t cmdlen = 0;
+  uint64_t since;
 
-  if (!handle || handle->mutex == nullptr) {
+  if (!handle || !handle->connected || handle->sock == ESL_SOCK_INVALID ||
+      cmd == nullptr) {
     return ESL_FAIL;
   }
 
-  esl_mutex_lock(handle->mutex);
-  if (!handle->connected || handle->sock == ESL_SOCK_INVALID) {
-    esl_mutex_unlock(handle->mutex);
+  cmdlen = strlen(cmd);
+  if (cmdlen == 0) {
     return ESL_FAIL;
   }
 
-  esl_event_safe_destroy(&handle->last_sr_event);
-
-  *handle->last_sr_reply = '\0';
+  esl_log(ESL_LOG_DEBUG, "SEND\n%s\n", cmd);
 
-  if ((status = esl_send(handle, cmd))) {
-    esl_mutex_unlock(handle->mutex);
-    return status;
+  /* writers only wait on each other, never on a thread reading events */
+  since = esl_wakeup_generation(handle->wakeup);
+  if (handle->send_mutex) {
+    esl_mutex_lock(handle->send_mutex);
+  }
+  status = handle_send(handle, cmd, cmdlen, since);
+  if (handle->send_mutex) {
+    esl_mutex_unlock(handle->send_mutex);
   }
 
-recv:
-
-  esl_event_safe_destroy(&handle->last_sr_event);
-
-  *handle->last_sr_reply = '\0';
-
-  status = esl_recv_event_timed(handle, ms, 0, &handle->last_sr_event);
-
-  if (handle->last_sr_event) {
-    char *ct = esl_event_get_header(handle->last_sr_event, "content-type");
-
-    if (ct && strcasecmp(ct, "api/response") &&
-        strcasecmp(ct, "command/reply")) {
-      esl_event_t *ep;
+  return status;
+}
 
-      for (ep = handle->race_event; ep && ep->next; ep = ep->next)
-        ;
+/* Commands answered while another thread is reading events: the reply
+ * future sits in the handle's FIFO behind any pipelined commands, and
+ * whichever thread reads the reply hands it over, so the receive lock is
+ * never needed. */
+ESL_DECLARE(esl_status_t)
+esl_send_recv_timed(esl_handle_t *handle, const char *cmd, uint32_t ms) {
+  return esl_send_recv_until(handle, cmd, ms ? esl_monotonic_ms() + ms : 0);
+}
 
-      if (ep) {
-        ep->next = handle->last_sr_event;
-      } else {
-        handle->race_event = handle->last_sr_event;
-      }
+ESL_DECLARE(esl_status_t)
+esl_send_recv_until(esl_handle_t *handle, const char *cmd,
+                    uint64_t deadline_ms) {
+  esl_reply_t *reply = nullptr;
+  esl_event_t *event = nullptr;
+  esl_mutex_t *lock = nullptr;
+  esl_status_t status;
+  const char *hval;
 
-      handle->last_sr_event = nullptr;
+  if (!handle || handle->mutex == nullptr || !handle->connected ||
+      handle->sock == ESL_SOCK_INVALID) {
+    return ESL_FAIL;
+  }
 
-      esl_mutex_unlock(handle->mutex);
-      esl_mutex_lock(handle->mutex);
+  if (esl_send_async(handle, cmd, &reply) != ESL_SUCCESS) {
+    return ESL_FAIL;
+  }
 
-      if (!handle->connected || handle->sock == ESL_SOCK_INVALID) {
-        handle->connected = 0;
-        esl_mutex_unlock(handle->mutex);
-        return ESL_FAIL;
-      }
+  status = esl_reply_wait_until(handle, reply, deadline_ms, &event);
+  esl_reply_destroy(&reply);
 
-      goto recv;
+  if ((lock = handle->send_mutex ? handle->send_mutex : handle->mutex) ==
+      nullptr) {
+    /* disconnected meanwhile */
+    if (event) {
+      esl_event_destroy(&event);
     }
+    return ESL_FAIL;
+  }
 
-    hval = esl_event_get_header(handle->last_sr_event, "reply-text");
-
+  /* last_sr_event belongs to the sending side */
+  esl_mutex_lock(lock);
+  esl_event_safe_destroy(&handle->last_sr_event);
+  *handle->last_sr_reply = '\0';
+  handle->last_sr_event = event;
+  if (event) {
+    hval = esl_event_get_header(event, "reply-text");
     if (!esl_strlen_zero(hval)) {
       snprintf(handle->last_sr_reply, sizeof(handle->last_sr_reply), "%s",
                hval);
     }
   }
-
-  esl_mutex_unlock(handle->mutex);
+  esl_mutex_unlock(lock);
 
   return status;
 }
@@ -31,12 +31,23 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+/* memfd_create() */
+#define _GNU_SOURCE
+
 #include "esl/esl_buffer.h"
 #include "esl/esl.h"
+#include "esl/esl_scan.h"
 #include <stdatomic.h>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 static _Atomic unsigned buffer_id = 0;
 
+constexpr esl_size_t ESL_BUFFER_MAX_BOUNDARIES = 32;
+
 struct esl_buffer {
   unsigned char *data;
   unsigned char *head;
@@ -47,8 +58,215 @@ struct esl_buffer {
   esl_size_t blocksize;
   unsigned id;
   int loops;
+  /* data is datalen bytes of a memfd mapped twice back to back, so the
+   * used bytes at head are always contiguous and writes wrap instead of
+   * compacting. head stays in the first copy. */
+  bool mirrored;
+  /* Grow by at least the current size instead of only by blocksize. */
+  bool geometric;
+  /* Packet boundary scanning. Positions count bytes since the last reset,
+   * so they survive compaction and reallocation: consumed is the position
+   * of head, scan_pos the first byte not yet examined and boundaries[] the
+   * end positions of packets already found, oldest first. */
+  esl_size_t consumed;
+  esl_size_t scan_pos;
+  esl_size_t boundaries[ESL_BUFFER_MAX_BOUNDARIES];
+  esl_size_t boundary_first;
+  esl_size_t boundary_count;
 };
 
+static void buffer_scan_reset(esl_buffer_t *buffer) {
+  buffer->consumed = 0;
+  buffer->scan_pos = 0;
+  buffer->boundary_first = 0;
+  buffer->boundary_count = 0;
+}
+
+/* Account for datalen bytes removed from the front. Reading exactly up to
+ * the oldest boundary keeps the scan state; anything else starts the scan
+ * over at the new head, which is where the packet search begins. */
+static void buffer_scan_consume(esl_buffer_t *buffer, esl_size_t datalen) {
+  if (!datalen) {
+    return;
+  }
+
+  buffer->consumed += datalen;
+
+  if (buffer->boundary_count &&
+      buffer->boundaries[buffer->boundary_first] == buffer->consumed) {
+    buffer->boundary_first =
+        (buffer->boundary_first + 1) % ESL_BUFFER_MAX_BOUNDARIES;
+    buffer->boundary_count--;
+    return;
+  }
+
+  buffer->boundary_first = 0;
+  buffer->boundary_count = 0;
+  buffer->scan_pos = buffer->consumed;
+}
+
+/* Examine bytes written since the last scan for "\n\n" (or "\n\r\n")
+ * packet ends. Stops at a NUL byte, an incomplete terminator at the end of
+ * the data, or when the boundary queue is full; with queue_limit false it
+ * only counts past that point without recording anything. */
+static esl_size_t buffer_scan(esl_buffer_t *buffer, bool queue_limit) {
+  const char *head = (const char *)buffer->head;
+  const esl_size_t end = buffer->used;
+  esl_size_t p = buffer->scan_pos - buffer->consumed;
+  esl_size_t extra = 0;
+
+  while (p < end) {
+    esl_size_t pe;
+
+    p += esl_scan_find2(head + p, end - p, '\n', '\0');
+    if (p >= end || head[p] == '\0') {
+      break;
+    }
+
+    pe = p + 1;
+    if (pe >= end) {
+      break;
+    }
+    if (head[pe] == '\r' && ++pe >= end) {
+      break;
+    }
+    if (head[pe] == '\n') {
+      if (buffer->boundary_count < ESL_BUFFER_MAX_BOUNDARIES) {
+        buffer->boundaries[(buffer->boundary_first + buffer->boundary_count) %
+                           ESL_BUFFER_MAX_BOUNDARIES] = buffer->consumed + pe + 1;
+        buffer->boundary_count++;
+        buffer->scan_pos = buffer->consumed + pe + 1;
+      } else if (queue_limit) {
+        break;
+      } else {
+        extra++;
+      }
+      p = pe + 1;
+      continue;
+    }
+    p++;
+  }
+
+  if (buffer->boundary_count < ESL_BUFFER_MAX_BOUNDARIES) {
+    buffer->scan_pos = buffer->consumed + p;
+  }
+
+  return extra;
+}
+
+/* Oldest offset from data whose bytes are still the ones written there.
+ * Once the tail of a mirrored buffer wraps it reuses the space before
+ * head, so seeking and looping cannot go back further than this. */
+static esl_size_t buffer_rewind_floor(esl_buffer_t *buffer) {
+  if (buffer->mirrored && buffer->actually_used > buffer->datalen) {
+    return buffer->actually_used - buffer->datalen;
+  }
+  return 0;
+}
+
+/* Move head back into the first copy after a read went past it. */
+static void buffer_mirror_wrap(esl_buffer_t *buffer) {
+  if (buffer->mirrored &&
+      (esl_size_t)(buffer->head - buffer->data) >= buffer->datalen) {
+    buffer->head -= buffer->datalen;
+    buffer->actually_used -= buffer->datalen;
+  }
+}
+
+#ifdef __linux__
+static unsigned char *buffer_mirror_map(esl_size_t len) {
+  unsigned char *base = MAP_FAILED;
+  int fd;
+
+  if ((fd = memfd_create("esl_buffer", MFD_CLOEXEC)) < 0) {
+    return nullptr;
+  }
+  if (ftruncate(fd, (off_t)len) != 0) {
+    goto fail;
+  }
+
+  base = mmap(nullptr, len * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    goto fail;
+  }
+  if (mmap(base, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) ==
+          MAP_FAILED ||
+      mmap(base + len, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+           0) == MAP_FAILED) {
+    munmap(base, len * 2);
+    base = MAP_FAILED;
+    goto fail;
+  }
+
+fail:
+  close(fd);
+  return base == MAP_FAILED ? nullptr : base;
+}
+
+static esl_size_t buffer_mirror_size(esl_size_t len) {
+  const esl_size_t page = (esl_size_t)sysconf(_SC_PAGESIZE);
+
+  if (len > SIZE_MAX / 2 - page) {
+    return 0;
+  }
+  return (len + page - 1) / page * page;
+}
+#endif
+
+/* How much to add to the allocation when need more bytes do not fit. */
+static esl_size_t buffer_growth(esl_buffer_t *buffer, esl_size_t need) {
+  esl_size_t grow = buffer->blocksize;
+
+  if (buffer->geometric && grow < buffer->datalen) {
+    grow = buffer->datalen;
+  }
+  if (grow < need) {
+    grow = need;
+  }
+  if (grow > SIZE_MAX - buffer->datalen) {
+    return 0;
+  }
+  return grow;
+}
+
+/* Remap a mirrored buffer to hold size bytes, copying the used bytes to the
+ * front of the new mapping. */
+static bool buffer_mirror_remap(esl_buffer_t *buffer, esl_size_t size) {
+#ifdef __linux__
+  unsigned char *data;
+
+  if (!(size = buffer_mirror_size(size))) {
+    return false;
+  }
+  if (size == buffer->datalen) {
+    return true;
+  }
+  if (!(data = buffer_mirror_map(size))) {
+    return false;
+  }
+
+  memcpy(data, buffer->head, buffer->used);
+  munmap(buffer->data, buffer->datalen * 2);
+  buffer->data = data;
+  buffer->head = data;
+  buffer->actually_used = buffer->used;
+  buffer->datalen = size;
+
+  return true;
+#else
+  (void)buffer;
+  (void)size;
+  return false;
+#endif
+}
+
+/* Remap a mirrored buffer so at least len bytes fit. */
+static bool buffer_mirror_grow(esl_buffer_t *buffer, esl_size_t len) {
+  const esl_size_t grow = buffer_growth(buffer, len - buffer->datalen);
+
+  return grow && buffer_mirror_remap(buffer, buffer->datalen + grow);
+}
+
 ESL_DECLARE(esl_status_t)
 esl_buffer_create(esl_buffer_t **buffer, esl_size_t blocksize,
                   esl_size_t start_len, esl_size_t max_len) {
@@ -90,6 +308,61 @@ esl_buffer_create(esl_buffer_t **buffer, esl_size_t blocksize,
   return ESL_FAIL;
 }
 
+ESL_DECLARE(esl_status_t)
+esl_buffer_create_mirrored(esl_buffer_t **buffer, esl_size_t blocksize,
+                           esl_size_t start_len, esl_size_t max_len) {
+#ifdef __linux__
+  esl_buffer_t *new_buffer = nullptr;
+  esl_size_t size;
+
+  if (buffer == nullptr) {
+    return ESL_FAIL;
+  }
+  *buffer = nullptr;
+
+  if (!start_len) {
+    start_len = 250;
+  }
+
+  if (!blocksize) {
+    blocksize = start_len;
+  }
+
+  if (!(size = buffer_mirror_size(start_len))) {
+    return ESL_FAIL;
+  }
+
+  if (!(new_buffer = calloc(1, sizeof(*new_buffer)))) {
+    return ESL_FAIL;
+  }
+
+  if (!(new_buffer->data = buffer_mirror_map(size))) {
+    free(new_buffer);
+    return ESL_FAIL;
+  }
+
+  new_buffer->mirrored = true;
+  new_buffer->max_len = max_len;
+  new_buffer->datalen = size;
+  new_buffer->id =
+      atomic_fetch_add_explicit(&buffer_id, 1u, memory_order_relaxed);
+  new_buffer->blocksize = blocksize;
+  new_buffer->head = new_buffer->data;
+
+  *buffer = new_buffer;
+  return ESL_SUCCESS;
+#else
+  (void)blocksize;
+  (void)start_len;
+  (void)max_len;
+
+  if (buffer != nullptr) {
+    *buffer = nullptr;
+  }
+  return ESL_FAIL;
+#endif
+}
+
 ESL_DECLARE(esl_size_t) esl_buffer_len(esl_buffer_t *buffer) {
 
   esl_assert(buffer != nullptr);
@@ -130,8 +403,13 @@ esl_buffer_seek(esl_buffer_t *buffer, esl_size_t datalen) {
     reading = buffer->used;
   }
 
+  if (reading < buffer_rewind_floor(buffer)) {
+    reading = buffer_rewind_floor(buffer);
+  }
+
   buffer->used = buffer->actually_used - reading;
   buffer->head = buffer->data + reading;
+  buffer_scan_reset(buffer);
 
   return reading;
 }
@@ -153,6 +431,8 @@ esl_buffer_toss(esl_buffer_t *buffer, esl_size_t datalen) {
 
   buffer->used -= reading;
   buffer->head += reading;
+  buffer_scan_consume(buffer, reading);
+  buffer_mirror_wrap(buffer);
 
   return buffer->used;
 }
@@ -174,8 +454,10 @@ esl_buffer_read_loop(esl_buffer_t *buffer, void *data, esl_size_t datalen) {
     if (buffer->loops == 0) {
       return len;
     }
-    buffer->head = buffer->data;
-    buffer->used = buffer->actually_used;
+    buffer->head = buffer->data + buffer_rewind_floor(buffer);
+    buffer->used = buffer->actually_used -
+                   (esl_size_t)(buffer->head - buffer->data);
+    buffer_scan_reset(buffer);
     len = esl_buffer_read(buffer, (char *)data + len, datalen - len);
     buffer->loops--;
   }
@@ -202,6 +484,8 @@ esl_buffer_read(esl_buffer_t *buffer, void *data, esl_size_t datalen) {
   memcpy(data, buffer->head, reading);
   buffer->used -= reading;
   buffer->head += reading;
+  buffer_scan_consume(buffer, reading);
+  buffer_mirror_wrap(buffer);
 
   /* if (buffer->id == 4) printf("%u o %d = %d\n", buffer->id,
    * (unsigned)reading, (unsigned)buffer->used); */
@@ -209,68 +493,30 @@ esl_buffer_read(esl_buffer_t *buffer, void *data, esl_size_t datalen) {
 }
 
 ESL_DECLARE(esl_size_t) esl_buffer_packet_count(esl_buffer_t *buffer) {
-  char *pe, *p, *e, *head;
-  esl_size_t x = 0;
+  esl_size_t extra;
 
   esl_assert(buffer != nullptr);
 
-  head = (char *)buffer->head;
-
-  e = (head + buffer->used);
+  extra = buffer_scan(buffer, false);
 
-  for (p = head; p && *p && p < e; p++) {
-    if (*p == '\n') {
-      pe = p + 1;
-      if (pe >= e) {
-        break;
-      }
-      if (*pe == '\r') {
-        pe++;
-        if (pe >= e) {
-          break;
-        }
-      }
-      if (*pe == '\n') {
-        p = pe;
-        x++;
-      }
-    }
-  }
-
-  return x;
+  return buffer->boundary_count + extra;
 }
 
 ESL_DECLARE(esl_size_t)
 esl_buffer_read_packet(esl_buffer_t *buffer, void *data, esl_size_t maxlen) {
-  char *pe, *p, *e, *head;
   esl_size_t datalen = 0;
 
   esl_assert(buffer != nullptr);
   esl_assert(data != nullptr);
 
-  head = (char *)buffer->head;
-
-  e = (head + buffer->used);
+  if (!buffer->boundary_count) {
+    buffer_scan(buffer, true);
+  }
 
-  for (p = head; p && *p && p < e; p++) {
-    if (*p == '\n') {
-      pe = p + 1;
-      if (pe >= e) {
-        break;
-      }
-      if (*pe == '\r') {
-        pe++;
-        if (pe >= e) {
-          break;
-        }
-      }
-      if (*pe == '\n') {
-        datalen = pe - head;
-        if (datalen > maxlen) {
-          datalen = maxlen;
-        }
-        break;
-      }
+  if (buffer->boundary_count) {
+    datalen = buffer->boundaries[buffer->boundary_first] - buffer->consumed;
+    if (datalen > maxlen) {
+      datalen = maxlen;
     }
   }
 
@@ -290,7 +536,7 @@ esl_buffer_write(esl_buffer_t *buffer, const void *data, esl_size_t datalen) {
   }
 
   if (buffer->used > buffer->datalen ||
-      buffer->actually_used > buffer->datalen) {
+      (!buffer->mirrored && buffer->actually_used > buffer->datalen)) {
     return 0;
   }
   if (datalen > (SIZE_MAX - buffer->used)) {
@@ -303,6 +549,17 @@ esl_buffer_write(esl_buffer_t *buffer, const void *data, esl_size_t datalen) {
     return 0;
   }
 
+  if (buffer->mirrored) {
+    if (buffer->datalen - buffer->used < datalen &&
+        !buffer_mirror_grow(buffer, buffer->used + datalen)) {
+      return 0;
+    }
+    memcpy(buffer->head + buffer->used, data, datalen);
+    buffer->used += datalen;
+    buffer->actually_used += datalen;
+    return buffer->used;
+  }
+
   actual_freespace = buffer->datalen - buffer->actually_used;
   if (actual_freespace < datalen &&
       (!buffer->max_len || (buffer->used + datalen <= buffer->max_len))) {
@@ -321,21 +578,13 @@ esl_buffer_write(esl_buffer_t *buffer, const void *data, esl_size_t datalen) {
   */
 
   if (freespace < datalen) {
-    esl_size_t new_size, new_block_size;
+    esl_size_t new_size, grow;
     void *data1;
 
-    if (datalen > (SIZE_MAX - buffer->datalen)) {
-      return 0;
-    }
-    new_size = buffer->datalen + datalen;
-    if (buffer->blocksize > (SIZE_MAX - buffer->datalen)) {
+    if (!(grow = buffer_growth(buffer, datalen))) {
       return 0;
     }
-    new_block_size = buffer->datalen + buffer->blocksize;
-
-    if (new_block_size > new_size) {
-      new_size = new_block_size;
-    }
+    new_size = buffer->datalen + grow;
     buffer->head = buffer->data;
     data1 = realloc(buffer->data, new_size);
     if (!data1) {
@@ -361,6 +610,131 @@ esl_buffer_write(esl_buffer_t *buffer, const void *data, esl_size_t datalen) {
   return buffer->used;
 }
 
+ESL_DECLARE(esl_size_t)
+esl_buffer_reserve(esl_buffer_t *buffer, esl_size_t min_len, void **data) {
+  esl_size_t tail_space;
+
+  esl_assert(buffer != nullptr);
+  esl_assert(data != nullptr);
+  esl_assert(buffer->data != nullptr);
+
+  *data = nullptr;
+
+  if (buffer->max_len) {
+    if (buffer->used >= buffer->max_len) {
+      return 0;
+    }
+    if (min_len > buffer->max_len - buffer->used) {
+      min_len = buffer->max_len - buffer->used;
+    }
+  }
+
+  if (min_len == 0) {
+    min_len = 1;
+  }
+
+  if (buffer->mirrored) {
+    if (buffer->datalen - buffer->used < min_len &&
+        !buffer_mirror_grow(buffer, buffer->used + min_len)) {
+      return 0;
+    }
+    tail_space = buffer->datalen - buffer->used;
+    goto done;
+  }
+
+  tail_space = buffer->datalen - buffer->actually_used;
+
+  if (tail_space < min_len && buffer->head != buffer->data) {
+    memmove(buffer->data, buffer->head, buffer->used);
+    buffer->head = buffer->data;
+    buffer->actually_used = buffer->used;
+    tail_space = buffer->datalen - buffer->actually_used;
+  }
+
+  if (tail_space < min_len) {
+    esl_size_t grow;
+    void *data1;
+
+    if (!(grow = buffer_growth(buffer, min_len - tail_space))) {
+      return 0;
+    }
+    if (!(data1 = realloc(buffer->data, buffer->datalen + grow))) {
+      return 0;
+    }
+    buffer->data = data1;
+    buffer->head = buffer->data;
+    buffer->datalen += grow;
+    tail_space = buffer->datalen - buffer->actually_used;
+  }
+
+done:
+  if (buffer->max_len && tail_space > buffer->max_len - buffer->used) {
+    tail_space = buffer->max_len - buffer->used;
+  }
+
+  *data = buffer->head + buffer->used;
+
+  return tail_space;
+}
+
+ESL_DECLARE(esl_size_t)
+esl_buffer_commit(esl_buffer_t *buffer, esl_size_t datalen) {
+  esl_assert(buffer != nullptr);
+
+  if (datalen > buffer->datalen - (buffer->mirrored ? buffer->used
+                                                    : buffer->actually_used)) {
+    return 0;
+  }
+
+  buffer->used += datalen;
+  buffer->actually_used += datalen;
+
+  return buffer->used;
+}
+
+ESL_DECLARE(void)
+esl_buffer_set_geometric(esl_buffer_t *buffer, bool geometric) {
+  if (buffer == nullptr) {
+    return;
+  }
+  buffer->geometric = geometric;
+}
+
+ESL_DECLARE(esl_size_t)
+esl_buffer_shrink(esl_buffer_t *buffer, esl_size_t len) {
+  unsigned char *data;
+
+  esl_assert(buffer != nullptr);
+
+  if (len < buffer->used) {
+    len = buffer->used;
+  }
+  if (!len) {
+    len = 1;
+  }
+  if (len >= buffer->datalen) {
+    return buffer->datalen;
+  }
+
+  if (buffer->mirrored) {
+    buffer_mirror_remap(buffer, len);
+    return buffer->datalen;
+  }
+
+  if (buffer->head != buffer->data) {
+    memmove(buffer->data, buffer->head, buffer->used);
+    buffer->head = buffer->data;
+    buffer->actually_used = buffer->used;
+  }
+  if ((data = realloc(buffer->data, len))) {
+    buffer->data = data;
+    buffer->head = data;
+    buffer->datalen = len;
+  }
+
+  return buffer->datalen;
+}
+
 ESL_DECLARE(void) esl_buffer_zero(esl_buffer_t *buffer) {
   esl_assert(buffer != nullptr);
   esl_assert(buffer->data != nullptr);
@@ -368,6 +742,7 @@ ESL_DECLARE(void) esl_buffer_zero(esl_buffer_t *buffer) {
   buffer->used = 0;
   buffer->actually_used = 0;
   buffer->head = buffer->data;
+  buffer_scan_reset(buffer);
 }
 
 ESL_DECLARE(esl_size_t)
@@ -388,7 +763,12 @@ ESL_DECLARE(void) esl_buffer_destroy(esl_buffer_t **buffer) {
   }
 
   if (*buffer) {
-    free((*buffer)->data);
+#ifdef __linux__
+    if ((*buffer)->mirrored) {
+      munmap((*buffer)->data, (*buffer)->datalen * 2);
+    } else
+#endif
+      free((*buffer)->data);
     (*buffer)->data = nullptr;
     free(*buffer);
   }
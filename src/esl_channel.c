@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "esl/esl_channel.h"
+#include "esl/esl_event.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/* Producer and consumer indices live on separate cache lines so the two
+ * sides do not keep stealing each other's line. */
+constexpr esl_size_t ESL_CHANNEL_CACHE_LINE = 64;
+
+/* A slot is free for the producer claiming position pos when its sequence
+ * is pos, and holds an event for the consumer at pos when it is pos + 1. */
+typedef struct {
+  _Atomic esl_size_t seq;
+  esl_event_t *event;
+} esl_channel_slot_t;
+
+struct esl_event_channel {
+  alignas(ESL_CHANNEL_CACHE_LINE) _Atomic esl_size_t tail;
+  alignas(ESL_CHANNEL_CACHE_LINE) _Atomic esl_size_t head;
+  /* set by a consumer about to sleep on wakefd */
+  _Atomic bool sleeping;
+  alignas(ESL_CHANNEL_CACHE_LINE) esl_channel_slot_t *slots;
+  esl_size_t mask;
+  esl_channel_mode_t mode;
+  /* eventfd, or the read end of a pipe whose write end is wakefd_w */
+  int wakefd;
+  int wakefd_w;
+};
+
+/* Claim up to n consecutive free slots for the producer. Returns the first
+ * position and stores the count claimed in *claimed (0 when full). */
+static esl_size_t channel_claim(esl_event_channel_t *channel, esl_size_t n,
+                                esl_size_t *claimed) {
+  esl_size_t pos = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+
+  for (;;) {
+    esl_size_t k = 0;
+
+    /* the consumer frees slots in order, so the free ones are a run */
+    while (k < n &&
+           atomic_load_explicit(
+               &channel->slots[(pos + k) & channel->mask].seq,
+               memory_order_acquire) == pos + k) {
+      k++;
+    }
+
+    if (k == 0) {
+      const esl_size_t seq = atomic_load_explicit(
+          &channel->slots[pos & channel->mask].seq, memory_order_acquire);
+
+      if ((esl_ssize_t)(seq - pos) < 0) {
+        *claimed = 0;
+        return pos;
+      }
+      /* another producer took pos meanwhile */
+      pos = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+      continue;
+    }
+
+    if (channel->mode == ESL_CHANNEL_SPSC) {
+      atomic_store_explicit(&channel->tail, pos + k, memory_order_relaxed);
+    } else if (!atomic_compare_exchange_weak_explicit(
+                   &channel->tail, &pos, pos + k, memory_order_relaxed,
+                   memory_order_relaxed)) {
+      continue;
+    }
+
+    *claimed = k;
+    return pos;
+  }
+}
+
+/* Wake the consumer if it went to sleep. The fence orders the slots just
+ * published before the check of the flag the consumer set before its last
+ * look at them. */
+static void channel_wake(esl_event_channel_t *channel) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&channel->sleeping, memory_order_relaxed) &&
+      atomic_exchange(&channel->sleeping, false)) {
+    const uint64_t one = 1;
+    const size_t len = channel->wakefd_w == channel->wakefd ? sizeof(one) : 1;
+
+    if (write(channel->wakefd_w, &one, len) < 0) {
+      /* pipe full or counter saturated, a wakeup is already pending */
+    }
+  }
+}
+
+static bool channel_ready(esl_event_channel_t *channel) {
+  const esl_size_t pos =
+      atomic_load_explicit(&channel->head, memory_order_relaxed);
+
+  return atomic_load_explicit(&channel->slots[pos & channel->mask].seq,
+                              memory_order_acquire) == pos + 1;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_event_channel_create(esl_event_channel_t **channel, esl_size_t capacity,
+                         esl_channel_mode_t mode) {
+  esl_event_channel_t *new_channel = nullptr;
+  esl_size_t size = 2;
+
+  if (channel == nullptr || capacity == 0 ||
+      (mode != ESL_CHANNEL_SPSC && mode != ESL_CHANNEL_MPSC)) {
+    return ESL_FAIL;
+  }
+  *channel = nullptr;
+
+  while (size < capacity) {
+    size *= 2;
+  }
+
+  if ((new_channel = aligned_alloc(ESL_CHANNEL_CACHE_LINE,
+                                   sizeof(*new_channel))) == nullptr) {
+    return ESL_FAIL;
+  }
+  memset(new_channel, 0, sizeof(*new_channel));
+  new_channel->wakefd = new_channel->wakefd_w = -1;
+  new_channel->mask = size - 1;
+  new_channel->mode = mode;
+
+  if ((new_channel->slots = calloc(size, sizeof(*new_channel->slots))) ==
+      nullptr) {
+    goto fail;
+  }
+  for (esl_size_t i = 0; i < size; i++) {
+    atomic_init(&new_channel->slots[i].seq, i);
+  }
+
+#ifdef __linux__
+  if ((new_channel->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    goto fail;
+  }
+  new_channel->wakefd_w = new_channel->wakefd;
+#else
+  {
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+      goto fail;
+    }
+    new_channel->wakefd = fds[0];
+    new_channel->wakefd_w = fds[1];
+    for (int i = 0; i < 2; i++) {
+      (void)fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+      (void)fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+  }
+#endif
+
+  *channel = new_channel;
+  return ESL_SUCCESS;
+
+fail:
+  free(new_channel->slots);
+  free(new_channel);
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(void) esl_event_channel_destroy(esl_event_channel_t **channel) {
+  esl_event_channel_t *cp = nullptr;
+  esl_event_t *event = nullptr;
+
+  if (channel == nullptr || *channel == nullptr) {
+    return;
+  }
+
+  cp = *channel;
+  *channel = nullptr;
+
+  while (esl_event_channel_pop(cp, &event) == ESL_SUCCESS) {
+    esl_event_destroy(&event);
+  }
+
+  if (cp->wakefd_w >= 0 && cp->wakefd_w != cp->wakefd) {
+    close(cp->wakefd_w);
+  }
+  if (cp->wakefd >= 0) {
+    close(cp->wakefd);
+  }
+  free(cp->slots);
+  free(cp);
+}
+
+ESL_DECLARE(esl_status_t)
+esl_event_channel_push(esl_event_channel_t *channel, esl_event_t *event) {
+  esl_size_t pushed = 0;
+
+  return esl_event_channel_push_batch(channel, &event, 1, &pushed);
+}
+
+ESL_DECLARE(esl_status_t)
+esl_event_channel_push_batch(esl_event_channel_t *channel,
+                             esl_event_t **events, esl_size_t n,
+                             esl_size_t *pushed) {
+  esl_size_t claimed = 0;
+  esl_size_t pos;
+
+  if (pushed) {
+    *pushed = 0;
+  }
+  if (channel == nullptr || events == nullptr || pushed == nullptr) {
+    return ESL_FAIL;
+  }
+  if (n == 0) {
+    return ESL_SUCCESS;
+  }
+
+  pos = channel_claim(channel, n, &claimed);
+  if (claimed == 0) {
+    return ESL_BREAK;
+  }
+
+  for (esl_size_t i = 0; i < claimed; i++) {
+    esl_channel_slot_t *slot = &channel->slots[(pos + i) & channel->mask];
+
+    slot->event = events[i];
+    atomic_store_explicit(&slot->seq, pos + i + 1, memory_order_release);
+  }
+
+  channel_wake(channel);
+
+  *pushed = claimed;
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_event_channel_pop(esl_event_channel_t *channel, esl_event_t **event) {
+  esl_size_t n = 0;
+
+  return esl_event_channel_pop_batch(channel, event, 1, &n);
+}
+
+ESL_DECLARE(esl_status_t)
+esl_event_channel_pop_batch(esl_event_channel_t *channel, esl_event_t **out,
+                            esl_size_t max, esl_size_t *n) {
+  esl_size_t pos;
+  esl_size_t count = 0;
+
+  if (n) {
+    *n = 0;
+  }
+  if (channel == nullptr || out == nullptr || n == nullptr) {
+    return ESL_FAIL;
+  }
+
+  pos = atomic_load_explicit(&channel->head, memory_order_relaxed);
+
+  while (count < max) {
+    esl_channel_slot_t *slot = &channel->slots[(pos + count) & channel->mask];
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) !=
+        pos + count + 1) {
+      break;
+    }
+    out[count] = slot->event;
+    slot->event = nullptr;
+    /* free for the producer one lap later */
+    atomic_store_explicit(&slot->seq, pos + count + channel->mask + 1,
+                          memory_order_release);
+    count++;
+  }
+
+  if (count == 0) {
+    return ESL_BREAK;
+  }
+  atomic_store_explicit(&channel->head, pos + count, memory_order_relaxed);
+
+  *n = count;
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_event_channel_wait(esl_event_channel_t *channel, uint32_t ms) {
+  uint64_t drain;
+
+  if (channel == nullptr) {
+    return ESL_FAIL;
+  }
+
+  for (;;) {
+    int activity;
+
+    if (channel_ready(channel)) {
+      return ESL_SUCCESS;
+    }
+
+    atomic_store(&channel->sleeping, true);
+    if (channel_ready(channel)) {
+      atomic_store(&channel->sleeping, false);
+      return ESL_SUCCESS;
+    }
+
+    activity = esl_wait_sock(channel->wakefd, ms ? ms : 1000, ESL_POLL_READ);
+    atomic_store(&channel->sleeping, false);
+
+    if (activity > 0) {
+      while (read(channel->wakefd, &drain, sizeof(drain)) > 0)
+        ;
+    }
+
+    if (channel_ready(channel)) {
+      return ESL_SUCCESS;
+    }
+    if (ms && activity <= 0) {
+      return ESL_BREAK;
+    }
+  }
+}
+
+ESL_DECLARE(esl_size_t) esl_event_channel_depth(esl_event_channel_t *channel) {
+  esl_size_t head;
+  esl_size_t tail;
+
+  if (channel == nullptr) {
+    return 0;
+  }
+
+  head = atomic_load_explicit(&channel->head, memory_order_acquire);
+  tail = atomic_load_explicit(&channel->tail, memory_order_acquire);
+
+  return tail > head ? tail - head : 0;
+}
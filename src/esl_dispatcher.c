@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esl/esl_dispatcher.h"
+#include "esl/esl_channel.h"
+
+constexpr esl_size_t ESL_DISPATCH_DEFAULT_QUEUE = 4096;
+/* Events a worker takes off its shard per turn. */
+constexpr esl_size_t ESL_DISPATCH_BATCH = 64;
+/* How long an idle worker sleeps before looking for a stop request. */
+constexpr uint32_t ESL_DISPATCH_IDLE_MS = 100;
+/* Longest pause between retries of a blocked dispatch, in microseconds. */
+constexpr long ESL_DISPATCH_MAX_BACKOFF_US = 1000;
+constexpr esl_size_t ESL_DISPATCH_CACHE_LINE = 64;
+
+/* Each shard sits on its own cache lines, so workers counting what they
+ * handled do not contend with each other. */
+typedef struct {
+  alignas(ESL_DISPATCH_CACHE_LINE) esl_event_channel_t *channel;
+  esl_dispatcher_t *dispatcher;
+  unsigned index;
+  pthread_t thread;
+  bool started;
+  _Atomic esl_size_t high_water;
+  _Atomic uint64_t dispatched;
+  _Atomic uint64_t rejected;
+  alignas(ESL_DISPATCH_CACHE_LINE) _Atomic uint64_t handled;
+} esl_dispatch_shard_t;
+
+struct esl_dispatcher {
+  esl_dispatcher_config_t config;
+  esl_dispatch_callback_t callback;
+  void *user_data;
+  esl_dispatch_shard_t *shards;
+  _Atomic bool running;
+};
+
+static void *dispatch_worker(void *data) {
+  esl_dispatch_shard_t *shard = data;
+  esl_dispatcher_t *dispatcher = shard->dispatcher;
+  esl_event_t *events[ESL_DISPATCH_BATCH];
+
+  for (;;) {
+    esl_size_t n = 0;
+
+    if (esl_event_channel_pop_batch(shard->channel, events,
+                                    ESL_DISPATCH_BATCH, &n) == ESL_SUCCESS) {
+      for (esl_size_t i = 0; i < n; i++) {
+        dispatcher->callback(dispatcher, events[i], shard->index,
+                             dispatcher->user_data);
+      }
+      atomic_fetch_add_explicit(&shard->handled, n, memory_order_relaxed);
+      continue;
+    }
+
+    /* a stop request is only honoured once the shard is empty */
+    if (!atomic_load_explicit(&dispatcher->running, memory_order_acquire)) {
+      break;
+    }
+    (void)esl_event_channel_wait(shard->channel, ESL_DISPATCH_IDLE_MS);
+  }
+
+  return nullptr;
+}
+
+static uint32_t dispatch_hash(const char *key) {
+  uint32_t hash = 2'166'136'261u;
+
+  for (; *key; key++) {
+    hash = (hash ^ (unsigned char)*key) * 16'777'619u;
+  }
+  return hash;
+}
+
+static void dispatch_note_depth(esl_dispatch_shard_t *shard) {
+  const esl_size_t depth = esl_event_channel_depth(shard->channel);
+  esl_size_t high =
+      atomic_load_explicit(&shard->high_water, memory_order_relaxed);
+
+  while (depth > high && !atomic_compare_exchange_weak_explicit(
+                             &shard->high_water, &high, depth,
+                             memory_order_relaxed, memory_order_relaxed))
+    ;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_dispatcher_create(esl_dispatcher_t **dispatcher,
+                      const esl_dispatcher_config_t *config,
+                      esl_dispatch_callback_t callback, void *user_data) {
+  esl_dispatcher_t *new_dispatcher = nullptr;
+  pthread_attr_t attr;
+  unsigned count;
+
+  if (dispatcher == nullptr || callback == nullptr) {
+    return ESL_FAIL;
+  }
+  *dispatcher = nullptr;
+
+  if ((new_dispatcher = calloc(1, sizeof(*new_dispatcher))) == nullptr) {
+    return ESL_FAIL;
+  }
+  if (config) {
+    new_dispatcher->config = *config;
+  }
+  if (!new_dispatcher->config.shards) {
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    new_dispatcher->config.shards = cpus > 0 ? (unsigned)cpus : 1;
+  }
+  if (!new_dispatcher->config.queue_len) {
+    new_dispatcher->config.queue_len = ESL_DISPATCH_DEFAULT_QUEUE;
+  }
+  new_dispatcher->callback = callback;
+  new_dispatcher->user_data = user_data;
+  atomic_init(&new_dispatcher->running, true);
+  count = new_dispatcher->config.shards;
+
+  if ((new_dispatcher->shards = aligned_alloc(
+           ESL_DISPATCH_CACHE_LINE,
+           count * sizeof(*new_dispatcher->shards))) == nullptr) {
+    free(new_dispatcher);
+    return ESL_FAIL;
+  }
+  memset(new_dispatcher->shards, 0, count * sizeof(*new_dispatcher->shards));
+
+  for (unsigned i = 0; i < count; i++) {
+    esl_dispatch_shard_t *shard = &new_dispatcher->shards[i];
+
+    shard->dispatcher = new_dispatcher;
+    shard->index = i;
+    if (esl_event_channel_create(&shard->channel,
+                                 new_dispatcher->config.queue_len,
+                                 ESL_CHANNEL_MPSC) != ESL_SUCCESS) {
+      goto fail;
+    }
+  }
+
+  if (pthread_attr_init(&attr) != 0) {
+    goto fail;
+  }
+  if (new_dispatcher->config.stack_size) {
+    (void)pthread_attr_setstacksize(&attr, new_dispatcher->config.stack_size);
+  }
+  for (unsigned i = 0; i < count; i++) {
+    esl_dispatch_shard_t *shard = &new_dispatcher->shards[i];
+
+    if (pthread_create(&shard->thread, &attr, dispatch_worker, shard) != 0) {
+      pthread_attr_destroy(&attr);
+      goto fail;
+    }
+    shard->started = true;
+  }
+  pthread_attr_destroy(&attr);
+
+  *dispatcher = new_dispatcher;
+  return ESL_SUCCESS;
+
+fail:
+  esl_dispatcher_destroy(&new_dispatcher);
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(void) esl_dispatcher_destroy(esl_dispatcher_t **dispatcher) {
+  esl_dispatcher_t *dp = nullptr;
+
+  if (dispatcher == nullptr || *dispatcher == nullptr) {
+    return;
+  }
+
+  dp = *dispatcher;
+  *dispatcher = nullptr;
+
+  atomic_store_explicit(&dp->running, false, memory_order_release);
+  for (unsigned i = 0; i < dp->config.shards; i++) {
+    if (dp->shards[i].started) {
+      pthread_join(dp->shards[i].thread, nullptr);
+    }
+  }
+  for (unsigned i = 0; i < dp->config.shards; i++) {
+    esl_event_channel_destroy(&dp->shards[i].channel);
+  }
+
+  free(dp->shards);
+  free(dp);
+}
+
+ESL_DECLARE(unsigned)
+esl_dispatcher_shard(esl_dispatcher_t *dispatcher, esl_event_t *event) {
+  const char *key;
+
+  if (dispatcher == nullptr || event == nullptr) {
+    return 0;
+  }
+
+  if ((key = esl_event_get_header(event, "unique-id")) == nullptr &&
+      (key = esl_event_get_header(event, "job-uuid")) == nullptr &&
+      (key = esl_event_get_header(event, "core-uuid")) == nullptr) {
+    return 0;
+  }
+
+  return dispatch_hash(key) % dispatcher->config.shards;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_dispatcher_dispatch(esl_dispatcher_t *dispatcher, esl_event_t *event) {
+  esl_dispatch_shard_t *shard = nullptr;
+  long backoff_us = 50;
+
+  if (dispatcher == nullptr || event == nullptr) {
+    return ESL_FAIL;
+  }
+
+  shard = &dispatcher->shards[esl_dispatcher_shard(dispatcher, event)];
+
+  while (esl_event_channel_push(shard->channel, event) != ESL_SUCCESS) {
+    const struct timespec pause = {.tv_nsec = backoff_us * 1000};
+
+    if (dispatcher->config.overflow == ESL_DISPATCH_OVERFLOW_REJECT) {
+      atomic_fetch_add_explicit(&shard->rejected, 1, memory_order_relaxed);
+      return ESL_BREAK;
+    }
+
+    /* back-pressure: the caller waits for the shard's worker */
+    nanosleep(&pause, nullptr);
+    if (backoff_us < ESL_DISPATCH_MAX_BACKOFF_US) {
+      backoff_us *= 2;
+    }
+  }
+
+  atomic_fetch_add_explicit(&shard->dispatched, 1, memory_order_relaxed);
+  dispatch_note_depth(shard);
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(unsigned) esl_dispatcher_shards(esl_dispatcher_t *dispatcher) {
+  return dispatcher ? dispatcher->config.shards : 0;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_dispatcher_get_stats(esl_dispatcher_t *dispatcher, unsigned shard,
+                         esl_dispatcher_stats_t *stats) {
+  esl_dispatch_shard_t *sp = nullptr;
+
+  if (dispatcher == nullptr || stats == nullptr ||
+      shard >= dispatcher->config.shards) {
+    return ESL_FAIL;
+  }
+
+  sp = &dispatcher->shards[shard];
+  *stats = (esl_dispatcher_stats_t){
+      .depth = esl_event_channel_depth(sp->channel),
+      .high_water = atomic_load(&sp->high_water),
+      .dispatched = atomic_load(&sp->dispatched),
+      .handled = atomic_load(&sp->handled),
+      .rejected = atomic_load(&sp->rejected)};
+
+  return ESL_SUCCESS;
+}
@@ -37,12 +37,31 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 constexpr size_t ESL_EVENT_MAX_BODY_LENGTH = 16'777'216;
 constexpr size_t ESL_EVENT_JSON_MAX_LENGTH = 16'777'216;
 constexpr size_t ESL_EVENT_JSON_MAX_HEADERS = 4'096;
 constexpr size_t ESL_EVENT_JSON_MAX_ARRAY_ITEMS = 4'096;
 constexpr size_t ESL_EVENT_JSON_MAX_HEADER_NAME_LENGTH = 1'024;
+/* First arena block, allocated together with the event. Later blocks double
+ * in size, so a 150-header CHANNEL_* event needs three allocations. */
+constexpr size_t ESL_EVENT_ARENA_FIRST_BLOCK = 4'096;
+/* Objects a thread keeps per pool class before handing a batch over to the
+ * overflow list, which holds at most ESL_EVENT_POOL_GLOBAL of each. */
+constexpr int ESL_EVENT_POOL_CACHE = 256;
+constexpr int ESL_EVENT_POOL_BATCH = 64;
+constexpr size_t ESL_EVENT_POOL_GLOBAL = 16'384;
+/* Arena blocks a pooled arena event keeps for its next use */
+constexpr size_t ESL_EVENT_POOL_ARENA_KEEP = 65'536;
+/* Header count from which lookups go through a hash index */
+constexpr esl_size_t ESL_EVENT_INDEX_THRESHOLD = 16;
+constexpr esl_size_t ESL_EVENT_INDEX_MIN_SIZE = 64;
+constexpr esl_ssize_t ESL_HASH_KEY_STRING = -1;
+/* Probe table over the interned names, a power of two above twice their
+ * number */
+constexpr size_t ESL_INTERN_SLOTS = 256;
 
 [[nodiscard]] static bool
 esl_string_len_within_limit(const char *s, size_t limit, size_t *out_len) {
@@ -88,6 +107,509 @@ static char *my_dup(const char *s) {
 #endif
 
 static void free_header(esl_event_header_t **header);
+static esl_status_t own_header(esl_event_t *event,
+                               esl_event_header_t *header);
+
+typedef struct esl_event_arena_block esl_event_arena_block_t;
+struct esl_event_arena_block {
+  esl_event_arena_block_t *next;
+  size_t size;
+};
+
+struct esl_event_arena {
+  /* free space left in the current block */
+  char *next;
+  char *end;
+  /* blocks after the first, newest first */
+  esl_event_arena_block_t *blocks;
+  /* blocks kept from an earlier use of a pooled event */
+  esl_event_arena_block_t *spare;
+  size_t block_size;
+  /* arena headers that picked up heap strings or arrays since, which
+   * esl_event_destroy has to visit */
+  size_t spilled;
+};
+
+/* Interned header names, indexed by esl_header_key_t. The hashes are what
+ * esl_ci_hashfunc_default gives for each name, worked out ahead of time. */
+typedef struct {
+  const char *name;
+  esl_size_t len;
+  unsigned int hash;
+} esl_intern_t;
+
+#define ESL_INTERN(key, str, h) [key] = {str, sizeof(str) - 1, h}
+static const esl_intern_t INTERNED[ESL_HDR_COUNT] = {
+    ESL_INTERN(ESL_HDR_EVENT_NAME, "Event-Name", 2768839824u),
+    ESL_INTERN(ESL_HDR_EVENT_SUBCLASS, "Event-Subclass", 510576879u),
+    ESL_INTERN(ESL_HDR_EVENT_SEQUENCE, "Event-Sequence", 1930065384u),
+    ESL_INTERN(ESL_HDR_EVENT_UUID, "Event-UUID", 2769113030u),
+    ESL_INTERN(ESL_HDR_EVENT_DATE_LOCAL, "Event-Date-Local", 3276964421u),
+    ESL_INTERN(ESL_HDR_EVENT_DATE_GMT, "Event-Date-GMT", 1829054946u),
+    ESL_INTERN(ESL_HDR_EVENT_DATE_TIMESTAMP, "Event-Date-Timestamp",
+               2010618926u),
+    ESL_INTERN(ESL_HDR_EVENT_CALLING_FILE, "Event-Calling-File", 2735080854u),
+    ESL_INTERN(ESL_HDR_EVENT_CALLING_FUNCTION, "Event-Calling-Function",
+               3147645756u),
+    ESL_INTERN(ESL_HDR_EVENT_CALLING_LINE_NUMBER, "Event-Calling-Line-Number",
+               2453474324u),
+    ESL_INTERN(ESL_HDR_CORE_UUID, "Core-UUID", 3005451533u),
+    ESL_INTERN(ESL_HDR_FREESWITCH_HOSTNAME, "FreeSWITCH-Hostname", 4277563264u),
+    ESL_INTERN(ESL_HDR_FREESWITCH_SWITCHNAME, "FreeSWITCH-Switchname",
+               317471124u),
+    ESL_INTERN(ESL_HDR_FREESWITCH_IPV4, "FreeSWITCH-IPv4", 1791458308u),
+    ESL_INTERN(ESL_HDR_FREESWITCH_IPV6, "FreeSWITCH-IPv6", 1791458310u),
+    ESL_INTERN(ESL_HDR_CONTENT_TYPE, "Content-Type", 2713895210u),
+    ESL_INTERN(ESL_HDR_CONTENT_LENGTH, "Content-Length", 157516714u),
+    ESL_INTERN(ESL_HDR_CONTENT_DISPOSITION, "Content-Disposition", 2584784573u),
+    ESL_INTERN(ESL_HDR_REPLY_TEXT, "Reply-Text", 3051083326u),
+    ESL_INTERN(ESL_HDR_JOB_UUID, "Job-UUID", 466387231u),
+    ESL_INTERN(ESL_HDR_JOB_COMMAND, "Job-Command", 3889275911u),
+    ESL_INTERN(ESL_HDR_JOB_COMMAND_ARG, "Job-Command-Arg", 10266702u),
+    ESL_INTERN(ESL_HDR_UNIQUE_ID, "Unique-ID", 1675647729u),
+    ESL_INTERN(ESL_HDR_OTHER_LEG_UNIQUE_ID, "Other-Leg-Unique-ID", 3094557989u),
+    ESL_INTERN(ESL_HDR_CHANNEL_STATE, "Channel-State", 128401639u),
+    ESL_INTERN(ESL_HDR_CHANNEL_STATE_NUMBER, "Channel-State-Number",
+               998056125u),
+    ESL_INTERN(ESL_HDR_CHANNEL_NAME, "Channel-Name", 2476550919u),
+    ESL_INTERN(ESL_HDR_CHANNEL_CALL_STATE, "Channel-Call-State", 2883918448u),
+    ESL_INTERN(ESL_HDR_CHANNEL_CALL_UUID, "Channel-Call-UUID", 2169873062u),
+    ESL_INTERN(ESL_HDR_CHANNEL_PRESENCE_ID, "Channel-Presence-ID", 1127734773u),
+    ESL_INTERN(ESL_HDR_CHANNEL_HIT_DIALPLAN, "Channel-HIT-Dialplan",
+               1673661629u),
+    ESL_INTERN(ESL_HDR_CHANNEL_READ_CODEC_NAME, "Channel-Read-Codec-Name",
+               3584934939u),
+    ESL_INTERN(ESL_HDR_CHANNEL_READ_CODEC_RATE, "Channel-Read-Codec-Rate",
+               3585078918u),
+    ESL_INTERN(ESL_HDR_CHANNEL_WRITE_CODEC_NAME, "Channel-Write-Codec-Name",
+               1856186602u),
+    ESL_INTERN(ESL_HDR_CHANNEL_WRITE_CODEC_RATE, "Channel-Write-Codec-Rate",
+               1856330581u),
+    ESL_INTERN(ESL_HDR_ANSWER_STATE, "Answer-State", 3211163102u),
+    ESL_INTERN(ESL_HDR_CALL_DIRECTION, "Call-Direction", 1046589354u),
+    ESL_INTERN(ESL_HDR_PRESENCE_CALL_DIRECTION, "Presence-Call-Direction",
+               4173246252u),
+    ESL_INTERN(ESL_HDR_HANGUP_CAUSE, "Hangup-Cause", 492445633u),
+    ESL_INTERN(ESL_HDR_APPLICATION, "Application", 1873133332u),
+    ESL_INTERN(ESL_HDR_APPLICATION_DATA, "Application-Data", 3122863131u),
+    ESL_INTERN(ESL_HDR_APPLICATION_RESPONSE, "Application-Response",
+               783634704u),
+    ESL_INTERN(ESL_HDR_APPLICATION_UUID, "Application-UUID", 3123495480u),
+    ESL_INTERN(ESL_HDR_CALLER_DIRECTION, "Caller-Direction", 484183265u),
+    ESL_INTERN(ESL_HDR_CALLER_USERNAME, "Caller-Username", 558248640u),
+    ESL_INTERN(ESL_HDR_CALLER_DIALPLAN, "Caller-Dialplan", 1700839621u),
+    ESL_INTERN(ESL_HDR_CALLER_CALLER_ID_NAME, "Caller-Caller-ID-Name",
+               950150267u),
+    ESL_INTERN(ESL_HDR_CALLER_CALLER_ID_NUMBER, "Caller-Caller-ID-Number",
+               3945208323u),
+    ESL_INTERN(ESL_HDR_CALLER_ORIG_CALLER_ID_NAME, "Caller-Orig-Caller-ID-Name",
+               1532729401u),
+    ESL_INTERN(ESL_HDR_CALLER_ORIG_CALLER_ID_NUMBER,
+               "Caller-Orig-Caller-ID-Number", 2718725441u),
+    ESL_INTERN(ESL_HDR_CALLER_CALLEE_ID_NAME, "Caller-Callee-ID-Name",
+               1313892206u),
+    ESL_INTERN(ESL_HDR_CALLER_CALLEE_ID_NUMBER, "Caller-Callee-ID-Number",
+               628221366u),
+    ESL_INTERN(ESL_HDR_CALLER_NETWORK_ADDR, "Caller-Network-Addr", 3429624114u),
+    ESL_INTERN(ESL_HDR_CALLER_ANI, "Caller-ANI", 3428231864u),
+    ESL_INTERN(ESL_HDR_CALLER_DESTINATION_NUMBER, "Caller-Destination-Number",
+               3490468440u),
+    ESL_INTERN(ESL_HDR_CALLER_UNIQUE_ID, "Caller-Unique-ID", 3738630769u),
+    ESL_INTERN(ESL_HDR_CALLER_SOURCE, "Caller-Source", 4232759857u),
+    ESL_INTERN(ESL_HDR_CALLER_CONTEXT, "Caller-Context", 3045244133u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_NAME, "Caller-Channel-Name", 172595847u),
+    ESL_INTERN(ESL_HDR_CALLER_PROFILE_INDEX, "Caller-Profile-Index",
+               2210587062u),
+    ESL_INTERN(ESL_HDR_CALLER_PROFILE_CREATED_TIME,
+               "Caller-Profile-Created-Time", 78038546u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_CREATED_TIME,
+               "Caller-Channel-Created-Time", 3029462874u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_ANSWERED_TIME,
+               "Caller-Channel-Answered-Time", 2090010875u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_PROGRESS_TIME,
+               "Caller-Channel-Progress-Time", 3564947351u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_PROGRESS_MEDIA_TIME,
+               "Caller-Channel-Progress-Media-Time", 190887108u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_HANGUP_TIME, "Caller-Channel-Hangup-Time",
+               315800133u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_TRANSFER_TIME,
+               "Caller-Channel-Transfer-Time", 199935655u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_RESURRECT_TIME,
+               "Caller-Channel-Resurrect-Time", 2975190881u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_BRIDGED_TIME,
+               "Caller-Channel-Bridged-Time", 4058405395u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_LAST_HOLD, "Caller-Channel-Last-Hold",
+               1619881838u),
+    ESL_INTERN(ESL_HDR_CALLER_CHANNEL_HOLD_ACCUM, "Caller-Channel-Hold-Accum",
+               2062107843u),
+    ESL_INTERN(ESL_HDR_CALLER_SCREEN_BIT, "Caller-Screen-Bit", 1043211244u),
+    ESL_INTERN(ESL_HDR_CALLER_PRIVACY_HIDE_NAME, "Caller-Privacy-Hide-Name",
+               2321718899u),
+    ESL_INTERN(ESL_HDR_CALLER_PRIVACY_HIDE_NUMBER, "Caller-Privacy-Hide-Number",
+               2934829563u),
+    ESL_INTERN(ESL_HDR_VARIABLE_UUID, "variable_uuid", 773929212u),
+    ESL_INTERN(ESL_HDR_VARIABLE_CALL_UUID, "variable_call_uuid", 1915018743u),
+    ESL_INTERN(ESL_HDR_VARIABLE_DIRECTION, "variable_direction", 109111686u),
+    ESL_INTERN(ESL_HDR_VARIABLE_SESSION_ID, "variable_session_id", 1893921141u),
+    ESL_INTERN(ESL_HDR_VARIABLE_CHANNEL_NAME, "variable_channel_name",
+               3186899518u),
+    ESL_INTERN(ESL_HDR_VARIABLE_SIP_CALL_ID, "variable_sip_call_id",
+               3694039320u),
+};
+#undef ESL_INTERN
+
+/* INTERNED index + 1 by hash, 0 for an empty slot */
+static uint8_t intern_slots[ESL_INTERN_SLOTS];
+static pthread_once_t intern_once = PTHREAD_ONCE_INIT;
+
+static unsigned int esl_ci_hashfunc_default(const char *char_key,
+                                            esl_ssize_t *klen);
+
+static void intern_init(void) {
+  for (int key = 0; key < ESL_HDR_COUNT; key++) {
+    esl_ssize_t len = ESL_HASH_KEY_STRING;
+    size_t i = INTERNED[key].hash & (ESL_INTERN_SLOTS - 1);
+
+    assert(esl_ci_hashfunc_default(INTERNED[key].name, &len) ==
+           INTERNED[key].hash);
+    while (intern_slots[i]) {
+      i = (i + 1) & (ESL_INTERN_SLOTS - 1);
+    }
+    intern_slots[i] = (uint8_t)(key + 1);
+  }
+}
+
+/* The interned copy of a name, matched with its case, or nullptr. */
+static const esl_intern_t *intern_find(const char *name, esl_size_t len,
+                                       unsigned long hash) {
+  pthread_once(&intern_once, intern_init);
+
+  for (size_t i = hash & (ESL_INTERN_SLOTS - 1); intern_slots[i];
+       i = (i + 1) & (ESL_INTERN_SLOTS - 1)) {
+    const esl_intern_t *in = &INTERNED[intern_slots[i] - 1];
+
+    if (in->hash == hash && in->len == len && !memcmp(in->name, name, len)) {
+      return in;
+    }
+  }
+
+  return nullptr;
+}
+
+static void *arena_alloc(esl_event_arena_t *arena, size_t size,
+                         size_t align) {
+  auto at = ((uintptr_t)arena->next + align - 1) & ~(uintptr_t)(align - 1);
+
+  if (at > (uintptr_t)arena->end || size > (uintptr_t)arena->end - at) {
+    esl_event_arena_block_t *block, **sp;
+    size_t block_size = arena->block_size * 2;
+    const size_t need = sizeof(*block) + align + size;
+
+    if (size > SIZE_MAX - sizeof(*block) - align) {
+      return nullptr;
+    }
+    for (sp = &arena->spare; *sp && (*sp)->size < need; sp = &(*sp)->next) {
+    }
+    if ((block = *sp) != nullptr) {
+      *sp = block->next;
+      block_size = block->size;
+    } else {
+      while (block_size < need) {
+        block_size = block_size > SIZE_MAX / 2 ? need : block_size * 2;
+      }
+      if ((block = malloc(block_size)) == nullptr) {
+        return nullptr;
+      }
+      block->size = block_size;
+    }
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->block_size = block_size;
+    arena->next = (char *)(block + 1);
+    arena->end = (char *)block + block_size;
+    at = ((uintptr_t)arena->next + align - 1) & ~(uintptr_t)(align - 1);
+  }
+
+  arena->next = (char *)at + size;
+  return (void *)at;
+}
+
+static void arena_free_blocks(esl_event_arena_block_t *block) {
+  esl_event_arena_block_t *next;
+
+  while (block) {
+    next = block->next;
+    free(block);
+    block = next;
+  }
+}
+
+/* Event pool: per-thread free lists, one per object class, that trade
+ * batches with a mutex-protected overflow list. */
+typedef enum {
+  POOL_EVENT,
+  POOL_ARENA_EVENT,
+  POOL_HEADER,
+  POOL_STRING_16,
+  POOL_STRING_32,
+  POOL_STRING_64,
+  POOL_CLASSES
+} pool_class_t;
+
+static constexpr size_t POOL_SIZES[POOL_CLASSES] = {
+    [POOL_EVENT] = sizeof(esl_event_t),
+    [POOL_ARENA_EVENT] = sizeof(esl_event_t) + sizeof(esl_event_arena_t) +
+                         ESL_EVENT_ARENA_FIRST_BLOCK,
+    [POOL_HEADER] = sizeof(esl_event_header_t),
+    [POOL_STRING_16] = 16,
+    [POOL_STRING_32] = 32,
+    [POOL_STRING_64] = 64};
+
+typedef struct pool_node pool_node_t;
+struct pool_node {
+  pool_node_t *next;
+};
+
+typedef struct {
+  pool_node_t *head[POOL_CLASSES];
+  int count[POOL_CLASSES];
+  bool registered;
+} pool_cache_t;
+
+static struct {
+  pthread_mutex_t lock;
+  pool_node_t *head[POOL_CLASSES];
+  size_t count[POOL_CLASSES];
+} pool_global = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static thread_local pool_cache_t pool_cache;
+static _Atomic bool pool_enabled;
+static _Atomic uint64_t pool_hits[POOL_CLASSES];
+static _Atomic uint64_t pool_misses[POOL_CLASSES];
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+static bool pool_key_ok;
+
+static void pool_release(pool_class_t cls, pool_node_t *node) {
+  if (cls == POOL_ARENA_EVENT) {
+    arena_free_blocks(((esl_event_arena_t *)((esl_event_t *)node + 1))->spare);
+  }
+  free(node);
+}
+
+/* Move up to count objects of a class from a thread cache to the overflow
+ * list, releasing any the list has no room for. */
+static void pool_spill(pool_cache_t *cache, pool_class_t cls, int count) {
+  pool_node_t *node;
+
+  pthread_mutex_lock(&pool_global.lock);
+  while (count-- > 0 && (node = cache->head[cls]) != nullptr) {
+    cache->head[cls] = node->next;
+    cache->count[cls]--;
+    if (pool_global.count[cls] < ESL_EVENT_POOL_GLOBAL) {
+      node->next = pool_global.head[cls];
+      pool_global.head[cls] = node;
+      pool_global.count[cls]++;
+    } else {
+      pool_release(cls, node);
+    }
+  }
+  pthread_mutex_unlock(&pool_global.lock);
+}
+
+static void pool_thread_exit(void *data) {
+  pool_cache_t *cache = data;
+
+  for (int cls = 0; cls < POOL_CLASSES; cls++) {
+    pool_spill(cache, (pool_class_t)cls, cache->count[cls]);
+  }
+}
+
+static void pool_key_create(void) {
+  pool_key_ok = pthread_key_create(&pool_key, pool_thread_exit) == 0;
+}
+
+static void *pool_get(pool_class_t cls) {
+  pool_cache_t *cache = &pool_cache;
+  pool_node_t *node;
+
+  if (!atomic_load_explicit(&pool_enabled, memory_order_relaxed)) {
+    return nullptr;
+  }
+
+  if (cache->head[cls] == nullptr) {
+    pthread_mutex_lock(&pool_global.lock);
+    for (int i = 0; i < ESL_EVENT_POOL_BATCH &&
+                    (node = pool_global.head[cls]) != nullptr;
+         i++) {
+      pool_global.head[cls] = node->next;
+      pool_global.count[cls]--;
+      node->next = cache->head[cls];
+      cache->head[cls] = node;
+      cache->count[cls]++;
+    }
+    pthread_mutex_unlock(&pool_global.lock);
+  }
+
+  if ((node = cache->head[cls]) == nullptr) {
+    atomic_fetch_add_explicit(&pool_misses[cls], 1, memory_order_relaxed);
+    return nullptr;
+  }
+  cache->head[cls] = node->next;
+  cache->count[cls]--;
+  atomic_fetch_add_explicit(&pool_hits[cls], 1, memory_order_relaxed);
+
+  return node;
+}
+
+/* Keep an object for reuse. Returns false when the pool is off and the
+ * caller should free it. */
+static bool pool_put(pool_class_t cls, void *object) {
+  pool_cache_t *cache = &pool_cache;
+  pool_node_t *node = object;
+
+  if (!atomic_load_explicit(&pool_enabled, memory_order_relaxed)) {
+    return false;
+  }
+
+  if (!cache->registered) {
+    /* hand the cache back to the overflow list when the thread exits */
+    pthread_once(&pool_key_once, pool_key_create);
+    if (!pool_key_ok || pthread_setspecific(pool_key, cache) != 0) {
+      return false;
+    }
+    cache->registered = true;
+  }
+
+  node->next = cache->head[cls];
+  cache->head[cls] = node;
+  if (++cache->count[cls] > ESL_EVENT_POOL_CACHE) {
+    pool_spill(cache, cls, ESL_EVENT_POOL_BATCH);
+  }
+
+  return true;
+}
+
+[[nodiscard]] static pool_class_t pool_string_class(size_t size) {
+  if (size <= POOL_SIZES[POOL_STRING_16]) {
+    return POOL_STRING_16;
+  }
+  if (size <= POOL_SIZES[POOL_STRING_32]) {
+    return POOL_STRING_32;
+  }
+  if (size <= POOL_SIZES[POOL_STRING_64]) {
+    return POOL_STRING_64;
+  }
+  return POOL_CLASSES;
+}
+
+/* Copy a header name, into a pooled string slab when the pool is on and the
+ * name is short. */
+static char *dup_name(esl_event_header_t *header, const char *name) {
+  const size_t size = strlen(name) + 1;
+  const pool_class_t cls = pool_string_class(size);
+  char *copy;
+
+  if (cls == POOL_CLASSES ||
+      !atomic_load_explicit(&pool_enabled, memory_order_relaxed)) {
+    return DUP(name);
+  }
+  if ((copy = pool_get(cls)) == nullptr &&
+      (copy = malloc(POOL_SIZES[cls])) == nullptr) {
+    return nullptr;
+  }
+  header->flags |= ESL_HF_POOLED;
+
+  return memcpy(copy, name, size);
+}
+
+static void free_name(esl_event_header_t *header) {
+  if (header->flags & ESL_HF_INTERNED) {
+    header->name = nullptr;
+    return;
+  }
+  if (header->name && (header->flags & ESL_HF_POOLED) &&
+      pool_put(pool_string_class(strlen(header->name) + 1), header->name)) {
+    header->name = nullptr;
+    return;
+  }
+  FREE(header->name);
+}
+
+ESL_DECLARE(void) esl_event_pool_enable(bool enable) {
+  atomic_store_explicit(&pool_enabled, enable, memory_order_relaxed);
+}
+
+ESL_DECLARE(void) esl_event_pool_trim(void) {
+  pool_cache_t *cache = &pool_cache;
+  pool_node_t *node;
+
+  pthread_mutex_lock(&pool_global.lock);
+  for (int cls = 0; cls < POOL_CLASSES; cls++) {
+    while ((node = cache->head[cls]) != nullptr) {
+      cache->head[cls] = node->next;
+      pool_release((pool_class_t)cls, node);
+    }
+    cache->count[cls] = 0;
+    while ((node = pool_global.head[cls]) != nullptr) {
+      pool_global.head[cls] = node->next;
+      pool_release((pool_class_t)cls, node);
+    }
+    pool_global.count[cls] = 0;
+  }
+  pthread_mutex_unlock(&pool_global.lock);
+}
+
+ESL_DECLARE(void) esl_event_pool_get_stats(esl_event_pool_stats_t *stats) {
+  if (stats == nullptr) {
+    return;
+  }
+
+  *stats = (esl_event_pool_stats_t){
+      .event_hits = atomic_load(&pool_hits[POOL_EVENT]) +
+                    atomic_load(&pool_hits[POOL_ARENA_EVENT]),
+      .event_misses = atomic_load(&pool_misses[POOL_EVENT]) +
+                      atomic_load(&pool_misses[POOL_ARENA_EVENT]),
+      .header_hits = atomic_load(&pool_hits[POOL_HEADER]),
+      .header_misses = atomic_load(&pool_misses[POOL_HEADER])};
+  for (int cls = POOL_STRING_16; cls <= POOL_STRING_64; cls++) {
+    stats->string_hits += atomic_load(&pool_hits[cls]);
+    stats->string_misses += atomic_load(&pool_misses[cls]);
+  }
+}
+
+static esl_event_header_t *alloc_header(esl_event_t *event) {
+  esl_event_header_t *header;
+
+  if (event && event->arena) {
+    header = arena_alloc(event->arena, sizeof(*header),
+                         alignof(esl_event_header_t));
+    if (header) {
+      memset(header, 0, sizeof(*header));
+      header->flags = ESL_HF_ARENA;
+    }
+    return header;
+  }
+
+  if ((header = pool_get(POOL_HEADER)) == nullptr) {
+    header = ALLOC(sizeof(*header));
+  }
+
+  if (header) {
+    memset(header, 0, sizeof(*header));
+  }
+  return header;
+}
+
+/* Headers the borrowed and arena paths can simply append. */
+[[nodiscard]] static bool plain_header(esl_event_t *event,
+                                       const char *header_name,
+                                       esl_size_t name_len, const char *value,
+                                       esl_size_t value_len) {
+  return value_len != 0 && !esl_test_flag(event, ESL_EF_UNIQ_HEADERS) &&
+         strcmp(header_name, "_body") != 0 &&
+         !memchr(header_name, '[', name_len) && !strstr(value, "ARRAY::");
+}
 
 /* make sure this is synced with the esl_event_types_t enum in esl_types.h
    also never put any new ones before EVENT_ALL
@@ -186,6 +708,85 @@ static const char *EVENT_NAMES[] = {"CUSTOM",
                                     "SHUTDOWN_REQUESTED",
                                     "ALL"};
 
+/* Minimal perfect hashes over EVENT_NAMES and CONTENT_TYPES. A name is keyed
+ * by its length and four case-folded bytes, the key picks a bucket, and the
+ * bucket's displacement spreads its names over distinct slots, so a lookup is
+ * one hash and one strcasecmp against the only candidate. The tables were
+ * searched for ahead of time and have to be searched again whenever either
+ * list changes; run_test_name_event_lookup checks every entry round-trips. */
+constexpr unsigned ESL_EVENT_NAME_BUCKET_BITS = 5;
+constexpr unsigned ESL_CONTENT_TYPE_BUCKET_BITS = 2;
+
+static const uint8_t EVENT_NAME_DISP[1U << ESL_EVENT_NAME_BUCKET_BITS] = {
+    5, 2, 1, 2, 10, 7, 32, 10, 16, 52, 3, 10, 0, 22, 34, 13, 22, 20, 1, 0, 6, 5,
+    0, 6, 25, 29, 1, 33, 55, 11, 0, 227,
+};
+
+/* esl_event_types_t by slot */
+static const uint8_t EVENT_NAME_SLOTS[] = {
+    19, 65, 23, 52, 70, 46, 71, 27, 31, 86, 41, 72, 39, 68, 8, 64, 92, 63, 50,
+    60, 51, 79, 80, 24, 78, 11, 74, 6, 26, 53, 21, 88, 13, 28, 59, 47, 14, 40,
+    18, 2, 29, 22, 76, 15, 58, 3, 54, 87, 66, 69, 5, 4, 67, 37, 77, 34, 90, 43,
+    57, 33, 49, 44, 56, 20, 16, 75, 61, 82, 85, 0, 45, 32, 10, 73, 83, 91, 35,
+    1, 9, 89, 30, 55, 17, 48, 81, 62, 84, 7, 42, 25, 12, 38, 36,
+};
+
+static_assert(sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]) ==
+                  ESL_EVENT_ALL + 1,
+              "EVENT_NAMES is out of sync with esl_event_types_t");
+static_assert(sizeof(EVENT_NAME_SLOTS) == ESL_EVENT_ALL + 1,
+              "EVENT_NAME_SLOTS is out of sync with EVENT_NAMES");
+
+static const char *CONTENT_TYPES[ESL_CT_COUNT] = {
+    [ESL_CT_AUTH_REQUEST] = "auth/request",
+    [ESL_CT_API_RESPONSE] = "api/response",
+    [ESL_CT_COMMAND_REPLY] = "command/reply",
+    [ESL_CT_TEXT_EVENT_PLAIN] = "text/event-plain",
+    [ESL_CT_TEXT_EVENT_JSON] = "text/event-json",
+    [ESL_CT_TEXT_EVENT_XML] = "text/event-xml",
+    [ESL_CT_TEXT_DISCONNECT_NOTICE] = "text/disconnect-notice",
+    [ESL_CT_TEXT_RUDE_REJECTION] = "text/rude-rejection",
+    [ESL_CT_LOG_DATA] = "log/data",
+};
+
+static const uint8_t CONTENT_TYPE_DISP[1U << ESL_CONTENT_TYPE_BUCKET_BITS] = {
+    0, 2, 3, 31,
+};
+
+/* esl_content_type_t by slot */
+static const uint8_t CONTENT_TYPE_SLOTS[ESL_CT_COUNT - 1] = {
+    6, 2, 3, 1, 8, 9, 4, 5, 7,
+};
+
+/* The slot a name of at least two bytes hashes to in a table of count. */
+static size_t name_slot(const char *name, size_t len, const uint8_t *disp,
+                        unsigned bits, size_t count) {
+  const auto s = (const unsigned char *)name;
+  const uint32_t key = ((uint32_t)(s[0] | 0x20) |
+                        (uint32_t)(s[len / 2] | 0x20) << 8 |
+                        (uint32_t)(s[len - 1] | 0x20) << 16 |
+                        (uint32_t)(s[len - 2] | 0x20) << 24) ^
+                       (uint32_t)len;
+  const uint32_t h = key * 0x9E37'79B1U;
+
+  return (((h ^ disp[h >> (32 - bits)]) * 0x85EB'CA6BU) >> 16) % count;
+}
+
+/* The event id whose name matches, or -1. */
+static int event_name_find(const char *name, size_t len) {
+  uint8_t id;
+
+  if (len < 2) {
+    return -1;
+  }
+
+  id = EVENT_NAME_SLOTS[name_slot(name, len, EVENT_NAME_DISP,
+                                  ESL_EVENT_NAME_BUCKET_BITS,
+                                  sizeof(EVENT_NAME_SLOTS))];
+
+  return strcasecmp(name, EVENT_NAMES[id]) ? -1 : id;
+}
+
 ESL_DECLARE(const char *) esl_event_name(esl_event_types_t event) {
   if (event < ESL_EVENT_CUSTOM || event > ESL_EVENT_ALL) {
     return "INVALID";
@@ -195,26 +796,50 @@ ESL_DECLARE(const char *) esl_event_name(esl_event_types_t event) {
 
 ESL_DECLARE(esl_status_t)
 esl_name_event(const char *name, esl_event_types_t *type) {
-  esl_event_types_t x;
+  size_t len;
+  int x, tail = -1;
 
   if (name == nullptr || type == nullptr) {
     return ESL_FAIL;
   }
 
-  for (x = 0; x <= ESL_EVENT_ALL; x++) {
-    if ((strlen(name) > 13 && !strcasecmp(name + 13, EVENT_NAMES[x])) ||
-        !strcasecmp(name, EVENT_NAMES[x])) {
-      *type = x;
-      return ESL_SUCCESS;
-    }
+  /* skip a SWITCH_EVENT_ prefix, the lower id winning if both forms match */
+  len = strlen(name);
+  x = event_name_find(name, len);
+  if (len > 13) {
+    tail = event_name_find(name + 13, len - 13);
+  }
+  if (tail >= 0 && (x < 0 || tail < x)) {
+    x = tail;
   }
 
-  return ESL_FAIL;
+  if (x < 0) {
+    return ESL_FAIL;
+  }
+
+  *type = (esl_event_types_t)x;
+  return ESL_SUCCESS;
 }
 
-ESL_DECLARE(esl_status_t)
-esl_event_create_subclass(esl_event_t **event, esl_event_types_t event_id,
-                          const char *subclass_name) {
+ESL_DECLARE(esl_content_type_t) esl_content_type(const char *value) {
+  size_t len;
+  uint8_t ct;
+
+  if (value == nullptr || (len = strlen(value)) < 2) {
+    return ESL_CT_UNKNOWN;
+  }
+
+  ct = CONTENT_TYPE_SLOTS[name_slot(value, len, CONTENT_TYPE_DISP,
+                                    ESL_CONTENT_TYPE_BUCKET_BITS,
+                                    sizeof(CONTENT_TYPE_SLOTS))];
+
+  return strcasecmp(value, CONTENT_TYPES[ct]) ? ESL_CT_UNKNOWN
+                                              : (esl_content_type_t)ct;
+}
+
+static esl_status_t event_create(esl_event_t **event,
+                                 esl_event_types_t event_id,
+                                 const char *subclass_name, bool arena) {
   if (event == nullptr) {
     return ESL_FAIL;
   }
@@ -226,12 +851,32 @@ esl_event_create_subclass(esl_event_t **event, esl_event_types_t event_id,
     return ESL_FAIL;
   }
 
-  *event = ALLOC(sizeof(esl_event_t));
-  if (*event == nullptr) {
-    return ESL_FAIL;
-  }
+  if (arena) {
+    /* the event, its arena and the first block are one allocation */
+    const size_t size = sizeof(esl_event_t) + sizeof(esl_event_arena_t);
+    esl_event_arena_block_t *spare = nullptr;
 
-  memset(*event, 0, sizeof(esl_event_t));
+    if ((*event = pool_get(POOL_ARENA_EVENT)) != nullptr) {
+      spare = ((esl_event_arena_t *)(*event + 1))->spare;
+    } else if ((*event = malloc(POOL_SIZES[POOL_ARENA_EVENT])) == nullptr) {
+      return ESL_FAIL;
+    }
+    memset(*event, 0, size);
+    (*event)->arena = (esl_event_arena_t *)(*event + 1);
+    (*event)->arena->next = (char *)*event + size;
+    (*event)->arena->end = (*event)->arena->next + ESL_EVENT_ARENA_FIRST_BLOCK;
+    (*event)->arena->block_size = ESL_EVENT_ARENA_FIRST_BLOCK;
+    (*event)->arena->spare = spare;
+  } else {
+    if ((*event = pool_get(POOL_EVENT)) == nullptr) {
+      *event = ALLOC(sizeof(esl_event_t));
+    }
+    if (*event == nullptr) {
+      return ESL_FAIL;
+    }
+
+    memset(*event, 0, sizeof(esl_event_t));
+  }
 
   if (event_id != ESL_EVENT_CLONE) {
     (*event)->event_id = event_id;
@@ -259,6 +904,18 @@ esl_event_create_subclass(esl_event_t **event, esl_event_types_t event_id,
   return ESL_SUCCESS;
 }
 
+ESL_DECLARE(esl_status_t)
+esl_event_create_subclass(esl_event_t **event, esl_event_types_t event_id,
+                          const char *subclass_name) {
+  return event_create(event, event_id, subclass_name, false);
+}
+
+ESL_DECLARE(esl_status_t)
+esl_event_create_arena(esl_event_t **event, esl_event_types_t event_id,
+                       const char *subclass_name) {
+  return event_create(event, event_id, subclass_name, true);
+}
+
 ESL_DECLARE(const char *) esl_priority_name(esl_priority_t priority) {
   switch (priority) { /*lol */
   case ESL_PRIORITY_NORMAL:
@@ -283,7 +940,6 @@ esl_event_set_priority(esl_event_t *event, esl_priority_t priority) {
                                      esl_priority_name(priority));
 }
 
-constexpr esl_ssize_t ESL_HASH_KEY_STRING = -1;
 constexpr int ESL_EVENT_HEADER_INDEX_MAX = 4'000;
 
 [[nodiscard]] static bool esl_parse_event_header_index(const char *expr,
@@ -333,25 +989,171 @@ static unsigned int esl_ci_hashfunc_default(const char *char_key,
   return hash;
 }
 
-ESL_DECLARE(esl_event_header_t *)
-esl_event_get_header_ptr(esl_event_t *event, const char *header_name) {
+/* Marks an index slot whose header was deleted; probing continues past it. */
+static esl_event_header_t index_deleted;
+
+/* The slot holding the first header called name, or if there is none, the
+ * slot where it would go. */
+static esl_event_header_t **index_find(esl_event_t *event, const char *name,
+                                       unsigned long hash) {
+  const esl_size_t mask = event->index_size - 1;
+  esl_event_header_t **reuse = nullptr;
+
+  for (esl_size_t i = hash & mask;; i = (i + 1) & mask) {
+    esl_event_header_t **slot = &event->index[i];
+
+    if (*slot == nullptr) {
+      return reuse ? reuse : slot;
+    }
+    if (*slot == &index_deleted) {
+      if (reuse == nullptr) {
+        reuse = slot;
+      }
+    } else if ((*slot)->hash == hash &&
+               ((*slot)->name == name || !strcasecmp((*slot)->name, name))) {
+      return slot;
+    }
+  }
+}
+
+[[nodiscard]] static bool index_found(esl_event_header_t **slot) {
+  return *slot != nullptr && *slot != &index_deleted;
+}
+
+/* (Re)build the index from the header list, which keeps the first header of
+ * each name. On failure the event goes back to walking its list. */
+static bool index_build(esl_event_t *event) {
   esl_event_header_t *hp;
-  esl_ssize_t hlen = -1;
-  unsigned long hash = 0;
+  esl_size_t size = ESL_EVENT_INDEX_MIN_SIZE;
 
-  if (event == nullptr || header_name == nullptr)
-    return nullptr;
+  FREE(event->index);
+  event->index = nullptr;
+  event->index_size = event->index_used = 0;
 
-  hash = esl_ci_hashfunc_default(header_name, &hlen);
+  while (size < event->header_count * 2) {
+    if (size > SIZE_MAX / 2 / sizeof(*event->index)) {
+      return false;
+    }
+    size *= 2;
+  }
+  if ((event->index = calloc(size, sizeof(*event->index))) == nullptr) {
+    return false;
+  }
+  event->index_size = size;
+
+  for (hp = event->headers; hp; hp = hp->next) {
+    esl_event_header_t **slot = index_find(event, hp->name, hp->hash);
+
+    if (!index_found(slot)) {
+      *slot = hp;
+      event->index_used++;
+    }
+  }
+
+  return true;
+}
+
+/* Account for a header just linked into the list, at its head when top. */
+static void index_add(esl_event_t *event, esl_event_header_t *header,
+                      bool top) {
+  esl_event_header_t **slot;
+
+  event->header_count++;
+  if (event->index == nullptr) {
+    return;
+  }
+
+  if ((event->index_used + 1) * 4 > event->index_size * 3) {
+    (void)index_build(event);
+    return;
+  }
+
+  slot = index_find(event, header->name, header->hash);
+  if (!index_found(slot)) {
+    if (*slot == nullptr) {
+      event->index_used++;
+    }
+    *slot = header;
+  } else if (top) {
+    *slot = header;
+  }
+}
+
+/* Account for a header about to be freed. Its next pointer still leads to
+ * the rest of the list, where the next header of the same name is found. */
+static void index_remove(esl_event_t *event, esl_event_header_t *header) {
+  esl_event_header_t **slot, *hp;
+
+  event->header_count--;
+  if (event->index == nullptr) {
+    return;
+  }
+
+  slot = index_find(event, header->name, header->hash);
+  if (*slot != header) {
+    return;
+  }
+  for (hp = header->next; hp; hp = hp->next) {
+    if (hp->hash == header->hash && !strcasecmp(hp->name, header->name)) {
+      break;
+    }
+  }
+  *slot = hp ? hp : &index_deleted;
+}
+
+static esl_event_header_t *find_header(esl_event_t *event,
+                                       const char *header_name,
+                                       unsigned long hash) {
+  esl_event_header_t *hp;
+
+  if (event->index ||
+      (event->header_count >= ESL_EVENT_INDEX_THRESHOLD &&
+       index_build(event))) {
+    esl_event_header_t **slot = index_find(event, header_name, hash);
+
+    return index_found(slot) ? *slot : nullptr;
+  }
 
   for (hp = event->headers; hp; hp = hp->next) {
-    if ((!hp->hash || hash == hp->hash) && !strcasecmp(hp->name, header_name)) {
+    if ((!hp->hash || hash == hp->hash) &&
+        (hp->name == header_name || !strcasecmp(hp->name, header_name))) {
       return hp;
     }
   }
   return nullptr;
 }
 
+ESL_DECLARE(esl_event_header_t *)
+esl_event_get_header_ptr(esl_event_t *event, const char *header_name) {
+  esl_ssize_t hlen = -1;
+
+  if (event == nullptr || header_name == nullptr)
+    return nullptr;
+
+  return find_header(event, header_name,
+                     esl_ci_hashfunc_default(header_name, &hlen));
+}
+
+ESL_DECLARE(esl_event_header_t *)
+esl_event_get_header_key_ptr(esl_event_t *event, esl_header_key_t key) {
+  if (event == nullptr || (unsigned)key >= ESL_HDR_COUNT) {
+    return nullptr;
+  }
+
+  return find_header(event, INTERNED[key].name, INTERNED[key].hash);
+}
+
+ESL_DECLARE(char *)
+esl_event_get_header_key(esl_event_t *event, esl_header_key_t key) {
+  esl_event_header_t *hp = esl_event_get_header_key_ptr(event, key);
+
+  return hp ? hp->value : nullptr;
+}
+
+ESL_DECLARE(const char *) esl_header_key_name(esl_header_key_t key) {
+  return (unsigned)key < ESL_HDR_COUNT ? INTERNED[key].name : nullptr;
+}
+
 ESL_DECLARE(char *)
 esl_event_get_header_idx(esl_event_t *event, const char *header_name, int idx) {
   esl_event_header_t *hp;
@@ -377,6 +1179,102 @@ esl_event_get_header_idx(esl_event_t *event, const char *header_name, int idx) {
   return nullptr;
 }
 
+ESL_DECLARE(bool)
+esl_event_get_header_view(esl_event_t *event, const char *header_name,
+                          esl_header_view_t *view) {
+  esl_event_header_t *hp;
+
+  if (view == nullptr ||
+      (hp = esl_event_get_header_ptr(event, header_name)) == nullptr) {
+    return false;
+  }
+
+  view->name = hp->name;
+  view->value = hp->value;
+
+  if (hp->flags & ESL_HF_BORROWED) {
+    view->name_len = hp->name_len;
+    view->value_len = hp->value_len;
+  } else {
+    view->name_len = strlen(hp->name);
+    view->value_len = hp->value ? strlen(hp->value) : 0;
+  }
+
+  return true;
+}
+
+static esl_status_t append_borrowed(esl_event_t *event, char *header_name,
+                                    esl_size_t name_len, unsigned long hash,
+                                    char *value, esl_size_t value_len) {
+  esl_event_header_t *header;
+  const esl_intern_t *in;
+
+  if ((header = alloc_header(event)) == nullptr) {
+    return ESL_FAIL;
+  }
+
+  header->name = header_name;
+  header->name_len = name_len;
+  header->value = value;
+  header->value_len = value_len;
+  header->flags |= ESL_HF_BORROWED;
+  header->hash = hash;
+  if ((in = intern_find(header_name, name_len, hash)) != nullptr) {
+    header->name = (char *)in->name;
+    header->flags |= ESL_HF_INTERNED;
+  }
+
+  if (event->last_header) {
+    event->last_header->next = header;
+  } else {
+    event->headers = header;
+  }
+  event->last_header = header;
+  index_add(event, header, false);
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_event_add_header_borrowed(esl_event_t *event, char *header_name,
+                              esl_size_t name_len, char *value,
+                              esl_size_t value_len) {
+  esl_ssize_t hlen = (esl_ssize_t)name_len;
+
+  if (event == nullptr || header_name == nullptr || value == nullptr) {
+    return ESL_FAIL;
+  }
+
+  /* anything beyond a plain append takes the copying path */
+  if (!plain_header(event, header_name, name_len, value, value_len)) {
+    return esl_event_add_header_string(event, ESL_STACK_BOTTOM, header_name,
+                                       value);
+  }
+
+  return append_borrowed(event, header_name, name_len,
+                         esl_ci_hashfunc_default(header_name, &hlen), value,
+                         value_len);
+}
+
+ESL_DECLARE(esl_status_t) esl_event_materialize(esl_event_t *event) {
+  esl_event_header_t *hp;
+
+  if (event == nullptr) {
+    return ESL_FAIL;
+  }
+
+  for (hp = event->headers; hp; hp = hp->next) {
+    if (own_header(event, hp) != ESL_SUCCESS) {
+      return ESL_FAIL;
+    }
+  }
+
+  FREE(event->header_block);
+  event->header_block = nullptr;
+
+  return ESL_SUCCESS;
+}
+
 ESL_DECLARE(char *) esl_event_get_body(esl_event_t *event) {
   return (event ? event->body : nullptr);
 }
@@ -394,6 +1292,14 @@ esl_event_del_header_val(esl_event_t *event, const char *header_name,
     return ESL_FAIL;
   }
 
+  hash = esl_ci_hashfunc_default(header_name, &hlen);
+
+  /* nothing by that name, no need to walk the list */
+  if (event->index &&
+      !index_found(index_find(event, header_name, hash))) {
+    return status;
+  }
+
   tp = event->headers;
   while (tp) {
     hp = tp;
@@ -401,7 +1307,6 @@ esl_event_del_header_val(esl_event_t *event, const char *header_name,
 
     x++;
     esl_assert(x < 1000000);
-    hash = esl_ci_hashfunc_default(header_name, &hlen);
 
     if ((!hp->hash || hash == hp->hash) &&
         (hp->name && !strcasecmp(header_name, hp->name)) &&
@@ -415,6 +1320,7 @@ esl_event_del_header_val(esl_event_t *event, const char *header_name,
         event->last_header = lp;
       }
 
+      index_remove(event, hp);
       free_header(&hp);
       status = ESL_SUCCESS;
     } else {
@@ -425,38 +1331,71 @@ esl_event_del_header_val(esl_event_t *event, const char *header_name,
   return status;
 }
 
-static esl_event_header_t *new_header(const char *header_name) {
+static esl_event_header_t *new_header(esl_event_t *event,
+                                      const char *header_name) {
   esl_event_header_t *header;
+  esl_ssize_t hlen = ESL_HASH_KEY_STRING;
+  const unsigned long hash = esl_ci_hashfunc_default(header_name, &hlen);
+  const esl_intern_t *in = intern_find(header_name, (esl_size_t)hlen, hash);
 
-#ifdef ESL_EVENT_RECYCLE
-  void *pop;
-  if (esl_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == ESL_SUCCESS) {
-    header = (esl_event_header_t *)pop;
-  } else {
-#endif
-    header = ALLOC(sizeof(*header));
-#ifdef ESL_EVENT_RECYCLE
-  }
-#endif
-
-  if (header == nullptr) {
+  if ((header = alloc_header(event)) == nullptr) {
     return nullptr;
   }
-  memset(header, 0, sizeof(*header));
-  header->name = DUP(header_name);
-  if (header->name == nullptr) {
-    FREE(header);
+  if (in) {
+    header->name = (char *)in->name;
+    header->flags |= ESL_HF_INTERNED;
+  } else if ((header->name = dup_name(header, header_name)) == nullptr) {
+    free_header(&header);
     return nullptr;
   }
+  /* the value this header gets is a heap string */
+  if (header->flags & ESL_HF_ARENA) {
+    event->arena->spilled++;
+  }
 
   return header;
 }
 
+/* Replace borrowed name and value pointers with owned copies so the header
+ * can be changed or outlive its event's header block. */
+static esl_status_t own_header(esl_event_t *event,
+                               esl_event_header_t *header) {
+  char *name, *value = nullptr;
+
+  if (!(header->flags & ESL_HF_BORROWED)) {
+    return ESL_SUCCESS;
+  }
+
+  if ((value = header->value) && (value = DUP(value)) == nullptr) {
+    return ESL_FAIL;
+  }
+  if ((header->flags & ESL_HF_INTERNED)) {
+    name = header->name;
+  } else if ((name = dup_name(header, header->name)) == nullptr) {
+    FREE(value);
+    return ESL_FAIL;
+  }
+
+  header->name = name;
+  header->value = value;
+  header->flags &= ~ESL_HF_BORROWED;
+  if (header->flags & ESL_HF_ARENA) {
+    event->arena->spilled++;
+  }
+
+  return ESL_SUCCESS;
+}
+
 static void free_header(esl_event_header_t **header) {
   assert(header);
 
   if (*header) {
-    FREE((*header)->name);
+    if ((*header)->flags & ESL_HF_BORROWED) {
+      (*header)->name = nullptr;
+      (*header)->value = nullptr;
+    }
+
+    free_name(*header);
 
     if ((*header)->idx) {
       int i = 0;
@@ -469,13 +1408,16 @@ static void free_header(esl_event_header_t **header) {
 
     FREE((*header)->value);
 
-#ifdef ESL_EVENT_RECYCLE
-    if (esl_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, *header) != ESL_SUCCESS) {
+    if ((*header)->flags & ESL_HF_ARENA) {
+      /* released with the event's arena */
+      *header = nullptr;
+      return;
+    }
+
+    if (!pool_put(POOL_HEADER, *header)) {
       FREE(*header);
     }
-#else
-    FREE(*header);
-#endif
+    *header = nullptr;
   }
 }
 
@@ -577,7 +1519,7 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event,
 
     if (!(header = esl_event_get_header_ptr(event, header_name)) && index_ptr) {
 
-      tmp_header = header = new_header(header_name);
+      tmp_header = header = new_header(event, header_name);
       if (header == nullptr) {
         goto fail;
       }
@@ -591,6 +1533,9 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event,
     }
 
     if (header || (header = esl_event_get_header_ptr(event, header_name))) {
+      if (own_header(event, header) != ESL_SUCCESS) {
+        goto fail;
+      }
 
       if (index_ptr) {
         if (index > -1 && index <= ESL_EVENT_HEADER_INDEX_MAX) {
@@ -681,7 +1626,7 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event,
       goto end;
     }
 
-    header = new_header(header_name);
+    header = new_header(event, header_name);
     if (header == nullptr) {
       goto fail;
     }
@@ -791,6 +1736,7 @@ static esl_status_t esl_event_base_add_header(esl_event_t *event,
       }
       event->last_header = header;
     }
+    index_add(event, header, stack & ESL_STACK_TOP);
     owned_new_header = nullptr;
   }
 
@@ -835,8 +1781,34 @@ ESL_DECLARE(esl_status_t)
 esl_event_add_header_string(esl_event_t *event, esl_stack_t stack,
                             const char *header_name, const char *data) {
   if (data) {
-    char *copy = DUP(data);
-    if (copy == nullptr) {
+    char *copy;
+
+    if (event && event->arena && header_name && stack == ESL_STACK_BOTTOM) {
+      const size_t name_len = strlen(header_name);
+      const size_t value_len = strlen(data);
+
+      if (plain_header(event, header_name, name_len, data, value_len)) {
+        esl_ssize_t hlen = (esl_ssize_t)name_len;
+        const unsigned long hash = esl_ci_hashfunc_default(header_name, &hlen);
+        /* an interned name needs no copy; otherwise name and value share
+         * one stretch of the arena */
+        const size_t name_size =
+            intern_find(header_name, name_len, hash) ? 0 : name_len + 1;
+        char *name;
+
+        if ((copy = arena_alloc(event->arena, name_size + value_len + 1, 1)) ==
+            nullptr) {
+          return ESL_FAIL;
+        }
+        name = name_size ? memcpy(copy, header_name, name_size)
+                         : (char *)header_name;
+        memcpy(copy + name_size, data, value_len + 1);
+        return append_borrowed(event, name, name_len, hash, copy + name_size,
+                               value_len);
+      }
+    }
+
+    if ((copy = DUP(data)) == nullptr) {
       return ESL_FAIL;
     }
     return esl_event_base_add_header(event, stack, header_name, copy);
@@ -909,20 +1881,41 @@ ESL_DECLARE(void) esl_event_destroy(esl_event_t **event) {
   ep = *event;
 
   if (ep) {
-    for (hp = ep->headers; hp;) {
+    /* headers living wholly in the arena need no visit */
+    for (hp = ep->arena && !ep->arena->spilled ? nullptr : ep->headers; hp;) {
       this = hp;
       hp = hp->next;
       free_header(&this);
     }
     FREE(ep->body);
     FREE(ep->subclass_name);
-#ifdef ESL_EVENT_RECYCLE
-    if (esl_queue_trypush(EVENT_RECYCLE_QUEUE, ep) != ESL_SUCCESS) {
+    FREE(ep->header_block);
+    FREE(ep->index);
+    if (ep->arena) {
+      esl_event_arena_t *arena = ep->arena;
+      esl_event_arena_block_t *block;
+      size_t kept = 0;
+
+      for (block = arena->spare; block; block = block->next) {
+        kept += block->size;
+      }
+      /* a pooled event keeps a bounded amount of blocks for its next use */
+      while ((block = arena->blocks) != nullptr &&
+             kept + block->size <= ESL_EVENT_POOL_ARENA_KEEP) {
+        arena->blocks = block->next;
+        block->next = arena->spare;
+        arena->spare = block;
+        kept += block->size;
+      }
+      arena_free_blocks(arena->blocks);
+      /* the first block shares the event's allocation */
+      if (!pool_put(POOL_ARENA_EVENT, ep)) {
+        arena_free_blocks(arena->spare);
+        free(ep);
+      }
+    } else if (!pool_put(POOL_EVENT, ep)) {
       FREE(ep);
     }
-#else
-    FREE(ep);
-#endif
   }
   *event = nullptr;
 }
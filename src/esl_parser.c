@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+
+#include "esl/esl_parser.h"
+#include "esl/esl_buffer.h"
+#include "esl/esl_event.h"
+#include "esl/esl_scan.h"
+
+constexpr esl_size_t ESL_MAX_CONTENT_LENGTH = 16'777'216;
+constexpr esl_size_t ESL_PARSER_MAX_HEADER = 65'535;
+constexpr esl_size_t ESL_PARSER_LINE_BATCH = 64;
+
+struct esl_parser {
+  esl_buffer_t *buffer;
+  bool own_buffer;
+  /* headers borrow from a per-event copy of the header block */
+  bool header_views;
+  /* header block waiting for its content-length body */
+  esl_event_t *pending_event;
+  esl_size_t pending_len;
+  /* body of pending_event, filled from the buffer or in place */
+  char *body;
+  esl_size_t body_have;
+  /* scratch space the header block is copied into for parsing */
+  char *header_buf;
+  esl_size_t header_size;
+};
+
+ESL_DECLARE(esl_status_t)
+esl_parser_create(esl_parser_t **parser, esl_buffer_t *buffer) {
+  esl_parser_t *new_parser = nullptr;
+
+  if (parser == nullptr) {
+    return ESL_FAIL;
+  }
+  *parser = nullptr;
+
+  new_parser = calloc(1, sizeof(*new_parser));
+  if (new_parser == nullptr) {
+    return ESL_FAIL;
+  }
+
+  if (buffer == nullptr) {
+    if (esl_buffer_create(&buffer, 1024, 1024, 0) != ESL_SUCCESS) {
+      free(new_parser);
+      return ESL_FAIL;
+    }
+    new_parser->own_buffer = true;
+  }
+
+  new_parser->buffer = buffer;
+  new_parser->header_views = true;
+  *parser = new_parser;
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(void) esl_parser_destroy(esl_parser_t **parser) {
+  esl_parser_t *pp;
+
+  if (parser == nullptr || *parser == nullptr) {
+    return;
+  }
+
+  pp = *parser;
+
+  esl_event_safe_destroy(&pp->pending_event);
+  free(pp->body);
+  if (pp->own_buffer) {
+    esl_buffer_destroy(&pp->buffer);
+  }
+  free(pp->header_buf);
+  free(pp);
+
+  *parser = nullptr;
+}
+
+ESL_DECLARE(void)
+esl_parser_set_header_views(esl_parser_t *parser, bool enable) {
+  if (parser != nullptr) {
+    parser->header_views = enable;
+  }
+}
+
+ESL_DECLARE(esl_buffer_t *) esl_parser_buffer(esl_parser_t *parser) {
+  return parser ? parser->buffer : nullptr;
+}
+
+ESL_DECLARE(esl_size_t) esl_parser_footprint(esl_parser_t *parser) {
+  if (parser == nullptr) {
+    return 0;
+  }
+  return parser->header_size + (parser->body ? parser->pending_len + 1 : 0);
+}
+
+ESL_DECLARE(void) esl_parser_trim(esl_parser_t *parser) {
+  if (parser == nullptr) {
+    return;
+  }
+  esl_safe_free(parser->header_buf);
+  parser->header_size = 0;
+}
+
+ESL_DECLARE(void) esl_parser_reset(esl_parser_t *parser) {
+  if (parser == nullptr) {
+    return;
+  }
+
+  esl_event_safe_destroy(&parser->pending_event);
+  esl_safe_free(parser->body);
+  parser->pending_len = 0;
+  parser->body_have = 0;
+  esl_buffer_zero(parser->buffer);
+}
+
+ESL_DECLARE(esl_status_t)
+esl_parser_feed(esl_parser_t *parser, const void *data, esl_size_t len) {
+  if (parser == nullptr || (data == nullptr && len)) {
+    errno = EINVAL;
+    return ESL_FAIL;
+  }
+
+  if (len && esl_buffer_write(parser->buffer, data, len) == 0) {
+    errno = EMSGSIZE;
+    return ESL_FAIL;
+  }
+
+  return ESL_SUCCESS;
+}
+
+static esl_status_t parser_parse_headers(esl_parser_t *parser, char *data,
+                                         esl_size_t len, esl_event_t **event) {
+  esl_scan_line_t lines[ESL_PARSER_LINE_BATCH];
+  esl_event_t *revent = nullptr;
+  esl_size_t block_len = 0;
+  esl_size_t off = 0;
+  char *cl;
+
+  /* with views, the header structs come from the event's arena as well */
+  if ((parser->header_views
+           ? esl_event_create_arena(&revent, ESL_EVENT_CLONE, nullptr)
+           : esl_event_create(&revent, ESL_EVENT_CLONE)) != ESL_SUCCESS ||
+      revent == nullptr) {
+    errno = ENOMEM;
+    return ESL_FAIL;
+  }
+  revent->event_id = ESL_EVENT_SOCKET_DATA;
+  if (esl_event_add_header_string(revent, ESL_STACK_BOTTOM, "Event-Name",
+                                  "SOCKET_DATA") != ESL_SUCCESS) {
+    errno = ENOMEM;
+    goto fail;
+  }
+
+  if (parser->header_views) {
+    /* one copy of the block for the event; its headers point into it */
+    if ((revent->header_block = malloc(len + 1)) == nullptr) {
+      errno = ENOMEM;
+      goto fail;
+    }
+    data = memcpy(revent->header_block, data, len + 1);
+  }
+
+  for (;;) {
+    const esl_size_t n = esl_scan_header_lines(data + off, len - off, lines,
+                                               ESL_PARSER_LINE_BATCH, &block_len);
+
+    for (esl_size_t i = 0; i < n; i++) {
+      const esl_size_t colon = off + lines[i].colon;
+      const esl_size_t end = off + lines[i].end;
+      char *hname = data + off + lines[i].start;
+      char *hval;
+      esl_size_t vlen;
+
+      if (colon == end) {
+        continue;
+      }
+
+      data[colon] = '\0';
+      data[end] = '\0';
+      hval = data + colon + 1;
+      while (*hval == ' ' || *hval == '\t')
+        hval++;
+
+      vlen = (esl_size_t)(data + end - hval);
+      if (memchr(hval, '%', vlen)) {
+        vlen = strlen(esl_url_decode(hval));
+      }
+      esl_log(ESL_LOG_DEBUG, "RECV HEADER [%s] = [%s]\n", hname, hval);
+      if (!strncmp(hval, "ARRAY::", 7)) {
+        if (esl_event_add_array(revent, hname, hval) != 0) {
+          errno = ENOMEM;
+          goto fail;
+        }
+      } else if (revent->header_block) {
+        if (esl_event_add_header_borrowed(revent, hname,
+                                          (esl_size_t)(data + colon - hname),
+                                          hval, vlen) != ESL_SUCCESS) {
+          errno = ENOMEM;
+          goto fail;
+        }
+      } else {
+        if (esl_event_add_header_string(revent, ESL_STACK_BOTTOM, hname,
+                                        hval) != ESL_SUCCESS) {
+          errno = ENOMEM;
+          goto fail;
+        }
+      }
+    }
+
+    if (block_len || n < ESL_PARSER_LINE_BATCH) {
+      break;
+    }
+    off += lines[n - 1].end + 1;
+  }
+
+  parser->pending_len = 0;
+
+  if ((cl = esl_event_get_header(revent, "content-length"))) {
+    char *endptr = nullptr;
+    unsigned long long parsed_len = 0;
+
+    errno = 0;
+    parsed_len = strtoull(cl, &endptr, 10);
+    if (errno != 0 || endptr == cl || (endptr != nullptr && *endptr != '\0') ||
+        parsed_len > (unsigned long long)ESL_MAX_CONTENT_LENGTH) {
+      errno = EPROTO;
+      goto fail;
+    }
+
+    parser->pending_len = (esl_size_t)parsed_len;
+    parser->pending_event = revent;
+    revent = nullptr;
+  }
+
+  *event = revent;
+  return ESL_SUCCESS;
+
+fail:
+  esl_event_destroy(&revent);
+  return ESL_FAIL;
+}
+
+/* Copy the next header block out of the input buffer. The scratch space only
+ * grows as large as the biggest header block seen so far. */
+static esl_size_t parser_read_header(esl_parser_t *parser) {
+  esl_size_t want = esl_buffer_inuse(parser->buffer);
+
+  if (want > ESL_PARSER_MAX_HEADER) {
+    want = ESL_PARSER_MAX_HEADER;
+  }
+
+  if (want + 1 > parser->header_size) {
+    esl_size_t new_size = parser->header_size ? parser->header_size : 1024;
+    char *new_buf;
+
+    while (new_size < want + 1) {
+      new_size *= 2;
+    }
+
+    if ((new_buf = realloc(parser->header_buf, new_size)) == nullptr) {
+      errno = ENOMEM;
+      return 0;
+    }
+    parser->header_buf = new_buf;
+    parser->header_size = new_size;
+  }
+
+  if ((want = esl_buffer_read_packet(parser->buffer, parser->header_buf,
+                                     want)) == 0) {
+    errno = EMSGSIZE;
+  }
+
+  return want;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_parser_next(esl_parser_t *parser, esl_event_t **event) {
+  if (parser == nullptr || event == nullptr) {
+    errno = EINVAL;
+    return ESL_FAIL;
+  }
+
+  *event = nullptr;
+
+  if (!parser->pending_event) {
+    esl_size_t len;
+
+    if (esl_buffer_packet_count(parser->buffer) == 0) {
+      return ESL_BREAK;
+    }
+
+    if ((len = parser_read_header(parser)) == 0) {
+      return ESL_FAIL;
+    }
+
+    parser->header_buf[len] = '\0';
+
+    if (parser_parse_headers(parser, parser->header_buf, len, event) !=
+        ESL_SUCCESS) {
+      return ESL_FAIL;
+    }
+
+    if (*event) {
+      return ESL_SUCCESS;
+    }
+  }
+
+  if (!parser->body) {
+    if ((parser->body = calloc(parser->pending_len + 1, sizeof(char))) ==
+        nullptr) {
+      errno = ENOMEM;
+      return ESL_FAIL;
+    }
+    parser->body_have = 0;
+  }
+
+  if (parser->body_have < parser->pending_len) {
+    parser->body_have +=
+        esl_buffer_read(parser->buffer, parser->body + parser->body_have,
+                        parser->pending_len - parser->body_have);
+  }
+
+  if (parser->body_have < parser->pending_len) {
+    return ESL_BREAK;
+  }
+
+  *event = parser->pending_event;
+  (*event)->body = parser->body;
+  parser->pending_event = nullptr;
+  parser->pending_len = 0;
+  parser->body = nullptr;
+  parser->body_have = 0;
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_size_t)
+esl_parser_body_window(esl_parser_t *parser, void **data) {
+  if (data == nullptr) {
+    return 0;
+  }
+  *data = nullptr;
+
+  if (parser == nullptr || !parser->body ||
+      esl_buffer_inuse(parser->buffer) > 0) {
+    return 0;
+  }
+
+  *data = parser->body + parser->body_have;
+
+  return parser->pending_len - parser->body_have;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_parser_body_commit(esl_parser_t *parser, esl_size_t len) {
+  if (parser == nullptr || !parser->body ||
+      len > parser->pending_len - parser->body_have) {
+    return ESL_FAIL;
+  }
+
+  parser->body_have += len;
+
+  return ESL_SUCCESS;
+}
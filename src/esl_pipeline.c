@@ -0,0 +1,869 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esl/esl_pipeline.h"
+#include "esl/esl_event.h"
+#include "esl/esl_queue.h"
+#include "esl/esl_threadmutex.h"
+#include "esl/esl_uring.h"
+#include "esl/esl_wakeup.h"
+
+/* How long the reading waiter blocks on the socket per turn when waiting
+ * without a deadline. */
+constexpr uint32_t ESL_PIPELINE_READ_SLICE = 1000;
+/* How long a waiter sleeps when another thread holds the handle for
+ * reading. */
+constexpr uint32_t ESL_PIPELINE_BUSY_SLICE = 10;
+/* Initial bucket count of the job table; it doubles as jobs are added. */
+constexpr esl_size_t ESL_PIPELINE_JOB_BUCKETS = 64;
+
+struct esl_reply {
+  esl_pipeline_t *pipeline;
+  esl_reply_t *next;
+  esl_event_t *event;
+  /* bgapi job this reply acknowledges, if any */
+  esl_job_t *job;
+  esl_status_t status;
+  bool done;
+  /* the caller's reference, if any, and, while pending, the FIFO's */
+  int refs;
+};
+
+struct esl_job {
+  esl_pipeline_t *pipeline;
+  /* hash chain while in the table, then the list of jobs to finish */
+  esl_job_t *next;
+  esl_job_callback_t callback;
+  void *user_data;
+  esl_event_t *event;
+  esl_status_t status;
+  bool done;
+  bool in_table;
+  uint32_t hash;
+  /* the caller's, the table's and the bgapi reply's while pending */
+  int refs;
+  char uuid[ESL_JOB_UUID_SIZE];
+};
+
+struct esl_pipeline {
+  pthread_mutex_t lock;
+  /* signalled when a reply or job completes or the reading waiter steps
+   * down */
+  pthread_cond_t cond;
+  esl_reply_t *head;
+  esl_reply_t *tail;
+  /* outstanding bgapi jobs, chained hash on Job-UUID */
+  esl_job_t **jobs;
+  esl_size_t job_buckets;
+  _Atomic esl_size_t job_count;
+  /* a waiter is reading the handle for everyone */
+  bool reading;
+  bool closed;
+  /* the handle's reference and one per live reply or job */
+  int refs;
+};
+
+static void pipeline_free(esl_pipeline_t *pipeline) {
+  pthread_cond_destroy(&pipeline->cond);
+  pthread_mutex_destroy(&pipeline->lock);
+  free(pipeline->jobs);
+  free(pipeline);
+}
+
+static uint32_t pipeline_hash(const char *uuid) {
+  uint32_t hash = 2'166'136'261u;
+
+  for (; *uuid; uuid++) {
+    hash = (hash ^ (unsigned char)*uuid) * 16'777'619u;
+  }
+  return hash;
+}
+
+/* Drop one reference to a job with the pipeline locked. Returns true if
+ * that was the last reference to the pipeline, which the caller must then
+ * free after unlocking. */
+static bool pipeline_job_unref(esl_pipeline_t *pipeline, esl_job_t *job) {
+  if (--job->refs > 0) {
+    return false;
+  }
+  esl_event_safe_destroy(&job->event);
+  free(job);
+  return --pipeline->refs == 0;
+}
+
+/* Same for a reply. */
+static bool pipeline_reply_unref(esl_pipeline_t *pipeline, esl_reply_t *reply) {
+  bool release = false;
+
+  if (--reply->refs > 0) {
+    return false;
+  }
+  if (reply->job) {
+    release = pipeline_job_unref(pipeline, reply->job);
+  }
+  esl_event_safe_destroy(&reply->event);
+  free(reply);
+  return --pipeline->refs == 0 || release;
+}
+
+static esl_status_t pipeline_job_insert(esl_pipeline_t *pipeline,
+                                        esl_job_t *job) {
+  const esl_size_t count =
+      atomic_load_explicit(&pipeline->job_count, memory_order_relaxed);
+  esl_size_t slot;
+
+  if (count >= pipeline->job_buckets) {
+    const esl_size_t buckets = pipeline->job_buckets
+                                   ? pipeline->job_buckets * 2
+                                   : ESL_PIPELINE_JOB_BUCKETS;
+    esl_job_t **jobs = calloc(buckets, sizeof(*jobs));
+
+    if (jobs == nullptr) {
+      return ESL_FAIL;
+    }
+    for (esl_size_t i = 0; i < pipeline->job_buckets; i++) {
+      esl_job_t *jp = pipeline->jobs[i];
+
+      while (jp) {
+        esl_job_t *next = jp->next;
+
+        slot = jp->hash & (buckets - 1);
+        jp->next = jobs[slot];
+        jobs[slot] = jp;
+        jp = next;
+      }
+    }
+    free(pipeline->jobs);
+    pipeline->jobs = jobs;
+    pipeline->job_buckets = buckets;
+  }
+
+  slot = job->hash & (pipeline->job_buckets - 1);
+  job->next = pipeline->jobs[slot];
+  pipeline->jobs[slot] = job;
+  job->in_table = true;
+  atomic_store_explicit(&pipeline->job_count, count + 1, memory_order_relaxed);
+
+  return ESL_SUCCESS;
+}
+
+static void pipeline_job_unlink(esl_pipeline_t *pipeline, esl_job_t *job) {
+  esl_job_t **jpp = &pipeline->jobs[job->hash & (pipeline->job_buckets - 1)];
+
+  while (*jpp != job) {
+    jpp = &(*jpp)->next;
+  }
+  *jpp = job->next;
+  job->next = nullptr;
+  job->in_table = false;
+  atomic_fetch_sub_explicit(&pipeline->job_count, 1, memory_order_relaxed);
+}
+
+static esl_job_t *pipeline_job_find(esl_pipeline_t *pipeline,
+                                    const char *uuid) {
+  const uint32_t hash = pipeline_hash(uuid);
+  esl_job_t *job;
+
+  if (!pipeline->job_buckets) {
+    return nullptr;
+  }
+
+  for (job = pipeline->jobs[hash & (pipeline->job_buckets - 1)]; job;
+       job = job->next) {
+    if (job->hash == hash && !strcmp(job->uuid, uuid)) {
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+/* Take a job out of the table onto a list of jobs to finish, with the
+ * pipeline locked. The table's reference moves to the list. */
+static void pipeline_job_settle(esl_pipeline_t *pipeline, esl_job_t *job,
+                                esl_event_t *event, esl_status_t status,
+                                esl_job_t **finish) {
+  pipeline_job_unlink(pipeline, job);
+  job->event = event;
+  job->status = status;
+  job->next = *finish;
+  *finish = job;
+}
+
+/* Run the callbacks of settled jobs, then wake their waiters. Called with
+ * the pipeline unlocked. */
+static void pipeline_job_finish(esl_pipeline_t *pipeline, esl_job_t *finish) {
+  while (finish) {
+    esl_job_t *job = finish;
+    bool release;
+
+    finish = job->next;
+    job->next = nullptr;
+
+    if (job->callback) {
+      job->callback(job, job->event, job->status, job->user_data);
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    job->done = true;
+    pthread_cond_broadcast(&pipeline->cond);
+    release = pipeline_job_unref(pipeline, job);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    if (release) {
+      pipeline_free(pipeline);
+    }
+  }
+}
+
+/* Complete the oldest pending reply with the pipeline locked. A bgapi
+ * command that was refused settles its job with the reply. */
+static bool pipeline_complete_head(esl_pipeline_t *pipeline, esl_event_t *event,
+                                   esl_status_t status, esl_job_t **finish) {
+  esl_reply_t *reply = pipeline->head;
+  esl_job_t *job = reply->job;
+
+  pipeline->head = reply->next;
+  if (!pipeline->head) {
+    pipeline->tail = nullptr;
+  }
+  reply->next = nullptr;
+  reply->event = event;
+  reply->status = status;
+  reply->done = true;
+
+  if (job && job->in_table && event) {
+    const char *hval = esl_event_get_header(event, "reply-text");
+
+    if (hval && !strncmp(hval, "-ERR", 4)) {
+      pipeline_job_settle(pipeline, job, event, ESL_FAIL, finish);
+      reply->event = nullptr;
+    }
+  }
+
+  pthread_cond_broadcast(&pipeline->cond);
+
+  return pipeline_reply_unref(pipeline, reply);
+}
+
+/* Fail every pending reply and job with the pipeline locked. */
+static bool pipeline_fail_all(esl_pipeline_t *pipeline, esl_job_t **finish) {
+  bool release = false;
+
+  while (pipeline->head) {
+    release = pipeline_complete_head(pipeline, nullptr, ESL_FAIL, finish) ||
+              release;
+  }
+  for (esl_size_t i = 0; i < pipeline->job_buckets; i++) {
+    while (pipeline->jobs[i]) {
+      pipeline_job_settle(pipeline, pipeline->jobs[i], nullptr, ESL_FAIL,
+                          finish);
+    }
+  }
+
+  return release;
+}
+
+ESL_DECLARE(esl_status_t) esl_pipeline_create(esl_pipeline_t **pipeline) {
+  esl_pipeline_t *new_pipeline = nullptr;
+  pthread_condattr_t attr;
+
+  if (pipeline == nullptr) {
+    return ESL_FAIL;
+  }
+  *pipeline = nullptr;
+
+  new_pipeline = calloc(1, sizeof(*new_pipeline));
+  if (new_pipeline == nullptr) {
+    return ESL_FAIL;
+  }
+
+  if (pthread_mutex_init(&new_pipeline->lock, nullptr) != 0) {
+    free(new_pipeline);
+    return ESL_FAIL;
+  }
+  if (pthread_condattr_init(&attr) != 0) {
+    goto fail;
+  }
+  if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+      pthread_cond_init(&new_pipeline->cond, &attr) != 0) {
+    pthread_condattr_destroy(&attr);
+    goto fail;
+  }
+  pthread_condattr_destroy(&attr);
+
+  new_pipeline->refs = 1;
+  *pipeline = new_pipeline;
+  return ESL_SUCCESS;
+
+fail:
+  pthread_mutex_destroy(&new_pipeline->lock);
+  free(new_pipeline);
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_pipeline_deliver(esl_pipeline_t *pipeline, esl_event_t *event) {
+  esl_job_t *finish = nullptr;
+  bool release = false;
+
+  if (pipeline == nullptr || event == nullptr) {
+    return ESL_FAIL;
+  }
+
+  pthread_mutex_lock(&pipeline->lock);
+  if (!pipeline->head) {
+    pthread_mutex_unlock(&pipeline->lock);
+    return ESL_FAIL;
+  }
+  release = pipeline_complete_head(pipeline, event, ESL_SUCCESS, &finish);
+  pthread_mutex_unlock(&pipeline->lock);
+
+  pipeline_job_finish(pipeline, finish);
+  if (release) {
+    pipeline_free(pipeline);
+  }
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(bool) esl_pipeline_has_jobs(esl_pipeline_t *pipeline) {
+  return pipeline &&
+         atomic_load_explicit(&pipeline->job_count, memory_order_relaxed) > 0;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_pipeline_resolve_job(esl_pipeline_t *pipeline, const char *uuid,
+                         esl_event_t *event) {
+  esl_job_t *finish = nullptr;
+  esl_job_t *job = nullptr;
+
+  if (pipeline == nullptr || uuid == nullptr || event == nullptr) {
+    return ESL_FAIL;
+  }
+
+  pthread_mutex_lock(&pipeline->lock);
+  if ((job = pipeline_job_find(pipeline, uuid)) == nullptr) {
+    pthread_mutex_unlock(&pipeline->lock);
+    return ESL_FAIL;
+  }
+  pipeline_job_settle(pipeline, job, event, ESL_SUCCESS, &finish);
+  pthread_mutex_unlock(&pipeline->lock);
+
+  pipeline_job_finish(pipeline, finish);
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(void) esl_pipeline_fail(esl_pipeline_t *pipeline) {
+  esl_job_t *finish = nullptr;
+  bool release;
+
+  if (pipeline == nullptr) {
+    return;
+  }
+
+  pthread_mutex_lock(&pipeline->lock);
+  release = pipeline_fail_all(pipeline, &finish);
+  pthread_mutex_unlock(&pipeline->lock);
+
+  pipeline_job_finish(pipeline, finish);
+  if (release) {
+    pipeline_free(pipeline);
+  }
+}
+
+ESL_DECLARE(void) esl_pipeline_close(esl_pipeline_t **pipeline) {
+  esl_pipeline_t *pp = nullptr;
+  esl_job_t *finish = nullptr;
+  bool release;
+
+  if (pipeline == nullptr || *pipeline == nullptr) {
+    return;
+  }
+
+  pp = *pipeline;
+  *pipeline = nullptr;
+
+  pthread_mutex_lock(&pp->lock);
+  pp->closed = true;
+  (void)pipeline_fail_all(pp, &finish);
+  pthread_mutex_unlock(&pp->lock);
+
+  /* the handle's reference keeps the pipeline alive until here */
+  pipeline_job_finish(pp, finish);
+
+  pthread_mutex_lock(&pp->lock);
+  release = --pp->refs == 0;
+  pthread_mutex_unlock(&pp->lock);
+
+  if (release) {
+    pipeline_free(pp);
+  }
+}
+
+ESL_DECLARE(void) esl_reply_destroy(esl_reply_t **reply) {
+  esl_pipeline_t *pipeline = nullptr;
+  bool release;
+
+  if (reply == nullptr || *reply == nullptr) {
+    return;
+  }
+
+  pipeline = (*reply)->pipeline;
+
+  pthread_mutex_lock(&pipeline->lock);
+  release = pipeline_reply_unref(pipeline, *reply);
+  pthread_mutex_unlock(&pipeline->lock);
+
+  if (release) {
+    pipeline_free(pipeline);
+  }
+
+  *reply = nullptr;
+}
+
+ESL_DECLARE(void) esl_job_destroy(esl_job_t **job) {
+  esl_pipeline_t *pipeline = nullptr;
+  bool release;
+
+  if (job == nullptr || *job == nullptr) {
+    return;
+  }
+
+  pipeline = (*job)->pipeline;
+
+  pthread_mutex_lock(&pipeline->lock);
+  release = pipeline_job_unref(pipeline, *job);
+  pthread_mutex_unlock(&pipeline->lock);
+
+  if (release) {
+    pipeline_free(pipeline);
+  }
+
+  *job = nullptr;
+}
+
+ESL_DECLARE(const char *) esl_job_uuid(esl_job_t *job) {
+  return job ? job->uuid : nullptr;
+}
+
+/* Queue a reply future and send the command under the send lock, so FIFO
+ * order and wire order are the same. A job goes into the table before
+ * the command is sent, so its BACKGROUND_JOB event always finds it. */
+static esl_status_t pipeline_send(esl_handle_t *handle, const char *cmd,
+                                  esl_job_t *job, esl_reply_t **reply) {
+  /* handles set up without a send lock keep everything on the one mutex */
+  esl_mutex_t *const lock =
+      handle->send_mutex ? handle->send_mutex : handle->mutex;
+  esl_pipeline_t *pipeline = nullptr;
+  esl_reply_t *new_reply = nullptr;
+  bool release = false;
+
+  if ((new_reply = calloc(1, sizeof(*new_reply))) == nullptr) {
+    return ESL_FAIL;
+  }
+
+  esl_mutex_lock(lock);
+
+  if (!handle->connected || handle->sock == ESL_SOCK_INVALID ||
+      (!handle->pipeline && esl_pipeline_create(&handle->pipeline) !=
+                                ESL_SUCCESS)) {
+    esl_mutex_unlock(lock);
+    free(new_reply);
+    return ESL_FAIL;
+  }
+  pipeline = handle->pipeline;
+
+  pthread_mutex_lock(&pipeline->lock);
+  if (job) {
+    job->pipeline = pipeline;
+    pipeline->refs++;
+    if (pipeline_job_insert(pipeline, job) != ESL_SUCCESS) {
+      job->pipeline = nullptr;
+      pipeline->refs--;
+      pthread_mutex_unlock(&pipeline->lock);
+      esl_mutex_unlock(lock);
+      free(new_reply);
+      return ESL_FAIL;
+    }
+  }
+  new_reply->pipeline = pipeline;
+  new_reply->job = job;
+  new_reply->refs = reply ? 2 : 1;
+  pipeline->refs++;
+  if (pipeline->tail) {
+    pipeline->tail->next = new_reply;
+  } else {
+    pipeline->head = new_reply;
+  }
+  pipeline->tail = new_reply;
+  pthread_mutex_unlock(&pipeline->lock);
+
+  if (esl_send(handle, cmd) != ESL_SUCCESS) {
+    /* unless a failing reader already completed them, the reply is still
+     * the tail (nothing else was sent after it) and the job is still in
+     * the table */
+    pthread_mutex_lock(&pipeline->lock);
+    if (job && job->in_table) {
+      pipeline_job_unlink(pipeline, job);
+      release = pipeline_job_unref(pipeline, job);
+    }
+    if (!new_reply->done) {
+      esl_reply_t *rp = pipeline->head;
+
+      if (rp == new_reply) {
+        pipeline->head = pipeline->tail = nullptr;
+      } else {
+        while (rp->next != new_reply) {
+          rp = rp->next;
+        }
+        rp->next = nullptr;
+        pipeline->tail = rp;
+      }
+      release = pipeline_reply_unref(pipeline, new_reply) || release;
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    esl_mutex_unlock(lock);
+    if (release) {
+      pipeline_free(pipeline);
+    }
+    if (reply) {
+      esl_reply_destroy(&new_reply);
+    }
+    return ESL_FAIL;
+  }
+
+  esl_mutex_unlock(lock);
+
+  if (reply) {
+    *reply = new_reply;
+  }
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_send_async(esl_handle_t *handle, const char *cmd, esl_reply_t **reply) {
+  if (reply == nullptr) {
+    return ESL_FAIL;
+  }
+  *reply = nullptr;
+
+  if (!handle || handle->mutex == nullptr || cmd == nullptr) {
+    return ESL_FAIL;
+  }
+
+  return pipeline_send(handle, cmd, nullptr, reply);
+}
+
+static uint64_t pipeline_mix(uint64_t x) {
+  x += 0x9e37'79b9'7f4a'7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58'476d'1ce4'e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d0'49bb'1331'11ebull;
+  return x ^ (x >> 31);
+}
+
+static uint64_t job_seed[2];
+static pthread_once_t job_seed_once = PTHREAD_ONCE_INIT;
+static _Atomic uint64_t job_counter = 0;
+
+static void pipeline_seed_jobs(void) {
+  const int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0 || read(fd, job_seed, sizeof(job_seed)) != sizeof(job_seed)) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    job_seed[0] = pipeline_mix((uint64_t)ts.tv_sec ^ (uint64_t)getpid());
+    job_seed[1] = pipeline_mix((uint64_t)ts.tv_nsec ^ job_seed[0]);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+/* A version 4 UUID from a per-process random seed and a counter. */
+static void pipeline_job_uuid(char uuid[ESL_JOB_UUID_SIZE]) {
+  uint64_t hi, lo, n;
+
+  pthread_once(&job_seed_once, pipeline_seed_jobs);
+  n = atomic_fetch_add_explicit(&job_counter, 1, memory_order_relaxed);
+  hi = pipeline_mix(job_seed[0] ^ n);
+  lo = pipeline_mix(job_seed[1] ^ hi);
+
+  hi = (hi & ~0xf000ull) | 0x4000ull;
+  lo = (lo & ~(3ull << 62)) | (2ull << 62);
+
+  snprintf(uuid, ESL_JOB_UUID_SIZE, "%08x-%04x-%04x-%04x-%012llx",
+           (unsigned)(hi >> 32), (unsigned)(hi >> 16) & 0xffff,
+           (unsigned)hi & 0xffff, (unsigned)(lo >> 48),
+           (unsigned long long)(lo & 0xffff'ffff'ffffull));
+}
+
+ESL_DECLARE(esl_status_t)
+esl_bgapi_submit(esl_handle_t *handle, const char *cmd,
+                 esl_job_callback_t callback, void *user_data,
+                 esl_job_t **job) {
+  esl_job_t *new_job = nullptr;
+  char *buf = nullptr;
+  size_t len;
+  esl_status_t status;
+
+  if (job) {
+    *job = nullptr;
+  }
+
+  if (!handle || handle->mutex == nullptr || esl_strlen_zero(cmd) ||
+      (!job && !callback)) {
+    return ESL_FAIL;
+  }
+
+  if ((new_job = calloc(1, sizeof(*new_job))) == nullptr) {
+    return ESL_FAIL;
+  }
+  pipeline_job_uuid(new_job->uuid);
+  new_job->hash = pipeline_hash(new_job->uuid);
+  new_job->callback = callback;
+  new_job->user_data = user_data;
+  /* the table's, the reply's and the caller's if it keeps the job */
+  new_job->refs = job ? 3 : 2;
+
+  len = strlen(cmd) + sizeof("bgapi \nJob-UUID: ") + ESL_JOB_UUID_SIZE;
+  if ((buf = malloc(len)) == nullptr) {
+    free(new_job);
+    return ESL_FAIL;
+  }
+  esl_snprintf(buf, len, "bgapi %s\nJob-UUID: %s", cmd, new_job->uuid);
+
+  status = pipeline_send(handle, buf, new_job, nullptr);
+  free(buf);
+
+  if (status != ESL_SUCCESS) {
+    if (new_job->pipeline == nullptr) {
+      free(new_job);
+    } else if (job) {
+      esl_job_destroy(&new_job);
+    }
+    return ESL_FAIL;
+  }
+
+  if (job) {
+    *job = new_job;
+  }
+  return ESL_SUCCESS;
+}
+
+/* Parse whatever the handle has buffered or can read without blocking.
+ * Replies and jobs complete on the way through the receive path; other
+ * events go on the handle's queue for esl_recv_event. The caller holds the
+ * handle mutex exactly once, so a push blocked on a full queue releases it
+ * to the consumers it is waiting for. */
+static esl_status_t pipeline_drain(esl_handle_t *handle) {
+  for (;;) {
+    esl_event_t *event = nullptr;
+    const esl_status_t status = esl_recv_event_nowait(handle, 0, &event);
+
+    if (status != ESL_SUCCESS) {
+      return status;
+    }
+    if (event && esl_handle_queue_event(handle, event) == ESL_FAIL &&
+        handle->mutex == nullptr) {
+      return ESL_FAIL;
+    }
+  }
+}
+
+/* One turn as the reading waiter: take what is there, otherwise wait up
+ * to ms for the socket and take what arrives. Returns false if another
+ * thread is already reading the handle; it routes replies as it goes, so
+ * there is nothing to do but wait for them. */
+static bool pipeline_read(esl_handle_t *handle, esl_pipeline_t *pipeline,
+                          const bool *done, uint32_t ms, uint64_t since) {
+  struct pollfd pfds[2] = {{0}};
+  esl_status_t status;
+  esl_socket_t fd;
+  bool finished;
+
+  if (esl_mutex_trylock(handle->mutex) != ESL_SUCCESS) {
+    return false;
+  }
+  status = pipeline_drain(handle);
+  fd = handle->uring ? esl_uring_fd(handle->uring) : handle->sock;
+  esl_mutex_unlock(handle->mutex);
+
+  /* the reply may already have been buffered; do not sit out a slice */
+  pthread_mutex_lock(&pipeline->lock);
+  finished = *done;
+  pthread_mutex_unlock(&pipeline->lock);
+
+  pfds[0] = (struct pollfd){.fd = fd, .events = POLLIN};
+  if (!finished && status != ESL_FAIL && fd != ESL_SOCK_INVALID &&
+      esl_wakeup_poll(handle->wakeup, since, pfds, 1, ms) == ESL_SUCCESS) {
+    if (esl_mutex_trylock(handle->mutex) != ESL_SUCCESS) {
+      return false;
+    }
+    (void)pipeline_drain(handle);
+    esl_mutex_unlock(handle->mutex);
+  }
+
+  return true;
+}
+
+/* Wait until *done is set, taking turns with other waiters at reading the
+ * handle. Returns with the pipeline locked: ESL_SUCCESS once done, ESL_BREAK
+ * when the monotonic deadline (if not 0) passed first, ESL_INTERRUPTED when
+ * the handle was woken. */
+static esl_status_t pipeline_wait(esl_handle_t *handle,
+                                  esl_pipeline_t *pipeline, const bool *done,
+                                  uint64_t deadline) {
+  const uint64_t since = esl_wakeup_generation(handle->wakeup);
+
+  pthread_mutex_lock(&pipeline->lock);
+
+  while (!*done) {
+    const uint64_t now = esl_monotonic_ms();
+    uint32_t slice = ESL_PIPELINE_READ_SLICE;
+
+    if (esl_wakeup_fired(handle->wakeup, since)) {
+      return ESL_INTERRUPTED;
+    }
+
+    if (deadline) {
+      if (now >= deadline) {
+        return ESL_BREAK;
+      }
+      if (deadline - now < slice) {
+        slice = (uint32_t)(deadline - now);
+      }
+    }
+
+    if (!pipeline->reading && !pipeline->closed) {
+      bool busy;
+
+      pipeline->reading = true;
+      pthread_mutex_unlock(&pipeline->lock);
+
+      busy = !pipeline_read(handle, pipeline, done, slice, since);
+      if (!handle->connected) {
+        esl_pipeline_fail(pipeline);
+      }
+
+      pthread_mutex_lock(&pipeline->lock);
+      pipeline->reading = false;
+      pthread_cond_broadcast(&pipeline->cond);
+      if (!busy || *done) {
+        continue;
+      }
+      /* the other reader delivers our reply; only a short wait in case it
+       * was not a reader but a brief holder of the handle mutex */
+      if (slice > ESL_PIPELINE_BUSY_SLICE) {
+        slice = ESL_PIPELINE_BUSY_SLICE;
+      }
+    }
+
+    {
+      const uint64_t until = now + slice;
+      const struct timespec abs = {
+          .tv_sec = (time_t)(until / 1000),
+          .tv_nsec = (long)(until % 1000) * 1'000'000};
+
+      pthread_cond_timedwait(&pipeline->cond, &pipeline->lock, &abs);
+    }
+  }
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reply_wait(esl_handle_t *handle, esl_reply_t *reply, uint32_t ms,
+               esl_event_t **event) {
+  return esl_reply_wait_until(handle, reply,
+                              ms ? esl_monotonic_ms() + ms : 0, event);
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reply_wait_until(esl_handle_t *handle, esl_reply_t *reply,
+                     uint64_t deadline_ms, esl_event_t **event) {
+  esl_status_t status;
+
+  if (event) {
+    *event = nullptr;
+  }
+  if (!handle || reply == nullptr) {
+    return ESL_FAIL;
+  }
+
+  if ((status = pipeline_wait(handle, reply->pipeline, &reply->done,
+                              deadline_ms)) == ESL_SUCCESS) {
+    status = reply->status;
+    if (event) {
+      *event = reply->event;
+      reply->event = nullptr;
+    }
+  }
+  pthread_mutex_unlock(&reply->pipeline->lock);
+
+  return status;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_job_wait(esl_handle_t *handle, esl_job_t *job, uint32_t ms,
+             esl_event_t **event) {
+  esl_status_t status;
+
+  if (event) {
+    *event = nullptr;
+  }
+  if (!handle || job == nullptr) {
+    return ESL_FAIL;
+  }
+
+  if ((status = pipeline_wait(handle, job->pipeline, &job->done,
+                              ms ? esl_monotonic_ms() + ms : 0)) ==
+      ESL_SUCCESS) {
+    status = job->status;
+    if (event) {
+      *event = job->event;
+      job->event = nullptr;
+    }
+  }
+  pthread_mutex_unlock(&job->pipeline->lock);
+
+  return status;
+}
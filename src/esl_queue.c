@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "esl/esl_queue.h"
+#include "esl/esl_event.h"
+#include "esl/esl_threadmutex.h"
+
+constexpr esl_size_t ESL_QUEUE_DEFAULT_CAPACITY = 16'384;
+constexpr uint32_t ESL_QUEUE_DEFAULT_BLOCK_MS = 1000;
+/* Slots a rank's ring allocates on its first push; it doubles from there. */
+constexpr esl_size_t ESL_QUEUE_MIN_SLOTS = 16;
+/* Priority classes in the order ESL_QUEUE_OVERFLOW_DROP_PRIORITY gives them
+ * up: low, normal, high. */
+constexpr int ESL_QUEUE_RANKS = 3;
+
+typedef struct {
+  esl_event_t *event;
+  /* arrival order across all ranks */
+  uint64_t seq;
+} esl_queue_slot_t;
+
+/* FIFO of one rank's events: size slots (a power of two), count of them
+ * used from head */
+typedef struct {
+  esl_queue_slot_t *slots;
+  esl_size_t size;
+  esl_size_t head;
+  esl_size_t count;
+} esl_queue_ring_t;
+
+struct esl_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t not_full;
+  pthread_cond_t not_empty;
+  /* one ring per priority rank; pop merges them by seq */
+  esl_queue_ring_t rings[ESL_QUEUE_RANKS];
+  uint64_t next_seq;
+  /* events queued over all rings */
+  esl_size_t count;
+  esl_queue_config_t config;
+  esl_size_t high_water;
+  uint64_t pushed;
+  uint64_t dropped;
+  bool closed;
+  /* the owner's reference and one per caller waiting for room */
+  int refs;
+  /* esl_queue_push_wait callers holding an event until there is room */
+  int blocked;
+};
+
+static int queue_rank(const esl_event_t *event) {
+  switch (event->priority) {
+  case ESL_PRIORITY_LOW:
+    return 0;
+  case ESL_PRIORITY_HIGH:
+    return 2;
+  default:
+    return 1;
+  }
+}
+
+static esl_queue_config_t queue_config(const esl_queue_config_t *config) {
+  esl_queue_config_t c = config ? *config : (esl_queue_config_t){0};
+
+  if (!c.capacity) {
+    c.capacity = ESL_QUEUE_DEFAULT_CAPACITY;
+  }
+  if (!c.block_ms) {
+    c.block_ms = ESL_QUEUE_DEFAULT_BLOCK_MS;
+  }
+  return c;
+}
+
+static void queue_free(esl_queue_t *queue) {
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_cond_destroy(&queue->not_full);
+  pthread_mutex_destroy(&queue->lock);
+  for (int r = 0; r < ESL_QUEUE_RANKS; r++) {
+    free(queue->rings[r].slots);
+  }
+  free(queue);
+}
+
+/* Remove and return the oldest event of a non-empty rank with the queue
+ * locked. */
+static esl_event_t *queue_take_rank(esl_queue_t *queue, int rank) {
+  esl_queue_ring_t *ring = &queue->rings[rank];
+  esl_event_t *event = ring->slots[ring->head].event;
+
+  ring->slots[ring->head].event = nullptr;
+  ring->head = (ring->head + 1) & (ring->size - 1);
+  ring->count--;
+  queue->count--;
+
+  return event;
+}
+
+/* Remove and return the oldest event with the queue locked: the earliest
+ * head of the ranks. */
+static esl_event_t *queue_take(esl_queue_t *queue) {
+  int oldest = -1;
+
+  for (int r = 0; r < ESL_QUEUE_RANKS; r++) {
+    const esl_queue_ring_t *ring = &queue->rings[r];
+
+    if (ring->count &&
+        (oldest < 0 ||
+         ring->slots[ring->head].seq <
+             queue->rings[oldest].slots[queue->rings[oldest].head].seq)) {
+      oldest = r;
+    }
+  }
+
+  return queue_take_rank(queue, oldest);
+}
+
+/* Make room for one more event in a rank's ring with the queue locked. */
+static esl_status_t queue_reserve(esl_queue_ring_t *ring) {
+  esl_queue_slot_t *slots;
+  esl_size_t size;
+
+  if (ring->count < ring->size) {
+    return ESL_SUCCESS;
+  }
+
+  size = ring->size ? ring->size * 2 : ESL_QUEUE_MIN_SLOTS;
+  if ((slots = calloc(size, sizeof(*slots))) == nullptr) {
+    return ESL_FAIL;
+  }
+  for (esl_size_t i = 0; i < ring->count; i++) {
+    slots[i] = ring->slots[(ring->head + i) & (ring->size - 1)];
+  }
+  free(ring->slots);
+  ring->slots = slots;
+  ring->size = size;
+  ring->head = 0;
+
+  return ESL_SUCCESS;
+}
+
+/* Drop the oldest event of the lowest rank present, if that rank is not
+ * above rank. Returns false if nothing queued ranks that low. */
+static bool queue_evict_rank(esl_queue_t *queue, int rank) {
+  for (int low = 0; low <= rank; low++) {
+    if (queue->rings[low].count) {
+      esl_event_t *victim = queue_take_rank(queue, low);
+
+      esl_event_destroy(&victim);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_queue_create(esl_queue_t **queue, const esl_queue_config_t *config) {
+  esl_queue_t *new_queue = nullptr;
+  pthread_condattr_t attr;
+
+  if (queue == nullptr) {
+    return ESL_FAIL;
+  }
+  *queue = nullptr;
+
+  if ((new_queue = calloc(1, sizeof(*new_queue))) == nullptr) {
+    return ESL_FAIL;
+  }
+
+  if (pthread_mutex_init(&new_queue->lock, nullptr) != 0) {
+    free(new_queue);
+    return ESL_FAIL;
+  }
+  if (pthread_condattr_init(&attr) != 0) {
+    goto fail;
+  }
+  if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+      pthread_cond_init(&new_queue->not_full, &attr) != 0) {
+    pthread_condattr_destroy(&attr);
+    goto fail;
+  }
+  pthread_condattr_destroy(&attr);
+  if (pthread_cond_init(&new_queue->not_empty, nullptr) != 0) {
+    pthread_cond_destroy(&new_queue->not_full);
+    goto fail;
+  }
+
+  new_queue->config = queue_config(config);
+  new_queue->refs = 1;
+  *queue = new_queue;
+  return ESL_SUCCESS;
+
+fail:
+  pthread_mutex_destroy(&new_queue->lock);
+  free(new_queue);
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_queue_configure(esl_queue_t *queue, const esl_queue_config_t *config) {
+  const esl_queue_config_t c = queue_config(config);
+  esl_status_t status = ESL_FAIL;
+
+  if (queue == nullptr) {
+    return ESL_FAIL;
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->count <= c.capacity) {
+    queue->config = c;
+    pthread_cond_broadcast(&queue->not_full);
+    status = ESL_SUCCESS;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return status;
+}
+
+ESL_DECLARE(void) esl_queue_destroy(esl_queue_t **queue) {
+  esl_queue_t *qp = nullptr;
+  bool release;
+
+  if (queue == nullptr || *queue == nullptr) {
+    return;
+  }
+
+  qp = *queue;
+  *queue = nullptr;
+
+  pthread_mutex_lock(&qp->lock);
+  while (qp->count) {
+    esl_event_t *event = queue_take(qp);
+    esl_event_destroy(&event);
+  }
+  qp->closed = true;
+  pthread_cond_broadcast(&qp->not_full);
+  pthread_cond_broadcast(&qp->not_empty);
+  release = --qp->refs == 0;
+  pthread_mutex_unlock(&qp->lock);
+
+  if (release) {
+    queue_free(qp);
+  }
+}
+
+/* Append *event with the queue locked, applying the overflow policy. Leaves
+ * *event set if it was not queued. */
+static esl_status_t queue_push_locked(esl_queue_t *queue,
+                                      esl_event_t **event) {
+  esl_queue_ring_t *ring;
+
+  queue->pushed++;
+
+  if (queue->count >= queue->config.capacity) {
+    bool room = false;
+
+    switch (queue->config.overflow) {
+    case ESL_QUEUE_OVERFLOW_DROP_OLDEST: {
+      esl_event_t *oldest = queue_take(queue);
+      esl_event_destroy(&oldest);
+      room = true;
+    } break;
+    case ESL_QUEUE_OVERFLOW_DROP_PRIORITY:
+      room = queue_evict_rank(queue, queue_rank(*event));
+      break;
+    default:
+      break;
+    }
+
+    queue->dropped++;
+    if (!room) {
+      return ESL_BREAK;
+    }
+  }
+
+  ring = &queue->rings[queue_rank(*event)];
+  if (queue_reserve(ring) != ESL_SUCCESS) {
+    queue->dropped++;
+    return ESL_FAIL;
+  }
+  ring->slots[(ring->head + ring->count) & (ring->size - 1)] =
+      (esl_queue_slot_t){.event = *event, .seq = queue->next_seq++};
+  ring->count++;
+  queue->count++;
+  if (queue->count > queue->high_water) {
+    queue->high_water = queue->count;
+  }
+  *event = nullptr;
+  pthread_cond_signal(&queue->not_empty);
+
+  return ESL_SUCCESS;
+}
+
+/* With the queue locked and a reference taken, wait up to block_ms for
+ * room with outer released. Returns with the queue locked and outer still
+ * released. */
+static esl_status_t queue_wait_locked(esl_queue_t *queue,
+                                      esl_mutex_t *outer) {
+  struct timespec abs;
+  esl_status_t status = ESL_SUCCESS;
+
+  clock_gettime(CLOCK_MONOTONIC, &abs);
+  abs.tv_sec += queue->config.block_ms / 1000;
+  abs.tv_nsec += (long)(queue->config.block_ms % 1000) * 1'000'000;
+  if (abs.tv_nsec >= 1'000'000'000) {
+    abs.tv_sec++;
+    abs.tv_nsec -= 1'000'000'000;
+  }
+
+  if (outer) {
+    esl_mutex_unlock(outer);
+  }
+
+  while (!queue->closed && queue->count >= queue->config.capacity) {
+    if (pthread_cond_timedwait(&queue->not_full, &queue->lock, &abs) ==
+        ETIMEDOUT) {
+      status = queue->count >= queue->config.capacity ? ESL_BREAK
+                                                      : ESL_SUCCESS;
+      break;
+    }
+  }
+
+  return queue->closed ? ESL_FAIL : status;
+}
+
+/* Drop a waiter's reference, unlock the queue and take outer back. */
+static void queue_wait_done(esl_queue_t *queue, esl_mutex_t *outer) {
+  const bool release = --queue->refs == 0;
+
+  pthread_mutex_unlock(&queue->lock);
+  if (outer) {
+    esl_mutex_lock(outer);
+  }
+  if (release) {
+    queue_free(queue);
+  }
+}
+
+ESL_DECLARE(esl_status_t)
+esl_queue_push(esl_queue_t *queue, esl_event_t *event) {
+  esl_status_t status;
+
+  if (event == nullptr) {
+    return ESL_FAIL;
+  }
+  if (queue == nullptr) {
+    esl_event_destroy(&event);
+    return ESL_FAIL;
+  }
+  event->next = nullptr;
+
+  pthread_mutex_lock(&queue->lock);
+  status = queue_push_locked(queue, &event);
+  pthread_mutex_unlock(&queue->lock);
+  if (event) {
+    esl_event_destroy(&event);
+  }
+
+  return status;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_queue_push_wait(esl_queue_t *queue, esl_event_t *event,
+                    esl_mutex_t *outer) {
+  esl_status_t status;
+
+  if (event == nullptr) {
+    return ESL_FAIL;
+  }
+  if (queue == nullptr) {
+    esl_event_destroy(&event);
+    return ESL_FAIL;
+  }
+  event->next = nullptr;
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->config.overflow != ESL_QUEUE_OVERFLOW_BLOCK ||
+      queue->count < queue->config.capacity) {
+    status = queue_push_locked(queue, &event);
+    pthread_mutex_unlock(&queue->lock);
+  } else {
+    queue->refs++;
+    queue->blocked++;
+    status = queue_wait_locked(queue, outer);
+    queue->blocked--;
+    /* queued before outer is taken back, so no consumer can read past it */
+    if (status != ESL_FAIL) {
+      status = queue_push_locked(queue, &event);
+    }
+    pthread_cond_broadcast(&queue->not_empty);
+    queue_wait_done(queue, outer);
+  }
+
+  if (event) {
+    esl_event_destroy(&event);
+  }
+
+  return status;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_queue_wait_room(esl_queue_t *queue, esl_mutex_t *outer) {
+  esl_status_t status;
+
+  if (queue == nullptr) {
+    return ESL_FAIL;
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->config.overflow != ESL_QUEUE_OVERFLOW_BLOCK ||
+      queue->count < queue->config.capacity) {
+    pthread_mutex_unlock(&queue->lock);
+    return ESL_SUCCESS;
+  }
+
+  queue->refs++;
+  status = queue_wait_locked(queue, outer);
+  queue_wait_done(queue, outer);
+
+  return status;
+}
+
+ESL_DECLARE(esl_event_t *) esl_queue_pop(esl_queue_t *queue) {
+  esl_event_t *event = nullptr;
+
+  if (queue == nullptr) {
+    return nullptr;
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  /* a blocked push already holds the next event; hand that out first */
+  while (!queue->count && queue->blocked && !queue->closed) {
+    pthread_cond_wait(&queue->not_empty, &queue->lock);
+  }
+  if (queue->count) {
+    event = queue_take(queue);
+    pthread_cond_signal(&queue->not_full);
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return event;
+}
+
+ESL_DECLARE(esl_size_t) esl_queue_depth(esl_queue_t *queue) {
+  esl_size_t depth;
+
+  if (queue == nullptr) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  depth = queue->count;
+  pthread_mutex_unlock(&queue->lock);
+
+  return depth;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_queue_get_stats(esl_queue_t *queue, esl_queue_stats_t *stats) {
+  if (queue == nullptr || stats == nullptr) {
+    return ESL_FAIL;
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  *stats = (esl_queue_stats_t){.depth = queue->count,
+                               .high_water = queue->high_water,
+                               .pushed = queue->pushed,
+                               .dropped = queue->dropped};
+  pthread_mutex_unlock(&queue->lock);
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_handle_set_event_queue(esl_handle_t *handle,
+                           const esl_queue_config_t *config) {
+  esl_status_t status;
+
+  if (!handle) {
+    return ESL_FAIL;
+  }
+
+  if (handle->mutex) {
+    esl_mutex_lock(handle->mutex);
+  }
+
+  if (handle->event_queue) {
+    status = esl_queue_configure(handle->event_queue, config);
+  } else {
+    status = esl_queue_create(&handle->event_queue, config);
+  }
+
+  if (handle->mutex) {
+    esl_mutex_unlock(handle->mutex);
+  }
+
+  return status;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_handle_queue_event(esl_handle_t *handle, esl_event_t *event) {
+  esl_status_t status;
+
+  if (!handle->event_queue &&
+      esl_queue_create(&handle->event_queue, nullptr) != ESL_SUCCESS) {
+    esl_event_destroy(&event);
+    return ESL_FAIL;
+  }
+
+  status = esl_queue_push_wait(handle->event_queue, event, handle->mutex);
+
+  /* a handle disconnected while we waited has no queue any more */
+  return handle->event_queue ? status : ESL_FAIL;
+}
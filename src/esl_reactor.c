@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "esl/esl_reactor.h"
+#include "esl/esl_event.h"
+#include "esl/esl_queue.h"
+#include "esl/esl_threadmutex.h"
+#include "esl/esl_uring.h"
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+constexpr int ESL_REACTOR_MAX_EVENTS = 256;
+
+struct esl_reactor_entry {
+  esl_handle_t *handle;
+  esl_socket_t sock;
+  esl_reactor_callback_t callback;
+  void *user_data;
+  bool removed;
+  bool drain;
+  struct esl_reactor_entry *next;
+};
+
+struct esl_reactor {
+  int epfd;
+  int wakefd;
+  esl_mutex_t *mutex;
+  struct esl_reactor_entry *entries;
+  esl_size_t count;
+  int depth;
+  _Atomic bool running;
+};
+
+ESL_DECLARE(esl_status_t) esl_reactor_create(esl_reactor_t **reactor) {
+  esl_reactor_t *new_reactor = nullptr;
+  struct epoll_event ev = {0};
+
+  if (reactor == nullptr) {
+    return ESL_FAIL;
+  }
+  *reactor = nullptr;
+
+  new_reactor = calloc(1, sizeof(*new_reactor));
+  if (new_reactor == nullptr) {
+    return ESL_FAIL;
+  }
+  new_reactor->epfd = -1;
+  new_reactor->wakefd = -1;
+
+  if ((new_reactor->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    goto fail;
+  }
+
+  if ((new_reactor->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    goto fail;
+  }
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  if (epoll_ctl(new_reactor->epfd, EPOLL_CTL_ADD, new_reactor->wakefd, &ev)) {
+    goto fail;
+  }
+
+  if (esl_mutex_create(&new_reactor->mutex) != ESL_SUCCESS) {
+    goto fail;
+  }
+
+  *reactor = new_reactor;
+  return ESL_SUCCESS;
+
+fail:
+  if (new_reactor->wakefd >= 0) {
+    close(new_reactor->wakefd);
+  }
+  if (new_reactor->epfd >= 0) {
+    close(new_reactor->epfd);
+  }
+  free(new_reactor);
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(void) esl_reactor_destroy(esl_reactor_t **reactor) {
+  esl_reactor_t *rp = nullptr;
+  struct esl_reactor_entry *ep, *next;
+
+  if (reactor == nullptr || *reactor == nullptr) {
+    return;
+  }
+
+  rp = *reactor;
+
+  for (ep = rp->entries; ep; ep = next) {
+    next = ep->next;
+    free(ep);
+  }
+
+  close(rp->wakefd);
+  close(rp->epfd);
+  esl_mutex_destroy(&rp->mutex);
+  free(rp);
+
+  *reactor = nullptr;
+}
+
+static void reactor_wake(esl_reactor_t *reactor) {
+  const uint64_t one = 1;
+
+  if (write(reactor->wakefd, &one, sizeof(one)) < 0) {
+    /* counter saturated, a wakeup is already pending */
+  }
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reactor_add_handle(esl_reactor_t *reactor, esl_handle_t *handle,
+                       esl_reactor_callback_t callback, void *user_data) {
+  struct esl_reactor_entry *entry = nullptr;
+  struct epoll_event ev = {0};
+
+  if (reactor == nullptr || handle == nullptr || callback == nullptr ||
+      !handle->connected || handle->sock == ESL_SOCK_INVALID ||
+      handle->packet_buf == nullptr) {
+    return ESL_FAIL;
+  }
+
+  entry = calloc(1, sizeof(*entry));
+  if (entry == nullptr) {
+    return ESL_FAIL;
+  }
+
+  entry->handle = handle;
+  /* a handle on the io_uring transport is readable through its ring */
+  entry->sock = handle->uring ? esl_uring_fd(handle->uring) : handle->sock;
+  entry->callback = callback;
+  entry->user_data = user_data;
+  /* anything buffered before registration will not raise EPOLLIN again */
+  entry->drain = esl_queue_depth(handle->event_queue) > 0 ||
+                 esl_buffer_inuse(handle->packet_buf) > 0;
+
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.ptr = entry;
+
+  esl_mutex_lock(reactor->mutex);
+
+  if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, entry->sock, &ev)) {
+    esl_mutex_unlock(reactor->mutex);
+    free(entry);
+    return ESL_FAIL;
+  }
+
+  entry->next = reactor->entries;
+  reactor->entries = entry;
+  reactor->count++;
+
+  esl_mutex_unlock(reactor->mutex);
+
+  if (entry->drain) {
+    reactor_wake(reactor);
+  }
+
+  return ESL_SUCCESS;
+}
+
+static void reactor_remove_entry(esl_reactor_t *reactor,
+                                 struct esl_reactor_entry *entry) {
+  if (entry->removed) {
+    return;
+  }
+
+  entry->removed = true;
+  (void)epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, entry->sock, nullptr);
+  reactor->count--;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reactor_remove_handle(esl_reactor_t *reactor, esl_handle_t *handle) {
+  struct esl_reactor_entry *ep;
+  esl_status_t status = ESL_FAIL;
+
+  if (reactor == nullptr || handle == nullptr) {
+    return ESL_FAIL;
+  }
+
+  esl_mutex_lock(reactor->mutex);
+  for (ep = reactor->entries; ep; ep = ep->next) {
+    if (ep->handle == handle && !ep->removed) {
+      reactor_remove_entry(reactor, ep);
+      status = ESL_SUCCESS;
+      break;
+    }
+  }
+  esl_mutex_unlock(reactor->mutex);
+
+  return status;
+}
+
+ESL_DECLARE(esl_size_t) esl_reactor_count(esl_reactor_t *reactor) {
+  esl_size_t count = 0;
+
+  if (reactor == nullptr) {
+    return 0;
+  }
+
+  esl_mutex_lock(reactor->mutex);
+  count = reactor->count;
+  esl_mutex_unlock(reactor->mutex);
+
+  return count;
+}
+
+/* Hand every complete event buffered on the entry's handle to its callback.
+ * Reads stop at the first would-block so one busy handle cannot hold the
+ * loop for longer than its socket backlog. */
+static bool reactor_drain(esl_reactor_t *reactor,
+                          struct esl_reactor_entry *entry) {
+  esl_handle_t *handle = entry->handle;
+  bool dispatched = false;
+
+  while (!entry->removed) {
+    esl_event_t *event = nullptr;
+    const auto status = esl_recv_event_nowait(handle, 1, nullptr);
+
+    if (status == ESL_BREAK) {
+      break;
+    }
+
+    if (status == ESL_SUCCESS) {
+      /* take the event over from last_event so last_ievent stays valid */
+      event = handle->last_event;
+      handle->last_event = nullptr;
+      if (event) {
+        entry->callback(reactor, handle, event, entry->user_data);
+        dispatched = true;
+      }
+      continue;
+    }
+
+    esl_mutex_lock(reactor->mutex);
+    reactor_remove_entry(reactor, entry);
+    esl_mutex_unlock(reactor->mutex);
+
+    entry->callback(reactor, handle, nullptr, entry->user_data);
+    dispatched = true;
+  }
+
+  return dispatched;
+}
+
+static void reactor_sweep(esl_reactor_t *reactor) {
+  struct esl_reactor_entry *ep, *lp = nullptr, *next;
+
+  for (ep = reactor->entries; ep; ep = next) {
+    next = ep->next;
+    if (ep->removed) {
+      if (lp) {
+        lp->next = next;
+      } else {
+        reactor->entries = next;
+      }
+      free(ep);
+    } else {
+      lp = ep;
+    }
+  }
+}
+
+static esl_status_t reactor_poll(esl_reactor_t *reactor, int timeout) {
+  struct epoll_event events[ESL_REACTOR_MAX_EVENTS];
+  struct esl_reactor_entry *ep;
+  bool dispatched = false;
+  bool woken = false;
+  int n, i;
+
+  n = epoll_wait(reactor->epfd, events, ESL_REACTOR_MAX_EVENTS, timeout);
+
+  if (n < 0) {
+    return errno == EINTR ? ESL_BREAK : ESL_FAIL;
+  }
+
+  esl_mutex_lock(reactor->mutex);
+  reactor->depth++;
+  esl_mutex_unlock(reactor->mutex);
+
+  for (i = 0; i < n; i++) {
+    ep = events[i].data.ptr;
+
+    if (ep == nullptr) {
+      uint64_t value = 0;
+      if (read(reactor->wakefd, &value, sizeof(value)) < 0) {
+        /* already drained by a concurrent wakeup */
+      }
+      woken = true;
+      continue;
+    }
+
+    if (reactor_drain(reactor, ep)) {
+      dispatched = true;
+    }
+  }
+
+  if (woken) {
+    esl_mutex_lock(reactor->mutex);
+    for (ep = reactor->entries; ep; ep = ep->next) {
+      if (!ep->drain || ep->removed) {
+        continue;
+      }
+      ep->drain = false;
+      esl_mutex_unlock(reactor->mutex);
+      if (reactor_drain(reactor, ep)) {
+        dispatched = true;
+      }
+      esl_mutex_lock(reactor->mutex);
+    }
+    esl_mutex_unlock(reactor->mutex);
+  }
+
+  esl_mutex_lock(reactor->mutex);
+  if (--reactor->depth == 0) {
+    reactor_sweep(reactor);
+  }
+  esl_mutex_unlock(reactor->mutex);
+
+  return dispatched ? ESL_SUCCESS : ESL_BREAK;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reactor_run_once(esl_reactor_t *reactor, uint32_t ms) {
+  if (reactor == nullptr) {
+    return ESL_FAIL;
+  }
+
+  return reactor_poll(reactor, ms > INT32_MAX ? INT32_MAX : (int)ms);
+}
+
+ESL_DECLARE(esl_status_t) esl_reactor_run(esl_reactor_t *reactor) {
+  if (reactor == nullptr) {
+    return ESL_FAIL;
+  }
+
+  atomic_store_explicit(&reactor->running, true, memory_order_release);
+
+  while (atomic_load_explicit(&reactor->running, memory_order_acquire)) {
+    if (reactor_poll(reactor, -1) == ESL_FAIL) {
+      atomic_store_explicit(&reactor->running, false, memory_order_release);
+      return ESL_FAIL;
+    }
+  }
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(void) esl_reactor_stop(esl_reactor_t *reactor) {
+  if (reactor == nullptr) {
+    return;
+  }
+
+  atomic_store_explicit(&reactor->running, false, memory_order_release);
+  reactor_wake(reactor);
+}
+
+#else
+
+ESL_DECLARE(esl_status_t) esl_reactor_create(esl_reactor_t **reactor) {
+  if (reactor != nullptr) {
+    *reactor = nullptr;
+  }
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(void) esl_reactor_destroy(esl_reactor_t **reactor) {
+  if (reactor != nullptr) {
+    *reactor = nullptr;
+  }
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reactor_add_handle([[maybe_unused]] esl_reactor_t *reactor,
+                       [[maybe_unused]] esl_handle_t *handle,
+                       [[maybe_unused]] esl_reactor_callback_t callback,
+                       [[maybe_unused]] void *user_data) {
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reactor_remove_handle([[maybe_unused]] esl_reactor_t *reactor,
+                          [[maybe_unused]] esl_handle_t *handle) {
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(esl_size_t)
+esl_reactor_count([[maybe_unused]] esl_reactor_t *reactor) {
+  return 0;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reactor_run_once([[maybe_unused]] esl_reactor_t *reactor,
+                     [[maybe_unused]] uint32_t ms) {
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_reactor_run([[maybe_unused]] esl_reactor_t *reactor) {
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(void) esl_reactor_stop([[maybe_unused]] esl_reactor_t *reactor) {}
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esl/esl_scan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ESL_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+constexpr esl_size_t ESL_SCAN_NO_COLON = SIZE_MAX;
+
+typedef struct {
+  const char *data;
+  esl_scan_line_t *lines;
+  esl_size_t max_lines;
+  esl_size_t count;
+  esl_size_t start;
+  esl_size_t colon;
+  esl_size_t block_len;
+} scan_lines_state_t;
+
+typedef struct {
+  const char *name;
+  esl_size_t (*find2)(const unsigned char *data, esl_size_t len,
+                      unsigned char a, unsigned char b);
+  void (*lines)(scan_lines_state_t *state, esl_size_t len);
+} scan_kernels_t;
+
+/* Handle a ':' or '\n' at pos. Returns true when scanning should stop. */
+static inline bool scan_lines_hit(scan_lines_state_t *state, esl_size_t pos) {
+  esl_size_t line_len;
+
+  if (state->data[pos] == ':') {
+    if (state->colon == ESL_SCAN_NO_COLON) {
+      state->colon = pos;
+    }
+    return false;
+  }
+
+  line_len = pos - state->start;
+  if (line_len == 0 || (line_len == 1 && state->data[state->start] == '\r')) {
+    state->block_len = pos + 1;
+    return true;
+  }
+
+  state->lines[state->count].start = state->start;
+  state->lines[state->count].colon =
+      state->colon == ESL_SCAN_NO_COLON ? pos : state->colon;
+  state->lines[state->count].end = pos;
+  state->count++;
+  state->start = pos + 1;
+  state->colon = ESL_SCAN_NO_COLON;
+
+  return state->count == state->max_lines;
+}
+
+static esl_size_t scan_find2_scalar(const unsigned char *data, esl_size_t len,
+                                    unsigned char a, unsigned char b) {
+  esl_size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (data[i] == a || data[i] == b) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+static void scan_lines_scalar_from(scan_lines_state_t *state, esl_size_t i,
+                                   esl_size_t len) {
+  for (; i < len; i++) {
+    const char c = state->data[i];
+
+    if ((c == '\n' || c == ':') && scan_lines_hit(state, i)) {
+      return;
+    }
+  }
+}
+
+static void scan_lines_scalar(scan_lines_state_t *state, esl_size_t len) {
+  scan_lines_scalar_from(state, 0, len);
+}
+
+static const scan_kernels_t SCAN_SCALAR = {
+    .name = "scalar",
+    .find2 = scan_find2_scalar,
+    .lines = scan_lines_scalar,
+};
+
+#ifdef ESL_SCAN_X86
+
+static esl_size_t scan_find2_sse2(const unsigned char *data, esl_size_t len,
+                                  unsigned char a, unsigned char b) {
+  const __m128i va = _mm_set1_epi8((char)a);
+  const __m128i vb = _mm_set1_epi8((char)b);
+  esl_size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+    const unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+
+    if (mask) {
+      return i + (esl_size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i + scan_find2_scalar(data + i, len - i, a, b);
+}
+
+static void scan_lines_sse2(scan_lines_state_t *state, esl_size_t len) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i colon = _mm_set1_epi8(':');
+  esl_size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)(state->data + i));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, colon)));
+
+    while (mask) {
+      if (scan_lines_hit(state, i + (esl_size_t)__builtin_ctz(mask))) {
+        return;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  scan_lines_scalar_from(state, i, len);
+}
+
+static const scan_kernels_t SCAN_SSE2 = {
+    .name = "sse2",
+    .find2 = scan_find2_sse2,
+    .lines = scan_lines_sse2,
+};
+
+__attribute__((target("avx2"))) static esl_size_t
+scan_find2_avx2(const unsigned char *data, esl_size_t len, unsigned char a,
+                unsigned char b) {
+  const __m256i va = _mm256_set1_epi8((char)a);
+  const __m256i vb = _mm256_set1_epi8((char)b);
+  esl_size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+    const unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+
+    if (mask) {
+      return i + (esl_size_t)__builtin_ctz(mask);
+    }
+  }
+
+  return i + scan_find2_sse2(data + i, len - i, a, b);
+}
+
+__attribute__((target("avx2"))) static void
+scan_lines_avx2(scan_lines_state_t *state, esl_size_t len) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i colon = _mm256_set1_epi8(':');
+  esl_size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)(state->data + i));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, colon)));
+
+    while (mask) {
+      if (scan_lines_hit(state, i + (esl_size_t)__builtin_ctz(mask))) {
+        return;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  scan_lines_scalar_from(state, i, len);
+}
+
+static const scan_kernels_t SCAN_AVX2 = {
+    .name = "avx2",
+    .find2 = scan_find2_avx2,
+    .lines = scan_lines_avx2,
+};
+
+#endif
+
+static _Atomic(const scan_kernels_t *) scan_active = nullptr;
+
+static const scan_kernels_t *scan_best(void) {
+#ifdef ESL_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return &SCAN_AVX2;
+  }
+  return &SCAN_SSE2;
+#else
+  return &SCAN_SCALAR;
+#endif
+}
+
+static inline const scan_kernels_t *scan_kernels(void) {
+  const scan_kernels_t *kernels =
+      atomic_load_explicit(&scan_active, memory_order_acquire);
+
+  if (kernels == nullptr) {
+    kernels = scan_best();
+    atomic_store_explicit(&scan_active, kernels, memory_order_release);
+  }
+
+  return kernels;
+}
+
+ESL_DECLARE(esl_size_t)
+esl_scan_find2(const void *data, esl_size_t len, unsigned char a,
+               unsigned char b) {
+  if (data == nullptr || len == 0) {
+    return 0;
+  }
+
+  return scan_kernels()->find2((const unsigned char *)data, len, a, b);
+}
+
+ESL_DECLARE(esl_size_t)
+esl_scan_header_lines(const char *data, esl_size_t len,
+                      esl_scan_line_t *lines, esl_size_t max_lines,
+                      esl_size_t *block_len) {
+  scan_lines_state_t state = {
+      .data = data,
+      .lines = lines,
+      .max_lines = max_lines,
+      .colon = ESL_SCAN_NO_COLON,
+  };
+
+  if (block_len) {
+    *block_len = 0;
+  }
+
+  if (data == nullptr || lines == nullptr || max_lines == 0) {
+    return 0;
+  }
+
+  scan_kernels()->lines(&state, len);
+
+  if (block_len) {
+    *block_len = state.block_len;
+  }
+
+  return state.count;
+}
+
+ESL_DECLARE(const char *) esl_scan_impl(void) { return scan_kernels()->name; }
+
+ESL_DECLARE(esl_status_t) esl_scan_set_impl(const char *name) {
+  const scan_kernels_t *kernels = nullptr;
+
+  if (name == nullptr) {
+    kernels = scan_best();
+  } else if (!strcmp(name, "scalar")) {
+    kernels = &SCAN_SCALAR;
+#ifdef ESL_SCAN_X86
+  } else if (!strcmp(name, "sse2")) {
+    kernels = &SCAN_SSE2;
+  } else if (!strcmp(name, "avx2")) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      kernels = &SCAN_AVX2;
+    }
+#endif
+  }
+
+  if (kernels == nullptr) {
+    return ESL_FAIL;
+  }
+
+  atomic_store_explicit(&scan_active, kernels, memory_order_release);
+
+  return ESL_SUCCESS;
+}
@@ -0,0 +1,691 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* accept4() */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "esl/esl_server.h"
+
+constexpr int ESL_SERVER_DEFAULT_BACKLOG = 10'000;
+constexpr int ESL_SERVER_DEFAULT_WORKERS = 128;
+constexpr int ESL_SERVER_DEFAULT_QUEUE = 1024;
+/* Connections taken off a listener per wakeup before they are queued. */
+constexpr int ESL_SERVER_ACCEPT_BATCH = 64;
+
+typedef struct {
+  esl_socket_t server_sock;
+  esl_socket_t client_sock;
+  struct sockaddr_in addr;
+} esl_server_conn_t;
+
+struct esl_server {
+  esl_server_config_t config;
+  esl_listen_callback_t callback;
+  void *user_data;
+  esl_socket_t *listeners;
+  int listener_count;
+  esl_port_t port;
+  /* socket file to remove on destroy, when bound to a "unix:" host */
+  struct sockaddr_un unix_addr;
+  /* written by esl_server_stop to wake acceptors out of poll() */
+  int stop_pipe[2];
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  /* admission queue, a ring of config.queue_len entries */
+  esl_server_conn_t *queue;
+  int queue_head;
+  int queue_count;
+  /* worker threads, grown by acceptors when started lazily or unbounded */
+  pthread_t *workers;
+  int worker_count;
+  int worker_cap;
+  int idle_workers;
+
+  _Atomic bool running;
+  _Atomic bool failed;
+  _Atomic uint64_t accepted;
+  _Atomic uint64_t rejected;
+  _Atomic uint64_t dropped;
+  _Atomic uint64_t handled;
+};
+
+typedef struct {
+  esl_server_t *server;
+  esl_socket_t listener;
+} esl_server_acceptor_t;
+
+static esl_status_t server_listen(esl_server_t *server, bool reuseport,
+                                  const struct sockaddr *addr,
+                                  socklen_t addr_len, esl_socket_t *sockP) {
+  const bool is_unix = addr->sa_family == AF_UNIX;
+  esl_socket_t sock;
+  int on = 1;
+  int flags;
+
+  *sockP = ESL_SOCK_INVALID;
+
+  if ((sock = socket(addr->sa_family, SOCK_STREAM,
+                     is_unix ? 0 : IPPROTO_TCP)) < 0) {
+    return ESL_FAIL;
+  }
+
+  if (!is_unix &&
+      setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0) {
+    goto fail;
+  }
+#ifdef SO_REUSEPORT
+  if (reuseport &&
+      setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+    goto fail;
+  }
+#else
+  if (reuseport) {
+    goto fail;
+  }
+#endif
+
+  /* acceptors drain the listener until EAGAIN */
+  if ((flags = fcntl(sock, F_GETFL, 0)) < 0 ||
+      fcntl(sock, F_SETFL, flags | O_NONBLOCK) != 0 ||
+      fcntl(sock, F_SETFD, FD_CLOEXEC) != 0) {
+    goto fail;
+  }
+
+  if (bind(sock, addr, addr_len) < 0 ||
+      listen(sock, server->config.backlog) < 0) {
+    goto fail;
+  }
+
+  *sockP = sock;
+  return ESL_SUCCESS;
+
+fail:
+  close(sock);
+  return ESL_FAIL;
+}
+
+static esl_status_t server_bind(esl_server_t *server) {
+  struct sockaddr_in addr = {0};
+  struct sockaddr_un unix_addr;
+  socklen_t addr_len = sizeof(addr);
+  const int wanted = server->config.acceptors;
+  bool reuseport = wanted > 1;
+  esl_status_t is_unix;
+
+  is_unix = esl_unix_sockaddr(server->config.host, &unix_addr, &addr_len);
+  if (is_unix == ESL_FAIL) {
+    return ESL_FAIL;
+  }
+  if (is_unix == ESL_SUCCESS) {
+    /* a path has one owner: every acceptor shares a single listener */
+    server->listeners = calloc(1, sizeof(*server->listeners));
+    if (server->listeners == nullptr) {
+      return ESL_FAIL;
+    }
+    esl_unix_unlink(&unix_addr);
+    if (server_listen(server, false, (struct sockaddr *)&unix_addr, addr_len,
+                      &server->listeners[0]) != ESL_SUCCESS) {
+      return ESL_FAIL;
+    }
+    server->listener_count = 1;
+    server->unix_addr = unix_addr;
+    return ESL_SUCCESS;
+  }
+  addr_len = sizeof(addr);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons((uint16_t)server->config.port);
+
+  if (server->config.host &&
+      inet_pton(AF_INET, server->config.host, &addr.sin_addr) != 1) {
+    return ESL_FAIL;
+  }
+
+  server->listeners = calloc((size_t)wanted, sizeof(*server->listeners));
+  if (server->listeners == nullptr) {
+    return ESL_FAIL;
+  }
+
+  if (server_listen(server, reuseport, (struct sockaddr *)&addr, sizeof(addr),
+                    &server->listeners[0]) != ESL_SUCCESS) {
+    /* no SO_REUSEPORT: every acceptor shares one listener */
+    if (!reuseport ||
+        server_listen(server, false, (struct sockaddr *)&addr, sizeof(addr),
+                      &server->listeners[0]) != ESL_SUCCESS) {
+      return ESL_FAIL;
+    }
+    reuseport = false;
+  }
+  server->listener_count = 1;
+
+  /* the remaining listeners join the port the first one got */
+  if (getsockname(server->listeners[0], (struct sockaddr *)&addr,
+                  &addr_len) != 0) {
+    return ESL_FAIL;
+  }
+  server->port = (esl_port_t)ntohs(addr.sin_port);
+
+  while (reuseport && server->listener_count < wanted) {
+    if (server_listen(server, true, (struct sockaddr *)&addr, sizeof(addr),
+                      &server->listeners[server->listener_count]) !=
+        ESL_SUCCESS) {
+      return ESL_FAIL;
+    }
+    server->listener_count++;
+  }
+
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_server_create(esl_server_t **server, const esl_server_config_t *config,
+                  esl_listen_callback_t callback, void *user_data) {
+  esl_server_t *new_server = nullptr;
+  bool lock_init = false, empty_init = false, full_init = false;
+
+  if (server == nullptr) {
+    return ESL_FAIL;
+  }
+  *server = nullptr;
+
+  if (callback == nullptr) {
+    return ESL_FAIL;
+  }
+
+  new_server = calloc(1, sizeof(*new_server));
+  if (new_server == nullptr) {
+    return ESL_FAIL;
+  }
+  new_server->stop_pipe[0] = new_server->stop_pipe[1] = -1;
+
+  if (config) {
+    new_server->config = *config;
+  }
+  if (new_server->config.backlog <= 0) {
+    new_server->config.backlog = ESL_SERVER_DEFAULT_BACKLOG;
+  }
+  if (new_server->config.workers <= 0 &&
+      new_server->config.workers != ESL_SERVER_WORKERS_UNBOUNDED) {
+    new_server->config.workers = ESL_SERVER_DEFAULT_WORKERS;
+  }
+  if (new_server->config.queue_len <= 0) {
+    new_server->config.queue_len = ESL_SERVER_DEFAULT_QUEUE;
+  }
+  if (new_server->config.acceptors <= 0) {
+    new_server->config.acceptors = 1;
+  }
+  /* host only needs to live until the sockets are bound */
+  new_server->callback = callback;
+  new_server->user_data = user_data;
+
+  new_server->queue = calloc((size_t)new_server->config.queue_len,
+                             sizeof(*new_server->queue));
+  if (new_server->queue == nullptr) {
+    goto fail;
+  }
+
+  if (pthread_mutex_init(&new_server->lock, nullptr) != 0) {
+    goto fail;
+  }
+  lock_init = true;
+  if (pthread_cond_init(&new_server->not_empty, nullptr) != 0) {
+    goto fail;
+  }
+  empty_init = true;
+  if (pthread_cond_init(&new_server->not_full, nullptr) != 0) {
+    goto fail;
+  }
+  full_init = true;
+
+  if (pipe(new_server->stop_pipe) != 0 ||
+      fcntl(new_server->stop_pipe[0], F_SETFL, O_NONBLOCK) != 0 ||
+      fcntl(new_server->stop_pipe[0], F_SETFD, FD_CLOEXEC) != 0 ||
+      fcntl(new_server->stop_pipe[1], F_SETFD, FD_CLOEXEC) != 0) {
+    goto fail;
+  }
+
+  if (server_bind(new_server) != ESL_SUCCESS) {
+    goto fail;
+  }
+  new_server->config.host = nullptr;
+
+  *server = new_server;
+  return ESL_SUCCESS;
+
+fail:
+  if (full_init) {
+    pthread_cond_destroy(&new_server->not_full);
+  }
+  if (empty_init) {
+    pthread_cond_destroy(&new_server->not_empty);
+  }
+  if (lock_init) {
+    pthread_mutex_destroy(&new_server->lock);
+  }
+  for (int i = 0; i < new_server->listener_count; i++) {
+    close(new_server->listeners[i]);
+  }
+  esl_unix_unlink(&new_server->unix_addr);
+  if (new_server->stop_pipe[0] >= 0) {
+    close(new_server->stop_pipe[0]);
+    close(new_server->stop_pipe[1]);
+  }
+  free(new_server->listeners);
+  free(new_server->queue);
+  free(new_server);
+  return ESL_FAIL;
+}
+
+static void server_close_conn(esl_server_conn_t *conn) {
+  close(conn->client_sock);
+  conn->client_sock = ESL_SOCK_INVALID;
+}
+
+static void *server_worker(void *obj);
+
+/* Whether the pool starts workers as connections arrive rather than all up
+ * front. */
+static bool server_grows(const esl_server_t *server) {
+  return server->config.workers == ESL_SERVER_WORKERS_UNBOUNDED ||
+         server->config.lazy_workers;
+}
+
+/* Start one more worker. Called with the lock held, or before any thread
+ * that could grow the pool is running. */
+static bool server_spawn_worker(esl_server_t *server) {
+  pthread_attr_t attr;
+  bool ok;
+
+  if (server->worker_count == server->worker_cap) {
+    const int cap = server->worker_cap ? server->worker_cap * 2 : 16;
+    pthread_t *workers =
+        realloc(server->workers, (size_t)cap * sizeof(*workers));
+
+    if (workers == nullptr) {
+      return false;
+    }
+    server->workers = workers;
+    server->worker_cap = cap;
+  }
+
+  if (pthread_attr_init(&attr) != 0) {
+    return false;
+  }
+  ok = (!server->config.stack_size ||
+        pthread_attr_setstacksize(&attr, server->config.stack_size) == 0) &&
+       pthread_create(&server->workers[server->worker_count], &attr,
+                      server_worker, server) == 0;
+  pthread_attr_destroy(&attr);
+  if (ok) {
+    server->worker_count++;
+  }
+
+  return ok;
+}
+
+/* Queue a batch of accepted connections, applying the overflow policy to
+ * the ones that do not fit. */
+static void server_enqueue(esl_server_t *server, esl_server_conn_t *batch,
+                           int count) {
+  const int cap = server->config.queue_len;
+
+  pthread_mutex_lock(&server->lock);
+
+  for (int i = 0; i < count; i++) {
+    if (server->queue_count == cap) {
+      switch (server->config.overflow) {
+      case ESL_SERVER_OVERFLOW_REJECT:
+        server_close_conn(&batch[i]);
+        atomic_fetch_add_explicit(&server->rejected, 1, memory_order_relaxed);
+        continue;
+      case ESL_SERVER_OVERFLOW_DROP_OLDEST:
+        server_close_conn(&server->queue[server->queue_head]);
+        server->queue_head = (server->queue_head + 1) % cap;
+        server->queue_count--;
+        atomic_fetch_add_explicit(&server->dropped, 1, memory_order_relaxed);
+        break;
+      case ESL_SERVER_OVERFLOW_BLOCK:
+      default:
+        while (server->queue_count == cap &&
+               atomic_load_explicit(&server->running, memory_order_acquire)) {
+          pthread_cond_wait(&server->not_full, &server->lock);
+        }
+        if (server->queue_count == cap) {
+          server_close_conn(&batch[i]);
+          continue;
+        }
+        break;
+      }
+    }
+
+    server->queue[(server->queue_head + server->queue_count) % cap] =
+        batch[i];
+    server->queue_count++;
+    /* if no worker can be started the connection waits for a busy one */
+    if (server_grows(server) && server->queue_count > server->idle_workers &&
+        (server->config.workers == ESL_SERVER_WORKERS_UNBOUNDED ||
+         server->worker_count < server->config.workers) &&
+        atomic_load_explicit(&server->running, memory_order_acquire)) {
+      (void)server_spawn_worker(server);
+    }
+    pthread_cond_signal(&server->not_empty);
+  }
+
+  pthread_mutex_unlock(&server->lock);
+}
+
+/* Take every pending connection off a listener, up to one batch. Returns
+ * false on an error that should stop the server. */
+static bool server_accept(esl_server_t *server, esl_socket_t listener) {
+  esl_server_conn_t batch[ESL_SERVER_ACCEPT_BATCH];
+  int count = 0;
+
+  while (count < ESL_SERVER_ACCEPT_BATCH) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    esl_socket_t sock;
+
+#ifdef __linux__
+    sock = accept4(listener, (struct sockaddr *)&addr, &addr_len,
+                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    sock = accept(listener, (struct sockaddr *)&addr, &addr_len);
+    if (sock >= 0) {
+      const int flags = fcntl(sock, F_GETFL, 0);
+
+      if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) != 0) {
+        close(sock);
+        continue;
+      }
+    }
+#endif
+
+    if (sock < 0) {
+      if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) {
+        continue;
+      }
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+          errno == ENOMEM) {
+        /* the listener stays readable; back off instead of spinning */
+        if (count == 0) {
+          (void)poll(nullptr, 0, 10);
+        }
+        break;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return false;
+      }
+      break;
+    }
+
+    batch[count++] = (esl_server_conn_t){
+        .server_sock = listener, .client_sock = sock, .addr = addr};
+  }
+
+  if (count) {
+    atomic_fetch_add_explicit(&server->accepted, (uint64_t)count,
+                              memory_order_relaxed);
+    server_enqueue(server, batch, count);
+  }
+
+  return true;
+}
+
+static void *server_acceptor(void *obj) {
+  esl_server_acceptor_t *acceptor = obj;
+  esl_server_t *server = acceptor->server;
+  struct pollfd pfds[2] = {
+      {.fd = acceptor->listener, .events = POLLIN},
+      {.fd = server->stop_pipe[0], .events = POLLIN},
+  };
+
+  while (atomic_load_explicit(&server->running, memory_order_acquire)) {
+    if (poll(pfds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      atomic_store_explicit(&server->failed, true, memory_order_release);
+      esl_server_stop(server);
+      break;
+    }
+    if (pfds[1].revents) {
+      break;
+    }
+    if ((pfds[0].revents & (POLLERR | POLLNVAL)) ||
+        ((pfds[0].revents & POLLIN) &&
+         !server_accept(server, acceptor->listener))) {
+      atomic_store_explicit(&server->failed, true, memory_order_release);
+      esl_server_stop(server);
+      break;
+    }
+  }
+
+  return nullptr;
+}
+
+static void *server_worker(void *obj) {
+  esl_server_t *server = obj;
+
+  for (;;) {
+    esl_server_conn_t conn;
+
+    pthread_mutex_lock(&server->lock);
+    server->idle_workers++;
+    while (!server->queue_count &&
+           atomic_load_explicit(&server->running, memory_order_acquire)) {
+      pthread_cond_wait(&server->not_empty, &server->lock);
+    }
+    server->idle_workers--;
+    if (!atomic_load_explicit(&server->running, memory_order_acquire)) {
+      pthread_mutex_unlock(&server->lock);
+      break;
+    }
+    conn = server->queue[server->queue_head];
+    server->queue_head = (server->queue_head + 1) % server->config.queue_len;
+    server->queue_count--;
+    pthread_cond_signal(&server->not_full);
+    pthread_mutex_unlock(&server->lock);
+
+    atomic_fetch_add_explicit(&server->handled, 1, memory_order_relaxed);
+    server->callback(conn.server_sock, conn.client_sock, &conn.addr,
+                     server->user_data);
+  }
+
+  return nullptr;
+}
+
+ESL_DECLARE(esl_status_t) esl_server_run(esl_server_t *server) {
+  const int acceptor_count = server ? server->config.acceptors : 0;
+  /* a growing pool starts empty and grows as connections arrive */
+  const int worker_count =
+      server && !server_grows(server) ? server->config.workers : 0;
+  esl_server_acceptor_t *acceptors = nullptr;
+  pthread_t *acceptor_threads = nullptr;
+  int acceptors_started = 0;
+  esl_status_t status = ESL_FAIL;
+  char drain[16];
+
+  if (server == nullptr ||
+      atomic_exchange_explicit(&server->running, true, memory_order_acq_rel)) {
+    return ESL_FAIL;
+  }
+  atomic_store_explicit(&server->failed, false, memory_order_relaxed);
+
+  /* a stop from a previous run leaves its wakeup byte behind */
+  while (read(server->stop_pipe[0], drain, sizeof(drain)) > 0) {
+  }
+
+  acceptors = calloc((size_t)acceptor_count, sizeof(*acceptors));
+  acceptor_threads = calloc((size_t)acceptor_count, sizeof(*acceptor_threads));
+  if (!acceptors || !acceptor_threads) {
+    goto done;
+  }
+
+  /* no acceptor is running yet, so the pool needs no lock */
+  while (server->worker_count < worker_count) {
+    if (!server_spawn_worker(server)) {
+      break;
+    }
+  }
+
+  if (server->worker_count == worker_count) {
+    for (int i = 0; i < acceptor_count; i++) {
+      acceptors[i] = (esl_server_acceptor_t){
+          .server = server,
+          .listener = server->listeners[i % server->listener_count]};
+    }
+    /* acceptor 0 runs on the calling thread */
+    for (acceptors_started = 1; acceptors_started < acceptor_count;
+         acceptors_started++) {
+      if (pthread_create(&acceptor_threads[acceptors_started], nullptr,
+                         server_acceptor,
+                         &acceptors[acceptors_started]) != 0) {
+        break;
+      }
+    }
+    if (acceptors_started == acceptor_count) {
+      server_acceptor(&acceptors[0]);
+      status = atomic_load_explicit(&server->failed, memory_order_acquire)
+                   ? ESL_FAIL
+                   : ESL_SUCCESS;
+    }
+  }
+
+  esl_server_stop(server);
+  for (int i = 1; i < acceptors_started; i++) {
+    pthread_join(acceptor_threads[i], nullptr);
+  }
+  /* with the acceptors gone nothing adds workers */
+  for (int i = 0; i < server->worker_count; i++) {
+    pthread_join(server->workers[i], nullptr);
+  }
+  server->worker_count = 0;
+
+done:
+  pthread_mutex_lock(&server->lock);
+  while (server->queue_count) {
+    server_close_conn(&server->queue[server->queue_head]);
+    server->queue_head = (server->queue_head + 1) % server->config.queue_len;
+    server->queue_count--;
+  }
+  pthread_mutex_unlock(&server->lock);
+
+  free(acceptor_threads);
+  free(acceptors);
+  atomic_store_explicit(&server->running, false, memory_order_release);
+
+  return status;
+}
+
+ESL_DECLARE(void) esl_server_stop(esl_server_t *server) {
+  if (server == nullptr) {
+    return;
+  }
+
+  pthread_mutex_lock(&server->lock);
+  atomic_store_explicit(&server->running, false, memory_order_release);
+  pthread_cond_broadcast(&server->not_empty);
+  pthread_cond_broadcast(&server->not_full);
+  pthread_mutex_unlock(&server->lock);
+
+  if (write(server->stop_pipe[1], "x", 1) < 0) {
+    /* pipe full, a wakeup is already pending */
+  }
+}
+
+ESL_DECLARE(void) esl_server_destroy(esl_server_t **server) {
+  esl_server_t *sp = nullptr;
+
+  if (server == nullptr || *server == nullptr) {
+    return;
+  }
+
+  sp = *server;
+
+  for (int i = 0; i < sp->listener_count; i++) {
+    close(sp->listeners[i]);
+  }
+  esl_unix_unlink(&sp->unix_addr);
+  close(sp->stop_pipe[0]);
+  close(sp->stop_pipe[1]);
+  pthread_cond_destroy(&sp->not_full);
+  pthread_cond_destroy(&sp->not_empty);
+  pthread_mutex_destroy(&sp->lock);
+  free(sp->listeners);
+  free(sp->queue);
+  free(sp->workers);
+  free(sp);
+
+  *server = nullptr;
+}
+
+ESL_DECLARE(esl_port_t) esl_server_port(esl_server_t *server) {
+  return server ? server->port : 0;
+}
+
+ESL_DECLARE(void)
+esl_server_get_stats(esl_server_t *server, esl_server_stats_t *stats) {
+  if (stats == nullptr) {
+    return;
+  }
+  *stats = (esl_server_stats_t){0};
+  if (server == nullptr) {
+    return;
+  }
+
+  stats->accepted =
+      atomic_load_explicit(&server->accepted, memory_order_relaxed);
+  stats->rejected =
+      atomic_load_explicit(&server->rejected, memory_order_relaxed);
+  stats->dropped = atomic_load_explicit(&server->dropped, memory_order_relaxed);
+  stats->handled = atomic_load_explicit(&server->handled, memory_order_relaxed);
+
+  pthread_mutex_lock(&server->lock);
+  stats->queued = (uint64_t)server->queue_count;
+  pthread_mutex_unlock(&server->lock);
+}
@@ -43,6 +43,10 @@ void esl_thread_override_default_stacksize(size_t size) {
   atomic_store_explicit(&thread_default_stacksize, size, memory_order_relaxed);
 }
 
+size_t esl_thread_default_stacksize(void) {
+  return atomic_load_explicit(&thread_default_stacksize, memory_order_relaxed);
+}
+
 static void *thread_launch(void *args) {
   esl_thread_t *thread = (esl_thread_t *)args;
   void *exit_val = thread->function(thread, thread->private_data);
@@ -54,9 +58,8 @@ static void *thread_launch(void *args) {
 
 ESL_DECLARE(esl_status_t)
 esl_thread_create_detached(esl_thread_function_t func, void *data) {
-  const auto stacksize =
-      atomic_load_explicit(&thread_default_stacksize, memory_order_relaxed);
-  return esl_thread_create_detached_ex(func, data, stacksize);
+  return esl_thread_create_detached_ex(func, data,
+                                       esl_thread_default_stacksize());
 }
 
 esl_status_t esl_thread_create_detached_ex(esl_thread_function_t func,
@@ -0,0 +1,772 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* syscall(), MAP_POPULATE and MAP_ANONYMOUS */
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "esl/esl_uring.h"
+#include "esl/esl_threadmutex.h"
+#include "esl/esl_wakeup.h"
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+constexpr unsigned ESL_URING_ENTRIES = 16;
+constexpr unsigned ESL_URING_BUF_COUNT = 16;
+constexpr unsigned ESL_URING_BUF_SIZE = 16'384;
+constexpr int ESL_URING_MAX_IOV = 4;
+
+constexpr uint64_t ESL_URING_TAG_RECV = 1;
+constexpr uint64_t ESL_URING_TAG_CANCEL = 2;
+constexpr uint64_t ESL_URING_TAG_SEND = 0x100;
+constexpr int ESL_URING_SEND_PENDING = INT_MIN;
+
+typedef struct {
+  uint16_t bid;
+  uint32_t len;
+  uint32_t off;
+} esl_uring_chunk_t;
+
+struct esl_uring {
+  int fd;
+  esl_socket_t sock;
+  /* guards the rings and the bookkeeping below */
+  esl_mutex_t *mutex;
+  /* serializes esl_uring_sendv so chains never interleave */
+  esl_mutex_t *send_mutex;
+
+  void *sq_ptr;
+  size_t sq_len;
+  void *cq_ptr;
+  size_t cq_len;
+  struct io_uring_sqe *sqes;
+  size_t sqes_len;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_array;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned sq_local_tail;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  struct io_uring_buf_ring *br;
+  size_t br_len;
+  unsigned char *bufs;
+  uint16_t br_tail;
+
+  esl_uring_chunk_t ready[ESL_URING_BUF_COUNT];
+  unsigned ready_head;
+  unsigned ready_count;
+
+  bool recv_armed;
+  bool cancel_pending;
+  bool eof;
+  int recv_error;
+
+  unsigned sends_inflight;
+  int send_res[ESL_URING_MAX_IOV];
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags, void *arg, size_t argsz) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      arg, argsz);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg,
+                          unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_buf_recycle(esl_uring_t *ring, uint16_t bid) {
+  struct io_uring_buf *buf =
+      &ring->br->bufs[ring->br_tail & (ESL_URING_BUF_COUNT - 1)];
+
+  buf->addr = (uint64_t)(uintptr_t)(ring->bufs +
+                                    (size_t)bid * ESL_URING_BUF_SIZE);
+  buf->len = ESL_URING_BUF_SIZE;
+  buf->bid = bid;
+  ring->br_tail++;
+  atomic_store_explicit((_Atomic uint16_t *)&ring->br->tail, ring->br_tail,
+                        memory_order_release);
+}
+
+static struct io_uring_sqe *uring_get_sqe(esl_uring_t *ring) {
+  const unsigned head = atomic_load_explicit((_Atomic unsigned *)ring->sq_head,
+                                             memory_order_acquire);
+  struct io_uring_sqe *sqe;
+  unsigned idx;
+
+  if (ring->sq_local_tail - head >= ring->sq_entries) {
+    return nullptr;
+  }
+
+  idx = ring->sq_local_tail & ring->sq_mask;
+  sqe = &ring->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  ring->sq_array[idx] = idx;
+  ring->sq_local_tail++;
+
+  return sqe;
+}
+
+static int uring_submit(esl_uring_t *ring) {
+  const unsigned head = atomic_load_explicit((_Atomic unsigned *)ring->sq_head,
+                                             memory_order_acquire);
+  const unsigned pending = ring->sq_local_tail - head;
+  int r;
+
+  atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, ring->sq_local_tail,
+                        memory_order_release);
+
+  if (pending == 0) {
+    return 0;
+  }
+
+  do {
+    r = uring_enter(ring->fd, pending, 0, 0, nullptr, 0);
+  } while (r < 0 && errno == EINTR);
+
+  return r < 0 ? -1 : 0;
+}
+
+/* Block for at most ms until at least one completion is posted. Called
+ * without ring->mutex so other threads can keep submitting and reaping.
+ * With a wakeup the ring descriptor is polled along with it instead, and
+ * false is returned once it has been signalled since the generation since
+ * was noted. */
+static bool uring_wait(esl_uring_t *ring, uint32_t ms, esl_wakeup_t *wakeup,
+                       uint64_t since) {
+  struct __kernel_timespec ts = {.tv_sec = ms / 1000,
+                                 .tv_nsec = (long long)(ms % 1000) * 1000000};
+  struct io_uring_getevents_arg arg = {0};
+
+  if (wakeup) {
+    struct pollfd pfds[2] = {{.fd = ring->fd, .events = POLLIN}};
+
+    return esl_wakeup_poll(wakeup, since, pfds, 1, ms) != ESL_INTERRUPTED;
+  }
+
+  arg.sigmask = 0;
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = (uint64_t)(uintptr_t)&ts;
+
+  (void)uring_enter(ring->fd, 0, 1,
+                    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                    sizeof(arg));
+  return true;
+}
+
+static void uring_handle_cqe(esl_uring_t *ring,
+                             const struct io_uring_cqe *cqe) {
+  if (cqe->user_data == ESL_URING_TAG_RECV) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+      ring->recv_armed = false;
+    }
+
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+      const unsigned slot = (ring->ready_head + ring->ready_count) &
+                            (ESL_URING_BUF_COUNT - 1);
+      ring->ready[slot].bid =
+          (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      ring->ready[slot].len = (uint32_t)cqe->res;
+      ring->ready[slot].off = 0;
+      ring->ready_count++;
+    } else if (cqe->res == 0) {
+      if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uring_buf_recycle(ring,
+                          (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+      }
+      ring->eof = true;
+    } else if (cqe->res < 0 && cqe->res != -ENOBUFS &&
+               cqe->res != -ECANCELED) {
+      ring->recv_error = -cqe->res;
+    }
+  } else if (cqe->user_data >= ESL_URING_TAG_SEND &&
+             cqe->user_data < ESL_URING_TAG_SEND + ESL_URING_MAX_IOV) {
+    ring->send_res[cqe->user_data - ESL_URING_TAG_SEND] = cqe->res;
+    ring->sends_inflight--;
+  } else if (cqe->user_data == ESL_URING_TAG_CANCEL) {
+    ring->cancel_pending = false;
+  }
+}
+
+static void uring_reap(esl_uring_t *ring) {
+  unsigned head = atomic_load_explicit((_Atomic unsigned *)ring->cq_head,
+                                       memory_order_relaxed);
+  const unsigned tail = atomic_load_explicit(
+      (_Atomic unsigned *)ring->cq_tail, memory_order_acquire);
+
+  while (head != tail) {
+    uring_handle_cqe(ring, &ring->cqes[head & ring->cq_mask]);
+    head++;
+  }
+
+  atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head,
+                        memory_order_release);
+}
+
+static int uring_arm_recv(esl_uring_t *ring) {
+  struct io_uring_sqe *sqe;
+
+  if (ring->recv_armed || ring->eof || ring->recv_error) {
+    return 0;
+  }
+
+  if ((sqe = uring_get_sqe(ring)) == nullptr) {
+    return -1;
+  }
+
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = ring->sock;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = ESL_URING_TAG_RECV;
+
+  ring->recv_armed = true;
+
+  return uring_submit(ring);
+}
+
+ESL_DECLARE(esl_status_t)
+esl_uring_create(esl_uring_t **ring, esl_socket_t sock) {
+  struct io_uring_params p = {0};
+  struct io_uring_buf_reg reg = {0};
+  esl_uring_t *new_ring = nullptr;
+  unsigned i;
+
+  if (ring == nullptr) {
+    return ESL_FAIL;
+  }
+  *ring = nullptr;
+
+  if (sock == ESL_SOCK_INVALID) {
+    return ESL_FAIL;
+  }
+
+  new_ring = calloc(1, sizeof(*new_ring));
+  if (new_ring == nullptr) {
+    return ESL_FAIL;
+  }
+  new_ring->sock = sock;
+  new_ring->sq_ptr = MAP_FAILED;
+  new_ring->cq_ptr = MAP_FAILED;
+  new_ring->sqes = MAP_FAILED;
+  new_ring->br = MAP_FAILED;
+
+  if ((new_ring->fd = uring_setup(ESL_URING_ENTRIES, &p)) < 0) {
+    free(new_ring);
+    return ESL_FAIL;
+  }
+
+  if (!(p.features & IORING_FEAT_EXT_ARG) ||
+      !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    goto fail;
+  }
+
+  new_ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  new_ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (new_ring->cq_len > new_ring->sq_len) {
+    new_ring->sq_len = new_ring->cq_len;
+  }
+
+  new_ring->sq_ptr = mmap(nullptr, new_ring->sq_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, new_ring->fd,
+                          IORING_OFF_SQ_RING);
+  if (new_ring->sq_ptr == MAP_FAILED) {
+    goto fail;
+  }
+  new_ring->cq_ptr = new_ring->sq_ptr;
+
+  new_ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  new_ring->sqes = mmap(nullptr, new_ring->sqes_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, new_ring->fd,
+                        IORING_OFF_SQES);
+  if (new_ring->sqes == MAP_FAILED) {
+    goto fail;
+  }
+
+  new_ring->sq_head = (unsigned *)((char *)new_ring->sq_ptr + p.sq_off.head);
+  new_ring->sq_tail = (unsigned *)((char *)new_ring->sq_ptr + p.sq_off.tail);
+  new_ring->sq_array =
+      (unsigned *)((char *)new_ring->sq_ptr + p.sq_off.array);
+  new_ring->sq_mask =
+      *(unsigned *)((char *)new_ring->sq_ptr + p.sq_off.ring_mask);
+  new_ring->sq_entries = p.sq_entries;
+  new_ring->sq_local_tail = *new_ring->sq_tail;
+  new_ring->cq_head = (unsigned *)((char *)new_ring->cq_ptr + p.cq_off.head);
+  new_ring->cq_tail = (unsigned *)((char *)new_ring->cq_ptr + p.cq_off.tail);
+  new_ring->cq_mask =
+      *(unsigned *)((char *)new_ring->cq_ptr + p.cq_off.ring_mask);
+  new_ring->cqes =
+      (struct io_uring_cqe *)((char *)new_ring->cq_ptr + p.cq_off.cqes);
+
+  new_ring->br_len = ESL_URING_BUF_COUNT * sizeof(struct io_uring_buf);
+  new_ring->br = mmap(nullptr, new_ring->br_len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (new_ring->br == MAP_FAILED) {
+    goto fail;
+  }
+
+  new_ring->bufs = malloc((size_t)ESL_URING_BUF_COUNT * ESL_URING_BUF_SIZE);
+  if (new_ring->bufs == nullptr) {
+    goto fail;
+  }
+
+  reg.ring_addr = (uint64_t)(uintptr_t)new_ring->br;
+  reg.ring_entries = ESL_URING_BUF_COUNT;
+  reg.bgid = 0;
+  if (uring_register(new_ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+    goto fail;
+  }
+
+  for (i = 0; i < ESL_URING_BUF_COUNT; i++) {
+    uring_buf_recycle(new_ring, (uint16_t)i);
+  }
+
+  if (esl_mutex_create(&new_ring->mutex) != ESL_SUCCESS) {
+    goto fail;
+  }
+  if (esl_mutex_create(&new_ring->send_mutex) != ESL_SUCCESS) {
+    goto fail;
+  }
+
+  if (uring_arm_recv(new_ring) != 0) {
+    goto fail;
+  }
+
+  *ring = new_ring;
+  return ESL_SUCCESS;
+
+fail:
+  esl_uring_destroy(&new_ring);
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(void) esl_uring_destroy(esl_uring_t **ring) {
+  esl_uring_t *rp;
+
+  if (ring == nullptr || *ring == nullptr) {
+    return;
+  }
+
+  rp = *ring;
+
+  /* closing the ring cancels the multishot recv and any linked sends */
+  if (rp->fd >= 0) {
+    close(rp->fd);
+  }
+  if (rp->sqes != MAP_FAILED) {
+    munmap(rp->sqes, rp->sqes_len);
+  }
+  if (rp->sq_ptr != MAP_FAILED) {
+    munmap(rp->sq_ptr, rp->sq_len);
+  }
+  if (rp->br != MAP_FAILED) {
+    munmap(rp->br, rp->br_len);
+  }
+  free(rp->bufs);
+  if (rp->mutex) {
+    esl_mutex_destroy(&rp->mutex);
+  }
+  if (rp->send_mutex) {
+    esl_mutex_destroy(&rp->send_mutex);
+  }
+  free(rp);
+
+  *ring = nullptr;
+}
+
+ESL_DECLARE(int) esl_uring_fd(esl_uring_t *ring) {
+  return ring ? ring->fd : -1;
+}
+
+/* Move completed receive buffers into the caller's buffer and hand them
+ * back to the kernel. Called with ring->mutex held. */
+static esl_ssize_t uring_collect(esl_uring_t *ring, esl_buffer_t *buffer) {
+  esl_ssize_t total = 0;
+
+  while (ring->ready_count) {
+    esl_uring_chunk_t *chunk = &ring->ready[ring->ready_head];
+    const unsigned char *data =
+        ring->bufs + (size_t)chunk->bid * ESL_URING_BUF_SIZE + chunk->off;
+
+    if (esl_buffer_write(buffer, data, chunk->len) == 0) {
+      errno = EMSGSIZE;
+      return total ? total : -1;
+    }
+
+    total += (esl_ssize_t)chunk->len;
+    uring_buf_recycle(ring, chunk->bid);
+    ring->ready_head = (ring->ready_head + 1) & (ESL_URING_BUF_COUNT - 1);
+    ring->ready_count--;
+  }
+
+  return total;
+}
+
+ESL_DECLARE(esl_ssize_t)
+esl_uring_recv(esl_uring_t *ring, esl_buffer_t *buffer, uint32_t ms,
+               esl_wakeup_t *wakeup, uint64_t since) {
+  esl_ssize_t total = 0;
+  bool woken = false;
+
+  if (ring == nullptr || buffer == nullptr) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  esl_mutex_lock(ring->mutex);
+
+  uring_reap(ring);
+
+  if (!ring->ready_count && !ring->eof && !ring->recv_error && ms) {
+    if (uring_arm_recv(ring) != 0) {
+      esl_mutex_unlock(ring->mutex);
+      return -1;
+    }
+    esl_mutex_unlock(ring->mutex);
+    woken = !uring_wait(ring, ms, wakeup, since);
+    esl_mutex_lock(ring->mutex);
+    uring_reap(ring);
+  }
+
+  total = uring_collect(ring, buffer);
+
+  /* a multishot recv ends when the buffer ring runs dry; restart it now that
+   * buffers have been returned */
+  if (total >= 0 && uring_arm_recv(ring) != 0) {
+    total = -1;
+  }
+
+  if (total == 0 && (ring->eof || ring->recv_error)) {
+    errno = ring->recv_error ? ring->recv_error : ECONNRESET;
+    total = -1;
+  } else if (total == 0 && woken) {
+    errno = EINTR;
+    total = -1;
+  }
+
+  esl_mutex_unlock(ring->mutex);
+
+  return total;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_uring_detach(esl_uring_t *ring, esl_buffer_t *buffer) {
+  struct io_uring_sqe *sqe;
+  esl_status_t status = ESL_SUCCESS;
+
+  if (ring == nullptr || buffer == nullptr) {
+    return ESL_FAIL;
+  }
+
+  esl_mutex_lock(ring->mutex);
+
+  uring_reap(ring);
+
+  if (ring->recv_armed && (sqe = uring_get_sqe(ring)) != nullptr) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = ESL_URING_TAG_RECV;
+    sqe->user_data = ESL_URING_TAG_CANCEL;
+    ring->cancel_pending = true;
+
+    if (uring_submit(ring) == 0) {
+      while (ring->cancel_pending || ring->recv_armed) {
+        esl_mutex_unlock(ring->mutex);
+        (void)uring_wait(ring, 1000, nullptr, 0);
+        esl_mutex_lock(ring->mutex);
+        uring_reap(ring);
+      }
+    } else {
+      status = ESL_FAIL;
+    }
+  }
+
+  if (uring_collect(ring, buffer) < 0) {
+    status = ESL_FAIL;
+  }
+
+  ring->eof = ring->eof || status != ESL_SUCCESS;
+
+  esl_mutex_unlock(ring->mutex);
+
+  return status;
+}
+
+ESL_DECLARE(esl_ssize_t)
+esl_uring_sendv(esl_uring_t *ring, const struct iovec *iov, int iovcnt,
+                uint32_t ms, esl_wakeup_t *wakeup, uint64_t since) {
+  esl_ssize_t sent = 0;
+  bool cancelled = false;
+  bool woken = false;
+  int i;
+
+  if (ring == nullptr || iov == nullptr || iovcnt <= 0 ||
+      iovcnt > ESL_URING_MAX_IOV) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (esl_wakeup_fired(wakeup, since)) {
+    errno = EINTR;
+    return -1;
+  }
+
+  esl_mutex_lock(ring->send_mutex);
+  esl_mutex_lock(ring->mutex);
+
+  for (i = 0; i < iovcnt; i++) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+    if (sqe == nullptr) {
+      /* nothing of this chain has been submitted yet */
+      ring->sq_local_tail -= (unsigned)i;
+      esl_mutex_unlock(ring->mutex);
+      esl_mutex_unlock(ring->send_mutex);
+      errno = EBUSY;
+      return -1;
+    }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = ring->sock;
+    sqe->addr = (uint64_t)(uintptr_t)iov[i].iov_base;
+    sqe->len = (uint32_t)iov[i].iov_len;
+    /* a short send has to break the link, or the next part would be
+     * written ahead of the unsent remainder */
+    sqe->msg_flags = MSG_WAITALL;
+    sqe->user_data = ESL_URING_TAG_SEND + (uint64_t)i;
+    if (i + 1 < iovcnt) {
+      sqe->flags = IOSQE_IO_LINK;
+    }
+    ring->send_res[i] = ESL_URING_SEND_PENDING;
+  }
+
+  ring->sends_inflight = (unsigned)iovcnt;
+
+  if (uring_submit(ring) != 0) {
+    ring->sends_inflight = 0;
+    esl_mutex_unlock(ring->mutex);
+    esl_mutex_unlock(ring->send_mutex);
+    return -1;
+  }
+
+  uring_reap(ring);
+
+  while (ring->sends_inflight) {
+    esl_mutex_unlock(ring->mutex);
+    /* once cancelled only the completions are left to wait for */
+    woken = !uring_wait(ring, ms, cancelled ? nullptr : wakeup, since) ||
+            woken;
+    esl_mutex_lock(ring->mutex);
+    uring_reap(ring);
+
+    if (ring->sends_inflight && !cancelled) {
+      /* the kernel still references the caller's memory, so the chain has
+       * to be cancelled and completed before returning */
+      for (i = 0; i < iovcnt; i++) {
+        struct io_uring_sqe *sqe;
+
+        if (ring->send_res[i] != ESL_URING_SEND_PENDING ||
+            (sqe = uring_get_sqe(ring)) == nullptr) {
+          continue;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = ESL_URING_TAG_SEND + (uint64_t)i;
+        sqe->user_data = ESL_URING_TAG_CANCEL;
+      }
+      (void)uring_submit(ring);
+      cancelled = true;
+    }
+  }
+
+  for (i = 0; i < iovcnt; i++) {
+    if (ring->send_res[i] < 0) {
+      if (sent == 0) {
+        errno = -ring->send_res[i];
+        sent = -1;
+      }
+      break;
+    }
+    sent += ring->send_res[i];
+    if ((size_t)ring->send_res[i] < iov[i].iov_len) {
+      break;
+    }
+  }
+
+  /* report why the chain was cancelled, not that it was */
+  if (cancelled && (sent == 0 || (sent < 0 && errno == ECANCELED))) {
+    errno = woken ? EINTR : ETIMEDOUT;
+    sent = -1;
+  }
+
+  esl_mutex_unlock(ring->mutex);
+  esl_mutex_unlock(ring->send_mutex);
+
+  return sent;
+}
+
+ESL_DECLARE(bool) esl_uring_supported(void) {
+  static _Atomic int supported = -1;
+  int cached = atomic_load_explicit(&supported, memory_order_acquire);
+  int sockets[2] = {-1, -1};
+  esl_uring_t *ring = nullptr;
+  esl_buffer_t *buffer = nullptr;
+  bool ok = false;
+
+  if (cached >= 0) {
+    return cached == 1;
+  }
+
+  /* buffer rings and multishot recv cannot be probed through
+   * IORING_REGISTER_PROBE, so run one real receive over a socketpair */
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0 &&
+      esl_buffer_create(&buffer, 64, 64, 0) == ESL_SUCCESS &&
+      esl_uring_create(&ring, sockets[0]) == ESL_SUCCESS &&
+      write(sockets[1], "x", 1) == 1) {
+    ok = esl_uring_recv(ring, buffer, 1000, nullptr, 0) == 1 &&
+         ring->recv_armed;
+  }
+
+  esl_uring_destroy(&ring);
+  esl_buffer_destroy(&buffer);
+  if (sockets[0] >= 0) {
+    close(sockets[0]);
+  }
+  if (sockets[1] >= 0) {
+    close(sockets[1]);
+  }
+
+  atomic_store_explicit(&supported, ok ? 1 : 0, memory_order_release);
+
+  return ok;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_handle_use_uring(esl_handle_t *handle, bool enable) {
+  esl_status_t status = ESL_SUCCESS;
+
+  if (handle == nullptr || handle->mutex == nullptr) {
+    return ESL_FAIL;
+  }
+
+  esl_mutex_lock(handle->mutex);
+
+  if (enable && !handle->uring) {
+    if (!handle->connected || handle->sock == ESL_SOCK_INVALID ||
+        !esl_uring_supported() ||
+        esl_uring_create(&handle->uring, handle->sock) != ESL_SUCCESS) {
+      status = ESL_FAIL;
+    }
+  } else if (!enable && handle->uring) {
+    status = esl_uring_detach(handle->uring, handle->packet_buf);
+    esl_uring_destroy(&handle->uring);
+  }
+
+  esl_mutex_unlock(handle->mutex);
+
+  return status;
+}
+
+#else
+
+ESL_DECLARE(bool) esl_uring_supported(void) { return false; }
+
+ESL_DECLARE(esl_status_t)
+esl_uring_create(esl_uring_t **ring, [[maybe_unused]] esl_socket_t sock) {
+  if (ring != nullptr) {
+    *ring = nullptr;
+  }
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(void) esl_uring_destroy(esl_uring_t **ring) {
+  if (ring != nullptr) {
+    *ring = nullptr;
+  }
+}
+
+ESL_DECLARE(esl_status_t)
+esl_uring_detach([[maybe_unused]] esl_uring_t *ring,
+                 [[maybe_unused]] esl_buffer_t *buffer) {
+  return ESL_FAIL;
+}
+
+ESL_DECLARE(int) esl_uring_fd([[maybe_unused]] esl_uring_t *ring) {
+  return -1;
+}
+
+ESL_DECLARE(esl_ssize_t)
+esl_uring_recv([[maybe_unused]] esl_uring_t *ring,
+               [[maybe_unused]] esl_buffer_t *buffer,
+               [[maybe_unused]] uint32_t ms,
+               [[maybe_unused]] esl_wakeup_t *wakeup,
+               [[maybe_unused]] uint64_t since) {
+  errno = ENOSYS;
+  return -1;
+}
+
+ESL_DECLARE(esl_ssize_t)
+esl_uring_sendv([[maybe_unused]] esl_uring_t *ring,
+                [[maybe_unused]] const struct iovec *iov,
+                [[maybe_unused]] int iovcnt, [[maybe_unused]] uint32_t ms,
+                [[maybe_unused]] esl_wakeup_t *wakeup,
+                [[maybe_unused]] uint64_t since) {
+  errno = ENOSYS;
+  return -1;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_handle_use_uring([[maybe_unused]] esl_handle_t *handle,
+                     [[maybe_unused]] bool enable) {
+  return ESL_FAIL;
+}
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2007-2014, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "esl/esl_wakeup.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+struct esl_wakeup {
+  _Atomic uint64_t generation;
+  /* eventfd, or the read end of a pipe whose write end is fd_w */
+  int fd;
+  int fd_w;
+  /* waits polling fd, each with the generation it noted. The signal side
+   * never takes the lock, so it stays usable from signal handlers. */
+  pthread_mutex_t lock;
+  esl_wakeup_waiter_t *waiters;
+};
+
+ESL_DECLARE(esl_status_t) esl_wakeup_create(esl_wakeup_t **wakeup) {
+  esl_wakeup_t *new_wakeup = nullptr;
+
+  if (wakeup == nullptr) {
+    return ESL_FAIL;
+  }
+  *wakeup = nullptr;
+
+  if ((new_wakeup = calloc(1, sizeof(*new_wakeup))) == nullptr) {
+    return ESL_FAIL;
+  }
+  atomic_init(&new_wakeup->generation, 0);
+  if (pthread_mutex_init(&new_wakeup->lock, nullptr) != 0) {
+    free(new_wakeup);
+    return ESL_FAIL;
+  }
+
+#ifdef __linux__
+  if ((new_wakeup->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    pthread_mutex_destroy(&new_wakeup->lock);
+    free(new_wakeup);
+    return ESL_FAIL;
+  }
+  new_wakeup->fd_w = new_wakeup->fd;
+#else
+  {
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+      pthread_mutex_destroy(&new_wakeup->lock);
+      free(new_wakeup);
+      return ESL_FAIL;
+    }
+    new_wakeup->fd = fds[0];
+    new_wakeup->fd_w = fds[1];
+    for (int i = 0; i < 2; i++) {
+      (void)fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+      (void)fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+  }
+#endif
+
+  *wakeup = new_wakeup;
+  return ESL_SUCCESS;
+}
+
+ESL_DECLARE(void) esl_wakeup_destroy(esl_wakeup_t **wakeup) {
+  esl_wakeup_t *wp = nullptr;
+
+  if (wakeup == nullptr || *wakeup == nullptr) {
+    return;
+  }
+
+  wp = *wakeup;
+  *wakeup = nullptr;
+
+  if (wp->fd_w != wp->fd) {
+    close(wp->fd_w);
+  }
+  close(wp->fd);
+  pthread_mutex_destroy(&wp->lock);
+  free(wp);
+}
+
+static void wakeup_write(esl_wakeup_t *wakeup) {
+  const uint64_t one = 1;
+
+  if (write(wakeup->fd_w, &one, wakeup->fd_w == wakeup->fd ? sizeof(one) : 1) <
+      0) {
+    /* pipe full or counter saturated, a wakeup is already pending */
+  }
+}
+
+/* Empty the descriptor unless a registered wait has not seen the latest
+ * signal yet; the last such wait to leave does it instead. Called with the
+ * lock held. */
+static void wakeup_settle(esl_wakeup_t *wakeup) {
+  const uint64_t generation = atomic_load(&wakeup->generation);
+  uint64_t drain;
+
+  for (const esl_wakeup_waiter_t *w = wakeup->waiters; w; w = w->next) {
+    if (w->since != generation) {
+      return;
+    }
+  }
+
+  while (read(wakeup->fd, &drain, sizeof(drain)) > 0)
+    ;
+
+  /* a signal that landed meanwhile may have been read with the rest */
+  if (atomic_load(&wakeup->generation) != generation) {
+    wakeup_write(wakeup);
+  }
+}
+
+ESL_DECLARE(void) esl_wakeup_signal(esl_wakeup_t *wakeup) {
+  if (wakeup == nullptr) {
+    return;
+  }
+
+  /* the generation goes first, so a waiter woken by the descriptor always
+   * sees it changed */
+  atomic_fetch_add(&wakeup->generation, 1);
+  wakeup_write(wakeup);
+}
+
+ESL_DECLARE(uint64_t) esl_wakeup_generation(esl_wakeup_t *wakeup) {
+  return wakeup ? atomic_load(&wakeup->generation) : 0;
+}
+
+ESL_DECLARE(int) esl_wakeup_fd(esl_wakeup_t *wakeup) {
+  return wakeup ? wakeup->fd : -1;
+}
+
+ESL_DECLARE(void) esl_wakeup_clear(esl_wakeup_t *wakeup) {
+  if (wakeup == nullptr) {
+    return;
+  }
+
+  pthread_mutex_lock(&wakeup->lock);
+  wakeup_settle(wakeup);
+  pthread_mutex_unlock(&wakeup->lock);
+}
+
+ESL_DECLARE(void)
+esl_wakeup_enter(esl_wakeup_t *wakeup, esl_wakeup_waiter_t *waiter,
+                 uint64_t since) {
+  if (wakeup == nullptr || waiter == nullptr) {
+    return;
+  }
+
+  waiter->since = since;
+  pthread_mutex_lock(&wakeup->lock);
+  waiter->next = wakeup->waiters;
+  wakeup->waiters = waiter;
+  pthread_mutex_unlock(&wakeup->lock);
+}
+
+ESL_DECLARE(void)
+esl_wakeup_leave(esl_wakeup_t *wakeup, esl_wakeup_waiter_t *waiter) {
+  esl_wakeup_waiter_t **link;
+
+  if (wakeup == nullptr || waiter == nullptr) {
+    return;
+  }
+
+  pthread_mutex_lock(&wakeup->lock);
+  for (link = &wakeup->waiters; *link && *link != waiter;
+       link = &(*link)->next)
+    ;
+  if (*link) {
+    *link = waiter->next;
+  }
+  /* a wait that was interrupted may be the last one owed the signal */
+  if (esl_wakeup_fired(wakeup, waiter->since)) {
+    wakeup_settle(wakeup);
+  }
+  pthread_mutex_unlock(&wakeup->lock);
+}
+
+ESL_DECLARE(bool) esl_wakeup_fired(esl_wakeup_t *wakeup, uint64_t since) {
+  return wakeup != nullptr && atomic_load(&wakeup->generation) != since;
+}
+
+ESL_DECLARE(esl_status_t)
+esl_wakeup_poll(esl_wakeup_t *wakeup, uint64_t since, struct pollfd *pfds,
+                nfds_t n, uint32_t ms) {
+  const uint64_t deadline = esl_monotonic_ms() + ms;
+  /* a poll that cannot sleep cannot sleep through a signal either */
+  const bool registered = wakeup != nullptr && ms != 0;
+  esl_wakeup_waiter_t waiter;
+  esl_status_t status;
+
+  if (pfds == nullptr) {
+    return ESL_FAIL;
+  }
+
+  if (registered) {
+    esl_wakeup_enter(wakeup, &waiter, since);
+  }
+
+  for (;;) {
+    uint64_t now;
+    int ready;
+
+    if (esl_wakeup_fired(wakeup, since)) {
+      status = ESL_INTERRUPTED;
+      break;
+    }
+
+    pfds[n] = (struct pollfd){.fd = esl_wakeup_fd(wakeup), .events = POLLIN};
+    ready = poll(pfds, n + 1, ms > INT_MAX ? INT_MAX : (int)ms);
+
+    if (esl_wakeup_fired(wakeup, since)) {
+      status = ESL_INTERRUPTED;
+      break;
+    }
+    if (ready < 0) {
+      status = errno == EINTR ? ESL_BREAK : ESL_FAIL;
+      break;
+    }
+    if (pfds[n].revents == 0 || ready > 1) {
+      status = ready ? ESL_SUCCESS : ESL_BREAK;
+      break;
+    }
+
+    /* only a signal from before this wait is left: clear it, unless a wait
+     * it interrupted has yet to leave, and wait out the rest of the time */
+    esl_wakeup_clear(wakeup);
+    if ((now = esl_monotonic_ms()) >= deadline) {
+      status = ESL_BREAK;
+      break;
+    }
+    ms = (uint32_t)(deadline - now);
+  }
+
+  if (registered) {
+    esl_wakeup_leave(wakeup, &waiter);
+  }
+
+  return status;
+}
@@ -1,10 +1,21 @@
 #include "esl/esl.h"
 #include "esl/esl_buffer.h"
+#include "esl/esl_channel.h"
 #include "esl/esl_config.h"
+#include "esl/esl_dispatcher.h"
 #include "esl/esl_event.h"
 #include "esl/esl_json.h"
+#include "esl/esl_parser.h"
+#include "esl/esl_pipeline.h"
+#include "esl/esl_queue.h"
+#include "esl/esl_reactor.h"
+#include "esl/esl_scan.h"
+#include "esl/esl_server.h"
 #include "esl/esl_threadmutex.h"
+#include "esl/esl_uring.h"
+#include "esl/esl_wakeup.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +36,34 @@ static void *test_thread_mark_done([[maybe_unused]] esl_thread_t *thread,
   return nullptr;
 }
 
+[[nodiscard]] static bool test_handle_open_pair(esl_handle_t *handle,
+                                               int *peer) {
+  int sockets[2] = {-1, -1};
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+    return false;
+  }
+
+  handle->sock = sockets[0];
+  *peer = sockets[1];
+
+  if (esl_mutex_create(&handle->mutex) != ESL_SUCCESS ||
+      esl_buffer_create(&handle->packet_buf, 4096, 4096, 0) != ESL_SUCCESS) {
+    close(sockets[0]);
+    close(sockets[1]);
+    *peer = -1;
+    return false;
+  }
+
+  handle->connected = 1;
+  return true;
+}
+
+[[nodiscard]] static bool test_write_all(int fd, const char *data) {
+  const auto len = strlen(data);
+  return write(fd, data, len) == (ssize_t)len;
+}
+
 [[nodiscard]] static bool run_test_url_encode_decode() {
   const char *raw = "A B+C%";
   char encoded[128] = {0};
@@ -270,6 +309,217 @@ done:
   return ok && buffer == nullptr;
 }
 
+[[nodiscard]] static bool run_test_buffer_packet_scan_incremental() {
+  esl_buffer_t *buffer = nullptr;
+  char packet[32];
+  char out[64];
+  bool ok = false;
+
+  if (esl_buffer_create(&buffer, 64, 64, 0) != ESL_SUCCESS) {
+    goto done;
+  }
+
+  /* more packets than the boundary queue holds */
+  for (int i = 0; i < 100; i++) {
+    const int len = snprintf(packet, sizeof(packet), "N: %d\n\n", i);
+    if (esl_buffer_write(buffer, packet, (esl_size_t)len) == 0) {
+      goto done;
+    }
+  }
+  if (esl_buffer_packet_count(buffer) != 100) {
+    goto done;
+  }
+  for (int i = 0; i < 100; i++) {
+    const int len = snprintf(packet, sizeof(packet), "N: %d\n\n", i);
+    memset(out, 0, sizeof(out));
+    if (esl_buffer_read_packet(buffer, out, sizeof(out)) != (esl_size_t)len ||
+        strcmp(out, packet) != 0 ||
+        esl_buffer_packet_count(buffer) != (esl_size_t)(99 - i)) {
+      goto done;
+    }
+  }
+
+  /* a terminator split across writes, with a CR in the middle */
+  if (esl_buffer_write(buffer, "A: 1\n", 5) == 0 ||
+      esl_buffer_packet_count(buffer) != 0 ||
+      esl_buffer_write(buffer, "\r", 1) == 0 ||
+      esl_buffer_packet_count(buffer) != 0 ||
+      esl_buffer_write(buffer, "\nbody\n\nB: 2\n\n", 13) == 0 ||
+      esl_buffer_packet_count(buffer) != 3) {
+    goto done;
+  }
+
+  /* a read that ends off a boundary rescans from the new head */
+  memset(out, 0, sizeof(out));
+  if (esl_buffer_read_packet(buffer, out, sizeof(out)) != 7 ||
+      esl_buffer_read(buffer, out, 5) != 5 ||
+      esl_buffer_packet_count(buffer) != 1 ||
+      esl_buffer_read_packet(buffer, out, sizeof(out)) != 7 ||
+      memcmp(out, "\nB: 2\n\n", 7) != 0 ||
+      esl_buffer_packet_count(buffer) != 0) {
+    goto done;
+  }
+
+  ok = true;
+
+done:
+  esl_buffer_destroy(&buffer);
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_buffer_mirrored() {
+  esl_buffer_t *buffer = nullptr;
+  char packet[128];
+  char out[256];
+  char big[10'000];
+  esl_size_t size;
+  void *space;
+  bool ok = false;
+
+  if (esl_buffer_create_mirrored(&buffer, 4096, 4096, 0) != ESL_SUCCESS) {
+#ifdef __linux__
+    goto done;
+#else
+    return true;
+#endif
+  }
+  size = esl_buffer_len(buffer);
+
+  /* packets keep straddling the end without the buffer growing */
+  for (int i = 0; i < 500; i++) {
+    const int len = snprintf(packet, sizeof(packet),
+                             "Event-Sequence: %d\nPadding: %070d\n\n", i, i);
+    if (esl_buffer_write(buffer, packet, (esl_size_t)len) == 0 ||
+        (i % 3 == 2 && esl_buffer_packet_count(buffer) != 3)) {
+      goto done;
+    }
+    if (i % 3 != 2) {
+      continue;
+    }
+    for (int j = i - 2; j <= i; j++) {
+      const int plen = snprintf(packet, sizeof(packet),
+                                "Event-Sequence: %d\nPadding: %070d\n\n", j, j);
+      memset(out, 0, sizeof(out));
+      if (esl_buffer_read_packet(buffer, out, sizeof(out)) != (esl_size_t)plen ||
+          strcmp(out, packet) != 0) {
+        goto done;
+      }
+    }
+  }
+  if (esl_buffer_len(buffer) != size) {
+    goto done;
+  }
+
+  /* reserved space is contiguous even when it crosses the end */
+  esl_buffer_zero(buffer);
+  memset(big, 'x', sizeof(big));
+  if (esl_buffer_write(buffer, big, size - 10) == 0 ||
+      esl_buffer_toss(buffer, size - 20) != 10 ||
+      esl_buffer_reserve(buffer, 100, &space) != size - 10) {
+    goto done;
+  }
+  memcpy(space, "0123456789\n\n", 12);
+  if (esl_buffer_commit(buffer, 12) != 22 ||
+      esl_buffer_read_packet(buffer, out, sizeof(out)) != 22 ||
+      memcmp(out, "xxxxxxxxxx0123456789\n\n", 22) != 0) {
+    goto done;
+  }
+
+  /* growing remaps and keeps the buffered bytes */
+  if (esl_buffer_write(buffer, "head", 4) != 4 ||
+      esl_buffer_write(buffer, big, sizeof(big)) != sizeof(big) + 4 ||
+      esl_buffer_len(buffer) <= size ||
+      esl_buffer_read(buffer, out, 8) != 8 || memcmp(out, "headxxxx", 8) != 0 ||
+      esl_buffer_inuse(buffer) != sizeof(big) - 4) {
+    goto done;
+  }
+
+  ok = true;
+
+done:
+  esl_buffer_destroy(&buffer);
+  return ok && buffer == nullptr;
+}
+
+[[nodiscard]] static bool run_test_scan_kernels() {
+  static const char *impls[] = {"scalar", "sse2", "avx2"};
+  char block[4096];
+  char bytes[300];
+  esl_scan_line_t lines[128];
+  esl_size_t block_len = 0;
+  size_t pos = 0;
+  int tested = 0;
+  bool ok = false;
+
+  for (int i = 0; i < 100; i++) {
+    pos += (size_t)snprintf(block + pos, sizeof(block) - pos,
+                            i % 7 ? "Header-%d: value %d\n" : "Bare line %d%d\n",
+                            i, i * 31);
+  }
+  memcpy(block + pos, "\r\nbody: x\n", 11);
+  pos += 11;
+
+  for (size_t i = 0; i < sizeof(bytes); i++) {
+    bytes[i] = (char)('a' + i % 23);
+  }
+
+  for (size_t impl = 0; impl < sizeof(impls) / sizeof(impls[0]); impl++) {
+    esl_size_t n;
+
+    if (esl_scan_set_impl(impls[impl]) != ESL_SUCCESS) {
+      continue;
+    }
+    if (strcmp(esl_scan_impl(), impls[impl]) != 0) {
+      goto done;
+    }
+    tested++;
+
+    /* every match position and length around the vector widths */
+    for (size_t len = 0; len < 80; len++) {
+      for (size_t at = 0; at < len; at += 3) {
+        bytes[at] = '\n';
+        if (esl_scan_find2(bytes, len, '\n', '\0') != at) {
+          goto done;
+        }
+        bytes[at] = (char)('a' + at % 23);
+      }
+      if (esl_scan_find2(bytes, len, '\n', '\0') != len) {
+        goto done;
+      }
+    }
+
+    n = esl_scan_header_lines(block, pos, lines, 128, &block_len);
+    if (n != 100 || block_len != pos - 9) {
+      goto done;
+    }
+    for (esl_size_t i = 0; i < n; i++) {
+      const bool bare = i % 7 == 0;
+      if (block[lines[i].end] != '\n' ||
+          (i && lines[i].start != lines[i - 1].end + 1) ||
+          (bare ? lines[i].colon != lines[i].end
+                : block[lines[i].colon] != ':')) {
+        goto done;
+      }
+    }
+
+    /* a full batch stops early and resumes after the last line */
+    n = esl_scan_header_lines(block, pos, lines, 64, &block_len);
+    if (n != 64 || block_len != 0 ||
+        esl_scan_header_lines(block + lines[63].end + 1,
+                              pos - lines[63].end - 1, lines, 64,
+                              &block_len) != 36 ||
+        block_len == 0) {
+      goto done;
+    }
+  }
+
+  ok = tested > 0;
+
+done:
+  (void)esl_scan_set_impl(nullptr);
+  return ok;
+}
+
 [[nodiscard]] static bool run_test_json_helpers() {
   cJSON *root = nullptr;
   cJSON *parsed = nullptr;
@@ -898,6 +1148,2556 @@ done:
   return ok;
 }
 
+[[nodiscard]] static bool run_test_parser_incremental() {
+  const char *stream = "Content-Type: api/response\n"
+                       "Content-Length: 5\n\nhello"
+                       "Content-Type: command/reply\n"
+                       "Reply-Text: +OK%20done\n\n";
+  const size_t stream_len = strlen(stream);
+  esl_parser_t *parser = nullptr;
+  esl_event_t *event = nullptr;
+  esl_event_t *events[2] = {nullptr, nullptr};
+  int count = 0;
+  bool ok = false;
+
+  if (esl_parser_create(&parser, nullptr) != ESL_SUCCESS ||
+      parser == nullptr || esl_parser_buffer(parser) == nullptr) {
+    goto done;
+  }
+
+  /* one byte at a time: every prefix must yield BREAK, never a partial */
+  for (size_t i = 0; i < stream_len; i++) {
+    esl_status_t status;
+
+    if (esl_parser_feed(parser, stream + i, 1) != ESL_SUCCESS) {
+      goto done;
+    }
+    while ((status = esl_parser_next(parser, &event)) == ESL_SUCCESS) {
+      if (count == 2) {
+        goto done;
+      }
+      events[count++] = event;
+      event = nullptr;
+    }
+    if (status != ESL_BREAK) {
+      goto done;
+    }
+  }
+
+  if (count != 2 || events[0]->body == nullptr ||
+      strcmp(events[0]->body, "hello") != 0 ||
+      strcmp(esl_event_get_header(events[0], "content-type"),
+             "api/response") != 0 ||
+      events[1]->body != nullptr ||
+      strcmp(esl_event_get_header(events[1], "reply-text"), "+OK done") != 0) {
+    goto done;
+  }
+
+  if (esl_parser_feed(parser, "Content-Length: 12x\n\n", 21) !=
+          ESL_SUCCESS ||
+      esl_parser_next(parser, &event) != ESL_FAIL || event != nullptr) {
+    goto done;
+  }
+
+  /* a half received body is dropped by reset */
+  if (esl_parser_feed(parser, "Content-Length: 4\n\nab", 21) !=
+          ESL_SUCCESS ||
+      esl_parser_next(parser, &event) != ESL_BREAK) {
+    goto done;
+  }
+  esl_parser_reset(parser);
+  if (esl_buffer_inuse(esl_parser_buffer(parser)) != 0 ||
+      esl_parser_feed(parser, "Reply-Text: x\n\n", 15) != ESL_SUCCESS ||
+      esl_parser_next(parser, &event) != ESL_SUCCESS || event == nullptr ||
+      event->body != nullptr) {
+    goto done;
+  }
+
+  ok = true;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  for (int i = 0; i < count; i++) {
+    esl_event_destroy(&events[i]);
+  }
+  esl_parser_destroy(&parser);
+  return ok && parser == nullptr;
+}
+
+[[nodiscard]] static bool run_test_event_header_views() {
+  const char *packet = "Content-Type: text/event-plain\n"
+                       "Unique-ID: abc%2Ddef\n"
+                       "Variable_x: ARRAY::a|:b\n\n";
+  esl_parser_t *parser = nullptr;
+  esl_event_t *event = nullptr;
+  esl_event_t *copy = nullptr;
+  esl_event_header_t *hp;
+  esl_header_view_t view = {0};
+  bool ok = false;
+
+  if (esl_parser_create(&parser, nullptr) != ESL_SUCCESS ||
+      esl_parser_feed(parser, packet, strlen(packet)) != ESL_SUCCESS ||
+      esl_parser_next(parser, &event) != ESL_SUCCESS || event == nullptr ||
+      event->header_block == nullptr) {
+    goto done;
+  }
+
+  if (!esl_event_get_header_view(event, "unique-id", &view) ||
+      view.name_len != 9 || memcmp(view.name, "Unique-ID", 9) != 0 ||
+      view.value_len != 7 || strcmp(view.value, "abc-def") != 0 ||
+      esl_event_get_header_view(event, "missing", &view)) {
+    goto done;
+  }
+
+  hp = esl_event_get_header_ptr(event, "content-type");
+  if (hp == nullptr || !(hp->flags & ESL_HF_BORROWED) ||
+      strcmp(esl_event_get_header_idx(event, "variable_x", 1), "b") != 0) {
+    goto done;
+  }
+
+  /* changing a borrowed header makes it own its strings */
+  if (esl_event_add_header_string(event, ESL_STACK_PUSH, "Content-Type",
+                                  "extra") != ESL_SUCCESS ||
+      (hp->flags & ESL_HF_BORROWED) ||
+      strcmp(esl_event_get_header_idx(event, "content-type", 0),
+             "text/event-plain") != 0 ||
+      esl_event_del_header(event, "unique-id") != ESL_SUCCESS ||
+      esl_event_dup(&copy, event) != ESL_SUCCESS) {
+    goto done;
+  }
+
+  if (esl_event_materialize(event) != ESL_SUCCESS ||
+      event->header_block != nullptr ||
+      strcmp(esl_event_get_header(copy, "variable_x"), "ARRAY::a|:b") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  esl_parser_set_header_views(parser, false);
+  if (esl_parser_feed(parser, "Reply-Text: +OK\n\n", 17) != ESL_SUCCESS ||
+      esl_parser_next(parser, &event) != ESL_SUCCESS ||
+      event->header_block != nullptr ||
+      (esl_event_get_header_ptr(event, "reply-text")->flags &
+       ESL_HF_BORROWED)) {
+    goto done;
+  }
+
+  ok = true;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  if (copy != nullptr) {
+    esl_event_destroy(&copy);
+  }
+  esl_parser_destroy(&parser);
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_recv_body_in_place() {
+  constexpr size_t body_len = 300'000;
+  esl_handle_t handle = {0};
+  esl_buffer_t *buffer = nullptr;
+  esl_event_t *event = nullptr;
+  char *body = nullptr;
+  char header[64];
+  char out[8] = {0};
+  void *space = nullptr;
+  size_t sent = 0;
+  int peer = -1;
+  bool ok = false;
+
+  /* reserve/commit hands out tail space after compacting read data */
+  if (esl_buffer_create(&buffer, 16, 16, 32) != ESL_SUCCESS ||
+      esl_buffer_write(buffer, "0123456789", 10) != 10 ||
+      esl_buffer_read(buffer, out, 6) != 6 ||
+      esl_buffer_reserve(buffer, 100, &space) != 28 || space == nullptr ||
+      (memcpy(space, "ab", 2), esl_buffer_commit(buffer, 2)) != 6 ||
+      esl_buffer_read(buffer, out, sizeof(out)) != 6 ||
+      memcmp(out, "6789ab", 6) != 0) {
+    goto done;
+  }
+
+  body = malloc(body_len);
+  if (body == nullptr || !test_handle_open_pair(&handle, &peer)) {
+    goto done;
+  }
+  for (size_t i = 0; i < body_len; i++) {
+    body[i] = (char)('a' + i % 26);
+  }
+
+  snprintf(header, sizeof(header),
+           "Content-Type: api/response\nContent-Length: %zu\n\n", body_len);
+  if (!test_write_all(peer, header) || write(peer, body, 1000) != 1000 ||
+      esl_recv_event_nowait(&handle, 0, nullptr) != ESL_BREAK) {
+    goto done;
+  }
+
+  while (sent < body_len - 1000) {
+    const size_t left = body_len - 1000 - sent;
+    const auto chunk =
+        write(peer, body + 1000 + sent, left < 32'768 ? left : 32'768);
+    esl_status_t status;
+
+    if (chunk <= 0) {
+      goto done;
+    }
+    sent += (size_t)chunk;
+
+    status = esl_recv_event_nowait(&handle, 0, &event);
+    if (status == ESL_SUCCESS) {
+      break;
+    }
+    if (status != ESL_BREAK) {
+      goto done;
+    }
+  }
+
+  while (event == nullptr) {
+    if (esl_recv_event_nowait(&handle, 0, &event) == ESL_FAIL) {
+      goto done;
+    }
+  }
+
+  if (event->body == nullptr || memcmp(event->body, body, body_len) != 0 ||
+      event->body[body_len] != '\0' ||
+      esl_buffer_inuse(handle.packet_buf) != 0) {
+    goto done;
+  }
+
+  ok = true;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  free(body);
+  esl_buffer_destroy(&buffer);
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_handle_footprint_compact() {
+  constexpr size_t value_len = 40'000;
+  esl_handle_t handle = {0};
+  esl_event_t *event = nullptr;
+  esl_footprint_t footprint;
+  char *packet = nullptr;
+  size_t len, sent = 0;
+  int peer = -1;
+  bool ok = false;
+
+  packet = malloc(value_len + 64);
+  if (packet == nullptr || !test_handle_open_pair(&handle, &peer) ||
+      esl_handle_set_footprint(&handle, ESL_FOOTPRINT_COMPACT) !=
+          ESL_SUCCESS) {
+    goto done;
+  }
+
+  /* one oversized header block, all but its final newline */
+  len = (size_t)snprintf(packet, 64, "Content-Type: text/test\nBig: ");
+  memset(packet + len, 'v', value_len);
+  len += value_len;
+  memcpy(packet + len, "\n\n", 2);
+  len += 2;
+
+  while (sent < len - 1) {
+    const size_t left = len - 1 - sent;
+    const auto chunk = write(peer, packet + sent, left < 8192 ? left : 8192);
+
+    if (chunk <= 0) {
+      goto done;
+    }
+    sent += (size_t)chunk;
+    while (esl_buffer_inuse(handle.packet_buf) < sent) {
+      if (esl_recv_event_nowait(&handle, 0, nullptr) != ESL_BREAK) {
+        goto done;
+      }
+    }
+  }
+
+  /* the buffer doubled its way up instead of growing by a fixed chunk */
+  if (esl_handle_footprint(&handle, &footprint) != ESL_SUCCESS ||
+      footprint.buffer_used != len - 1 || footprint.buffer_size < len ||
+      (footprint.buffer_size & (footprint.buffer_size - 1)) != 0 ||
+      footprint.handle_size != sizeof(handle)) {
+    goto done;
+  }
+
+  if (write(peer, "\n", 1) != 1) {
+    goto done;
+  }
+  while (event == nullptr) {
+    if (esl_recv_event_nowait(&handle, 0, &event) == ESL_FAIL) {
+      goto done;
+    }
+  }
+
+  /* and gave it back once the packet was parsed */
+  if (strlen(esl_event_get_header(event, "Big")) != value_len ||
+      esl_handle_footprint(&handle, &footprint) != ESL_SUCCESS ||
+      footprint.buffer_used != 0 || footprint.buffer_size > 4096 ||
+      footprint.parser_size != 0 ||
+      footprint.total != footprint.handle_size + footprint.buffer_size) {
+    goto done;
+  }
+
+  ok = esl_handle_set_footprint(&handle, (esl_footprint_mode_t)7) == ESL_FAIL;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  free(packet);
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+typedef struct {
+  int events;
+  int disconnects;
+  bool bodies_ok;
+} test_reactor_state_t;
+
+static void test_reactor_callback([[maybe_unused]] esl_reactor_t *reactor,
+                                  [[maybe_unused]] esl_handle_t *handle,
+                                  esl_event_t *event, void *user_data) {
+  test_reactor_state_t *state = (test_reactor_state_t *)user_data;
+
+  if (event == nullptr) {
+    state->disconnects++;
+    return;
+  }
+
+  state->events++;
+  if (event->body != nullptr && strcmp(event->body, "hello") != 0) {
+    state->bodies_ok = false;
+  }
+  esl_event_destroy(&event);
+}
+
+[[nodiscard]] static bool run_test_reactor_dispatch() {
+  esl_reactor_t *reactor = nullptr;
+  esl_handle_t first = {0};
+  esl_handle_t second = {0};
+  test_reactor_state_t state_first = {.bodies_ok = true};
+  test_reactor_state_t state_second = {.bodies_ok = true};
+  int peer_first = -1;
+  int peer_second = -1;
+  int attempts = 50;
+  bool ok = false;
+
+  if (!test_handle_open_pair(&first, &peer_first) ||
+      !test_handle_open_pair(&second, &peer_second)) {
+    goto done;
+  }
+
+  if (esl_reactor_create(&reactor) != ESL_SUCCESS || reactor == nullptr) {
+    goto done;
+  }
+
+  if (!test_write_all(peer_first, "Content-Type: api/response\n"
+                                  "Content-Length: 5\n\nhel")) {
+    goto done;
+  }
+
+  if (esl_reactor_add_handle(reactor, &first, test_reactor_callback,
+                             &state_first) != ESL_SUCCESS ||
+      esl_reactor_add_handle(reactor, &second, test_reactor_callback,
+                             &state_second) != ESL_SUCCESS ||
+      esl_reactor_count(reactor) != 2) {
+    goto done;
+  }
+
+  if (esl_reactor_run_once(reactor, 50) != ESL_BREAK || state_first.events) {
+    goto done;
+  }
+
+  if (!test_write_all(peer_first, "loContent-Type: command/reply\n"
+                                  "Reply-Text: +OK\n\n") ||
+      !test_write_all(peer_second, "Content-Type: api/response\n"
+                                   "Content-Length: 5\n\nhello")) {
+    goto done;
+  }
+
+  while (attempts-- > 0 &&
+         (state_first.events < 2 || state_second.events < 1)) {
+    if (esl_reactor_run_once(reactor, 50) == ESL_FAIL) {
+      goto done;
+    }
+  }
+
+  if (state_first.events != 2 || state_second.events != 1 ||
+      !state_first.bodies_ok || !state_second.bodies_ok ||
+      strcmp(first.last_reply, "+OK") != 0) {
+    goto done;
+  }
+
+  close(peer_second);
+  peer_second = -1;
+  attempts = 50;
+  while (attempts-- > 0 && state_second.disconnects == 0) {
+    if (esl_reactor_run_once(reactor, 50) == ESL_FAIL) {
+      goto done;
+    }
+  }
+
+  if (state_second.disconnects != 1 || esl_reactor_count(reactor) != 1) {
+    goto done;
+  }
+
+  if (esl_reactor_remove_handle(reactor, &first) != ESL_SUCCESS ||
+      esl_reactor_remove_handle(reactor, &first) != ESL_FAIL ||
+      esl_reactor_count(reactor) != 0) {
+    goto done;
+  }
+
+  ok = true;
+
+done:
+  esl_reactor_destroy(&reactor);
+  if (peer_first >= 0) {
+    close(peer_first);
+  }
+  if (peer_second >= 0) {
+    close(peer_second);
+  }
+  (void)esl_disconnect(&first);
+  (void)esl_disconnect(&second);
+  return ok && reactor == nullptr;
+}
+
+[[nodiscard]] static bool run_test_uring_transport() {
+  esl_handle_t handle = {0};
+  esl_event_t *event = nullptr;
+  char received[64] = {0};
+  ssize_t total = 0;
+  int peer = -1;
+  bool ok = false;
+
+  if (!test_handle_open_pair(&handle, &peer)) {
+    goto done;
+  }
+
+  if (!esl_uring_supported()) {
+    /* the handle must keep working on kernels without io_uring */
+    ok = esl_handle_use_uring(&handle, true) == ESL_FAIL &&
+         handle.uring == nullptr;
+    goto done;
+  }
+
+  if (esl_handle_use_uring(&handle, true) != ESL_SUCCESS ||
+      handle.uring == nullptr) {
+    goto done;
+  }
+
+  if (esl_send(&handle, "api status") != ESL_SUCCESS) {
+    goto done;
+  }
+  while (total < 12) {
+    const auto got = read(peer, received + total, sizeof(received) - 1 - total);
+    if (got <= 0) {
+      goto done;
+    }
+    total += got;
+  }
+  if (strcmp(received, "api status\n\n") != 0) {
+    goto done;
+  }
+
+  if (!test_write_all(peer, "Content-Type: api/response\n"
+                            "Content-Length: 5\n\nhel") ||
+      esl_wait_sock(esl_uring_fd(handle.uring), 1000, ESL_POLL_READ) <= 0 ||
+      esl_recv_event_nowait(&handle, 0, nullptr) != ESL_BREAK ||
+      !test_write_all(peer, "lo") ||
+      esl_recv_event_timed(&handle, 1000, 0, &event) != ESL_SUCCESS ||
+      event == nullptr || event->body == nullptr ||
+      strcmp(event->body, "hello") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  /* data the ring already took off the socket must survive switching back */
+  if (!test_write_all(peer, "Content-Type: command/reply\n"
+                            "Reply-Text: +OK\n\n")) {
+    goto done;
+  }
+  if (esl_wait_sock(esl_uring_fd(handle.uring), 1000, ESL_POLL_READ) <= 0 ||
+      esl_handle_use_uring(&handle, false) != ESL_SUCCESS ||
+      handle.uring != nullptr ||
+      esl_recv_event_timed(&handle, 1000, 0, nullptr) != ESL_SUCCESS ||
+      strcmp(handle.last_reply, "+OK") != 0) {
+    goto done;
+  }
+
+  ok = true;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+static void test_sleep_ms(long ms) {
+  const struct timespec delay = {.tv_sec = 0, .tv_nsec = ms * 1'000'000};
+  nanosleep(&delay, nullptr);
+}
+
+typedef struct {
+  esl_server_t *server;
+  _Atomic bool hold;
+  _Atomic int served;
+  _Atomic int finished;
+  esl_status_t status;
+} test_server_state_t;
+
+static void test_server_callback([[maybe_unused]] esl_socket_t server_sock,
+                                 esl_socket_t client_sock,
+                                 [[maybe_unused]] struct sockaddr_in *addr,
+                                 void *user_data) {
+  test_server_state_t *state = user_data;
+
+  while (atomic_load_explicit(&state->hold, memory_order_acquire)) {
+    test_sleep_ms(1);
+  }
+  if (write(client_sock, "ok", 2) == 2) {
+    atomic_fetch_add_explicit(&state->served, 1, memory_order_relaxed);
+  }
+  close(client_sock);
+}
+
+static void *test_server_thread([[maybe_unused]] esl_thread_t *thread,
+                                void *data) {
+  test_server_state_t *state = data;
+
+  state->status = esl_server_run(state->server);
+  atomic_store_explicit(&state->finished, 1, memory_order_release);
+
+  return nullptr;
+}
+
+[[nodiscard]] static int test_server_connect(esl_port_t port) {
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_port = htons((uint16_t)port),
+                             .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  const int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (sock >= 0 && connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+/* What the server sent before closing: "ok", or "" when it dropped us. */
+[[nodiscard]] static bool test_server_expect(int sock, const char *expect) {
+  char got[8] = {0};
+  size_t total = 0;
+
+  while (esl_wait_sock(sock, 5000, ESL_POLL_READ) > 0) {
+    const auto n = read(sock, got + total, sizeof(got) - 1 - total);
+    if (n <= 0) {
+      return n == 0 && strcmp(got, expect) == 0;
+    }
+    total += (size_t)n;
+  }
+  return false;
+}
+
+/* Poll a server counter until it reaches want or five seconds pass. */
+[[nodiscard]] static bool test_server_wait(esl_server_t *server,
+                                           size_t offset, uint64_t want) {
+  for (int i = 0; i < 5000; i++) {
+    esl_server_stats_t stats;
+    uint64_t value;
+
+    esl_server_get_stats(server, &stats);
+    memcpy(&value, (char *)&stats + offset, sizeof(value));
+    if (value == want) {
+      return true;
+    }
+    test_sleep_ms(1);
+  }
+  return false;
+}
+
+[[nodiscard]] static bool test_server_finish(test_server_state_t *state) {
+  esl_server_stop(state->server);
+  for (int i = 0; i < 5000; i++) {
+    if (atomic_load_explicit(&state->finished, memory_order_acquire)) {
+      return state->status == ESL_SUCCESS;
+    }
+    test_sleep_ms(1);
+  }
+  return false;
+}
+
+[[nodiscard]] static bool run_test_server_pool() {
+  esl_server_config_t config = {
+      .host = "127.0.0.1", .workers = 2, .queue_len = 4, .acceptors = 2};
+  test_server_state_t state = {0};
+  esl_server_stats_t stats;
+  int socks[3] = {-1, -1, -1};
+  bool running = false;
+  bool ok = false;
+
+  /* many connections through a small pool of workers */
+  if (esl_server_create(&state.server, &config, test_server_callback,
+                        &state) != ESL_SUCCESS ||
+      esl_server_port(state.server) == 0 ||
+      esl_thread_create_detached(test_server_thread, &state) != ESL_SUCCESS) {
+    goto done;
+  }
+  running = true;
+
+  for (int i = 0; i < 20; i++) {
+    const int sock = test_server_connect(esl_server_port(state.server));
+    const bool served = sock >= 0 && test_server_expect(sock, "ok");
+
+    if (sock >= 0) {
+      close(sock);
+    }
+    if (!served) {
+      goto done;
+    }
+  }
+
+  running = false;
+  esl_server_get_stats(state.server, &stats);
+  if (!test_server_finish(&state) || stats.accepted != 20 ||
+      stats.handled != 20 || atomic_load(&state.served) != 20) {
+    goto done;
+  }
+  esl_server_destroy(&state.server);
+
+  /* one busy worker, one queue slot, and the third connection is refused */
+  config = (esl_server_config_t){.host = "127.0.0.1",
+                                 .workers = 1,
+                                 .queue_len = 1,
+                                 .overflow = ESL_SERVER_OVERFLOW_REJECT};
+  atomic_store(&state.hold, true);
+  atomic_store(&state.finished, 0);
+  if (esl_server_create(&state.server, &config, test_server_callback,
+                        &state) != ESL_SUCCESS ||
+      esl_thread_create_detached(test_server_thread, &state) != ESL_SUCCESS) {
+    goto done;
+  }
+  running = true;
+
+  if ((socks[0] = test_server_connect(esl_server_port(state.server))) < 0 ||
+      !test_server_wait(state.server, offsetof(esl_server_stats_t, handled),
+                        1) ||
+      (socks[1] = test_server_connect(esl_server_port(state.server))) < 0 ||
+      !test_server_wait(state.server, offsetof(esl_server_stats_t, queued),
+                        1) ||
+      (socks[2] = test_server_connect(esl_server_port(state.server))) < 0 ||
+      !test_server_wait(state.server, offsetof(esl_server_stats_t, rejected),
+                        1) ||
+      !test_server_expect(socks[2], "")) {
+    goto done;
+  }
+
+  atomic_store(&state.hold, false);
+  if (!test_server_expect(socks[0], "ok") ||
+      !test_server_expect(socks[1], "ok")) {
+    goto done;
+  }
+
+  running = false;
+  if (!test_server_finish(&state)) {
+    goto done;
+  }
+  esl_server_destroy(&state.server);
+  for (int i = 0; i < 3; i++) {
+    close(socks[i]);
+    socks[i] = -1;
+  }
+
+  /* an unbounded pool runs every held callback at once */
+  config = (esl_server_config_t){.host = "127.0.0.1",
+                                 .workers = ESL_SERVER_WORKERS_UNBOUNDED,
+                                 .queue_len = 1};
+  atomic_store(&state.hold, true);
+  atomic_store(&state.finished, 0);
+  if (esl_server_create(&state.server, &config, test_server_callback,
+                        &state) != ESL_SUCCESS ||
+      esl_thread_create_detached(test_server_thread, &state) != ESL_SUCCESS) {
+    goto done;
+  }
+  running = true;
+
+  for (int i = 0; i < 3; i++) {
+    if ((socks[i] = test_server_connect(esl_server_port(state.server))) < 0) {
+      goto done;
+    }
+  }
+  if (!test_server_wait(state.server, offsetof(esl_server_stats_t, handled),
+                        3)) {
+    goto done;
+  }
+
+  atomic_store(&state.hold, false);
+  for (int i = 0; i < 3; i++) {
+    if (!test_server_expect(socks[i], "ok")) {
+      goto done;
+    }
+  }
+
+  running = false;
+  if (!test_server_finish(&state)) {
+    goto done;
+  }
+  esl_server_destroy(&state.server);
+  for (int i = 0; i < 3; i++) {
+    close(socks[i]);
+    socks[i] = -1;
+  }
+
+  /* a lazy pool grows on demand but no further than workers, on the
+   * stack esl_listen_threaded gives it */
+  config = (esl_server_config_t){.host = "127.0.0.1",
+                                 .workers = 2,
+                                 .lazy_workers = true,
+                                 .queue_len = 4,
+                                 .stack_size = esl_thread_default_stacksize()};
+  atomic_store(&state.hold, true);
+  atomic_store(&state.finished, 0);
+  if (esl_server_create(&state.server, &config, test_server_callback,
+                        &state) != ESL_SUCCESS ||
+      esl_thread_create_detached(test_server_thread, &state) != ESL_SUCCESS) {
+    goto done;
+  }
+  running = true;
+
+  for (int i = 0; i < 3; i++) {
+    if ((socks[i] = test_server_connect(esl_server_port(state.server))) < 0) {
+      goto done;
+    }
+  }
+  if (!test_server_wait(state.server, offsetof(esl_server_stats_t, handled),
+                        2) ||
+      !test_server_wait(state.server, offsetof(esl_server_stats_t, queued),
+                        1)) {
+    goto done;
+  }
+  test_sleep_ms(50);
+  esl_server_get_stats(state.server, &stats);
+  if (stats.handled != 2) {
+    goto done;
+  }
+
+  atomic_store(&state.hold, false);
+  for (int i = 0; i < 3; i++) {
+    if (!test_server_expect(socks[i], "ok")) {
+      goto done;
+    }
+  }
+
+  running = false;
+  ok = test_server_finish(&state);
+
+done:
+  atomic_store(&state.hold, false);
+  if (running) {
+    (void)test_server_finish(&state);
+  }
+  for (int i = 0; i < 3; i++) {
+    if (socks[i] >= 0) {
+      close(socks[i]);
+    }
+  }
+  esl_server_destroy(&state.server);
+  return ok;
+}
+
+typedef struct {
+  esl_handle_t *handle;
+  int peer;
+  _Atomic int base;
+  _Atomic int done;
+  _Atomic int matched;
+} test_pipeline_state_t;
+
+/* Answer every command read from the peer with an api/response echoing it,
+ * in order, until the peer is closed. "api gone" is never answered. */
+static void *test_pipeline_responder([[maybe_unused]] esl_thread_t *thread,
+                                     void *data) {
+  test_pipeline_state_t *state = data;
+  char in[4096];
+  size_t have = 0;
+
+  for (;;) {
+    const auto got = read(state->peer, in + have, sizeof(in) - 1 - have);
+    char *start = in;
+    char *end;
+
+    if (got <= 0) {
+      break;
+    }
+    have += (size_t)got;
+    in[have] = '\0';
+    while ((end = strstr(start, "\n\n"))) {
+      char reply[256];
+      const int cmd_len = (int)(end - start);
+      int len;
+
+      if (strncmp(start, "api gone", 8) == 0) {
+        start = end + 2;
+        continue;
+      }
+      len = snprintf(reply, sizeof(reply),
+                     "Content-Type: api/response\n"
+                     "Content-Length: %d\n\n%.*s",
+                     cmd_len, cmd_len, start);
+      if (write(state->peer, reply, (size_t)len) != len) {
+        break;
+      }
+      start = end + 2;
+    }
+    have -= (size_t)(start - in);
+    memmove(in, start, have);
+  }
+
+  atomic_fetch_add_explicit(&state->done, 1, memory_order_release);
+  return nullptr;
+}
+
+static void *test_pipeline_client([[maybe_unused]] esl_thread_t *thread,
+                                  void *data) {
+  test_pipeline_state_t *state = data;
+  const int base = atomic_fetch_add(&state->base, 100);
+  esl_reply_t *replies[25] = {nullptr};
+  char cmd[32];
+
+  for (int i = 0; i < 25; i++) {
+    snprintf(cmd, sizeof(cmd), "api cmd%d", base + i);
+    if (esl_send_async(state->handle, cmd, &replies[i]) != ESL_SUCCESS) {
+      break;
+    }
+  }
+  for (int i = 0; i < 25 && replies[i]; i++) {
+    esl_event_t *event = nullptr;
+
+    snprintf(cmd, sizeof(cmd), "api cmd%d", base + i);
+    if (esl_reply_wait(state->handle, replies[i], 5000, &event) ==
+            ESL_SUCCESS &&
+        event->body && strcmp(event->body, cmd) == 0) {
+      atomic_fetch_add(&state->matched, 1);
+    }
+    if (event != nullptr) {
+      esl_event_destroy(&event);
+    }
+    esl_reply_destroy(&replies[i]);
+  }
+
+  atomic_fetch_add_explicit(&state->done, 1, memory_order_release);
+  return nullptr;
+}
+
+[[nodiscard]] static bool run_test_send_async_pipelined() {
+  esl_handle_t handle = {0};
+  test_pipeline_state_t state = {.handle = &handle};
+  esl_reply_t *replies[3] = {nullptr};
+  esl_event_t *event = nullptr;
+  char sent[64] = {0};
+  size_t total = 0;
+  int peer = -1;
+  bool ok = false;
+
+  if (!test_handle_open_pair(&handle, &peer) ||
+      esl_send_async(&handle, "api one", &replies[0]) != ESL_SUCCESS ||
+      esl_send_async(&handle, "api two", &replies[1]) != ESL_SUCCESS ||
+      esl_send_async(&handle, "api three", &replies[2]) != ESL_SUCCESS) {
+    goto done;
+  }
+  while (total < 28) {
+    const auto got = read(peer, sent + total, sizeof(sent) - 1 - total);
+    if (got <= 0) {
+      goto done;
+    }
+    total += (size_t)got;
+  }
+  if (strcmp(sent, "api one\n\napi two\n\napi three\n\n") != 0) {
+    goto done;
+  }
+
+  /* replies complete in order, around an unrelated event */
+  if (!test_write_all(peer, "Content-Type: log/data\nContent-Length: 3\n\nabc"
+                            "Content-Type: api/response\nContent-Length: 2\n\n"
+                            "r1"
+                            "Content-Type: command/reply\nReply-Text: +OK r2\n\n"
+                            "Content-Type: api/response\nContent-Length: 2\n\n"
+                            "r3") ||
+      esl_reply_wait(&handle, replies[2], 1000, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "r3") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+  if (esl_reply_wait(&handle, replies[1], 1000, &event) != ESL_SUCCESS ||
+      strcmp(esl_event_get_header(event, "Reply-Text"), "+OK r2") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+  if (esl_reply_wait(&handle, replies[0], 1000, nullptr) != ESL_SUCCESS ||
+      esl_recv_event(&handle, 1, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "abc") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+  for (int i = 0; i < 3; i++) {
+    esl_reply_destroy(&replies[i]);
+  }
+
+  /* a timed out future keeps its place, and esl_send_recv queues behind it */
+  if (esl_send_async(&handle, "api late", &replies[0]) != ESL_SUCCESS ||
+      esl_reply_wait(&handle, replies[0], 20, nullptr) != ESL_BREAK) {
+    goto done;
+  }
+  esl_reply_destroy(&replies[0]);
+  state.peer = peer;
+  if (esl_thread_create_detached(test_pipeline_responder, &state) !=
+          ESL_SUCCESS ||
+      esl_send_recv_timed(&handle, "api now", 1000) != ESL_SUCCESS ||
+      handle.last_sr_event == nullptr ||
+      strcmp(handle.last_sr_event->body, "api now") != 0) {
+    goto done;
+  }
+
+  /* many threads sharing the handle each get their own replies */
+  for (int i = 0; i < 4; i++) {
+    if (esl_thread_create_detached(test_pipeline_client, &state) !=
+        ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  for (int i = 0; i < 10'000 && atomic_load(&state.done) < 4; i++) {
+    test_sleep_ms(1);
+  }
+  if (atomic_load(&state.matched) != 100) {
+    goto done;
+  }
+
+  /* a dropped connection fails whatever is still pending */
+  if (esl_send_async(&handle, "api gone", &replies[0]) != ESL_SUCCESS) {
+    goto done;
+  }
+  shutdown(peer, SHUT_RDWR);
+  for (int i = 0; i < 5000 && atomic_load(&state.done) < 5; i++) {
+    test_sleep_ms(1);
+  }
+  ok = atomic_load(&state.done) == 5 &&
+       esl_reply_wait(&handle, replies[0], 1000, nullptr) == ESL_FAIL;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  for (int i = 0; i < 3; i++) {
+    esl_reply_destroy(&replies[i]);
+  }
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+typedef struct {
+  _Atomic int calls;
+  esl_status_t status;
+  char body[16];
+} test_job_result_t;
+
+static void test_job_callback([[maybe_unused]] esl_job_t *job,
+                              esl_event_t *event, esl_status_t status,
+                              void *user_data) {
+  test_job_result_t *result = user_data;
+
+  result->status = status;
+  if (event && event->body) {
+    snprintf(result->body, sizeof(result->body), "%s", event->body);
+  }
+  atomic_fetch_add(&result->calls, 1);
+}
+
+/* Write a BACKGROUND_JOB event for uuid with the given result body. */
+[[nodiscard]] static bool test_write_job_event(int peer, const char *uuid,
+                                               const char *result) {
+  char inner[256];
+  char outer[512];
+  int inner_len;
+  int outer_len;
+
+  inner_len = snprintf(inner, sizeof(inner),
+                       "Event-Name: BACKGROUND_JOB\nJob-UUID: %s\n"
+                       "Content-Length: %zu\n\n%s",
+                       uuid, strlen(result), result);
+  outer_len = snprintf(outer, sizeof(outer),
+                       "Content-Type: text/event-plain\n"
+                       "Content-Length: %d\n\n%s",
+                       inner_len, inner);
+  return outer_len > 0 && (size_t)outer_len < sizeof(outer) &&
+         test_write_all(peer, outer);
+}
+
+[[nodiscard]] static bool run_test_bgapi_jobs() {
+  esl_handle_t handle = {0};
+  test_job_result_t result = {0};
+  esl_job_t *jobs[2] = {nullptr};
+  esl_event_t *event = nullptr;
+  char sent[512] = {0};
+  char expect[512];
+  char replies[512];
+  char uuid[ESL_JOB_UUID_SIZE] = {0};
+  const char *second = nullptr;
+  size_t total = 0;
+  int peer = -1;
+  bool ok = false;
+
+  /* the job with only a callback has no handle to read its Job-UUID from,
+   * so it is recovered from what was sent */
+  if (!test_handle_open_pair(&handle, &peer) ||
+      esl_bgapi_submit(&handle, "status", nullptr, nullptr, &jobs[0]) !=
+          ESL_SUCCESS ||
+      esl_bgapi_submit(&handle, "uptime", test_job_callback, &result,
+                       nullptr) != ESL_SUCCESS ||
+      esl_bgapi_submit(&handle, "bogus", nullptr, nullptr, &jobs[1]) !=
+          ESL_SUCCESS ||
+      esl_bgapi_submit(&handle, "status", nullptr, nullptr, nullptr) !=
+          ESL_FAIL ||
+      strlen(esl_job_uuid(jobs[0])) != ESL_JOB_UUID_SIZE - 1 ||
+      esl_job_uuid(jobs[0])[14] != '4' ||
+      !strcmp(esl_job_uuid(jobs[0]), esl_job_uuid(jobs[1]))) {
+    goto done;
+  }
+  while (!(second = strstr(sent, "\n\n")) ||
+         !(second = strstr(second + 2, "\n\n")) ||
+         !strstr(second + 2, "\n\n")) {
+    const auto got = read(peer, sent + total, sizeof(sent) - 1 - total);
+    if (got <= 0) {
+      goto done;
+    }
+    total += (size_t)got;
+  }
+  if (!(second = strstr(sent + 1, "bgapi uptime\nJob-UUID: "))) {
+    goto done;
+  }
+  memcpy(uuid, second + sizeof("bgapi uptime\nJob-UUID: ") - 1,
+         ESL_JOB_UUID_SIZE - 1);
+  snprintf(expect, sizeof(expect),
+           "bgapi status\nJob-UUID: %s\n\n"
+           "bgapi uptime\nJob-UUID: %s\n\n"
+           "bgapi bogus\nJob-UUID: %s\n\n",
+           esl_job_uuid(jobs[0]), uuid, esl_job_uuid(jobs[1]));
+  if (strcmp(sent, expect) != 0) {
+    goto done;
+  }
+
+  /* the bgapi replies alone complete nothing, except a refusal */
+  snprintf(replies, sizeof(replies),
+           "Content-Type: command/reply\nReply-Text: +OK Job-UUID: %s\n\n"
+           "Content-Type: command/reply\nReply-Text: +OK Job-UUID: %s\n\n"
+           "Content-Type: command/reply\nReply-Text: -ERR bogus Command "
+           "not found!\n\n",
+           esl_job_uuid(jobs[0]), uuid);
+  if (!test_write_all(peer, replies) ||
+      esl_job_wait(&handle, jobs[0], 20, nullptr) != ESL_BREAK ||
+      esl_job_wait(&handle, jobs[1], 1000, &event) != ESL_FAIL ||
+      event == nullptr ||
+      strncmp(esl_event_get_header(event, "Reply-Text"), "-ERR", 4) != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  /* BACKGROUND_JOB events complete their jobs by Job-UUID, in any order,
+   * and other events still reach esl_recv_event */
+  if (!test_write_job_event(peer, uuid, "+OK up") ||
+      !test_write_all(peer, "Content-Type: log/data\nContent-Length: 3\n\n"
+                            "abc") ||
+      !test_write_job_event(peer, esl_job_uuid(jobs[0]), "+OK status") ||
+      esl_job_wait(&handle, jobs[0], 1000, &event) != ESL_SUCCESS ||
+      event == nullptr || event->event_id != ESL_EVENT_BACKGROUND_JOB ||
+      strcmp(event->body, "+OK status") != 0 ||
+      atomic_load(&result.calls) != 1 || result.status != ESL_SUCCESS ||
+      strcmp(result.body, "+OK up") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+  if (esl_recv_event(&handle, 1, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "abc") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+  esl_job_destroy(&jobs[0]);
+  esl_job_destroy(&jobs[1]);
+
+  /* a job still outstanding fails when the handle is disconnected */
+  result.status = ESL_SUCCESS;
+  if (esl_bgapi_submit(&handle, "uptime", test_job_callback, &result,
+                       &jobs[0]) != ESL_SUCCESS) {
+    goto done;
+  }
+  (void)esl_disconnect(&handle);
+  ok = atomic_load(&result.calls) == 2 && result.status == ESL_FAIL &&
+       esl_job_wait(&handle, jobs[0], 1000, nullptr) == ESL_FAIL;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  esl_job_destroy(&jobs[0]);
+  esl_job_destroy(&jobs[1]);
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+[[nodiscard]] static esl_event_t *test_queue_event(const char *name,
+                                                   esl_priority_t priority) {
+  esl_event_t *event = nullptr;
+
+  if (esl_event_create(&event, ESL_EVENT_CUSTOM) != ESL_SUCCESS) {
+    return nullptr;
+  }
+  event->priority = priority;
+  if (esl_event_add_body(event, "%s", name) != ESL_SUCCESS) {
+    esl_event_destroy(&event);
+  }
+  return event;
+}
+
+/* Pop the queue and compare the bodies with the space separated names. */
+[[nodiscard]] static bool test_queue_expect(esl_queue_t *queue,
+                                            const char *names) {
+  char got[128] = {0};
+  esl_event_t *event;
+
+  while ((event = esl_queue_pop(queue))) {
+    snprintf(got + strlen(got), sizeof(got) - strlen(got), "%s%s",
+             *got ? " " : "", event->body);
+    esl_event_destroy(&event);
+  }
+  return strcmp(got, names) == 0;
+}
+
+[[nodiscard]] static bool run_test_event_queue() {
+  esl_queue_config_t config = {.capacity = 3};
+  esl_queue_stats_t stats = {0};
+  esl_queue_t *queue = nullptr;
+  esl_handle_t handle = {0};
+  esl_event_t *event = nullptr;
+  char name[8];
+  int peer = -1;
+  bool ok = false;
+
+  /* drop oldest keeps the newest capacity events, in order, and the slot
+   * array wraps and grows without reordering them */
+  if (esl_queue_create(&queue, &config) != ESL_SUCCESS) {
+    return false;
+  }
+  for (int i = 0; i < 5; i++) {
+    snprintf(name, sizeof(name), "e%d", i);
+    if (esl_queue_push(queue, test_queue_event(name, ESL_PRIORITY_NORMAL)) !=
+        ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  if (esl_queue_depth(queue) != 3 ||
+      esl_queue_get_stats(queue, &stats) != ESL_SUCCESS ||
+      stats.pushed != 5 || stats.dropped != 2 || stats.high_water != 3 ||
+      !test_queue_expect(queue, "e2 e3 e4")) {
+    goto done;
+  }
+  config.capacity = 40;
+  if (esl_queue_configure(queue, &config) != ESL_SUCCESS) {
+    goto done;
+  }
+  for (int i = 0, next = 0; i < 40; i++) {
+    snprintf(name, sizeof(name), "%d", i);
+    if (esl_queue_push(queue, test_queue_event(name, ESL_PRIORITY_NORMAL)) !=
+        ESL_SUCCESS) {
+      goto done;
+    }
+    if (i % 3 == 0) {
+      if ((event = esl_queue_pop(queue)) == nullptr ||
+          atoi(event->body) != next++) {
+        goto done;
+      }
+      esl_event_destroy(&event);
+    }
+  }
+  if (esl_queue_depth(queue) != 26) {
+    goto done;
+  }
+  while ((event = esl_queue_pop(queue))) {
+    esl_event_destroy(&event);
+  }
+
+  /* drop by priority evicts the oldest of the lowest class, and refuses a
+   * newcomer ranking below everything queued */
+  config = (esl_queue_config_t){
+      .capacity = 3, .overflow = ESL_QUEUE_OVERFLOW_DROP_PRIORITY};
+  if (esl_queue_configure(queue, &config) != ESL_SUCCESS ||
+      esl_queue_push(queue, test_queue_event("n1", ESL_PRIORITY_NORMAL)) !=
+          ESL_SUCCESS ||
+      esl_queue_push(queue, test_queue_event("l1", ESL_PRIORITY_LOW)) !=
+          ESL_SUCCESS ||
+      esl_queue_push(queue, test_queue_event("h1", ESL_PRIORITY_HIGH)) !=
+          ESL_SUCCESS ||
+      esl_queue_push(queue, test_queue_event("n2", ESL_PRIORITY_NORMAL)) !=
+          ESL_SUCCESS ||
+      esl_queue_push(queue, test_queue_event("h2", ESL_PRIORITY_HIGH)) !=
+          ESL_SUCCESS ||
+      esl_queue_push(queue, test_queue_event("l2", ESL_PRIORITY_LOW)) !=
+          ESL_BREAK ||
+      !test_queue_expect(queue, "h1 n2 h2")) {
+    goto done;
+  }
+
+  /* a full priority queue keeps arrival order across priorities while it
+   * evicts and grows: 30 to 39 push out the lows 0 to 27 */
+  config.capacity = 30;
+  if (esl_queue_configure(queue, &config) != ESL_SUCCESS) {
+    goto done;
+  }
+  for (int i = 0; i < 40; i++) {
+    static const esl_priority_t priorities[] = {
+        ESL_PRIORITY_LOW, ESL_PRIORITY_NORMAL, ESL_PRIORITY_HIGH};
+
+    snprintf(name, sizeof(name), "%d", i);
+    if (esl_queue_push(queue, test_queue_event(name, priorities[i % 3])) !=
+        ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  /* four highs push out the lows left, then a low is refused and a normal
+   * pushes out the oldest normal, 1 */
+  for (int i = 40; i < 44; i++) {
+    snprintf(name, sizeof(name), "%d", i);
+    if (esl_queue_push(queue, test_queue_event(name, ESL_PRIORITY_HIGH)) !=
+        ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  if (esl_queue_push(queue, test_queue_event("44", ESL_PRIORITY_LOW)) !=
+          ESL_BREAK ||
+      esl_queue_push(queue, test_queue_event("45", ESL_PRIORITY_NORMAL)) !=
+          ESL_SUCCESS ||
+      esl_queue_depth(queue) != 30) {
+    goto done;
+  }
+  for (int i = 2; i < 46; i++) {
+    if ((i < 40 && i % 3 == 0) || i == 44) {
+      continue;
+    }
+    if ((event = esl_queue_pop(queue)) == nullptr || atoi(event->body) != i) {
+      goto done;
+    }
+    esl_event_destroy(&event);
+  }
+  if (esl_queue_depth(queue) != 0) {
+    goto done;
+  }
+
+  /* block waits for room and gives up after block_ms */
+  config = (esl_queue_config_t){
+      .capacity = 1, .overflow = ESL_QUEUE_OVERFLOW_BLOCK, .block_ms = 20};
+  if (esl_queue_configure(queue, &config) != ESL_SUCCESS ||
+      esl_queue_wait_room(queue, nullptr) != ESL_SUCCESS ||
+      esl_queue_push(queue, test_queue_event("b1", ESL_PRIORITY_NORMAL)) !=
+          ESL_SUCCESS ||
+      esl_queue_wait_room(queue, nullptr) != ESL_BREAK ||
+      esl_queue_push(queue, test_queue_event("b2", ESL_PRIORITY_NORMAL)) !=
+          ESL_BREAK ||
+      esl_queue_configure(queue, &(esl_queue_config_t){.capacity = 1}) !=
+          ESL_SUCCESS ||
+      !test_queue_expect(queue, "b1")) {
+    goto done;
+  }
+
+  /* events interleaved with an esl_send_recv reply land in a bounded
+   * handle queue */
+  if (esl_handle_set_event_queue(&handle,
+                                 &(esl_queue_config_t){.capacity = 2}) !=
+          ESL_SUCCESS ||
+      !test_handle_open_pair(&handle, &peer) ||
+      !test_write_all(peer, "Content-Type: log/data\nContent-Length: 2\n\nd1"
+                            "Content-Type: log/data\nContent-Length: 2\n\nd2"
+                            "Content-Type: log/data\nContent-Length: 2\n\nd3"
+                            "Content-Type: api/response\nContent-Length: 2\n\n"
+                            "ok") ||
+      esl_send_recv(&handle, "api x") != ESL_SUCCESS ||
+      strcmp(handle.last_sr_event->body, "ok") != 0 ||
+      esl_queue_get_stats(handle.event_queue, &stats) != ESL_SUCCESS ||
+      stats.depth != 2 || stats.dropped != 1 ||
+      esl_recv_event(&handle, 1, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "d2") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+  ok = esl_recv_event(&handle, 1, &event) == ESL_SUCCESS &&
+       strcmp(event->body, "d3") == 0 &&
+       esl_queue_depth(handle.event_queue) == 0;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  esl_queue_destroy(&queue);
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+typedef struct {
+  esl_handle_t *handle;
+  char got[16];
+  _Atomic uint64_t first_ms;
+  _Atomic int done;
+} test_queue_consumer_t;
+
+/* Start once the producer is parked on the full queue, then take three
+ * events. */
+static void *test_queue_consumer([[maybe_unused]] esl_thread_t *thread,
+                                 void *data) {
+  test_queue_consumer_t *state = data;
+  esl_event_t *event = nullptr;
+
+  test_sleep_ms(100);
+  for (int i = 0; i < 3 &&
+                  esl_recv_event(state->handle, 1, &event) == ESL_SUCCESS;
+       i++) {
+    if (i == 0) {
+      atomic_store(&state->first_ms, esl_monotonic_ms());
+    }
+    snprintf(state->got + strlen(state->got),
+             sizeof(state->got) - strlen(state->got), "%s%s", i ? " " : "",
+             event->body ? event->body : "");
+    esl_event_destroy(&event);
+  }
+
+  atomic_store_explicit(&state->done, 1, memory_order_release);
+  return nullptr;
+}
+
+[[nodiscard]] static bool run_test_event_queue_block() {
+  esl_handle_t handle = {0};
+  test_queue_consumer_t state = {.handle = &handle};
+  esl_queue_stats_t stats = {0};
+  uint64_t start, elapsed;
+  int peer = -1;
+  bool ok = false;
+
+  /* a reply behind more events than a blocking queue holds: the reader
+   * parks with the handle released, a consumer makes room, and nothing is
+   * dropped or reordered */
+  if (esl_handle_set_event_queue(
+          &handle, &(esl_queue_config_t){.capacity = 1,
+                                         .overflow = ESL_QUEUE_OVERFLOW_BLOCK,
+                                         .block_ms = 2000}) != ESL_SUCCESS ||
+      !test_handle_open_pair(&handle, &peer) ||
+      !test_write_all(peer, "Content-Type: log/data\nContent-Length: 2\n\nd1"
+                            "Content-Type: log/data\nContent-Length: 2\n\nd2"
+                            "Content-Type: log/data\nContent-Length: 2\n\nd3"
+                            "Content-Type: api/response\nContent-Length: 2\n\n"
+                            "ok") ||
+      esl_thread_create_detached(test_queue_consumer, &state) !=
+          ESL_SUCCESS) {
+    goto done;
+  }
+
+  start = esl_monotonic_ms();
+  if (esl_send_recv(&handle, "api x") != ESL_SUCCESS ||
+      strcmp(handle.last_sr_event->body, "ok") != 0) {
+    goto done;
+  }
+  elapsed = esl_monotonic_ms() - start;
+
+  for (int i = 0; i < 5000 && !atomic_load_explicit(&state.done,
+                                                    memory_order_acquire);
+       i++) {
+    test_sleep_ms(1);
+  }
+  ok = atomic_load(&state.done) && elapsed < 1000 &&
+       atomic_load(&state.first_ms) - start < 1000 &&
+       strcmp(state.got, "d1 d2 d3") == 0 &&
+       esl_queue_get_stats(handle.event_queue, &stats) == ESL_SUCCESS &&
+       stats.dropped == 0;
+
+done:
+  for (int i = 0; i < 5000 && !atomic_load(&state.done); i++) {
+    test_sleep_ms(1);
+  }
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_recv_events_batch() {
+  esl_handle_t handle = {0};
+  esl_event_t *events[4] = {nullptr};
+  size_t n = 0;
+  int peer = -1;
+  bool ok = false;
+
+  /* complete packets come out in batches of at most max, a partial one
+   * stays buffered */
+  if (!test_handle_open_pair(&handle, &peer) ||
+      !test_write_all(peer, "Content-Type: log/data\nContent-Length: 2\n\nb1"
+                            "Content-Type: log/data\nContent-Length: 2\n\nb2"
+                            "Content-Type: log/data\nContent-Length: 2\n\nb3"
+                            "Content-Type: log/data\nContent-Length: 2\n\nb4"
+                            "Content-Type: log/data\nContent-Length: 2\n\nb5"
+                            "Content-Type: log/data\nContent-Len") ||
+      esl_recv_events(&handle, events, 4, 0, &n) != ESL_SUCCESS || n != 4 ||
+      strcmp(events[0]->body, "b1") != 0 ||
+      strcmp(events[3]->body, "b4") != 0) {
+    goto done;
+  }
+  for (size_t i = 0; i < n; i++) {
+    esl_event_destroy(&events[i]);
+  }
+  if (esl_recv_events(&handle, events, 4, 0, &n) != ESL_SUCCESS || n != 1 ||
+      strcmp(events[0]->body, "b5") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&events[0]);
+
+  /* nothing complete: wait for the socket, then give up */
+  if (esl_recv_events(&handle, events, 4, 20, &n) != ESL_BREAK || n != 0 ||
+      !test_write_all(peer, "gth: 2\n\nb6")) {
+    goto done;
+  }
+  ok = esl_recv_events(&handle, events, 4, 1000, &n) == ESL_SUCCESS &&
+       n == 1 && strcmp(events[0]->body, "b6") == 0;
+
+done:
+  for (size_t i = 0; i < 4; i++) {
+    if (events[i] != nullptr) {
+      esl_event_destroy(&events[i]);
+    }
+  }
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+/* Read events until one with body "stop" arrives. */
+static void *test_duplex_streamer([[maybe_unused]] esl_thread_t *thread,
+                                  void *data) {
+  test_pipeline_state_t *state = data;
+  esl_event_t *event = nullptr;
+
+  while (esl_recv_event(state->handle, 1, &event) == ESL_SUCCESS) {
+    const bool stop = event->body && strcmp(event->body, "stop") == 0;
+
+    esl_event_destroy(&event);
+    if (stop) {
+      atomic_store(&state->matched, 1);
+      break;
+    }
+  }
+
+  atomic_fetch_add_explicit(&state->done, 1, memory_order_release);
+  return nullptr;
+}
+
+[[nodiscard]] static bool run_test_full_duplex() {
+  esl_handle_t handle = {0};
+  test_pipeline_state_t state = {.handle = &handle};
+  struct timespec start;
+  struct timespec end;
+  int peer = -1;
+  bool ok = false;
+
+  if (!test_handle_open_pair(&handle, &peer) ||
+      esl_mutex_create(&handle.send_mutex) != ESL_SUCCESS) {
+    goto done;
+  }
+  state.peer = peer;
+
+  /* a thread parked in esl_recv_event does not hold up commands: the reply
+   * reaches esl_send_recv through the thread that read it */
+  if (esl_thread_create_detached(test_duplex_streamer, &state) !=
+      ESL_SUCCESS) {
+    goto done;
+  }
+  test_sleep_ms(50);
+  if (esl_thread_create_detached(test_pipeline_responder, &state) !=
+      ESL_SUCCESS) {
+    goto done;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (esl_send_recv_timed(&handle, "api ping", 5000) != ESL_SUCCESS ||
+      handle.last_sr_event == nullptr ||
+      strcmp(handle.last_sr_event->body, "api ping") != 0 ||
+      esl_send(&handle, "api pong") != ESL_SUCCESS) {
+    goto done;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if ((end.tv_sec - start.tv_sec) * 1000 +
+          (end.tv_nsec - start.tv_nsec) / 1'000'000 >=
+      500) {
+    goto done;
+  }
+
+  /* the streaming thread still gets its events, after the stray reply */
+  if (!test_write_all(peer, "Content-Type: log/data\nContent-Length: 4\n\n"
+                            "stop")) {
+    goto done;
+  }
+  for (int i = 0; i < 2000 && atomic_load(&state.done) < 1; i++) {
+    test_sleep_ms(1);
+  }
+  ok = atomic_load(&state.matched) == 1 && atomic_load(&handle.connected);
+
+done:
+  if (peer >= 0) {
+    shutdown(peer, SHUT_RDWR);
+  }
+  for (int i = 0; i < 2000 && atomic_load(&state.done) < 2; i++) {
+    test_sleep_ms(1);
+  }
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+typedef struct {
+  esl_event_channel_t *channel;
+  _Atomic int done;
+} test_channel_state_t;
+
+/* Push 1000 events numbered from the thread's base, two at a time. */
+static void *test_channel_producer([[maybe_unused]] esl_thread_t *thread,
+                                   void *data) {
+  test_channel_state_t *state = data;
+  static _Atomic int bases = 0;
+  const int base = atomic_fetch_add(&bases, 1) % 4 * 1000;
+
+  for (int i = 0; i < 1000; i += 2) {
+    esl_event_t *events[2] = {nullptr};
+    esl_size_t off = 0;
+
+    for (int j = 0; j < 2; j++) {
+      if (esl_event_create(&events[j], ESL_EVENT_CUSTOM) != ESL_SUCCESS ||
+          esl_event_add_body(events[j], "%d", base + i + j) != ESL_SUCCESS) {
+        return nullptr;
+      }
+    }
+    while (off < 2) {
+      esl_size_t pushed = 0;
+
+      if (esl_event_channel_push_batch(state->channel, events + off, 2 - off,
+                                       &pushed) == ESL_BREAK) {
+        test_sleep_ms(1);
+      }
+      off += pushed;
+    }
+  }
+
+  atomic_fetch_add(&state->done, 1);
+  return nullptr;
+}
+
+[[nodiscard]] static bool run_test_event_channel() {
+  test_channel_state_t state = {0};
+  esl_event_t *events[64] = {nullptr};
+  esl_event_t *event = nullptr;
+  int next[4] = {0, 1000, 2000, 3000};
+  esl_size_t n = 0;
+  int received = 0;
+  bool ok = false;
+
+  /* a full SPSC ring refuses more, and batches come out in order */
+  if (esl_event_channel_create(&state.channel, 3, ESL_CHANNEL_SPSC) !=
+      ESL_SUCCESS) {
+    return false;
+  }
+  for (int i = 0; i < 5; i++) {
+    if (esl_event_create(&events[i], ESL_EVENT_CUSTOM) != ESL_SUCCESS ||
+        esl_event_add_body(events[i], "%d", i) != ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  if (esl_event_channel_push_batch(state.channel, events, 5, &n) !=
+          ESL_SUCCESS ||
+      n != 4 || esl_event_channel_depth(state.channel) != 4 ||
+      esl_event_channel_push(state.channel, events[4]) != ESL_BREAK) {
+    goto done;
+  }
+  for (int i = 0; i < 4; i++) {
+    events[i] = nullptr;
+  }
+  if (esl_event_channel_pop(state.channel, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "0") != 0 ||
+      esl_event_channel_push(state.channel, events[4]) != ESL_SUCCESS) {
+    goto done;
+  }
+  events[4] = nullptr;
+  esl_event_destroy(&event);
+  if (esl_event_channel_pop_batch(state.channel, events, 64, &n) !=
+          ESL_SUCCESS ||
+      n != 4 || strcmp(events[0]->body, "1") != 0 ||
+      strcmp(events[3]->body, "4") != 0) {
+    goto done;
+  }
+  for (esl_size_t i = 0; i < n; i++) {
+    esl_event_destroy(&events[i]);
+  }
+  if (esl_event_channel_pop(state.channel, &event) != ESL_BREAK ||
+      esl_event_channel_wait(state.channel, 10) != ESL_BREAK) {
+    goto done;
+  }
+  esl_event_channel_destroy(&state.channel);
+
+  /* four producers into one MPSC ring; the consumer sleeps when idle and
+   * sees each producer's events in its order */
+  if (esl_event_channel_create(&state.channel, 16, ESL_CHANNEL_MPSC) !=
+      ESL_SUCCESS) {
+    goto done;
+  }
+  for (int i = 0; i < 4; i++) {
+    if (esl_thread_create_detached(test_channel_producer, &state) !=
+        ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  while (received < 4000) {
+    if (esl_event_channel_wait(state.channel, 5000) != ESL_SUCCESS ||
+        esl_event_channel_pop_batch(state.channel, events, 64, &n) !=
+            ESL_SUCCESS) {
+      goto done;
+    }
+    for (esl_size_t i = 0; i < n; i++) {
+      const int value = atoi(events[i]->body);
+
+      if (value != next[value / 1000]++) {
+        goto done;
+      }
+      esl_event_destroy(&events[i]);
+      received++;
+    }
+  }
+  for (int i = 0; i < 2000 && atomic_load(&state.done) < 4; i++) {
+    test_sleep_ms(1);
+  }
+  ok = atomic_load(&state.done) == 4 &&
+       esl_event_channel_depth(state.channel) == 0;
+
+done:
+  for (size_t i = 0; i < 64; i++) {
+    if (events[i] != nullptr) {
+      esl_event_destroy(&events[i]);
+    }
+  }
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  esl_event_channel_destroy(&state.channel);
+  return ok;
+}
+
+typedef struct {
+  int next[8];
+  int shard_of[8];
+  _Atomic int handled;
+  _Atomic bool gate;
+  _Atomic bool error;
+} test_dispatch_state_t;
+
+/* Check each call's events arrive in order and always on the same shard. */
+static void test_dispatch_callback([[maybe_unused]] esl_dispatcher_t *dp,
+                                   esl_event_t *event, unsigned shard,
+                                   void *user_data) {
+  test_dispatch_state_t *state = user_data;
+  const char *call = esl_event_get_header(event, "unique-id");
+  const char *seq = esl_event_get_header(event, "event-sequence");
+
+  while (!atomic_load(&state->gate)) {
+    test_sleep_ms(1);
+  }
+  if (call != nullptr && seq != nullptr) {
+    const int c = atoi(call + strlen("call-"));
+
+    if (state->next[c]++ != atoi(seq) ||
+        (state->shard_of[c] >= 0 && state->shard_of[c] != (int)shard)) {
+      atomic_store(&state->error, true);
+    }
+    state->shard_of[c] = (int)shard;
+  }
+  atomic_fetch_add(&state->handled, 1);
+  esl_event_destroy(&event);
+}
+
+[[nodiscard]] static bool run_test_dispatcher_sharding() {
+  test_dispatch_state_t state = {.shard_of = {-1, -1, -1, -1, -1, -1, -1, -1}};
+  esl_dispatcher_config_t config = {.shards = 4, .queue_len = 8};
+  esl_dispatcher_t *dp = nullptr;
+  esl_dispatcher_stats_t stats = {0};
+  esl_event_t *event = nullptr;
+  uint64_t dispatched = 0;
+  int rejected = 0;
+  bool ok = false;
+
+  /* eight interleaved calls over four shards, blocking when a shard is
+   * full; destroy drains everything still queued */
+  atomic_store(&state.gate, true);
+  if (esl_dispatcher_create(&dp, &config, test_dispatch_callback, &state) !=
+          ESL_SUCCESS ||
+      esl_dispatcher_shards(dp) != 4) {
+    goto done;
+  }
+  for (int i = 0; i < 800; i++) {
+    if (esl_event_create(&event, ESL_EVENT_CHANNEL_STATE) != ESL_SUCCESS ||
+        esl_event_add_header(event, ESL_STACK_BOTTOM, "Unique-ID", "call-%d",
+                             i % 8) != ESL_SUCCESS ||
+        esl_event_add_header(event, ESL_STACK_BOTTOM, "Event-Sequence", "%d",
+                             i / 8) != ESL_SUCCESS ||
+        esl_dispatcher_shard(dp, event) >= 4 ||
+        esl_dispatcher_dispatch(dp, event) != ESL_SUCCESS) {
+      goto done;
+    }
+    event = nullptr;
+  }
+  for (unsigned i = 0; i < 4; i++) {
+    if (esl_dispatcher_get_stats(dp, i, &stats) != ESL_SUCCESS ||
+        stats.rejected != 0 || stats.high_water > 8) {
+      goto done;
+    }
+    dispatched += stats.dispatched;
+  }
+  esl_dispatcher_destroy(&dp);
+  if (dispatched != 800 || atomic_load(&state.handled) != 800 ||
+      atomic_load(&state.error)) {
+    goto done;
+  }
+  for (int c = 0; c < 8; c++) {
+    if (state.next[c] != 100) {
+      goto done;
+    }
+  }
+
+  /* with the worker held up, a tiny shard fills and further events are
+   * refused and left with the caller */
+  atomic_store(&state.gate, false);
+  atomic_store(&state.handled, 0);
+  config = (esl_dispatcher_config_t){
+      .shards = 1, .queue_len = 2, .overflow = ESL_DISPATCH_OVERFLOW_REJECT};
+  if (esl_dispatcher_create(&dp, &config, test_dispatch_callback, &state) !=
+      ESL_SUCCESS) {
+    goto done;
+  }
+  for (int i = 0; i < 10; i++) {
+    if (esl_event_create(&event, ESL_EVENT_CUSTOM) != ESL_SUCCESS) {
+      goto done;
+    }
+    if (esl_dispatcher_dispatch(dp, event) == ESL_BREAK) {
+      esl_event_destroy(&event);
+      rejected++;
+    }
+    event = nullptr;
+  }
+  if (esl_dispatcher_get_stats(dp, 0, &stats) != ESL_SUCCESS ||
+      esl_dispatcher_get_stats(dp, 1, &stats) != ESL_FAIL ||
+      rejected < 6 || stats.rejected != (uint64_t)rejected ||
+      stats.dispatched + stats.rejected != 10 || stats.high_water != 2) {
+    goto done;
+  }
+  atomic_store(&state.gate, true);
+  esl_dispatcher_destroy(&dp);
+  ok = atomic_load(&state.handled) == 10 - rejected;
+
+done:
+  atomic_store(&state.gate, true);
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  esl_dispatcher_destroy(&dp);
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_wait_strategy() {
+  esl_handle_t handle = {0};
+  esl_wait_strategy_t strategy = {.mode = ESL_WAIT_OPTIMISTIC};
+  esl_event_t *event = nullptr;
+  uint64_t start;
+  int peer = -1;
+  bool ok = false;
+
+  if (esl_handle_set_wait_strategy(
+          &handle, &(esl_wait_strategy_t){.mode = (esl_wait_mode_t)42}) !=
+          ESL_FAIL ||
+      !test_handle_open_pair(&handle, &peer) ||
+      esl_handle_set_wait_strategy(&handle, &strategy) != ESL_SUCCESS) {
+    goto done;
+  }
+
+  /* optimistic reads find data already waiting without polling first */
+  if (!test_write_all(peer,
+                      "Content-Type: log/data\nContent-Length: 2\n\no1") ||
+      esl_recv_event(&handle, 0, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "o1") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  /* a deadline also bounds an event that is only partly received */
+  start = esl_monotonic_ms();
+  if (!test_write_all(peer, "Content-Type: log/data\nContent-Length: 2\n\np") ||
+      esl_recv_event_timed(&handle, 50, 0, &event) != ESL_BREAK ||
+      esl_monotonic_ms() - start < 50 || esl_monotonic_ms() - start > 1000 ||
+      !test_write_all(peer, "2") ||
+      esl_recv_event_until(&handle, esl_monotonic_ms() + 1000, 0, &event) !=
+          ESL_SUCCESS ||
+      strcmp(event->body, "p2") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  /* busy-polling handles spin before sleeping and still honour the
+   * deadline when nothing comes */
+  strategy = (esl_wait_strategy_t){
+      .mode = ESL_WAIT_BUSY_POLL, .poll_ms = 10, .spin_us = 200};
+  if (esl_handle_set_wait_strategy(&handle, &strategy) != ESL_SUCCESS ||
+      esl_recv_event_until(&handle, esl_monotonic_ms() + 20, 0, &event) !=
+          ESL_BREAK ||
+      !test_write_all(peer,
+                      "Content-Type: log/data\nContent-Length: 2\n\nb1") ||
+      esl_recv_event(&handle, 0, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "b1") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  ok = esl_handle_set_wait_strategy(&handle, nullptr) == ESL_SUCCESS &&
+       handle.wait.mode == ESL_WAIT_POLL;
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  if (peer >= 0) {
+    close(peer);
+  }
+  (void)esl_disconnect(&handle);
+  return ok;
+}
+
+typedef struct {
+  esl_handle_t *handles[2];
+  size_t count;
+  size_t ready;
+  _Atomic int status;
+  _Atomic bool started;
+  _Atomic bool done;
+} test_wakeup_state_t;
+
+/* Block in esl_recv_event, or in esl_wait_handles on count handles. */
+static void *test_wakeup_waiter([[maybe_unused]] esl_thread_t *thread,
+                                void *data) {
+  test_wakeup_state_t *state = data;
+  esl_event_t *event = nullptr;
+
+  atomic_store(&state->started, true);
+  if (state->count) {
+    atomic_store(&state->status, esl_wait_handles(state->handles, state->count,
+                                                  3000, &state->ready));
+  } else {
+    atomic_store(&state->status,
+                 esl_recv_event(state->handles[0], 0, &event));
+  }
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  atomic_store(&state->done, true);
+  return nullptr;
+}
+
+/* Start the waiters, give them time to park, then wake handle once, or
+ * disconnect it. Every waiter must return well within a poll slice. A receive the wakeup missed is released through peer so the test
+ * fails, not hangs. */
+[[nodiscard]] static bool test_wakeup_run(test_wakeup_state_t *states,
+                                          size_t n, esl_handle_t *handle,
+                                          int peer, bool disconnect) {
+  uint64_t deadline;
+  bool ok = true;
+
+  for (size_t i = 0; i < n; i++) {
+    atomic_store(&states[i].status, -1);
+    atomic_store(&states[i].started, false);
+    atomic_store(&states[i].done, false);
+    if (esl_thread_create_detached(test_wakeup_waiter, &states[i]) !=
+        ESL_SUCCESS) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    for (int j = 0; j < 200 && !atomic_load(&states[i].started); j++) {
+      test_sleep_ms(5);
+    }
+  }
+  test_sleep_ms(50);
+
+  deadline = esl_monotonic_ms() + 500;
+  if (disconnect) {
+    ok = esl_disconnect(handle) == ESL_SUCCESS;
+  } else if (esl_handle_wakeup(handle) != ESL_SUCCESS) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    while (!atomic_load(&states[i].done) && esl_monotonic_ms() < deadline) {
+      test_sleep_ms(5);
+    }
+    /* a disconnect may also end the receive as a closed connection */
+    ok = ok && atomic_load(&states[i].done) &&
+         (atomic_load(&states[i].status) == ESL_INTERRUPTED ||
+          (disconnect && atomic_load(&states[i].status) == ESL_FAIL));
+  }
+  if (!ok && !disconnect &&
+      !test_write_all(peer, "Content-Type: log/data\n\n")) {
+    return false;
+  }
+  /* do not leave a waiter behind on handles about to be torn down */
+  for (size_t i = 0; i < n; i++) {
+    while (!atomic_load(&states[i].done)) {
+      test_sleep_ms(5);
+    }
+  }
+
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_handle_wakeup() {
+  esl_handle_t handle = {0};
+  esl_handle_t other = {0};
+  test_wakeup_state_t states[2] = {
+      {.handles = {&handle, &other}},
+      {.handles = {&handle, &other}, .count = 2},
+  };
+  esl_handle_t *both[2] = {&handle, &other};
+  esl_event_t *event = nullptr;
+  size_t ready = 0;
+  int peer = -1;
+  int other_peer = -1;
+  bool ok = false;
+
+  if (esl_handle_wakeup(&handle) != ESL_FAIL ||
+      !test_handle_open_pair(&handle, &peer) ||
+      !test_handle_open_pair(&other, &other_peer) ||
+      esl_wakeup_create(&handle.wakeup) != ESL_SUCCESS ||
+      esl_wakeup_create(&other.wakeup) != ESL_SUCCESS) {
+    goto done;
+  }
+
+  /* a blocked receive returns at once and the handle stays usable */
+  if (!test_wakeup_run(states, 1, &handle, peer, false) || !handle.connected ||
+      !test_write_all(peer,
+                      "Content-Type: log/data\nContent-Length: 2\n\nw1") ||
+      esl_recv_event(&handle, 0, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "w1") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  /* a wakeup nobody waited for does not cut short a later wait */
+  if (esl_handle_wakeup(&handle) != ESL_SUCCESS ||
+      esl_recv_event_timed(&handle, 20, 0, &event) != ESL_BREAK) {
+    goto done;
+  }
+
+  /* one thread waiting on several handles */
+  if (esl_wait_handles(both, 2, 20, &ready) != ESL_BREAK ||
+      !test_write_all(other_peer,
+                      "Content-Type: log/data\nContent-Length: 2\n\nw2") ||
+      esl_wait_handles(both, 2, 1000, &ready) != ESL_SUCCESS ||
+      ready != 1 || esl_recv_event(&other, 0, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "w2") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  if (!test_wakeup_run(&states[1], 1, &other, other_peer, false) ||
+      states[1].ready != 1) {
+    goto done;
+  }
+
+  /* one signal reaches every thread blocked on the handle, not just the
+   * first to see the descriptor */
+  if (!test_wakeup_run(states, 2, &handle, peer, false) ||
+      states[1].ready != 0) {
+    goto done;
+  }
+
+  /* the same over io_uring, where the ring descriptor is polled */
+  if (!esl_uring_supported()) {
+    ok = true;
+    goto done;
+  }
+  if (esl_handle_use_uring(&handle, true) != ESL_SUCCESS ||
+      !test_wakeup_run(states, 2, &handle, peer, false) ||
+      states[1].ready != 0 ||
+      !test_write_all(peer,
+                      "Content-Type: log/data\nContent-Length: 2\n\nw3") ||
+      esl_recv_event_timed(&handle, 1000, 0, &event) != ESL_SUCCESS ||
+      strcmp(event->body, "w3") != 0) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  /* disconnecting lets a receive blocked on the ring out before the ring
+   * goes away */
+  ok = test_wakeup_run(states, 1, &handle, peer, true);
+
+done:
+  if (event != nullptr) {
+    esl_event_destroy(&event);
+  }
+  if (peer >= 0) {
+    close(peer);
+  }
+  if (other_peer >= 0) {
+    close(other_peer);
+  }
+  (void)esl_disconnect(&handle);
+  (void)esl_disconnect(&other);
+  return ok;
+}
+
+/* Plays FreeSWITCH's side of the login, then waits for the client to leave.
+ * The server hands over non-blocking sockets. */
+static void test_unix_callback([[maybe_unused]] esl_socket_t server_sock,
+                               esl_socket_t client_sock,
+                               [[maybe_unused]] struct sockaddr_in *addr,
+                               void *user_data) {
+  test_server_state_t *state = user_data;
+  char buf[64];
+  size_t total = 0;
+
+  if (!test_write_all(client_sock, "Content-Type: auth/request\n\n")) {
+    goto done;
+  }
+  while (total < sizeof(buf) - 1 &&
+         esl_wait_sock(client_sock, 5000, ESL_POLL_READ) > 0) {
+    const auto n = read(client_sock, buf + total, sizeof(buf) - 1 - total);
+    if (n <= 0) {
+      goto done;
+    }
+    total += (size_t)n;
+    buf[total] = '\0';
+    if (strstr(buf, "\n\n")) {
+      break;
+    }
+  }
+  if (strcmp(buf, "auth ClueCon\n\n") != 0 ||
+      !test_write_all(client_sock, "Content-Type: command/reply\n"
+                                   "Reply-Text: +OK accepted\n\n")) {
+    goto done;
+  }
+  atomic_fetch_add_explicit(&state->served, 1, memory_order_relaxed);
+  while (esl_wait_sock(client_sock, 5000, ESL_POLL_READ) > 0 &&
+         read(client_sock, buf, sizeof(buf)) > 0) {
+  }
+
+done:
+  close(client_sock);
+}
+
+[[nodiscard]] static bool run_test_unix_transport() {
+  char host[64];
+  char long_host[sizeof(((struct sockaddr_un *)nullptr)->sun_path) + 8];
+  struct sockaddr_un addr;
+  socklen_t len = 0;
+  esl_server_config_t config = {.host = host, .workers = 1};
+  test_server_state_t state = {0};
+  esl_handle_t handle = {.sock = ESL_SOCK_INVALID};
+  bool running = false;
+  bool ok = false;
+
+  /* host parsing: TCP hosts pass through, bad paths are refused */
+  memset(long_host, 'x', sizeof(long_host) - 1);
+  memcpy(long_host, ESL_UNIX_PREFIX, sizeof(ESL_UNIX_PREFIX) - 1);
+  long_host[sizeof(long_host) - 1] = '\0';
+  if (esl_unix_sockaddr("127.0.0.1", &addr, &len) != ESL_BREAK ||
+      esl_unix_sockaddr("unix:", &addr, &len) != ESL_FAIL ||
+      esl_unix_sockaddr(long_host, &addr, &len) != ESL_FAIL ||
+      esl_unix_sockaddr("unix:@esl", &addr, &len) != ESL_SUCCESS ||
+      addr.sun_family != AF_UNIX || addr.sun_path[0] != '\0' ||
+      len != offsetof(struct sockaddr_un, sun_path) + 4) {
+    return false;
+  }
+
+  /* a login over a socket file, which the server removes on destroy */
+  esl_snprintf(host, sizeof(host), "unix:/tmp/esl-test-%d.sock",
+               (int)getpid());
+  if (esl_server_create(&state.server, &config, test_unix_callback, &state) !=
+          ESL_SUCCESS ||
+      access(host + 5, F_OK) != 0 ||
+      esl_thread_create_detached(test_server_thread, &state) != ESL_SUCCESS) {
+    goto done;
+  }
+  running = true;
+
+  if (esl_connect_timeout(&handle, host, 0, nullptr, "ClueCon", 5000) !=
+          ESL_SUCCESS ||
+      !handle.connected || esl_disconnect(&handle) != ESL_SUCCESS ||
+      !test_server_wait(state.server, offsetof(esl_server_stats_t, handled),
+                        1)) {
+    goto done;
+  }
+
+  running = false;
+  if (!test_server_finish(&state)) {
+    goto done;
+  }
+  esl_server_destroy(&state.server);
+  ok = atomic_load(&state.served) == 1 && access(host + 5, F_OK) != 0;
+
+done:
+  if (running) {
+    (void)test_server_finish(&state);
+  }
+  (void)esl_disconnect(&handle);
+  esl_server_destroy(&state.server);
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_event_arena() {
+  esl_event_t *event = nullptr;
+  esl_event_t *plain = nullptr;
+  esl_event_t *copy = nullptr;
+  char *arena_text = nullptr;
+  char *plain_text = nullptr;
+  char name[32];
+  char value[64];
+  esl_event_header_t *hp;
+  bool ok = false;
+
+  if (esl_event_create_arena(&event, ESL_EVENT_CUSTOM, "unit::arena") !=
+          ESL_SUCCESS ||
+      esl_event_create_subclass(&plain, ESL_EVENT_CUSTOM, "unit::arena") !=
+          ESL_SUCCESS ||
+      event->arena == nullptr || plain->arena != nullptr) {
+    goto done;
+  }
+
+  /* enough headers to spill past the first block */
+  for (int i = 0; i < 300; i++) {
+    esl_snprintf(name, sizeof(name), "Variable_%d", i);
+    esl_snprintf(value, sizeof(value), "value-%d", i);
+    if (esl_event_add_header_string(event, ESL_STACK_BOTTOM, name, value) !=
+            ESL_SUCCESS ||
+        esl_event_add_header_string(plain, ESL_STACK_BOTTOM, name, value) !=
+            ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  memset(value, 'x', sizeof(value) - 1);
+  value[sizeof(value) - 1] = '\0';
+  hp = esl_event_get_header_ptr(event, "variable_7");
+  if (hp == nullptr || !(hp->flags & ESL_HF_ARENA) ||
+      !(hp->flags & ESL_HF_BORROWED) ||
+      esl_event_add_header(event, ESL_STACK_BOTTOM, "Big", "%s%s", value,
+                           value) != ESL_SUCCESS ||
+      esl_event_add_header(plain, ESL_STACK_BOTTOM, "Big", "%s%s", value,
+                           value) != ESL_SUCCESS) {
+    goto done;
+  }
+
+  /* changes behave as on any other event */
+  if (esl_event_add_header_string(event, ESL_STACK_PUSH, "Variable_7",
+                                  "pushed") != ESL_SUCCESS ||
+      esl_event_add_header_string(plain, ESL_STACK_PUSH, "Variable_7",
+                                  "pushed") != ESL_SUCCESS ||
+      esl_event_add_header_string(event, ESL_STACK_BOTTOM, "List[1]", "b") !=
+          ESL_SUCCESS ||
+      esl_event_add_header_string(plain, ESL_STACK_BOTTOM, "List[1]", "b") !=
+          ESL_SUCCESS ||
+      esl_event_del_header(event, "variable_9") != ESL_SUCCESS ||
+      esl_event_del_header(plain, "variable_9") != ESL_SUCCESS ||
+      strcmp(esl_event_get_header_idx(event, "variable_7", 1), "pushed") !=
+          0 ||
+      esl_event_get_header(event, "variable_9") != nullptr ||
+      strcmp(esl_event_get_header(event, "variable_299"), "value-299") != 0) {
+    goto done;
+  }
+
+  if (esl_event_serialize(event, &arena_text, false) != ESL_SUCCESS ||
+      esl_event_serialize(plain, &plain_text, false) != ESL_SUCCESS ||
+      strcmp(arena_text, plain_text) != 0 ||
+      esl_event_dup(&copy, event) != ESL_SUCCESS || copy->arena != nullptr) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  /* the copy owns everything it holds */
+  ok = strcmp(esl_event_get_header(copy, "variable_0"), "value-0") == 0 &&
+       strcmp(esl_event_get_header(copy, "event-subclass"), "unit::arena") ==
+           0;
+
+done:
+  free(arena_text);
+  free(plain_text);
+  if (event) {
+    esl_event_destroy(&event);
+  }
+  if (plain) {
+    esl_event_destroy(&plain);
+  }
+  if (copy) {
+    esl_event_destroy(&copy);
+  }
+  return ok;
+}
+
+typedef struct {
+  esl_event_t *events[512];
+  _Atomic bool freed;
+} test_pool_state_t;
+
+static void *test_pool_free_thread([[maybe_unused]] esl_thread_t *thread,
+                                   void *data) {
+  test_pool_state_t *state = data;
+
+  for (int i = 0; i < 512; i++) {
+    esl_event_destroy(&state->events[i]);
+  }
+  atomic_store_explicit(&state->freed, true, memory_order_release);
+  return nullptr;
+}
+
+[[nodiscard]] static bool test_pool_round(bool arena) {
+  esl_event_t *event = nullptr;
+
+  if ((arena ? esl_event_create_arena(&event, ESL_EVENT_CUSTOM, "unit::pool")
+             : esl_event_create_subclass(&event, ESL_EVENT_CUSTOM,
+                                         "unit::pool")) != ESL_SUCCESS) {
+    return false;
+  }
+  for (int i = 0; i < 200; i++) {
+    if (esl_event_add_header(event, ESL_STACK_BOTTOM, "Variable_pool", "%d",
+                             i) != ESL_SUCCESS) {
+      esl_event_destroy(&event);
+      return false;
+    }
+  }
+  const bool ok =
+      esl_event_add_header_string(event, ESL_STACK_PUSH, "Variable_pool",
+                                  "last") == ESL_SUCCESS &&
+      strcmp(esl_event_get_header(event, "event-subclass"), "unit::pool") == 0;
+  esl_event_destroy(&event);
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_event_pool() {
+  static test_pool_state_t state;
+  esl_event_pool_stats_t before, after;
+  bool ok = false;
+
+  esl_event_pool_enable(true);
+
+  /* once warm, creating and destroying events allocates nothing */
+  for (int i = 0; i < 4; i++) {
+    if (!test_pool_round(false) || !test_pool_round(true)) {
+      goto done;
+    }
+  }
+  esl_event_pool_get_stats(&before);
+  for (int i = 0; i < 16; i++) {
+    if (!test_pool_round(false) || !test_pool_round(true)) {
+      goto done;
+    }
+  }
+  esl_event_pool_get_stats(&after);
+  if (after.event_misses != before.event_misses ||
+      after.header_misses != before.header_misses ||
+      after.string_misses != before.string_misses ||
+      after.event_hits - before.event_hits != 32 ||
+      after.header_hits <= before.header_hits ||
+      after.string_hits <= before.string_hits) {
+    goto done;
+  }
+
+  /* events freed on another thread come back through the overflow list once
+   * this thread's own cache is drained */
+  for (int i = 0; i < 512; i++) {
+    if (esl_event_create(&state.events[i], ESL_EVENT_CUSTOM) != ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  if (esl_thread_create_detached(test_pool_free_thread, &state) !=
+      ESL_SUCCESS) {
+    goto done;
+  }
+  for (int i = 0; i < 5000 && !atomic_load(&state.freed); i++) {
+    test_sleep_ms(1);
+  }
+  esl_event_pool_get_stats(&before);
+  if (!test_pool_round(false)) {
+    goto done;
+  }
+  esl_event_pool_get_stats(&after);
+  ok = after.event_hits == before.event_hits + 1;
+
+done:
+  esl_event_pool_enable(false);
+  esl_event_pool_trim();
+  return ok;
+}
+
+/* What esl_event_get_header_ptr returned before there was an index. */
+static esl_event_header_t *test_index_walk(esl_event_t *event,
+                                           const char *name) {
+  for (esl_event_header_t *hp = event->headers; hp; hp = hp->next) {
+    if (!strcasecmp(hp->name, name)) {
+      return hp;
+    }
+  }
+  return nullptr;
+}
+
+[[nodiscard]] static bool test_index_agrees(esl_event_t *event) {
+  char name[32];
+
+  for (int i = 0; i < 120; i++) {
+    esl_snprintf(name, sizeof(name), "VARIABLE_%d", i);
+    if (esl_event_get_header_ptr(event, name) != test_index_walk(event, name)) {
+      return false;
+    }
+  }
+  return esl_event_get_header_ptr(event, "dup") ==
+         test_index_walk(event, "dup");
+}
+
+[[nodiscard]] static bool run_test_event_header_index() {
+  esl_event_t *event = nullptr;
+  char *text = nullptr;
+  char name[32];
+  bool ok = false;
+
+  if (esl_event_create(&event, ESL_EVENT_CUSTOM) != ESL_SUCCESS ||
+      esl_event_add_header_string(event, ESL_STACK_BOTTOM, "Dup", "first") !=
+          ESL_SUCCESS ||
+      esl_event_get_header_ptr(event, "dup") == nullptr ||
+      event->index != nullptr) {
+    goto done;
+  }
+
+  /* enough headers to index, with repeated names at both ends */
+  for (int i = 0; i < 100; i++) {
+    esl_snprintf(name, sizeof(name), "Variable_%d", i);
+    if (esl_event_add_header(event, ESL_STACK_BOTTOM, name, "%d", i) !=
+        ESL_SUCCESS) {
+      goto done;
+    }
+  }
+  if (esl_event_add_header_string(event, ESL_STACK_BOTTOM, "Dup", "last") !=
+          ESL_SUCCESS ||
+      strcmp(esl_event_get_header(event, "DUP"), "first") != 0 ||
+      event->index == nullptr || event->header_count != 103 ||
+      esl_event_add_header_string(event, ESL_STACK_TOP, "Top", "top") !=
+          ESL_SUCCESS ||
+      esl_event_get_header_ptr(event, "top") != event->headers ||
+      !test_index_agrees(event)) {
+    goto done;
+  }
+
+  /* deleting the first of a name uncovers the next one */
+  if (esl_event_del_header_val(event, "dup", "first") != ESL_SUCCESS ||
+      strcmp(esl_event_get_header(event, "dup"), "last") != 0 ||
+      esl_event_del_header(event, "dup") != ESL_SUCCESS ||
+      esl_event_get_header(event, "dup") != nullptr) {
+    goto done;
+  }
+
+  /* churn through deletes and re-adds, which rebuilds the table */
+  for (int round = 0; round < 20; round++) {
+    for (int i = round % 3; i < 100; i += 3) {
+      esl_snprintf(name, sizeof(name), "variable_%d", i);
+      if (esl_event_del_header(event, name) != ESL_SUCCESS ||
+          esl_event_add_header(event, ESL_STACK_BOTTOM, name, "r%d", round) !=
+              ESL_SUCCESS) {
+        goto done;
+      }
+    }
+    if (esl_event_add_header_string(event, ESL_STACK_PUSH, "Variable_5",
+                                    "pushed") != ESL_SUCCESS ||
+        !test_index_agrees(event)) {
+      goto done;
+    }
+  }
+
+  /* serialization still follows insertion order: the last round re-added
+   * every third header at the end */
+  if (esl_event_serialize(event, &text, false) != ESL_SUCCESS ||
+      strncmp(text, "Top: top\n", 9) != 0 ||
+      strstr(text, "Variable_0: ") > strstr(text, "Variable_99: ") ||
+      strstr(text, "Variable_99: ") > strstr(text, "variable_1: ") ||
+      strstr(text, "variable_1: ") > strstr(text, "variable_97: ")) {
+    goto done;
+  }
+  ok = event->header_count == 102;
+
+done:
+  free(text);
+  if (event) {
+    esl_event_destroy(&event);
+  }
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_event_interned_headers() {
+  const char *packet = "Unique-ID: abc\n"
+                       "unique-id: lower\n"
+                       "Caller-Caller-ID-Name: Bob\n"
+                       "X-Custom: z\n\n";
+  const char *uuid_name = esl_header_key_name(ESL_HDR_UNIQUE_ID);
+  esl_parser_t *parser = nullptr;
+  esl_event_t *event = nullptr;
+  esl_event_header_t *hp;
+  bool ok = false;
+
+  if (uuid_name == nullptr || strcmp(uuid_name, "Unique-ID") != 0 ||
+      esl_header_key_name(ESL_HDR_COUNT) != nullptr) {
+    return false;
+  }
+
+  /* parsed headers point at the interned names */
+  if (esl_parser_create(&parser, nullptr) != ESL_SUCCESS ||
+      esl_parser_feed(parser, packet, strlen(packet)) != ESL_SUCCESS ||
+      esl_parser_next(parser, &event) != ESL_SUCCESS || event == nullptr) {
+    goto done;
+  }
+  hp = esl_event_get_header_key_ptr(event, ESL_HDR_UNIQUE_ID);
+  if (hp == nullptr || hp->name != uuid_name ||
+      !(hp->flags & ESL_HF_INTERNED) || strcmp(hp->value, "abc") != 0 ||
+      hp->next->name == uuid_name ||
+      strcmp(esl_event_get_header_key(event, ESL_HDR_CALLER_CALLER_ID_NAME),
+             "Bob") != 0 ||
+      (esl_event_get_header_ptr(event, "x-custom")->flags & ESL_HF_INTERNED) ||
+      esl_event_get_header_key(event, ESL_HDR_JOB_UUID) != nullptr) {
+    goto done;
+  }
+
+  /* lookups by key still ignore case, and survive owning the strings */
+  if (esl_event_del_header_val(event, "unique-id", "abc") != ESL_SUCCESS ||
+      strcmp(esl_event_get_header_key(event, ESL_HDR_UNIQUE_ID), "lower") !=
+          0 ||
+      esl_event_materialize(event) != ESL_SUCCESS ||
+      (hp = esl_event_get_header_key_ptr(
+           event, ESL_HDR_CALLER_CALLER_ID_NAME)) == nullptr ||
+      hp->name != esl_header_key_name(ESL_HDR_CALLER_CALLER_ID_NAME)) {
+    goto done;
+  }
+  esl_event_destroy(&event);
+
+  /* every name is found by its precomputed hash, indexed or not */
+  if (esl_event_create(&event, ESL_EVENT_CLONE) != ESL_SUCCESS) {
+    goto done;
+  }
+  for (int key = 0; key < ESL_HDR_COUNT; key++) {
+    if (esl_event_add_header_string(event, ESL_STACK_BOTTOM,
+                                    esl_header_key_name(key),
+                                    "v") != ESL_SUCCESS ||
+        esl_event_get_header_key_ptr(event, key) != event->last_header ||
+        event->last_header->name != esl_header_key_name(key)) {
+      goto done;
+    }
+  }
+  ok = event->index != nullptr;
+
+done:
+  if (event) {
+    esl_event_destroy(&event);
+  }
+  esl_parser_destroy(&parser);
+  return ok;
+}
+
+[[nodiscard]] static bool run_test_name_event_lookup() {
+  static const struct {
+    const char *value;
+    esl_content_type_t ct;
+  } types[] = {
+      {"auth/request", ESL_CT_AUTH_REQUEST},
+      {"API/Response", ESL_CT_API_RESPONSE},
+      {"command/reply", ESL_CT_COMMAND_REPLY},
+      {"text/event-plain", ESL_CT_TEXT_EVENT_PLAIN},
+      {"Text/Event-JSON", ESL_CT_TEXT_EVENT_JSON},
+      {"text/event-xml", ESL_CT_TEXT_EVENT_XML},
+      {"text/disconnect-notice", ESL_CT_TEXT_DISCONNECT_NOTICE},
+      {"text/rude-rejection", ESL_CT_TEXT_RUDE_REJECTION},
+      {"log/data", ESL_CT_LOG_DATA},
+      {"text/event-plains", ESL_CT_UNKNOWN},
+      {"text/plain", ESL_CT_UNKNOWN},
+      {"x", ESL_CT_UNKNOWN},
+      {"", ESL_CT_UNKNOWN},
+  };
+  esl_event_types_t type;
+  char buf[64];
+
+  /* every name resolves as written, folded, and with the prefix */
+  for (int x = ESL_EVENT_CUSTOM; x <= ESL_EVENT_ALL; x++) {
+    const char *name = esl_event_name((esl_event_types_t)x);
+    size_t i;
+
+    if (esl_name_event(name, &type) != ESL_SUCCESS || (int)type != x) {
+      return false;
+    }
+    for (i = 0; name[i] && i < sizeof(buf) - 1; i++) {
+      buf[i] = (char)esl_tolower((unsigned char)name[i]);
+    }
+    buf[i] = '\0';
+    if (esl_name_event(buf, &type) != ESL_SUCCESS || (int)type != x) {
+      return false;
+    }
+    snprintf(buf, sizeof(buf), "SWITCH_EVENT_%s", name);
+    if (esl_name_event(buf, &type) != ESL_SUCCESS || (int)type != x) {
+      return false;
+    }
+  }
+
+  if (esl_name_event("", &type) == ESL_SUCCESS ||
+      esl_name_event("C", &type) == ESL_SUCCESS ||
+      esl_name_event("CHANNEL_CREATED", &type) == ESL_SUCCESS ||
+      esl_name_event("SWITCH_EVENT_", &type) == ESL_SUCCESS ||
+      esl_name_event(nullptr, &type) == ESL_SUCCESS) {
+    return false;
+  }
+
+  for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    if (esl_content_type(types[i].value) != types[i].ct) {
+      return false;
+    }
+  }
+
+  return esl_content_type(nullptr) == ESL_CT_UNKNOWN;
+}
+
 #define TEST(name)                                                             \
   do {                                                                         \
     printf("Running: %s\n", #name);                                            \
@@ -923,6 +3723,9 @@ int main() {
   TEST(buffer_max_len_enforced);
   TEST(buffer_destroy_null_safe);
   TEST(buffer_seek_packets_and_looping);
+  TEST(buffer_packet_scan_incremental);
+  TEST(buffer_mirrored);
+  TEST(scan_kernels);
   TEST(json_helpers);
   TEST(event_create_add_serialize);
   TEST(event_json_roundtrip);
@@ -935,6 +3738,29 @@ int main() {
   TEST(thread_detached_variants);
   TEST(separate_string_string);
   TEST(esl_guard_paths_and_wait_sock);
+  TEST(parser_incremental);
+  TEST(event_header_views);
+  TEST(recv_body_in_place);
+  TEST(handle_footprint_compact);
+  TEST(reactor_dispatch);
+  TEST(uring_transport);
+  TEST(server_pool);
+  TEST(send_async_pipelined);
+  TEST(bgapi_jobs);
+  TEST(event_queue);
+  TEST(event_queue_block);
+  TEST(recv_events_batch);
+  TEST(full_duplex);
+  TEST(event_channel);
+  TEST(dispatcher_sharding);
+  TEST(wait_strategy);
+  TEST(handle_wakeup);
+  TEST(unix_transport);
+  TEST(event_arena);
+  TEST(event_pool);
+  TEST(event_header_index);
+  TEST(event_interned_headers);
+  TEST(name_event_lookup);
 
   printf("\nResult: %d passed, %d failed\n", tests_passed, tests_failed);
   return tests_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;